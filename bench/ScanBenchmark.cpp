@@ -0,0 +1,464 @@
+/**
+ * ScanBenchmark.cpp : measures the scan, filter, shuffle and pick phases of the core library
+ * over reproducible synthetic directory trees
+ *
+ * Runs on Linux (or any POSIX system). See the Benchmarking section of the README to build it.
+ */
+
+#include <algorithm>     // sort
+#include <chrono>        // steady_clock
+#include <cstdio>        // printf
+#include <fstream>       // file streams
+#include <iostream>      // console IO
+#include <sstream>       // stringstream for splitting
+#include <string>        // strings
+#include <vector>        // dynamic containers
+
+#include <filesystem>    // file navigation. C++17 ONLY.
+
+#include <sys/resource.h> // getrusage
+#include <unistd.h>      // sync
+
+#include "core/Allocations.h"
+#include "core/Engine.h"
+#include "TreeGenerator.h"
+
+// == Allocation budgets ==
+
+// Checked with --check. Scans may allocate a bounded amount per file (names, frontier entries, index
+// growth), while picks at steady state must not allocate at all.
+static const double SCAN_ALLOCATIONS_PER_FILE = 2.0;
+static const uint64_t PICK_ALLOCATIONS = 0;
+
+// == List timeout ==
+
+// Checked with --check-timeout. The stalled directory takes longer than the timeout, but less than two,
+// so that a retrying scan still takes it.
+static const std::chrono::milliseconds CHECK_LIST_TIMEOUT(200);
+static const std::chrono::milliseconds CHECK_STALL(300);
+
+// == Memory ==
+
+/**
+* @brief Resets the peak resident set size of the process, where the kernel allows it (Linux 4.0+).
+*/
+static void resetPeakRss() {
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+}
+
+/**
+* @return Peak resident set size in KiB since the last reset, or since the process started.
+*/
+static uint64_t readPeakRss() {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::stoull(line.substr(6));
+		}
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)usage.ru_maxrss;
+}
+
+/**
+* @brief Drops the page, dentry and inode caches so that the following scan reads from disk. Requires root.
+*
+* @return If the caches could not be dropped, returns `false`.
+*/
+static bool dropCaches() {
+	sync();
+	std::ofstream dropCaches("/proc/sys/vm/drop_caches");
+	dropCaches << "3";
+	dropCaches.flush();
+	return (bool)dropCaches;
+}
+
+// == Phases ==
+
+/**
+* Measurements of a phase. With several repetitions, the fastest one is kept.
+*/
+struct PhaseStats {
+    std::string name;
+    uint64_t items = 0;
+    double seconds = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t maxAllocations = 0; // Across every run, for budget checks.
+    uint64_t maxItems = 0;
+    uint64_t peakRss = 0;
+    std::vector<double> runs;
+};
+
+/**
+* Measures a single run of a phase.
+*/
+class PhaseTimer {
+    private:
+        PhaseStats& stats;
+        std::chrono::steady_clock::time_point start;
+        AllocationCounts allocationStart;
+    public:
+        PhaseTimer(PhaseStats& phaseStats) : stats(phaseStats) {
+            resetPeakRss();
+            allocationStart = Allocations::total();
+            start = std::chrono::steady_clock::now();
+        }
+        void stop(const uint64_t items) {
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const AllocationCounts allocationCounts = Allocations::total() - allocationStart;
+            const uint64_t count = allocationCounts.allocations;
+            const uint64_t bytes = allocationCounts.bytes;
+            stats.peakRss = std::max(stats.peakRss, readPeakRss());
+            if (count > stats.maxAllocations) {
+                stats.maxAllocations = count;
+                stats.maxItems = items;
+            }
+            if (stats.runs.empty() || seconds < stats.seconds) {
+                stats.items = items;
+                stats.seconds = seconds;
+                stats.allocations = count;
+                stats.allocatedBytes = bytes;
+            }
+            stats.runs.push_back(seconds);
+        }
+};
+
+/**
+* @brief Displays the measurements of every phase as a table.
+*/
+static void displayStats(const std::vector<PhaseStats>& phases) {
+	printf("\n%-10s %12s %10s %10s %14s %12s %14s %12s\n", "phase", "items", "best s", "median s", "items/s", "allocs", "alloc bytes", "peak RSS KiB");
+	for (const PhaseStats& phase : phases) {
+		std::vector<double> runs = phase.runs;
+		std::sort(runs.begin(), runs.end());
+		const double median = runs.empty() ? 0 : runs[runs.size() / 2];
+		printf(
+			"%-10s %12llu %10.4f %10.4f %14.0f %12llu %14llu %12llu\n",
+			phase.name.c_str(),
+			(unsigned long long)phase.items,
+			phase.seconds,
+			median,
+			(phase.seconds > 0) ? phase.items / phase.seconds : 0.0,
+			(unsigned long long)phase.allocations,
+			(unsigned long long)phase.allocatedBytes,
+			(unsigned long long)phase.peakRss
+		);
+	}
+}
+
+/**
+* @brief Shows instructions on how to use the benchmark.
+*/
+static void showUsage(const char* executableName) {
+	std::cout << "Usage: " << executableName << " [-opts]\n\n"
+		<< "--dir directory\t\tWhere the tree is generated (default. rfbench in the temporary directory). Reused if generated with the same spec.\n"
+		<< "--seed n\t\tSeed of the tree (default. 1).\n"
+		<< "--fanout n\t\tSubdirectories per directory (default. 8).\n"
+		<< "--depth n\t\tLevels of subdirectories (default. 3).\n"
+		<< "--files n\t\tFiles in the tree (default. 100000).\n"
+		<< "--names min:max\t\tLength of names (default. 4:24).\n"
+		<< "--mix ext:weight,...\tExtension mix, where an empty extension means none (default. mp4:4,jpg:3,txt:2,:1).\n"
+		<< "--filter ext;ext;...\tExtensions whitelisted by the filter phase (default. mp4;jpg).\n"
+		<< "--picks n\t\tRandom and sequential picks of the pick phase (default. 100000).\n"
+		<< "--budget bytes\t\tMemory budget of the index (default. as rfopener, 0 for no limit).\n"
+		<< "--repeat n\t\tRuns of every phase (default. 5).\n"
+		<< "--cold\t\t\tDrop the page cache before every scan (requires root). Warm by default.\n"
+		<< "--memory\t\tScan an in-memory copy of the tree instead, which isolates the filter and index code from the kernel.\n"
+		<< "--latency us\t\tWith --memory, delay of every directory listing, to simulate slow network directories (default. 0).\n"
+		<< "--check\t\t\tFail if a run exceeds the allocation budgets (scans: " << SCAN_ALLOCATIONS_PER_FILE
+			<< " per file, picks: " << PICK_ALLOCATIONS << "). Requires RFOPENER_ALLOC_ACCOUNTING.\n"
+		<< "--check-timeout\t\tOnly check the list timeout: stall a directory of an in-memory tree past it, and fail unless it is\n"
+			<< "\t\t\tskipped and reported, and taken after all with :retry.\n";
+}
+
+/**
+* @brief Scans a small in-memory tree where one directory (holding 2 of its 5 files) is stalled past the list timeout.
+*
+* @param isRetrying Whether skipped directories are retried.
+* @param result Receives the result of the scan.
+* @return If the scan could not be started, returns `false`.
+*/
+static bool scanStalledTree(const bool isRetrying, ScanResult& result) {
+	const std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+	source->addFile("/tree/a/1.mp4");
+	source->addFile("/tree/a/2.mp4");
+	source->addFile("/tree/b/3.mp4");
+	source->addFile("/tree/stalled/4.mp4");
+	source->addFile("/tree/stalled/deep/5.mp4");
+	source->stallDirectory("/tree/stalled", CHECK_STALL);
+
+	Engine engine;
+	engine.setSource(source);
+	ScanOptions options;
+	options.checkpoint = false;
+	options.listTimeout = (uint32_t)CHECK_LIST_TIMEOUT.count();
+	options.retrySkipped = isRetrying;
+	std::string error;
+	if (!engine.setRoot("/tree", error) || !engine.configure(options, error)) {
+		std::cerr << "ERROR while configuring the scan:\n" << error << "\n";
+		return false;
+	}
+	result = engine.scan();
+	return true;
+}
+
+/**
+* @brief Checks that a directory listed past the list timeout is skipped and reported, and taken after all with :retry.
+*
+* @return If the check failed, returns `false`.
+*/
+static bool checkListTimeout() {
+	bool isPassed = true;
+	const auto expect = [&isPassed](const bool condition, const std::string& failure) {
+		if (!condition) {
+			std::cerr << "List timeout check failed: " << failure << "\n";
+			isPassed = false;
+		}
+	};
+
+	ScanResult result;
+	if (!scanStalledTree(false, result)) {
+		return false;
+	}
+	expect(result.ok, "the scan failed (" + result.error + ")");
+	expect(result.fileCount == 3, "the scan found " + std::to_string(result.fileCount) + " files instead of 3");
+	expect(result.stats.skippedDirectories == 1, "the stalled directory was not counted as skipped");
+	expect(
+		result.skippedDirectories.size() == 1 && result.skippedDirectories[0] == "/tree/stalled",
+		"the stalled directory was not reported"
+	);
+	std::cout << "Skipped: " << result.fileCount << " files, " << result.skippedDirectories.size() << " directory reported\n";
+
+	if (!scanStalledTree(true, result)) {
+		return false;
+	}
+	expect(result.ok, "the retrying scan failed (" + result.error + ")");
+	expect(result.fileCount == 5, "the retrying scan found " + std::to_string(result.fileCount) + " files instead of 5");
+	expect(result.stats.lateDirectories == 1, "the stalled directory was not counted as listed late");
+	expect(result.skippedDirectories.empty(), "the retrying scan still reported the stalled directory");
+	std::cout << "Retried: " << result.fileCount << " files, " << result.stats.lateDirectories << " directory listed late\n";
+	return isPassed;
+}
+
+/**
+* @brief Checks the allocations of every run against the budgets.
+*
+* @return If a budget was exceeded, returns `false`.
+*/
+static bool checkBudgets(const std::vector<PhaseStats>& phases) {
+	bool isWithinBudgets = true;
+	for (const PhaseStats& phase : phases) {
+		bool isExceeded = false;
+		if (phase.name == "scan" || phase.name == "filter") {
+			isExceeded = (phase.maxAllocations > SCAN_ALLOCATIONS_PER_FILE * std::max<uint64_t>(phase.maxItems, 1));
+		} else if (phase.name == "pick") {
+			isExceeded = (phase.maxAllocations > PICK_ALLOCATIONS);
+		}
+		if (isExceeded) {
+			std::cerr << "Allocation budget exceeded by the " << phase.name << " phase: "
+				<< phase.maxAllocations << " allocations for " << phase.maxItems << " items\n";
+			isWithinBudgets = false;
+		}
+	}
+	return isWithinBudgets;
+}
+
+int main(int argc, char** argv) {
+	TreeSpec spec;
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "rfbench";
+	std::vector<std::string> filter{ "mp4", "jpg" };
+	uint64_t pickCount = 100000;
+	ScanOptions defaults;
+	uint64_t memoryBudget = defaults.memoryBudget;
+	int repeat = 5;
+	bool isCold = false;
+	bool isInMemory = false;
+	bool isChecked = false;
+	bool isTimeoutChecked = false;
+	int64_t latency = 0;
+
+	// Parses arguments.
+	try {
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			const bool hasValue = (i + 1 < argc);
+			if (arg == "-h" || arg == "--help") {
+				showUsage(argv[0]);
+				return EXIT_SUCCESS;
+			}
+			if (arg == "--cold") {
+				isCold = true;
+				continue;
+			}
+			if (arg == "--memory") {
+				isInMemory = true;
+				continue;
+			}
+			if (arg == "--check") {
+				isChecked = true;
+				continue;
+			}
+			if (arg == "--check-timeout") {
+				isTimeoutChecked = true;
+				continue;
+			}
+			if (!hasValue) {
+				showUsage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			const std::string value = argv[++i];
+			if      (arg == "--dir")    directory = value;
+			else if (arg == "--seed")   spec.seed = std::stoull(value);
+			else if (arg == "--fanout") spec.fanOut = std::stoi(value);
+			else if (arg == "--depth")  spec.depth = std::stoi(value);
+			else if (arg == "--files")  spec.fileCount = std::stoull(value);
+			else if (arg == "--picks")  pickCount = std::stoull(value);
+			else if (arg == "--budget") memoryBudget = std::stoull(value);
+			else if (arg == "--repeat") repeat = std::max(1, std::stoi(value));
+			else if (arg == "--latency") latency = std::stoll(value);
+			else if (arg == "--names") {
+				const size_t separator = value.find(':');
+				spec.minNameLength = std::stoi(value.substr(0, separator));
+				spec.maxNameLength = (separator == std::string::npos) ? spec.minNameLength : std::stoi(value.substr(separator + 1));
+			}
+			else if (arg == "--mix") {
+				std::string error;
+				if (!TreeGenerator::parseExtensionMix(value, spec.extensions, error)) {
+					std::cerr << "ERROR while parsing the extension mix:\n" << error << "\n";
+					return EXIT_FAILURE;
+				}
+			}
+			else if (arg == "--filter") {
+				filter.clear();
+				std::string temp;
+				std::stringstream stringstream {value};
+				while (std::getline(stringstream, temp, ';')) {
+					filter.push_back(temp);
+				}
+			}
+			else {
+				showUsage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << "ERROR while parsing arguments:\n" << ex.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	if (isTimeoutChecked) {
+		return checkListTimeout() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (isChecked && !Allocations::isEnabled()) {
+		std::cerr << "ERROR: --check requires a build with RFOPENER_ALLOC_ACCOUNTING defined\n";
+		return EXIT_FAILURE;
+	}
+
+	// Generates (or reuses) the tree, on disk or in memory.
+	std::cout << "Tree: " << TreeGenerator::describe(spec) << "\n";
+	std::string error;
+	bool isGenerated = true;
+	const std::chrono::steady_clock::time_point generationStart = std::chrono::steady_clock::now();
+	Engine engine;
+	std::filesystem::path root;
+	if (isInMemory) {
+		const std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+		if (!TreeGenerator::populate(spec, *source, error)) {
+			std::cerr << "ERROR while generating the tree:\n" << error << "\n";
+			return EXIT_FAILURE;
+		}
+		source->setLatency(std::chrono::microseconds(latency), std::chrono::microseconds(0));
+		engine.setSource(source);
+		root = "/";
+		isCold = false;
+	} else {
+		if (!TreeGenerator::generate(spec, directory, isGenerated, error)) {
+			std::cerr << "ERROR while generating the tree:\n" << error << "\n";
+			return EXIT_FAILURE;
+		}
+		root = directory / TreeGenerator::TREE_NAME;
+	}
+	std::cout << (isGenerated ? "Generated in " : "Reused ") << (isInMemory ? "memory" : root.u8string());
+	if (isGenerated) {
+		std::cout << " (" << std::chrono::duration<double>(std::chrono::steady_clock::now() - generationStart).count() << " s)";
+	}
+	std::cout << "\nCache: " << (isInMemory ? "none" : isCold ? "cold" : "warm") << ", runs: " << repeat << "\n";
+
+	if (!engine.setRoot(root.u8string(), error)) {
+		std::cerr << "ERROR while resolving the tree:\n" << error << "\n";
+		return EXIT_FAILURE;
+	}
+	ScanOptions scanOptions;
+	scanOptions.depth = Scanner::MAX_DEPTH;
+	scanOptions.checkCaps = false;
+	scanOptions.memoryBudget = memoryBudget;
+	ScanOptions filterOptions = scanOptions;
+	filterOptions.extensions = filter;
+
+	std::vector<PhaseStats> phases(4);
+	phases[0].name = "scan";
+	phases[1].name = "filter";
+	phases[2].name = "shuffle";
+	phases[3].name = "pick";
+
+	for (int run = 0; run < repeat; ++run) {
+		// Scans with the filter first, so that the plain scan is left in the index for the remaining phases.
+		const ScanOptions* runOptions[2] = { &filterOptions, &scanOptions };
+		PhaseStats* runPhases[2] = { &phases[1], &phases[0] };
+		for (int i = 0; i < 2; ++i) {
+			if (isCold && !dropCaches()) {
+				std::cerr << "Could not drop the page cache (root is required); measuring a warm cache instead\n";
+				isCold = false;
+			}
+			if (!engine.configure(*runOptions[i], error)) {
+				std::cerr << "ERROR while configuring the scan:\n" << error << "\n";
+				return EXIT_FAILURE;
+			}
+			PhaseTimer timer(*runPhases[i]);
+			const ScanResult result = engine.scan();
+			timer.stop(result.fileCount);
+			if (!result.ok) {
+				std::cerr << "ERROR while scanning:\n" << result.error << "\n";
+				return EXIT_FAILURE;
+			}
+		}
+
+		PhaseTimer shuffleTimer(phases[2]);
+		engine.shuffle();
+		shuffleTimer.stop(engine.size());
+
+		// Builds the absolute path of every pick into a reserved buffer, as the console program does before opening it.
+		std::string absolutePath;
+		absolutePath.reserve(engine.getLongestPathLength());
+		size_t position;
+		size_t checksum = 0;
+		PhaseTimer pickTimer(phases[3]);
+		for (uint64_t pick = 0; pick < pickCount; ++pick) {
+			if (engine.pickRandom(position)) {
+				engine.buildAbsolutePath(position, absolutePath);
+				checksum += absolutePath.size();
+			}
+			if (engine.pickSequential(false, position)) {
+				engine.buildAbsolutePath(position, absolutePath);
+				checksum += absolutePath.size();
+			}
+		}
+		pickTimer.stop(pickCount * 2);
+		if (checksum == 0 && engine.size() > 0) {
+			std::cerr << "Picks built no paths\n";
+		}
+	}
+
+	displayStats(phases);
+	if (!Allocations::isEnabled()) {
+		std::cout << "\nAllocations are not counted; build with -DRFOPENER_ALLOC_ACCOUNTING to count them.\n";
+	}
+	if (isChecked && !checkBudgets(phases)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+// TreeGenerator.cpp : descriptions for the synthetic directory tree generator
+
+#include "TreeGenerator.h"
+
+#include <fstream>     // file streams
+#include <sstream>     // stringstream for splitting
+
+const char* TreeGenerator::MARKER_NAME = ".rfbench";
+const char* TreeGenerator::TREE_NAME = "tree";
+
+/**
+* SplitMix64, used instead of the standard distributions so that trees do not depend on the standard library.
+*/
+class SplitMix {
+    private:
+        uint64_t state;
+    public:
+        SplitMix(const uint64_t seed) : state(seed) {}
+        uint64_t next() {
+            uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+        // @return Integer in [min, max]
+        uint64_t between(const uint64_t min, const uint64_t max) { return min + next() % (max - min + 1); }
+};
+
+/**
+* @return Random name of the given length, made of lowercase letters, digits, spaces and dashes.
+*/
+static std::string randomName(SplitMix& random, const int length) {
+	static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz0123456789 -";
+	std::string name;
+	for (int i = 0; i < length; ++i) {
+		name += ALPHABET[random.next() % (sizeof(ALPHABET) - 1)];
+	}
+
+	// Trailing spaces are not allowed on every platform.
+	if (!name.empty() && name.back() == ' ') {
+		name.back() = '_';
+	}
+	return name;
+}
+
+std::string TreeGenerator::describe(const TreeSpec& spec) {
+	std::string description =
+		"seed=" + std::to_string(spec.seed) +
+		" fanout=" + std::to_string(spec.fanOut) +
+		" depth=" + std::to_string(spec.depth) +
+		" files=" + std::to_string(spec.fileCount) +
+		" names=" + std::to_string(spec.minNameLength) + ":" + std::to_string(spec.maxNameLength) +
+		" extensions=";
+	for (size_t i = 0; i < spec.extensions.size(); ++i) {
+		description += ((i > 0) ? "," : "") + spec.extensions[i].first + ":" + std::to_string(spec.extensions[i].second);
+	}
+	return description;
+}
+
+bool TreeGenerator::parseExtensionMix(const std::string& mix, std::vector<std::pair<std::string, int>>& extensions, std::string& error) {
+	extensions.clear();
+	std::string item;
+	std::stringstream stringstream {mix};
+	while (std::getline(stringstream, item, ',')) {
+		const size_t separator = item.rfind(':');
+		int weight = 1;
+		if (separator != std::string::npos) {
+			try {
+				weight = std::stoi(item.substr(separator + 1));
+			} catch (const std::exception&) {
+				weight = 0;
+			}
+		}
+		if (weight < 1) {
+			error = "Invalid weight in \"" + item + "\"";
+			return false;
+		}
+		extensions.emplace_back(item.substr(0, separator), weight);
+	}
+	return true;
+}
+
+bool TreeGenerator::build(const TreeSpec& spec, const std::function<bool(const std::string&, const bool)>& create) {
+	// Creates the directories level by level.
+	SplitMix random(spec.seed);
+	std::vector<std::string> directories{ "" };
+	size_t levelBegin = 0;
+	for (int level = 0; level < spec.depth; ++level) {
+		const size_t levelEnd = directories.size();
+		for (size_t parent = levelBegin; parent < levelEnd; ++parent) {
+			for (int child = 0; child < spec.fanOut; ++child) {
+				const int length = (int)random.between(spec.minNameLength, spec.maxNameLength);
+				directories.push_back(directories[parent] + randomName(random, length) + "." + std::to_string(child) + "/");
+				if (!create(directories.back(), true)) {
+					return false;
+				}
+			}
+		}
+		levelBegin = levelEnd;
+	}
+
+	// Draws the extension of every file by weight.
+	int totalWeight = 0;
+	for (const std::pair<std::string, int>& extension : spec.extensions) {
+		totalWeight += extension.second;
+	}
+
+	// Creates the files. Their number keeps names unique within a directory.
+	for (uint64_t file = 0; file < spec.fileCount; ++file) {
+		const std::string& parent = directories[(size_t)(random.next() % directories.size())];
+		const int length = (int)random.between(spec.minNameLength, spec.maxNameLength);
+		std::string name = randomName(random, length) + "-" + std::to_string(file);
+		if (totalWeight > 0) {
+			int draw = (int)(random.next() % (uint64_t)totalWeight);
+			for (const std::pair<std::string, int>& extension : spec.extensions) {
+				if ((draw -= extension.second) < 0) {
+					if (!extension.first.empty()) {
+						name += "." + extension.first;
+					}
+					break;
+				}
+			}
+		}
+		if (!create(parent + name, false)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TreeGenerator::isValid(const TreeSpec& spec, std::string& error) {
+	if (
+		(spec.fanOut < 1) ||
+		(spec.depth < 0) ||
+		(spec.minNameLength < 1) ||
+		(spec.maxNameLength < spec.minNameLength)
+	) {
+		error = "Invalid tree spec: " + describe(spec);
+		return false;
+	}
+	return true;
+}
+
+bool TreeGenerator::populate(const TreeSpec& spec, MemorySource& source, std::string& error) {
+	if (!isValid(spec, error)) {
+		return false;
+	}
+	return build(spec, [&source](const std::string& relativePath, const bool isDirectory) {
+		if (isDirectory) {
+			source.addDirectory(relativePath);
+		} else {
+			source.addFile(relativePath);
+		}
+		return true;
+	});
+}
+
+bool TreeGenerator::generate(const TreeSpec& spec, const std::filesystem::path& directory, bool& isGenerated, std::string& error) {
+	isGenerated = false;
+	if (!isValid(spec, error)) {
+		return false;
+	}
+	const std::string description = describe(spec);
+	const std::filesystem::path markerPath = directory / MARKER_NAME;
+	const std::filesystem::path root = directory / TREE_NAME;
+
+	try {
+		// Reuses a tree generated from the same spec, and only ever empties generated trees.
+		if (std::filesystem::exists(markerPath)) {
+			std::ifstream marker(markerPath);
+			std::string previous;
+			std::getline(marker, previous);
+			if (previous == description) {
+				return true;
+			}
+			marker.close();
+			std::filesystem::remove(markerPath);
+			std::filesystem::remove_all(root);
+		} else if (std::filesystem::exists(directory) && !std::filesystem::is_empty(directory)) {
+			error = "\"" + directory.u8string() + "\" is not empty and was not generated by the benchmark";
+			return false;
+		}
+		std::filesystem::create_directories(root);
+
+		// Creates the entries on disk.
+		const bool isBuilt = build(spec, [&root, &error](const std::string& relativePath, const bool isDirectory) {
+			const std::filesystem::path path = root / std::filesystem::u8path(relativePath);
+			if (isDirectory) {
+				std::filesystem::create_directory(path);
+				return true;
+			}
+			std::ofstream created(path);
+			if (!created) {
+				error = "Could not create \"" + path.u8string() + "\"";
+				return false;
+			}
+			return true;
+		});
+		if (!isBuilt) {
+			return false;
+		}
+
+		// Written last, so that an interrupted generation is not reused.
+		std::ofstream marker(markerPath);
+		marker << description << "\n";
+		if (!marker) {
+			error = "Could not write \"" + markerPath.u8string() + "\"";
+			return false;
+		}
+	}
+	catch (const std::exception& ex) {
+		error = ex.what();
+		return false;
+	}
+
+	isGenerated = true;
+	return true;
+}
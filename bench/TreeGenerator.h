@@ -0,0 +1,99 @@
+// TreeGenerator.h : declarations for the synthetic directory tree generator
+
+#pragma once
+
+#ifndef TREEGENERATOR_H_
+#define TREEGENERATOR_H_
+
+#include <cstdint>     // fixed width integers
+#include <functional>  // function
+#include <string>      // strings
+#include <utility>     // pair
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "core/MemorySource.h"
+
+/**
+* Shape of a synthetic directory tree.
+*/
+struct TreeSpec {
+    uint64_t seed = 1;              // Seed every name and placement is derived from.
+    int fanOut = 8;                 // Subdirectories per directory.
+    int depth = 3;                  // Levels of subdirectories below the root.
+    uint64_t fileCount = 100000;    // Files, spread uniformly among all directories (root included).
+    int minNameLength = 4;          // Minimum (inclusive) length of names, without extension.
+    int maxNameLength = 24;         // Maximum (inclusive) length of names, without extension.
+    std::vector<std::pair<std::string, int>> extensions = { // Extensions (without the dot) and their weights. Empty means none.
+        { "mp4", 4 }, { "jpg", 3 }, { "txt", 2 }, { "", 1 }
+    };
+};
+
+/**
+* Generates reproducible directory trees of empty files, so that scans can be measured on any
+* machine without real media. The same spec always produces the same names on every platform.
+*/
+class TreeGenerator {
+
+    private:
+        /**
+        * @brief Walks a spec, creating every directory before its contents.
+        *
+        * @param spec Spec.
+        * @param create Creates an entry from its relative path (directories end in a separator) and whether it
+        * is a directory. Returning `false` stops the walk.
+        * @return If creating an entry failed, returns `false`.
+        */
+        static bool build(const TreeSpec&, const std::function<bool(const std::string&, const bool)>&);
+        /**
+        * @brief Validates a spec.
+        *
+        * @param spec Spec.
+        * @param error Receives the description of the error, if any.
+        */
+        static bool isValid(const TreeSpec&, std::string&);
+
+    public:
+        static const char* MARKER_NAME; // File identifying a generated tree and the spec it was generated from
+        static const char* TREE_NAME;   // Subdirectory holding the tree, so that the marker is not part of it
+
+        /**
+        * @brief Describes a spec as a single line, which identifies the generated tree.
+        *
+        * @param spec Spec.
+        */
+        static std::string describe(const TreeSpec&);
+        /**
+        * @brief Parses an extension mix such as "mp4:4,jpg:3,:1", where an empty name means no extension.
+        *
+        * @param mix Extension mix.
+        * @param extensions Receives the extensions and their weights.
+        * @param error Receives the description of the error, if any.
+        * @return If the mix is malformed, returns `false`.
+        */
+        static bool parseExtensionMix(const std::string&, std::vector<std::pair<std::string, int>>&, std::string&);
+        /**
+        * @brief Generates a tree in the `TREE_NAME` subdirectory of a directory, unless it already holds one
+        * generated from the same spec. A directory holding a tree generated from a different spec is emptied
+        * first; any other non-empty directory is left untouched and reported as an error.
+        *
+        * @param spec Spec.
+        * @param directory Directory to generate the tree in. Created if missing.
+        * @param isGenerated Receives whether the tree had to be generated.
+        * @param error Receives the description of the error, if any.
+        * @return If the tree could not be generated, returns `false`.
+        */
+        static bool generate(const TreeSpec&, const std::filesystem::path&, bool&, std::string&);
+        /**
+        * @brief Builds the tree of a spec in memory instead, with the same names as on disk.
+        *
+        * @param spec Spec.
+        * @param source Source that receives the tree, below its root.
+        * @param error Receives the description of the error, if any.
+        * @return If the spec is invalid, returns `false`.
+        */
+        static bool populate(const TreeSpec&, MemorySource&, std::string&);
+};
+
+#endif
@@ -8,7 +8,7 @@
 class Args {
     private:
         static const int EQUAL_COMPARE = 0;
-        static const int ARG_COUNT = 7;
+        static const int ARG_COUNT = 36;
     public:
         static const char DELIMITER = ';';
         static constexpr const char* FLAGS_SHORTENED[ARG_COUNT] = {
@@ -18,7 +18,36 @@ class Args {
             "-x",
             "-e",
             "-d",
-            "-nc"
+            "-nc",
+            "-s",
+            "-sh",
+            "-o",
+            "-i",
+            "-m",
+            "-mb",
+            "-st",
+            "-pr",
+            "-tr",
+            "-tf",
+            "-mt",
+            "-sf",
+            "-fa",
+            "-nw",
+            "-df",
+            "-or",
+            "-rs",
+            "-lt",
+            "-io",
+            "-rl",
+            "-bo",
+            "-of",
+            "-xt",
+            "-sd",
+            "-ar",
+            "-ty",
+            "-dd",
+            "-fl",
+            "-sp"
         };
         static constexpr const char* FLAGS_WHOLE[ARG_COUNT] = {
             "--help",
@@ -27,7 +56,36 @@ class Args {
             "--exclude",
             "--extensions",
             "--depth",
-            "--nocap"
+            "--nocap",
+            "--shared",
+            "--shard",
+            "--output",
+            "--index",
+            "--merge",
+            "--mem-budget",
+            "--stats",
+            "--prometheus",
+            "--trace",
+            "--toggle",
+            "--match",
+            "--stratify",
+            "--fair",
+            "--new-only",
+            "--diff",
+            "--order",
+            "--resume-scan",
+            "--list-timeout",
+            "--io-class",
+            "--rate-limit",
+            "--backoff",
+            "--one-file-system",
+            "--skip-fstype",
+            "--split-devices",
+            "--archives",
+            "--type",
+            "--dedupe",
+            "--from-list",
+            "--shared-purge"
         };
         const enum ArgCodes {
             def = -1,
@@ -37,7 +95,36 @@ class Args {
             exclude,
             extensions,
             depth,
-            nocap
+            nocap,
+            shared,
+            shard,
+            output,
+            index,
+            merge,
+            memBudget,
+            stats,
+            prometheus,
+            trace,
+            toggle,
+            match,
+            stratify,
+            fair,
+            newOnly,
+            diff,
+            order,
+            resumeScan,
+            listTimeout,
+            ioClass,
+            rateLimit,
+            backoff,
+            oneFileSystem,
+            skipFstype,
+            splitDevices,
+            archives,
+            contentType,
+            dedupe,
+            fromList,
+            sharedPurge
         };
         /**
         * @brief Checks the provided flag against a list.
@@ -2,301 +2,496 @@
 
 #include "FileManager.h"
 #include "Args.h"
+#include "core/Allocations.h"
+
+#include <algorithm>   // find, max
+#include <chrono>      // pick timers
+#include <fstream>     // Prometheus file
 
 FileManager::FileManager(){
-	std::string emptyString;
-	setUp(emptyString);
+	std::vector<std::string> emptyVector;
+	setUp(emptyVector);
+}
+
+FileManager::FileManager(std::vector<std::string>& unprocessedDirectoryPathStrings) {
+	setUp(unprocessedDirectoryPathStrings);
+}
+
+void FileManager::setUp(const std::vector<std::string>& unprocessedDirectoryPathStrings) {
+	// Gets the canonical paths to the specified directories.
+	if (!setWorkingDirectories(unprocessedDirectoryPathStrings)) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+void FileManager::enableStats(const std::string& prometheusFilePath) {
+	isStatsEnabled = true;
+	prometheusPath = prometheusFilePath;
 }
 
-FileManager::FileManager(std::string& unprocessedDirectoryPathString) {
-	setUp(unprocessedDirectoryPathString);
+bool FileManager::addToggleFilter(const std::string& name, const PickFilter& filter) {
+	if (toggleFilters.size() >= MAX_TOGGLE_FILTERS) {
+		return false;
+	}
+	engine.enableFilterIndex();
+	toggleFilterNames.push_back(name);
+	toggleFilters.push_back(filter);
+	activeToggleFilters.push_back(false);
+	return true;
 }
 
-FileManager::~FileManager() {
-	rootDirectory.clear();
-	rootDirectoryString.clear();
-	directoryBlacklist.clear();
+bool FileManager::toggleFilter(const size_t number) {
+	if (number > toggleFilters.size()) {
+		return false;
+	}
+	if (number == 0) {
+		if (std::find(activeToggleFilters.begin(), activeToggleFilters.end(), true) == activeToggleFilters.end()) {
+			return false;
+		}
+		activeToggleFilters.assign(activeToggleFilters.size(), false);
+	} else {
+		activeToggleFilters[number - 1] = !activeToggleFilters[number - 1];
+	}
+	applyToggleFilters();
+	displayFilterInfo();
+	if (isStratified) {
+		displayStrataInfo();
+	}
+	return true;
+}
+
+void FileManager::applyToggleFilters() {
+	const Trace::Span span("toggle filters", "pick");
+	std::vector<PickFilter> filters;
+	for (size_t i = 0; i < toggleFilters.size(); ++i) {
+		if (activeToggleFilters[i]) {
+			filters.push_back(toggleFilters[i]);
+		}
+	}
+	std::string error;
+	if (!engine.setFilters(filters, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while filtering paths:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+}
 
-	extensionWhitelist.clear();
+void FileManager::enableMatch(const std::string& query) {
+	engine.enableTrigramIndex();
+	isMatchEnabled = true;
+	initialMatch = query;
+}
 
-    relativePathStrings.clear();
+bool FileManager::promptMatch() {
+	if (!isMatchEnabled) {
+		return false;
+	}
+	std::cout << "Search (empty to clear): " << termcolor::bright_cyan;
+	std::string query;
+	std::getline(std::cin, query);
+	std::cout << termcolor::reset;
+	applyMatch(query);
+	displayFilterInfo();
+	if (isStratified) {
+		displayStrataInfo();
+	}
+	return true;
 }
 
-void FileManager::setUp(const std::string& unprocessedDirectoryPathString) {
-	// Gets the canonical path to the specified directory.
-	if (!setWorkingDirectory(unprocessedDirectoryPathString)) {
+void FileManager::applyMatch(const std::string& query) {
+	std::string error;
+	if (!engine.setMatch(query, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while matching paths:\n" << error << termcolor::reset << "\n";
 		exit(EXIT_FAILURE);
 	}
+}
 
-	// Sets the shuffle index to 0
-	shuffleIndex = 0;
+void FileManager::preparePicks() {
+	if (!initialMatch.empty()) {
+		applyMatch(initialMatch);
+	}
+	if (!contentTypes.empty()) {
+		const ScanStats& typeStats = engine.getTypeStats();
+		std::cout << "Types read from "
+			<< termcolor::bright_cyan << typeStats.sniffedFiles << termcolor::reset << " files and found in the cache for "
+			<< termcolor::bright_cyan << typeStats.cachedTypes << termcolor::reset << "\n";
+		if (!engine.getTypeCacheError().empty()) {
+			std::cerr << termcolor::bright_yellow << "Could not write the type cache: " << engine.getTypeCacheError() << termcolor::reset << "\n";
+		}
+	}
+	if (isDeduplicated) {
+		const ScanStats& hashStats = engine.getHashStats();
+		std::cout << "Copies found: "
+			<< termcolor::bright_cyan << hashStats.duplicateFiles << termcolor::reset << " (sampled "
+			<< termcolor::bright_cyan << hashStats.sampledFiles << termcolor::reset << " files, hashed "
+			<< termcolor::bright_cyan << hashStats.hashedFiles << termcolor::reset << " whole and found "
+			<< termcolor::bright_cyan << hashStats.cachedHashes << termcolor::reset << " in the cache)\n";
+		if (!engine.getHashCacheError().empty()) {
+			std::cerr << termcolor::bright_yellow << "Could not write the hash cache: " << engine.getHashCacheError() << termcolor::reset << "\n";
+		}
+	}
+	if (!initialMatch.empty() || isNewOnly || !contentTypes.empty() || isDeduplicated) {
+		displayFilterInfo();
+		printLine();
+	}
+	if (isStratified) {
+		displayStrataInfo();
+		printLine();
+	}
+	if (isFair) {
+		std::cout << "Fair rotation with "
+			<< termcolor::bright_cyan << engine.getHistory().size() << termcolor::reset << " files in the history\n";
+		printLine();
+	}
+}
 
-	// Initializes a random seed.
-	randomEngine.seed((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
+void FileManager::stratify(const StratifyOptions& stratifyOptions) {
+	engine.stratify(stratifyOptions);
+	isStratified = true;
 }
 
-bool FileManager::setWorkingDirectory(const std::string& unprocessedDirectoryPath) {
-	try {
-		// Sets the working directory as the current path if no directory was provided, and the canonical path if it was.
-        rootDirectory = (unprocessedDirectoryPath.empty()) ?
-			std::filesystem::current_path() :
-			std::filesystem::canonical(unprocessedDirectoryPath);
-    }
-    catch (const std::exception& ex) {
-		std::cerr << termcolor::bright_red << "Resolving path \"" << termcolor::bright_cyan <<
-			unprocessedDirectoryPath << termcolor::bright_red << "\" threw exception:\n" << ex.what() << termcolor::reset << std::endl;
-        return false;
-    }
-	
-	// Initializes the string path.
-	rootDirectoryString = rootDirectory.generic_u8string() + "/";
+void FileManager::enableSnapshot(const std::string& snapshotPath, const bool newOnly) {
+	std::string error;
+	if (!engine.enableSnapshot(snapshotPath, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while reading snapshot file:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	if (newOnly) {
+		engine.restrictToNew();
+	}
+	isSnapshotEnabled = true;
+	isNewOnly = newOnly;
+}
 
+void FileManager::restrictToTypes(const std::vector<ContentType::Kind>& kinds) {
+	engine.restrictToTypes(kinds);
+	contentTypes = kinds;
+}
+
+void FileManager::collapseDuplicates() {
+	engine.collapseDuplicates();
+	isDeduplicated = true;
+}
+
+void FileManager::updateSnapshot() {
+	if (!isSnapshotEnabled) {
+		return;
+	}
+	displayDiffInfo();
+	printLine();
+	std::string error;
+	if (!engine.writeSnapshot(error)) {
+		std::cerr << termcolor::bright_yellow << "Could not replace the snapshot: " << error << termcolor::reset << "\n";
+	}
+}
+
+void FileManager::setOrder(const SortedOrder::Key key) {
+	engine.setOrder(key);
+}
+
+void FileManager::enableFairRotation(const std::string& historyPath) {
+	std::string error;
+	if (!engine.enableHistory(historyPath, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while opening history file:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	isFair = true;
+}
+
+bool FileManager::setWorkingDirectories(const std::vector<std::string>& unprocessedDirectoryPaths) {
+	std::string error;
+	if (!engine.setRoots(unprocessedDirectoryPaths, error)) {
+		std::cerr << termcolor::bright_red << "Resolving root directories threw exception:\n" << error << termcolor::reset << std::endl;
+		return false;
+	}
 	return true;
 }
 
-void FileManager::readPaths(
-	std::vector<std::string>& forbiddenDirectories,
-	std::vector<std::string>& allowedExtensions,
-	int depth,
-	bool checkCaps
-) {
-	// Clears the vector.
-	relativePathStrings.clear();
+void FileManager::reservePickBuffers() {
+	// UTF16 never takes more code units than UTF8 takes bytes.
+	const size_t longestPathLength = engine.getLongestPathLength();
+	pathBuffer.reserve(longestPathLength);
+	widePathBuffer.reserve(longestPathLength);
+}
 
-	// Validates (and adjusts, if necessary) the allowed depth value.
-	depth = adjustDepth(depth);
+void FileManager::readPaths(const ScanOptions& scanOptions, const std::string& listPath) {
+	// Validates the options.
+	std::string error;
+	if (!engine.configure(scanOptions, error)) {
+		std::cerr << termcolor::bright_red << "ERROR in scan options:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	const Scanner& scanner = engine.getScanner();
+	if (scanner.getIsDepthCapped()) {
+		displayCapWarning("depth", Scanner::MAX_DEPTH);
+	}
 
 	// Display basic info
-	displayBasicInfo(depth);
-
-	// Determines whether a directory blacklist and an extension whitelist must be included.
-	bool isDirectoryBlacklistEnabled = (forbiddenDirectories.size() > 0);
-	bool isExtensionWhitelistEnabled = (allowedExtensions.size() > 0);
+	displayBasicInfo(scanner.getDepth());
 
-	// If applicable, parse and display blacklisted directories.
-	if (isDirectoryBlacklistEnabled) {
-		directoryBlacklist.clear();
-		parseBlacklistedDirectories(forbiddenDirectories);
+	// If applicable, display blacklisted directories.
+	if (scanner.getDirectoryBlacklist().size() > 0) {
 		displayDirectoryBlacklist();
 	}
 
-	// If applicable, parse and display whitelisted extensions.
-	if (isExtensionWhitelistEnabled) {
-		extensionWhitelist.clear();
-		parseWhitelistedExtensions(allowedExtensions);
+	// If applicable, display whitelisted extensions.
+	if (scanner.getExtensionWhitelist().size() > 0) {
 		displayExtensionWhitelist();
 	}
 
-	printLine();
+	// If applicable, display the shard.
+	if (scanOptions.shardCount > 1) {
+		std::cout << "\nShard: " << termcolor::bright_cyan << scanOptions.shardIndex + 1 << termcolor::reset
+			<< " of " << termcolor::bright_cyan << scanOptions.shardCount << termcolor::reset;
+	}
 
-	// Initializes counters.
-	unsigned int fileCount = 0;
-	unsigned int directoryCount = 0;
-
-	try {
-		// Recursively iterates through the working directory.
-		for (std::filesystem::recursive_directory_iterator i = std::filesystem::recursive_directory_iterator(rootDirectory);
-		     i != std::filesystem::recursive_directory_iterator();
-		     ++i
-		) {
-			// If not disabled, check if path storage limit has been exceeded.
-			if (
-				(fileCount >= MAX_PATHS) &&
-				checkCaps
-			) {
-				displayCapWarning("file paths", MAX_PATHS);
-				break;
-			}
+	// If applicable, display the list the paths are read from.
+	const bool isListed = !listPath.empty();
+	if (isListed) {
+		std::cout << "\nPath list: " << termcolor::bright_cyan
+			<< ((listPath == PathList::STANDARD_INPUT) ? "standard input" : listPath) << termcolor::reset;
+	}
 
-			// Get the path of the current file.
-			std::filesystem::path path = i->path();
-
-			// Do not list directories.
-			if (std::filesystem::is_directory(path)) {
-				// Disable recursion for this directory if
-				if (
-					(
-						isDirectoryBlacklistEnabled &&
-					    isDirectoryBlacklisted(path)
-					) ||
-					i.depth() >= depth // maximum depth has been reached
-				) {
-					i.disable_recursion_pending(); // skip
-				} else {
-					// Count directory.
-					++directoryCount;
-				}
-			}
-			// Do list files.
-			else {
-				// Ignore if extension whitelist is enabled and the current file's extension does not match any.
-				if (isExtensionWhitelistEnabled &&
-					!isExtensionWhitelisted(path.extension().generic_u8string())) {
-					continue;
-				}
-
-				// Reads the file path, relative to the working directory, in UTF8 format.
-				relativePathStrings.push_back(
-					std::filesystem::relative(path, rootDirectory).generic_u8string()
-				);
-
-				// Count file and path string bytes.
-				++fileCount;
-			}
-		}
-	} catch (const std::exception& ex) {
-	    std::cerr << termcolor::bright_red << "ERROR while reading paths into memory:\n" << ex.what() << termcolor::reset << "\n";
+	printLine();
+
+	// Reads the paths (or attaches to a shared index, or reads them from the list).
+	const ScanResult result = isListed ? engine.readList(listPath) : engine.scan();
+	if (!result.ok) {
+		std::cerr << termcolor::bright_red << "ERROR while reading paths into memory:\n" << result.error << termcolor::reset << "\n";
 		exit(EXIT_FAILURE);
 	}
+	if (result.spilledCount > 0) {
+		displaySpillInfo(result.spilledCount);
+	}
 
-	// Sets the distribution.
-	distribution = std::uniform_int_distribution<>(0, (int)relativePathStrings.size() - 1);
+	// Displays the final file and directory counts, or the whole stats.
+	if (isStatsEnabled) {
+		scanResult = result;
+		isScanned = true;
+		std::cout << StatsReport::toJson(&scanResult, nullptr, engine.getRootStrings());
+		writePrometheusFile();
+	} else if (isListed) {
+		std::cout
+			<< termcolor::bright_cyan << result.fileCount << termcolor::reset << " files taken of "
+			<< termcolor::bright_cyan << result.stats.seenEntries << termcolor::reset << " listed";
+	} else if (!result.isSharedAttached) {
+		displayFileCounts(result);
+	}
+	if (scanOptions.share && !isListed) {
+		displaySharedIndexInfo(result);
+	}
+	if (!result.isSharedAttached && !isListed) {
+		displayCheckpointInfo(result, scanOptions.resume);
+		displaySkippedDirectories(result);
+	}
+	printLine();
+	updateSnapshot();
+	preparePicks();
+	reservePickBuffers();
+}
+
+void FileManager::loadIndex(const std::string& indexPath, const uint64_t memoryBudget) {
+	std::string error;
+	engine.setMemoryBudget(memoryBudget);
+	if (!engine.loadIndex(indexPath, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while loading index file:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
 
-	// Displays the final file and directory counts.
-	displayFileCounts(fileCount, directoryCount);
+	std::cout << "\nIndex file: " << termcolor::bright_cyan << indexPath << termcolor::reset;
+	displayWorkingDirectories();
+	printLine();
+	std::cout << termcolor::bright_cyan << engine.size() << termcolor::reset << " files loaded";
+	if (engine.getIndex().isSpilled()) {
+		displaySpillInfo(engine.getIndex().spilledSize());
+	}
 	printLine();
+	updateSnapshot();
+	preparePicks();
+	reservePickBuffers();
+}
+
+void FileManager::writeIndex(const std::string& indexPath) const {
+	std::string error;
+	if (!engine.writeIndex(indexPath, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while writing index file:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	std::cout << "Index written to " << termcolor::bright_cyan << indexPath << termcolor::reset << "\n";
+}
+
+void FileManager::reportDiff() const {
+	// Without a previous snapshot, every file would be listed.
+	if (!engine.hasPreviousSnapshot()) {
+		return;
+	}
+	const SnapshotDiff& diff = engine.getDiff();
+	const bool isRootShown = engine.getRootStrings().size() > 1;
+	diff.added.forEach([&](const uint32_t position) {
+		std::cout << termcolor::bright_green << "+ " << termcolor::reset;
+		if (isRootShown) std::cout << engine.getRootString(position);
+		std::cout << engine.path(position) << "\n";
+	});
+	diff.changed.forEach([&](const uint32_t position) {
+		std::cout << termcolor::bright_yellow << "~ " << termcolor::reset;
+		if (isRootShown) std::cout << engine.getRootString(position);
+		std::cout << engine.path(position) << "\n";
+	});
+}
+
+void FileManager::mergeIndexes(const std::vector<std::string>& inputPaths, const std::string& outputPath) {
+	std::string error;
+	uint64_t entryCount = 0;
+	if (!IndexFile::merge(inputPaths, outputPath, entryCount, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while merging index files:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	std::cout << "\nMerged " << termcolor::bright_cyan << inputPaths.size() << termcolor::reset << " index files ("
+		<< termcolor::bright_cyan << entryCount << termcolor::reset << " files) into "
+		<< termcolor::bright_cyan << outputPath << termcolor::reset << "\n";
+}
+
+void FileManager::purgeSharedIndexes() {
+	std::string error;
+	uint64_t removedCount = 0;
+	if (!SharedIndex::purge(removedCount, error)) {
+		std::cerr << termcolor::bright_red << "ERROR while purging shared indexes:\n" << error << termcolor::reset << "\n";
+		exit(EXIT_FAILURE);
+	}
+	std::cout << "\nRemoved " << termcolor::bright_cyan << removedCount << termcolor::reset << " shared memory segments\n";
 }
 
 void FileManager::shuffle() {
-	std::shuffle(
-		relativePathStrings.begin(),
-		relativePathStrings.end(),
-		randomEngine
-	);
+	engine.shuffle();
 }
 
 
 
 void FileManager::executeRandomFile(){
-	if (relativePathStrings.size() > 0) {
-		executeFile(relativePathStrings[distribution(randomEngine)]);
+	size_t position;
+	if (engine.pickRandom(position)) {
+		++pickStats.randomPicks;
+		executeFile(position);
 	} else {
-		std::cerr << termcolor::bright_yellow << "No paths have been stored into memory\n" << termcolor::reset;
+		displayEmptyWarning();
 	}
 }
 
 void FileManager::executeSequentialFile(const bool backwards){
-	if (relativePathStrings.size() > 0) {
-		adjustShuffleIndex(backwards);
+	size_t position;
+	if (engine.pickSequential(backwards, position)) {
+		++pickStats.sequentialPicks;
 		displayPlaylistInfo();
-		executeFile(relativePathStrings[shuffleIndex]);
+		executeFile(position);
 	} else {
-		std::cerr << termcolor::bright_yellow << "No paths have been stored into memory\n" << termcolor::reset;
+		displayEmptyWarning();
 	}
 }
 
 void FileManager::executeFirstFile(){
-	if (relativePathStrings.size() > 0) {
+	size_t position;
+	if (engine.pickCurrent(position)) {
+		++pickStats.sequentialPicks;
 		displayPlaylistInfo();
-		executeFile(relativePathStrings[0]);
+		executeFile(position);
 	} else {
-		std::cerr << termcolor::bright_yellow << "No paths have been stored into memory\n" << termcolor::reset;
+		displayEmptyWarning();
 	}
 }
 
-void FileManager::executeFile(const std::string& relativePath) const{
-	// Constructs the path.
-	std::wstring wideFilePath = FileManager::utf8ToWide(rootDirectoryString + relativePath);
+void FileManager::executeFile(const size_t position){
+	// Constructs the path into the reused buffers.
+	const AllocationCounts allocationStart = Allocations::thread();
+	const auto buildStart = std::chrono::steady_clock::now();
+	std::string error;
+	const bool isBuilt = engine.buildLaunchPath(position, pathBuffer, error);
+	FileManager::utf8ToWide(pathBuffer, widePathBuffer);
+	const auto buildEnd = std::chrono::steady_clock::now();
+	pickStats.buildNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(buildEnd - buildStart).count();
+	Trace::record("build path", "pick", buildStart, buildEnd);
 	
-	// Displays the path.
-	std::cout << termcolor::bright_cyan << relativePath << termcolor::reset << std::endl;
+	// Displays the path, preceded by its root directory if there are several.
+	if (engine.getRootStrings().size() > 1) {
+		std::cout << engine.getRootString(position);
+	}
+	std::cout << termcolor::bright_cyan << engine.path(position) << termcolor::reset << std::endl;
+
+	// Files inside archives are extracted first, and can not be opened if that fails.
+	if (!isBuilt) {
+		std::cerr << termcolor::bright_yellow << "Could not extract the file: " << error << termcolor::reset << "\n";
+		++pickStats.launches;
+		++pickStats.launchFailures;
+		return;
+	}
 	
-	// Executes the file corresponding to the path.
-	ShellExecuteW(0, 0, wideFilePath.c_str(), 0, 0, SW_SHOW);
-}
-
-std::wstring FileManager::utf8ToWide(const std::string& utf8str) {
-    int count = MultiByteToWideChar(CP_UTF8, 0, utf8str.c_str() , (int)utf8str.length(), NULL, 0);
-    std::wstring wstr(count, 0);
-    MultiByteToWideChar(CP_UTF8, 0, utf8str.c_str(), (int)utf8str.length(), &wstr[0], count);
-    return wstr;
-}
-
-int FileManager::adjustDepth(const int depth, const bool checkCaps) {
-	if (depth < MIN_DEPTH) {
-		return DEPTH_DEFAULT;
-	} else if (
-		(depth > MAX_DEPTH) &&
-		checkCaps
-	) {
-		displayCapWarning("depth", MAX_DEPTH);
-		return MAX_DEPTH;
+	// Executes the file corresponding to the path. Values above 32 mean success.
+	const auto launchStart = std::chrono::steady_clock::now();
+	const INT_PTR status = (INT_PTR)ShellExecuteW(0, 0, widePathBuffer.c_str(), 0, 0, SW_SHOW);
+	const auto launchEnd = std::chrono::steady_clock::now();
+	pickStats.launchNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(launchEnd - launchStart).count();
+	Trace::record("launch", "pick", launchStart, launchEnd, pathBuffer);
+	++pickStats.launches;
+	if (status <= 32) {
+		++pickStats.launchFailures;
 	}
-	else return depth;
-}
 
-void FileManager::adjustShuffleIndex(const bool backwards) {
-	const int shuffleLastIndex = (int)relativePathStrings.size() - 1;
-	if (backwards) {
-		if (shuffleIndex == 0) {
-			shuffleIndex = shuffleLastIndex;
-		} else {
-			--shuffleIndex;
-		}
-	} else {
-		if (shuffleIndex == shuffleLastIndex) {
-			shuffleIndex = 0;
-		} else {
-			++shuffleIndex;
+	// Records the open, which moves the file to the following rotation round.
+	if (isFair && status > 32) {
+		displayHistoryInfo(engine.findHistory(position));
+		if (!engine.recordOpen(position, error)) {
+			std::cerr << termcolor::bright_yellow << "Could not record the open in the history: " << error << termcolor::reset << "\n";
 		}
 	}
-}
 
-void FileManager::parseBlacklistedDirectories(const std::vector<std::string>& forbiddenDirectories) {
-	try {
-		for (const std::string& forbiddenDirectory : forbiddenDirectories) {
-			directoryBlacklist.push_back(
-				std::filesystem::canonical(forbiddenDirectory)
-			);
-		}
-	} catch (const std::exception& ex) {
-	    std::cerr << termcolor::bright_red << "ERROR while reading blacklisted directories into memory:\n" << ex.what() << termcolor::reset << "\n";
-		exit(EXIT_FAILURE);
-	}
+	const AllocationCounts allocationCounts = Allocations::thread() - allocationStart;
+	pickStats.allocations += allocationCounts.allocations;
+	pickStats.allocatedBytes += allocationCounts.bytes;
 }
 
-void FileManager::parseWhitelistedExtensions(const std::vector<std::string>& allowedExtensions) {
-	for (const std::string allowedExtension : allowedExtensions) {
-		extensionWhitelist.push_back(
-			EXTENSION_DOT + allowedExtension
-		);
+void FileManager::reportStats() const {
+	if (!isStatsEnabled) {
+		return;
 	}
+	std::cout << "\n" << StatsReport::toJson(isScanned ? &scanResult : nullptr, &pickStats, engine.getRootStrings());
+	writePrometheusFile();
 }
 
-bool FileManager::isDirectoryBlacklisted(const std::filesystem::path& directory) {
-	const std::vector<std::filesystem::path>::iterator it = std::find(
-	    directoryBlacklist.begin(),
-	    directoryBlacklist.end(),
-	    directory
-	);
-	return (it != directoryBlacklist.end());
-}
-
-bool FileManager::isExtensionWhitelisted(const std::string& extension) {
-	const std::vector<std::string>::iterator it = std::find(
-	    extensionWhitelist.begin(),
-	    extensionWhitelist.end(),
-	    extension
-	);
-	return (it != extensionWhitelist.end());
+void FileManager::utf8ToWide(const std::string& utf8str, std::wstring& wstr) {
+    int count = MultiByteToWideChar(CP_UTF8, 0, utf8str.c_str() , (int)utf8str.length(), NULL, 0);
+    wstr.resize(count);
+    if (count > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, utf8str.c_str(), (int)utf8str.length(), &wstr[0], count);
+    }
 }
 
 
 
 void FileManager::displayBasicInfo(const int depth) const{
-	std::cout << "\nWorking directory: " << termcolor::bright_cyan << rootDirectoryString << termcolor::reset
-		<< "\nDepth: " << termcolor::bright_cyan << depth << termcolor::reset;
+	displayWorkingDirectories();
+	std::cout << "\nDepth: " << termcolor::bright_cyan << depth << termcolor::reset;
+}
+
+void FileManager::displayWorkingDirectories() const{
+	const std::vector<std::string>& rootStrings = engine.getRootStrings();
+	if (rootStrings.size() == 1) {
+		std::cout << "\nWorking directory: " << termcolor::bright_cyan << rootStrings[0] << termcolor::reset;
+	} else {
+		std::cout << "\nWorking directories:";
+		for (const std::string& rootString : rootStrings) {
+			std::cout << "\n  " << termcolor::bright_cyan << rootString << termcolor::reset;
+		}
+	}
 }
 
 void FileManager::displayDirectoryBlacklist() const{
 	std::cout << "\nDirectory blacklist: \n" << termcolor::bright_cyan;
-	for (const std::filesystem::path& directory : directoryBlacklist) {
+	for (const std::filesystem::path& directory : engine.getScanner().getDirectoryBlacklist()) {
 		std::cout << directory.generic_u8string();
 	}
 	std::cout << termcolor::reset;
 }
 
 void FileManager::displayExtensionWhitelist() const{
+	const std::vector<std::string>& extensionWhitelist = engine.getScanner().getExtensionWhitelist();
 	std::cout << "\nExtension whitelist: " << termcolor::bright_cyan;
 	int i = 0;
 	while(i < extensionWhitelist.size()){
@@ -313,20 +508,192 @@ void FileManager::displayCapWarning(const char* capName, const int cap) const{
 		<< Args::FLAGS_SHORTENED[Args::nocap] << " or " << Args::FLAGS_WHOLE[Args::nocap] << termcolor::reset << "\n\n";
 }
 
-void FileManager::displayFileCounts(const unsigned int fileCount, const unsigned int directoryCount) const{
+void FileManager::displaySpillInfo(const uint64_t spilledCount) const{
+	std::cout << termcolor::bright_yellow << "\n\nMemory budget exceeded: "
+		<< termcolor::bright_cyan << spilledCount << termcolor::bright_yellow
+		<< " paths are kept in a temporary file. Raise the budget with flags "
+		<< Args::FLAGS_SHORTENED[Args::memBudget] << " or " << Args::FLAGS_WHOLE[Args::memBudget] << termcolor::reset << "\n\n";
+}
+
+void FileManager::displayFileCounts(const ScanResult& result) const{
+	const std::vector<std::string>& rootStrings = engine.getRootStrings();
+	if (rootStrings.size() > 1) {
+		for (size_t rootId = 0; rootId < result.rootCounts.size(); ++rootId) {
+			std::cout
+				<< termcolor::bright_cyan << result.rootCounts[rootId].fileCount      << termcolor::reset << " files, "
+				<< termcolor::bright_cyan << result.rootCounts[rootId].directoryCount << termcolor::reset << " subdirectories scanned in "
+				<< termcolor::bright_cyan << rootStrings[rootId] << termcolor::reset << "\n";
+		}
+		std::cout << "Total: ";
+	}
 	std::cout
-		<< termcolor::bright_cyan << fileCount      << termcolor::reset << " files, "
-		<< termcolor::bright_cyan << directoryCount << termcolor::reset << " subdirectories scanned";
+		<< termcolor::bright_cyan << result.fileCount      << termcolor::reset << " files, "
+		<< termcolor::bright_cyan << result.directoryCount << termcolor::reset << " subdirectories scanned";
+}
+
+void FileManager::displaySharedIndexInfo(const ScanResult& result) const{
+	if (result.isSharedAttached) {
+		std::cout
+			<< termcolor::bright_cyan << result.fileCount << termcolor::reset << " files attached from shared index (generation "
+			<< termcolor::bright_cyan << result.sharedGeneration << termcolor::reset << ")";
+	} else if (result.sharedGeneration != 0) {
+		std::cout
+			<< "\nPublished shared index (generation "
+			<< termcolor::bright_cyan << result.sharedGeneration << termcolor::reset << ")";
+	} else {
+		std::cerr << termcolor::bright_yellow << "\nCould not publish shared index: " << result.sharedError << termcolor::reset;
+	}
+}
+
+void FileManager::displayCheckpointInfo(const ScanResult& result, const bool isResuming) const{
+	if (result.resumedFileCount > 0) {
+		std::cout
+			<< "\nResumed from checkpoint with "
+			<< termcolor::bright_cyan << result.resumedFileCount << termcolor::reset << " files already scanned";
+	} else if (isResuming) {
+		std::cerr << termcolor::bright_yellow << "\nNo checkpoint to resume from: the scan started over" << termcolor::reset;
+	}
+	if (!result.checkpointError.empty()) {
+		std::cerr << termcolor::bright_yellow << "\nCould not checkpoint the scan: " << result.checkpointError << termcolor::reset;
+	}
+}
+
+void FileManager::displaySkippedDirectories(const ScanResult& result) const{
+	if (result.skippedDirectories.empty()) {
+		return;
+	}
+	std::cerr << termcolor::bright_yellow << "\n" << result.skippedDirectories.size()
+		<< " directories were not listed in time and were skipped:" << termcolor::reset;
+	for (const std::string& directory : result.skippedDirectories) {
+		std::cerr << "\n  " << directory;
+	}
+}
+
+void FileManager::writePrometheusFile() const{
+	if (prometheusPath.empty()) {
+		return;
+	}
+
+	// Writes a temporary file first, so that collectors never read a half-written one.
+	const std::string temporaryPath = prometheusPath + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file << StatsReport::toPrometheus(isScanned ? &scanResult : nullptr, &pickStats, engine.getRootStrings());
+		if (!file) {
+			std::cerr << termcolor::bright_yellow << "\nCould not write Prometheus file: " << temporaryPath << termcolor::reset;
+			return;
+		}
+	}
+	std::error_code errorCode;
+	std::filesystem::rename(temporaryPath, prometheusPath, errorCode);
+	if (errorCode) {
+		std::cerr << termcolor::bright_yellow << "\nCould not write Prometheus file: " << errorCode.message() << termcolor::reset;
+	}
 }
 
 void FileManager::displayPlaylistInfo() const{
 	std::cout << termcolor::bright_magenta << "["
-		<< termcolor::bright_cyan << shuffleIndex + 1
+		<< termcolor::bright_cyan << engine.getPlaylistIndex() + 1
 		<< termcolor::bright_magenta << " of "
-		<< termcolor::bright_cyan << relativePathStrings.size()
+		<< termcolor::bright_cyan << engine.getPickableCount()
 		<< termcolor::bright_magenta << "] " << termcolor::reset;
 }
 
+void FileManager::displayFilterInfo() const{
+	if (hasToggleFilters()) {
+		std::cout << "Filters:";
+		bool isAnyActive = false;
+		for (size_t i = 0; i < toggleFilters.size(); ++i) {
+			if (activeToggleFilters[i]) {
+				std::cout << termcolor::bright_magenta << " [" << i + 1 << "] " << termcolor::bright_cyan << toggleFilterNames[i] << termcolor::reset;
+				isAnyActive = true;
+			}
+		}
+		if (!isAnyActive) {
+			std::cout << termcolor::bright_cyan << " none" << termcolor::reset;
+		}
+		std::cout << " ";
+	}
+	if (isMatchEnabled) {
+		std::cout << "Match: " << termcolor::bright_cyan;
+		if (engine.getMatch().empty()) {
+			std::cout << "none";
+		} else {
+			std::cout << "\"" << engine.getMatch() << "\"";
+		}
+		std::cout << termcolor::reset << " ";
+	}
+	if (isNewOnly) {
+		std::cout << "New files only ";
+	}
+	if (!contentTypes.empty()) {
+		std::cout << "Types:";
+		for (const ContentType::Kind kind : contentTypes) {
+			std::cout << " " << termcolor::bright_cyan << ContentType::nameOf(kind) << termcolor::reset;
+		}
+		std::cout << " ";
+	}
+	if (isDeduplicated) {
+		std::cout << "Distinct contents only ";
+	}
+	std::cout << "- "
+		<< termcolor::bright_cyan << engine.getPickableCount() << termcolor::reset << " of "
+		<< termcolor::bright_cyan << engine.size() << termcolor::reset << " files\n";
+	if (engine.getPickableCount() == 0) {
+		displayEmptyWarning();
+	}
+}
+
+void FileManager::displayStrataInfo() const{
+	std::cout << "Picks spread over "
+		<< termcolor::bright_cyan << engine.getStrata().size() << termcolor::reset << " directories\n";
+}
+
+void FileManager::displayHistoryInfo(const HistoryRecord* record) const{
+	if (record == nullptr || record->openCount == 0) {
+		std::cout << termcolor::bright_magenta << "First open" << termcolor::reset << "\n";
+		return;
+	}
+
+	// Shows the elapsed time in the largest unit that fits.
+	const int64_t now = (int64_t)std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+	const int64_t seconds = std::max<int64_t>(now - record->lastOpened, 0);
+	std::cout << termcolor::bright_magenta << "Last opened " << termcolor::bright_cyan;
+	if (seconds < 60) {
+		std::cout << seconds << termcolor::bright_magenta << " seconds";
+	} else if (seconds < 3600) {
+		std::cout << seconds / 60 << termcolor::bright_magenta << " minutes";
+	} else if (seconds < 86400) {
+		std::cout << seconds / 3600 << termcolor::bright_magenta << " hours";
+	} else {
+		std::cout << seconds / 86400 << termcolor::bright_magenta << " days";
+	}
+	std::cout << " ago, opened " << termcolor::bright_cyan << record->openCount
+		<< termcolor::bright_magenta << (record->openCount == 1 ? " time" : " times") << " before" << termcolor::reset << "\n";
+}
+
+void FileManager::displayDiffInfo() const{
+	if (!engine.hasPreviousSnapshot()) {
+		std::cout << "No previous snapshot: every file is new\n";
+		return;
+	}
+	const SnapshotDiff& diff = engine.getDiff();
+	std::cout << "Since the previous run: "
+		<< termcolor::bright_cyan << diff.added.size() << termcolor::reset << " added, "
+		<< termcolor::bright_cyan << diff.changed.size() << termcolor::reset << " changed, "
+		<< termcolor::bright_cyan << diff.removedCount << termcolor::reset << " removed\n";
+}
+
+void FileManager::displayEmptyWarning() const{
+	if (engine.size() > 0) {
+		std::cerr << termcolor::bright_yellow << "No files match the active filters\n" << termcolor::reset;
+	} else {
+		std::cerr << termcolor::bright_yellow << "No paths have been stored into memory\n" << termcolor::reset;
+	}
+}
+
 void FileManager::printLine() {
 	std::cout << CONSOLE_LINE;
 }
@@ -9,108 +9,121 @@
 #include <string>      // strings
 #include <vector>      // dynamic containers
 #include <windows.h>   // Windows API functions
-#include <algorithm>   // shuffle, find
-#include <random>      // default_random_engine
-#include <chrono>      // chrono, system_clock
-
-#include <filesystem>  // file navigation. C++17 ONLY.
+#include <string_view> // non-owning string views
 
 #include "termcolor.h" // easy console colors, available at https://github.com/ikalnytskyi/termcolor
 
+#include "core/Engine.h"
+#include "core/StatsReport.h"
+#include "core/Trace.h"
+
 #undef max // undefine any macros for max(), such as Visual Studio's 
 
+/**
+* Console front-end over the core engine: displays information and executes picked files.
+*/
 class FileManager {
 
     private:
-        // Directory paths.
-        std::filesystem::path rootDirectory;
-        std::string rootDirectoryString;
-        std::vector<std::filesystem::path> directoryBlacklist;
+        // Engine.
+        Engine engine;
+
+        // Stats.
+        bool isStatsEnabled = false;
+        std::string prometheusPath;
+        ScanResult scanResult;
+        bool isScanned = false;
+        PickStats pickStats;
+
+        // Filters toggled with digit keys, and whether each one is active.
+        std::vector<std::string> toggleFilterNames;
+        std::vector<PickFilter> toggleFilters;
+        std::vector<bool> activeToggleFilters;
+
+        // Whether picks are spread over directories.
+        bool isStratified = false;
+
+        // Whether random picks rotate fairly through the open history.
+        bool isFair = false;
+
+        // Whether the index is compared with the snapshot of the previous run, and picks restricted to new files.
+        bool isSnapshotEnabled = false;
+        bool isNewOnly = false;
 
-        // Extensions.
-        std::vector<std::string> extensionWhitelist;
+        // Types picks are restricted to, if any.
+        std::vector<ContentType::Kind> contentTypes;
 
-        // Path string vector.
-        std::vector<std::string> relativePathStrings;
+        // Whether copies of files are left out of picks.
+        bool isDeduplicated = false;
 
-        // Shuffle index.
-        int shuffleIndex;
+        // Substring match, and the text matched once paths are read.
+        bool isMatchEnabled = false;
+        std::string initialMatch;
+
+        // Buffers reused by every pick, so that picks do not allocate.
+        std::string pathBuffer;
+        std::wstring widePathBuffer;
 
         // Other
         static constexpr const char* EXTENSION_SEPARATOR = ", ";
         static constexpr const char* CONSOLE_LINE = "\n\n====================================================================================\n\n";
 
-        // Random.
-        std::default_random_engine randomEngine;
-        std::uniform_int_distribution<> distribution;
-
         // == Main functions ==
         /**
         * @brief Set up centralization for constructors.
         */
-        void setUp(const std::string&);
+        void setUp(const std::vector<std::string>&);
         /**
-        * @brief Sets the working directory.
+        * @brief Sets the working directories.
         * 
-        * @param unprocessedDirectoryPathString Absolute or relative path where the target directory is located.
+        * @param unprocessedDirectoryPathStrings Absolute or relative paths where the target directories are located.
         * @return If an error was thrown, returns `false`.
         */
-        bool setWorkingDirectory(const std::string&);
-
-        // == Other functions ==
+        bool setWorkingDirectories(const std::vector<std::string>&);
         /**
-        * @brief Converts a UTF8 string into a wide string.
-        * 
-        * @param utf8str UTF8-encoded string.
-        * @return Wide string.
+        * @brief Reserves room in the pick buffers for the longest path in the index.
         */
-        static std::wstring utf8ToWide(const std::string&);
+        void reservePickBuffers();
         /**
-        * @brief Adjusts a depth value.
-        * 
-        * @param depth Initial depth.
-        * @param checkCaps Whether to check for the soft cap for the levels of depth while adjusting.
-        */
-        int adjustDepth(const int, const bool = true);
-        /**
-        * @brief Adjusts the shuffle index.
-        * 
-        * @param backwards Whether to go backwards. Defaults to false.
+        * @brief Restricts picks to the active toggle filters.
         */
-        void adjustShuffleIndex(const bool = false);
+        void applyToggleFilters();
         /**
-        * @brief Parses absolute or relative directory paths.
+        * @brief Restricts picks to the paths that contain a text.
         * 
-        * @param forbiddenDirectories List of blacklisted directories as absolute or relative path strings.
+        * @param query Text, or empty to clear the match.
         */
-        void parseBlacklistedDirectories(const std::vector<std::string>&);
+        void applyMatch(const std::string&);
         /**
-        * @brief Parses extension names.
-        * 
-        * @param allowedExtensions List of allowed extensions.
+        * @brief Applies the match given before reading paths, if any, and displays how picks are restricted and spread.
         */
-        void parseWhitelistedExtensions(const std::vector<std::string>&);
+        void preparePicks();
         /**
-        * @brief Determines whether a directory is blacklisted.
-        * 
-        * @param directory Directory.
+        * @brief Displays how many files changed since the previous run, and replaces its snapshot, if enabled.
         */
-        bool isDirectoryBlacklisted(const std::filesystem::path&);
+        void updateSnapshot();
+
+        // == Other functions ==
         /**
-        * @brief Determines whether an extension is whitelisted.
+        * @brief Converts a UTF8 string into a wide string, reusing the memory of the output.
         * 
-        * @param extension Extension.
+        * @param utf8str UTF8-encoded string.
+        * @param wstr Receives the wide string.
         */
-        bool isExtensionWhitelisted(const std::string&);
+        static void utf8ToWide(const std::string&, std::wstring&);
 
         // == Display functions ==
         /**
-        * @brief Displays the working directory and the selected depth cap.
+        * @brief Displays the working directories and the selected depth cap.
         * 
         * @param depth Depth cap for this instance.
         */
         void displayBasicInfo(const int) const;
         /**
+        * @brief Displays the working directories.
+        */
+        void displayWorkingDirectories() const;
+        /**
         * @brief Displays a line containing a friendly list of extensions.
         */
         void displayExtensionWhitelist() const;
@@ -126,58 +139,198 @@ class FileManager {
         */
         void displayCapWarning(const char*, const int) const;
         /**
-        * @brief Displays the amount of scanned files and distinct directories.
+        * @brief Displays how many files were added, changed and removed since the previous run.
+        */
+        void displayDiffInfo() const;
+        /**
+        * @brief Displays how many paths were spilled to disk because the memory budget was exceeded.
         * 
-        * @param fileCount File count.
-        * @param directoryCount Directory count.
+        * @param spilledCount Amount of spilled paths.
         */
-        void displayFileCounts(const unsigned int, const unsigned int) const;
+        void displaySpillInfo(const uint64_t) const;
+        /**
+        * @brief Displays the amount of scanned files and distinct directories, per root directory if there are several.
+        * 
+        * @param result Result of the scan.
+        */
+        void displayFileCounts(const ScanResult&) const;
+        /**
+        * @brief Displays the state of the shared index.
+        * 
+        * @param result Result of the scan.
+        */
+        void displaySharedIndexInfo(const ScanResult&) const;
+        /**
+        * @brief Displays how many files were resumed from checkpoints, and why checkpoints stopped, if they did.
+        * 
+        * @param result Result of the scan.
+        * @param isResuming Whether the scan was asked to resume.
+        */
+        void displayCheckpointInfo(const ScanResult&, const bool) const;
+        /**
+        * @brief Displays the directories skipped because they were not listed in time, if any.
+        * 
+        * @param result Result of the scan.
+        */
+        void displaySkippedDirectories(const ScanResult&) const;
+        /**
+        * @brief Writes the stats into the Prometheus file, if any.
+        */
+        void writePrometheusFile() const;
         /**
         * @brief Displays the current playlist index and amount of elements.
         */
         void displayPlaylistInfo() const;
+        /**
+        * @brief Displays the active toggle filters and match, whether only new files are picked, and how many files they leave.
+        */
+        void displayFilterInfo() const;
+        /**
+        * @brief Displays over how many directories picks are spread.
+        */
+        void displayStrataInfo() const;
+        /**
+        * @brief Displays when a file was last opened and how many times, before recording the current open.
+        * 
+        * @param record History record of the file, or `nullptr` if it has none.
+        */
+        void displayHistoryInfo(const HistoryRecord*) const;
+        /**
+        * @brief Displays a warning notifying that no paths are stored, or that none match the active filters.
+        */
+        void displayEmptyWarning() const;
 
     public:
-        // Soft limits and default values
-        static const int MAX_PATHS = 50000; // Maximum (inclusive) amount of paths allowed to be stored in a single file
-        static const int MIN_DEPTH = 0;     // Minimum (inclusive) depth
-        static const int MAX_DEPTH = 10;    // Maximum (inclusive) depth the recursive iterator is allowed to reach
-        static const int DEPTH_DEFAULT = 5; // Default depth the recursive iterator is allowed to reach
-
-        static const char EXTENSION_DOT = '.';
+        static const size_t MAX_TOGGLE_FILTERS = 9; // One per digit key, as 0 clears them
 
         // == Constructor ==
         FileManager();
         /**
-        * @param unprocessedDirectoryPathString Absolute or relative path of the root directory.
+        * @param unprocessedDirectoryPathStrings Absolute or relative paths of the root directories.
         */
-        FileManager(std::string&);
-        ~FileManager();
+        FileManager(std::vector<std::string>&);
 
         /**
-        * @brief Reads paths by iterating recursively and stores them into memory.
+        * @brief Reports stats as JSON instead of the bare file counts, and optionally in a Prometheus text file.
+        * 
+        * @param prometheusPath Path to the Prometheus text file, or empty for none.
+        */
+        void enableStats(const std::string&);
+        /**
+        * @brief Adds a filter that can be toggled while picking, without rescanning. Must be called before reading paths.
+        * 
+        * @param name Name displayed for the filter.
+        * @param filter Extensions and top-level directories matched by the filter.
+        * @return If there are already as many filters as digit keys, returns `false`.
+        */
+        bool addToggleFilter(const std::string&, const PickFilter&);
+        /**
+        * @brief Toggles a filter, or clears every filter.
+        * 
+        * @param number Number of the filter, from 1, or 0 to clear them all.
+        * @return If the filters did not change, returns `false`.
+        */
+        bool toggleFilter(const size_t);
+        // @return true if toggle filters were added
+        bool hasToggleFilters() const { return !toggleFilters.empty(); }
+        /**
+        * @brief Indexes the trigrams of the paths, so that picks can be restricted to the paths containing a text.
+        * Must be called before reading paths.
+        * 
+        * @param query Text matched once paths are read, or empty to match every path until a search.
+        */
+        void enableMatch(const std::string&);
+        /**
+        * @brief Asks for a text and restricts picks to the paths that contain it.
+        * 
+        * @return If matching is not enabled, returns `false`.
+        */
+        bool promptMatch();
+        // @return true if picks can be restricted to the paths containing a text
+        bool hasMatch() const { return isMatchEnabled; }
+        /**
+        * @brief Spreads picks over directories rather than over files. Must be called before reading paths.
+        * 
+        * @param stratifyOptions Grouping and weighting of the directories.
+        */
+        void stratify(const StratifyOptions&);
+        /**
+        * @brief Makes random picks come from the files opened the fewest times, as recorded in a history file
+        * that persists across runs. Must be called before reading paths.
+        * 
+        * @param historyPath Path to the history file, which is created if it does not exist.
+        */
+        void enableFairRotation(const std::string&);
+        /**
+        * @brief Compares the paths with the snapshot of the previous run, which is replaced once they are read.
+        * Must be called before reading paths.
+        * 
+        * @param snapshotPath Path to the snapshot file, which is created if it does not exist.
+        * @param newOnly Whether to restrict picks to the files added or changed since the previous run.
+        */
+        void enableSnapshot(const std::string&, const bool);
+        /**
+        * @brief Restricts picks to the files of the given types, told from their first bytes. Must be called before reading paths.
         * 
-        * @param forbiddenDirectories Directory blacklist.
-        * @param allowedExtensions Extension whitelist. If empty, no checks will be performed.
-        * @param depth Maximum depth that the recursive iterator is allowed to reach.
-        * @param checkCaps Whether to enable soft caps. Defaults to true.
+        * @param kinds Types.
         */
-        void readPaths(
-            std::vector<std::string>&,
-            std::vector<std::string>&,
-            int,
-            bool = true
-        );
+        void restrictToTypes(const std::vector<ContentType::Kind>&);
         /**
-        * @brief Shuffles read paths.
+        * @brief Leaves out of picks every file with the same contents as another one. Must be called before reading paths.
+        */
+        void collapseDuplicates();
+        /**
+        * @brief Makes playlists go through the files in order rather than shuffled. Must be called before reading paths.
+        * 
+        * @param key Key to sort the files by.
+        */
+        void setOrder(const SortedOrder::Key);
+
+        /**
+        * @brief Reads paths by iterating recursively, or from a list of paths, and stores them into memory.
+        * 
+        * @param scanOptions Directory blacklist, extension whitelist, maximum depth, depth cap, memory budget, sharing and shard.
+        * @param listPath Path to a list of paths to read instead of scanning, "-" for the standard input, or empty to scan.
+        */
+        void readPaths(const ScanOptions&, const std::string&);
+        /**
+        * @brief Loads paths from an index file instead of scanning.
+        * 
+        * @param indexPath Path to the index file.
+        * @param memoryBudget Bytes the paths may take in memory before spilling to disk, or 0 for no limit.
+        */
+        void loadIndex(const std::string&, const uint64_t);
+        /**
+        * @brief Writes the read paths into an index file.
+        * 
+        * @param indexPath Path to the index file.
+        */
+        void writeIndex(const std::string&) const;
+        /**
+        * @brief Merges index files into a single one.
+        * 
+        * @param inputPaths Paths to the index files to merge.
+        * @param outputPath Path to the merged index file.
+        */
+        static void mergeIndexes(const std::vector<std::string>&, const std::string&);
+        /**
+        * @brief Removes the shared indexes of the user, whatever the root and options they were published for.
+        */
+        static void purgeSharedIndexes();
+        /**
+        * @brief Lists the files added and changed since the previous run, if there was one.
+        */
+        void reportDiff() const;
+        /**
+        * @brief Shuffles read paths, or sorts them if an order was set.
         */
         void shuffle();
         /**
         * @brief Executes a file.
         * 
-        * @param relativePath The unprocessed relative path as a string.
+        * @param position Position of the file in the index.
         */
-        void executeFile(const std::string&) const;
+        void executeFile(const size_t);
         /**
         * @brief Executes a random file.
         */
@@ -193,9 +346,13 @@ class FileManager {
         */
         void executeFirstFile();
         /**
+        * @brief If stats are enabled, prints the stats of the session and rewrites the Prometheus file.
+        */
+        void reportStats() const;
+        /**
         * @brief Prints a line surrounded by double newline characters.
         */
         static void printLine();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -47,3 +47,14 @@ int Keys::refreshArrow(const int c) {
     }
     return c;
 }
+
+boolean Keys::isSearchKey(const int c) {
+    return c == SEARCH;
+}
+
+int Keys::digitOf(const int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    return -1;
+}
@@ -15,6 +15,7 @@ class Keys {
         static const int RIGHT_ARROW = 77;
         static const int DOWN_ARROW = 80;
         static const int LEFT_ARROW = 75;
+        static const int SEARCH = '/';
     public:
         // @return true if Enter or Space
         static boolean isConfirmKey(const int);
@@ -26,5 +27,9 @@ class Keys {
         static boolean isForwardKey(const int);
         // @return Actual arrow value if the character is identified as an arrow prefix, or the same one
         static int refreshArrow(const int);
+        // @return Value of a digit key, or -1 for any other key
+        static int digitOf(const int);
+        // @return true if Slash
+        static boolean isSearchKey(const int);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+// Allocations.cpp : descriptions for the optional heap allocation accounting
+
+#include "Allocations.h"
+
+#ifdef RFOPENER_ALLOC_ACCOUNTING
+
+#include <atomic>      // process counters
+#include <cstdlib>     // malloc, free
+#include <new>         // bad_alloc
+
+// Replacing the global operators makes GCC pair them with the standard ones.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<uint64_t> processAllocations{0};
+static std::atomic<uint64_t> processBytes{0};
+static thread_local uint64_t threadAllocations = 0;
+static thread_local uint64_t threadBytes = 0;
+
+// The nothrow forms are not replaced, since the standard ones call these.
+void* operator new(std::size_t size) {
+	processAllocations.fetch_add(1, std::memory_order_relaxed);
+	processBytes.fetch_add(size, std::memory_order_relaxed);
+	++threadAllocations;
+	threadBytes += size;
+	if (void* pointer = std::malloc(size ? size : 1)) {
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+bool Allocations::isEnabled() {
+	return true;
+}
+
+AllocationCounts Allocations::total() {
+	AllocationCounts counts;
+	counts.allocations = processAllocations.load(std::memory_order_relaxed);
+	counts.bytes = processBytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+AllocationCounts Allocations::thread() {
+	AllocationCounts counts;
+	counts.allocations = threadAllocations;
+	counts.bytes = threadBytes;
+	return counts;
+}
+
+#else
+
+bool Allocations::isEnabled() {
+	return false;
+}
+
+AllocationCounts Allocations::total() {
+	return AllocationCounts();
+}
+
+AllocationCounts Allocations::thread() {
+	return AllocationCounts();
+}
+
+#endif
@@ -0,0 +1,44 @@
+// Allocations.h : declarations for the optional heap allocation accounting
+
+#pragma once
+
+#ifndef ALLOCATIONS_H_
+#define ALLOCATIONS_H_
+
+#include <cstdint>     // fixed width integers
+
+/**
+* Amount of heap allocations and the bytes they requested.
+*/
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    // @return Allocations made since `start` was taken.
+    AllocationCounts operator-(const AllocationCounts& start) const {
+        AllocationCounts counts;
+        counts.allocations = allocations - start.allocations;
+        counts.bytes = bytes - start.bytes;
+        return counts;
+    }
+};
+
+/**
+* Counts heap allocations made through the global `operator new`, which this module replaces when
+* built with `RFOPENER_ALLOC_ACCOUNTING` defined. Otherwise, nothing is replaced and every count
+* stays at 0.
+*
+* Counts are kept per thread as well, so that concurrent scan workers can measure themselves.
+*/
+class Allocations {
+
+    public:
+        // @return Whether allocations are being counted, i.e. whether the build defines `RFOPENER_ALLOC_ACCOUNTING`.
+        static bool isEnabled();
+        // @return Allocations made by the whole process so far.
+        static AllocationCounts total();
+        // @return Allocations made by the calling thread so far.
+        static AllocationCounts thread();
+};
+
+#endif
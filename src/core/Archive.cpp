@@ -0,0 +1,425 @@
+// Archive.cpp : descriptions for reading the entries of zip and tar archives
+
+#include "Archive.h"
+#include "Hash.h"
+#include "Inflate.h"
+
+#include <algorithm>   // min, all_of
+#include <cctype>      // tolower
+#include <cstdlib>     // strtoull
+#include <cstring>     // memcmp, strlen
+
+static const uint32_t ZIP_LOCAL_SIGNATURE = 0x04034B50;
+static const uint32_t ZIP_CENTRAL_SIGNATURE = 0x02014B50;
+static const uint32_t ZIP_END_SIGNATURE = 0x06054B50;
+static const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064B50;
+static const uint32_t ZIP64_END_SIGNATURE = 0x06064B50;
+static const size_t ZIP_LOCAL_BYTES = 30;
+static const size_t ZIP_CENTRAL_BYTES = 46;
+static const size_t ZIP_END_BYTES = 22;
+static const size_t ZIP64_LOCATOR_BYTES = 20;
+static const size_t ZIP64_END_BYTES = 56;
+static const size_t ZIP_MAX_COMMENT_BYTES = 65535;
+static const uint16_t ZIP_STORED = 0;
+static const uint16_t ZIP_DEFLATED = 8;
+static const uint16_t ZIP_ENCRYPTED_FLAG = 1;
+static const uint16_t ZIP64_EXTRA_ID = 1;
+static const size_t TAR_BLOCK_BYTES = 512;
+
+static uint64_t little(const unsigned char* bytes, const int width) {
+	uint64_t value = 0;
+	for (int i = width - 1; i >= 0; --i) {
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+/**
+* @brief Reads a whole range of a file.
+*
+* @return false if the file ends before the range does.
+*/
+static bool readExactly(SourceFile& file, const uint64_t offset, std::string& bytes, const size_t size) {
+	bytes.resize(size);
+	return file.read(offset, &bytes[0], size) == size;
+}
+
+/**
+* @brief Turns a stored name into an index path: '/'-separated, without leading "./" or separators.
+*/
+static void normalizeName(std::string& name) {
+	std::replace(name.begin(), name.end(), '\\', '/');
+	size_t start = 0;
+	while (true) {
+		if (name.compare(start, 1, "/") == 0) {
+			start += 1;
+		} else if (name.compare(start, 2, "./") == 0) {
+			start += 2;
+		} else {
+			break;
+		}
+	}
+	name.erase(0, start);
+}
+
+Archive::Format Archive::formatOf(std::string_view name) {
+	static const struct { const char* extension; Format format; } FORMATS[] = {
+		{ ".zip", zip }, { ".tar", tar }
+	};
+	for (const auto& known : FORMATS) {
+		const size_t length = strlen(known.extension);
+		if (name.size() > length && std::equal(name.end() - length, name.end(), known.extension, [](const char a, const char b) {
+			return tolower((unsigned char)a) == b;
+		})) {
+			return known.format;
+		}
+	}
+	return none;
+}
+
+size_t Archive::findSeparator(std::string_view path) {
+	for (size_t separator = path.find(SEPARATOR); separator != std::string_view::npos; separator = path.find(SEPARATOR, separator + 1)) {
+		if (formatOf(path.substr(0, separator)) != none) {
+			return separator;
+		}
+	}
+	return std::string_view::npos;
+}
+
+/**
+* @brief Lists a zip archive from its central directory.
+*/
+static bool listZip(SourceFile& file, std::vector<ArchiveEntry>& entries, std::string& error) {
+	// Finds the end of central directory record, which only a comment may follow.
+	const uint64_t fileSize = file.size();
+	if (fileSize < ZIP_END_BYTES) {
+		error = "Not a zip archive";
+		return false;
+	}
+	const size_t tailSize = (size_t)std::min<uint64_t>(fileSize, ZIP_END_BYTES + ZIP_MAX_COMMENT_BYTES);
+	std::string tail;
+	if (!readExactly(file, fileSize - tailSize, tail, tailSize)) {
+		error = "Could not read the archive";
+		return false;
+	}
+	const unsigned char* tailBytes = (const unsigned char*)tail.data();
+	size_t end = tailSize - ZIP_END_BYTES + 1;
+	do {
+		--end;
+	} while (end > 0 && !(
+		little(tailBytes + end, 4) == ZIP_END_SIGNATURE &&
+		end + ZIP_END_BYTES + little(tailBytes + end + 20, 2) <= tailSize
+	));
+	if (little(tailBytes + end, 4) != ZIP_END_SIGNATURE) {
+		error = "Not a zip archive";
+		return false;
+	}
+	uint64_t entryCount = little(tailBytes + end + 10, 2);
+	uint64_t directorySize = little(tailBytes + end + 12, 4);
+	uint64_t directoryOffset = little(tailBytes + end + 16, 4);
+
+	// Archives too large for those fields keep them in the ZIP64 end record, which a locator points to.
+	const uint64_t endOffset = fileSize - tailSize + end;
+	if (entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) {
+		std::string locator;
+		std::string end64;
+		if (
+			endOffset < ZIP64_LOCATOR_BYTES ||
+			!readExactly(file, endOffset - ZIP64_LOCATOR_BYTES, locator, ZIP64_LOCATOR_BYTES) ||
+			little((const unsigned char*)locator.data(), 4) != ZIP64_LOCATOR_SIGNATURE ||
+			!readExactly(file, little((const unsigned char*)locator.data() + 8, 8), end64, ZIP64_END_BYTES) ||
+			little((const unsigned char*)end64.data(), 4) != ZIP64_END_SIGNATURE
+		) {
+			error = "The ZIP64 end record is missing";
+			return false;
+		}
+		const unsigned char* end64Bytes = (const unsigned char*)end64.data();
+		entryCount = little(end64Bytes + 32, 8);
+		directorySize = little(end64Bytes + 40, 8);
+		directoryOffset = little(end64Bytes + 48, 8);
+	}
+	if (directorySize > Archive::MAX_CENTRAL_DIRECTORY_BYTES || directoryOffset > fileSize || directorySize > fileSize - directoryOffset) {
+		error = "The central directory is out of bounds";
+		return false;
+	}
+
+	std::string directory;
+	if (!readExactly(file, directoryOffset, directory, (size_t)directorySize)) {
+		error = "Could not read the central directory";
+		return false;
+	}
+	const unsigned char* bytes = (const unsigned char*)directory.data();
+	size_t cursor = 0;
+	entries.clear();
+	for (uint64_t i = 0; i < entryCount; ++i) {
+		if (cursor + ZIP_CENTRAL_BYTES > directory.size() || little(bytes + cursor, 4) != ZIP_CENTRAL_SIGNATURE) {
+			error = "The central directory is damaged";
+			return false;
+		}
+		const uint16_t flags = (uint16_t)little(bytes + cursor + 8, 2);
+		ArchiveEntry entry;
+		entry.method = (uint16_t)little(bytes + cursor + 10, 2);
+		entry.crc = (uint32_t)little(bytes + cursor + 16, 4);
+		entry.compressedSize = little(bytes + cursor + 20, 4);
+		entry.size = little(bytes + cursor + 24, 4);
+		const size_t nameLength = (size_t)little(bytes + cursor + 28, 2);
+		const size_t extraLength = (size_t)little(bytes + cursor + 30, 2);
+		const size_t commentLength = (size_t)little(bytes + cursor + 32, 2);
+		entry.offset = little(bytes + cursor + 42, 4);
+		const size_t nameStart = cursor + ZIP_CENTRAL_BYTES;
+		cursor = nameStart + nameLength + extraLength + commentLength;
+		if (cursor > directory.size()) {
+			error = "The central directory is damaged";
+			return false;
+		}
+
+		// Sizes and offsets too large for their fields are kept in the ZIP64 extra field, in this order.
+		for (size_t extra = nameStart + nameLength; extra + 4 <= nameStart + nameLength + extraLength;) {
+			const uint16_t id = (uint16_t)little(bytes + extra, 2);
+			const size_t length = (size_t)little(bytes + extra + 2, 2);
+			size_t field = extra + 4;
+			const size_t fieldEnd = std::min(field + length, nameStart + nameLength + extraLength);
+			if (id == ZIP64_EXTRA_ID) {
+				for (uint64_t* value : { &entry.size, &entry.compressedSize, &entry.offset }) {
+					if (*value == 0xFFFFFFFF && field + 8 <= fieldEnd) {
+						*value = little(bytes + field, 8);
+						field += 8;
+					}
+				}
+			}
+			extra = fieldEnd;
+		}
+
+		entry.name.assign(directory, nameStart, nameLength);
+		if (
+			(entry.name.empty() || entry.name.back() == '/' || entry.name.back() == '\\') ||
+			(flags & ZIP_ENCRYPTED_FLAG) ||
+			(entry.method != ZIP_STORED && entry.method != ZIP_DEFLATED)
+		) {
+			continue;
+		}
+		normalizeName(entry.name);
+		if (!entry.name.empty()) {
+			entries.push_back(std::move(entry));
+		}
+	}
+	return true;
+}
+
+/**
+* @return Value of a numeric tar field: octal text, or big-endian binary if its first bit is set.
+*/
+static uint64_t tarNumber(const unsigned char* field, const size_t width) {
+	uint64_t value = 0;
+	if (field[0] & 0x80) {
+		for (size_t i = 1; i < width; ++i) {
+			value = (value << 8) | field[i];
+		}
+		return value;
+	}
+	for (size_t i = 0; i < width && field[i] != '\0'; ++i) {
+		if (field[i] >= '0' && field[i] <= '7') {
+			value = (value << 3) | (uint64_t)(field[i] - '0');
+		}
+	}
+	return value;
+}
+
+/**
+* @return Text of a tar field, up to its first null character.
+*/
+static std::string tarText(const unsigned char* field, const size_t width) {
+	size_t length = 0;
+	while (length < width && field[length] != '\0') {
+		++length;
+	}
+	return std::string((const char*)field, length);
+}
+
+/**
+* @brief Lists a tar archive by reading its headers, skipping over the data of every entry.
+*/
+static bool listTar(SourceFile& file, std::vector<ArchiveEntry>& entries, std::string& error) {
+	const uint64_t fileSize = file.size();
+	unsigned char header[TAR_BLOCK_BYTES];
+	std::string longName; // Name given to the following entry by a GNU long name or a pax header.
+	std::string payload;
+	entries.clear();
+	for (uint64_t offset = 0; offset + TAR_BLOCK_BYTES <= fileSize;) {
+		if (file.read(offset, header, TAR_BLOCK_BYTES) != TAR_BLOCK_BYTES) {
+			error = "Could not read the archive";
+			return false;
+		}
+
+		// Archives end with empty blocks. Headers carry the sum of their bytes, counting the sum itself as spaces.
+		if (std::all_of(header, header + TAR_BLOCK_BYTES, [](const unsigned char c) { return c == 0; })) {
+			break;
+		}
+		uint64_t sum = 0;
+		for (size_t i = 0; i < TAR_BLOCK_BYTES; ++i) {
+			sum += (i >= 148 && i < 156) ? ' ' : header[i];
+		}
+		if (sum != tarNumber(header + 148, 8)) {
+			error = (offset == 0) ? "Not a tar archive" : "A header is damaged";
+			return false;
+		}
+
+		const uint64_t size = tarNumber(header + 124, 12);
+		const uint64_t dataOffset = offset + TAR_BLOCK_BYTES;
+		offset = dataOffset + (size + TAR_BLOCK_BYTES - 1) / TAR_BLOCK_BYTES * TAR_BLOCK_BYTES;
+		if (offset < dataOffset || dataOffset + size > fileSize) {
+			error = "The archive is truncated";
+			return false;
+		}
+		const char type = (char)header[156];
+
+		// Long names come in entries of their own, before the entry they name.
+		if (type == 'L' || type == 'x') {
+			if (size > Archive::MAX_LONG_NAME_BYTES || !readExactly(file, dataOffset, payload, (size_t)size)) {
+				error = "A long name could not be read";
+				return false;
+			}
+			if (type == 'L') {
+				longName = payload.substr(0, payload.find('\0'));
+				continue;
+			}
+
+			// Pax records are "length key=value\n".
+			for (size_t record = 0; record < payload.size();) {
+				const size_t space = payload.find(' ', record);
+				const size_t length = (space == std::string::npos) ? 0 : (size_t)strtoull(payload.c_str() + record, nullptr, 10);
+				if (length == 0 || record + length > payload.size()) {
+					break;
+				}
+				if (payload.compare(space + 1, 5, "path=") == 0) {
+					longName = payload.substr(space + 6, record + length - 1 - (space + 6));
+				}
+				record += length;
+			}
+			continue;
+		}
+		if (type == 'g' || type == 'K') {
+			continue;
+		}
+
+		// Only regular files can be extracted, and ustar headers may split names in two.
+		if (type == '0' || type == '\0' || type == '7') {
+			ArchiveEntry entry;
+			if (!longName.empty()) {
+				entry.name = longName;
+			} else {
+				const std::string prefix = (memcmp(header + 257, "ustar", 5) == 0) ? tarText(header + 345, 155) : std::string();
+				entry.name = prefix.empty() ? tarText(header, 100) : prefix + '/' + tarText(header, 100);
+			}
+			entry.offset = dataOffset;
+			entry.size = size;
+			entry.compressedSize = size;
+			normalizeName(entry.name);
+			if (!entry.name.empty() && entry.name.back() != '/') {
+				entries.push_back(std::move(entry));
+			}
+		}
+		longName.clear();
+	}
+	return true;
+}
+
+bool Archive::list(SourceFile& file, const Format format, std::vector<ArchiveEntry>& entries, std::string& error) {
+	switch (format) {
+		case zip: return listZip(file, entries, error);
+		case tar: return listTar(file, entries, error);
+		default: break;
+	}
+	error = "Not an archive";
+	return false;
+}
+
+bool Archive::isExtracted(std::istream& input, const Format format, const ArchiveEntry& entry) {
+	if (format != zip) {
+		return false;
+	}
+	std::vector<char> buffer(Inflate::CHUNK_BYTES);
+	uint64_t read = 0;
+	uint32_t crc = 0;
+	while (input.read(buffer.data(), (std::streamsize)buffer.size()) || input.gcount() > 0) {
+		const size_t count = (size_t)input.gcount();
+		read += count;
+		if (read > entry.size) {
+			return false;
+		}
+		crc = Hash::crc32(buffer.data(), count, crc);
+	}
+	return (read == entry.size) && (crc == entry.crc);
+}
+
+bool Archive::extract(SourceFile& file, const Format format, const ArchiveEntry& entry, std::ostream& output, std::string& error) {
+	// Finds the data, which follows the local header of zip entries.
+	uint64_t dataOffset = entry.offset;
+	if (format == zip) {
+		std::string local;
+		if (
+			!readExactly(file, entry.offset, local, ZIP_LOCAL_BYTES) ||
+			little((const unsigned char*)local.data(), 4) != ZIP_LOCAL_SIGNATURE
+		) {
+			error = "The local header of \"" + entry.name + "\" is damaged";
+			return false;
+		}
+		dataOffset += ZIP_LOCAL_BYTES + little((const unsigned char*)local.data() + 26, 2) + little((const unsigned char*)local.data() + 28, 2);
+	}
+	if (dataOffset > file.size() || entry.compressedSize > file.size() - dataOffset) {
+		error = "\"" + entry.name + "\" is truncated";
+		return false;
+	}
+
+	// Streams the data, decompressing it if needed, and checks it on the way.
+	uint64_t readOffset = dataOffset;
+	const uint64_t readEnd = dataOffset + entry.compressedSize;
+	const auto read = [&](unsigned char* buffer, const size_t size) {
+		const size_t count = file.read(readOffset, buffer, (size_t)std::min<uint64_t>(size, readEnd - readOffset));
+		readOffset += count;
+		return count;
+	};
+	// Stops as soon as the data outgrows the listed size, so that a small archive can not fill the disk.
+	uint64_t written = 0;
+	uint32_t crc = 0;
+	bool isOversized = false;
+	const auto write = [&](const unsigned char* buffer, const size_t size) {
+		if (size > entry.size - written) {
+			isOversized = true;
+			return false;
+		}
+		written += size;
+		if (format == zip) {
+			crc = Hash::crc32(buffer, size, crc);
+		}
+		return (bool)output.write((const char*)buffer, (std::streamsize)size);
+	};
+	if (format == zip && entry.method == ZIP_DEFLATED) {
+		if (!Inflate::run(read, write, error) && !isOversized) {
+			error = "\"" + entry.name + "\": " + error;
+			return false;
+		}
+	} else {
+		std::vector<unsigned char> buffer(Inflate::CHUNK_BYTES);
+		while (readOffset < readEnd) {
+			const size_t count = read(buffer.data(), buffer.size());
+			if (count == 0 || !write(buffer.data(), count)) {
+				break;
+			}
+		}
+	}
+
+	if (isOversized) {
+		error = "\"" + entry.name + "\" is larger than listed";
+		return false;
+	}
+	if (!output) {
+		error = "\"" + entry.name + "\" could not be written";
+		return false;
+	}
+	if (written != entry.size || (format == zip && crc != entry.crc)) {
+		error = "\"" + entry.name + "\" is damaged";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+// Archive.h : declarations for reading the entries of zip and tar archives
+
+#pragma once
+
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#include <cstdint>     // fixed width integers
+#include <istream>     // input streams
+#include <ostream>     // output streams
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "DirectorySource.h"
+
+/**
+* File stored inside an archive.
+*/
+struct ArchiveEntry {
+    std::string name;            // Path inside the archive, '/'-separated and without leading separators.
+    uint64_t offset = 0;         // Offset of the local header (zip) or of the data (tar).
+    uint64_t size = 0;           // Size once extracted.
+    uint64_t compressedSize = 0; // Size as stored.
+    uint16_t method = 0;         // Compression method (zip): 0 for stored, 8 for deflated.
+    uint32_t crc = 0;            // CRC-32 of the extracted data (zip).
+};
+
+/**
+* Reads the entries of zip and tar archives without extracting them, so that the files they hold
+* can be indexed as `archive.zip!/inner/path`, and extracts a single entry once it is picked.
+*
+* Zip archives are listed from their central directory, found at the end of the file and read at once
+* (ZIP64 included). Tar archives are listed by reading their headers and skipping over the data (with
+* GNU long names and pax paths). Either way, listing reads a small part of the archive. Only entries that
+* can be extracted are listed: stored or deflated, unencrypted zip entries, and regular tar files.
+*/
+class Archive {
+
+    public:
+        enum Format {
+            none, // Not an archive.
+            zip,
+            tar
+        };
+
+        static constexpr const char* SEPARATOR = "!/";                      // Separates an archive from the path of an entry inside it
+        static const uint64_t MAX_CENTRAL_DIRECTORY_BYTES = 256ULL << 20;  // Largest zip central directory read
+        static const uint64_t MAX_LONG_NAME_BYTES = 1 << 20;               // Largest tar long name or pax header read
+
+        /**
+        * @param name File name.
+        * @return Format of an archive, told by its extension (".zip" or ".tar", in any case), or `none`.
+        */
+        static Format formatOf(std::string_view);
+        /**
+        * @param path Path that may lead into an archive.
+        * @return Position of the separator that follows the name of an archive, or `std::string::npos`.
+        */
+        static size_t findSeparator(std::string_view);
+        /**
+        * @brief Lists the files stored inside an archive.
+        *
+        * @param file Archive.
+        * @param format Format of the archive.
+        * @param entries Receives the entries.
+        * @param error Receives the description of the error, if any.
+        * @return If the archive is malformed, returns `false`.
+        */
+        static bool list(SourceFile&, const Format, std::vector<ArchiveEntry>&, std::string&);
+        /**
+        * @brief Extracts an entry, checking its size and (for zip) its CRC-32.
+        *
+        * @param file Archive.
+        * @param format Format of the archive.
+        * @param entry Entry, as listed.
+        * @param output Receives the extracted bytes.
+        * @param error Receives the description of the error, if any.
+        * @return If the entry could not be extracted, returns `false`.
+        */
+        static bool extract(SourceFile&, const Format, const ArchiveEntry&, std::ostream&, std::string&);
+        /**
+        * @brief Tells whether an entry extracted before can be reused, by checking its size and CRC-32. Only zip
+        * entries carry a CRC-32, so tar entries are never reused.
+        *
+        * @param input Bytes extracted before.
+        * @param format Format of the archive.
+        * @param entry Entry, as listed.
+        * @return Whether the bytes are those of the entry.
+        */
+        static bool isExtracted(std::istream&, const Format, const ArchiveEntry&);
+};
+
+#endif
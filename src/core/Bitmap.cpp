@@ -0,0 +1,267 @@
+// Bitmap.cpp : descriptions for compressed bitmaps of index positions
+
+#include "Bitmap.h"
+
+#include <algorithm>   // set_intersection, set_union, upper_bound, lower_bound
+#include <iterator>    // back_inserter
+
+/**
+* @return Amount of set bits of a word.
+*/
+static unsigned popcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (unsigned)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+* @return Index of the set bit of a word with the given rank.
+*/
+static unsigned selectInWord(uint64_t word, unsigned rank) {
+	// Skips whole bytes first.
+	unsigned shift = 0;
+	for (unsigned byteCount = popcount(word & 0xFF); rank >= byteCount; byteCount = popcount(word & 0xFF)) {
+		rank -= byteCount;
+		word >>= 8;
+		shift += 8;
+	}
+	for (;; word >>= 1, ++shift) {
+		if ((word & 1) && (rank-- == 0)) {
+			return shift;
+		}
+	}
+}
+
+unsigned Bitmap::lowestBit(const uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(word);
+#else
+	return selectInWord(word, 0);
+#endif
+}
+
+Bitmap::Bitmap() {
+	clear();
+}
+
+void Bitmap::clear() {
+	containers.clear();
+	containerRanks.clear();
+	cardinality = 0;
+}
+
+void Bitmap::add(const uint32_t position) {
+	const uint16_t key = (uint16_t)(position >> 16);
+	const uint16_t low = (uint16_t)(position & 0xFFFF);
+	if (containers.empty() || containers.back().key != key) {
+		containers.emplace_back();
+		containers.back().key = key;
+	}
+	Container& container = containers.back();
+	if (container.isBitset()) {
+		container.words[low >> 6] |= (uint64_t)1 << (low & 63);
+	} else {
+		container.values.push_back(low);
+	}
+	++container.cardinality;
+	++cardinality;
+	if (!container.isBitset() && container.cardinality > ARRAY_LIMIT) {
+		toBitset(container);
+	}
+}
+
+void Bitmap::finish() {
+	for (Container& container : containers) {
+		seal(container);
+	}
+	refreshRanks();
+}
+
+void Bitmap::toBitset(Container& container) {
+	container.words.assign(BITSET_WORDS, 0);
+	for (const uint16_t low : container.values) {
+		container.words[low >> 6] |= (uint64_t)1 << (low & 63);
+	}
+	std::vector<uint16_t>().swap(container.values);
+}
+
+void Bitmap::seal(Container& container) {
+	if (!container.isBitset()) {
+		return;
+	}
+
+	// Sparse bitsets (e.g. left by an intersection) go back to arrays.
+	if (container.cardinality <= ARRAY_LIMIT) {
+		container.values.clear();
+		container.values.reserve(container.cardinality);
+		for (size_t i = 0; i < BITSET_WORDS; ++i) {
+			for (uint64_t word = container.words[i]; word != 0; word &= word - 1) {
+				container.values.push_back((uint16_t)((i << 6) + lowestBit(word)));
+			}
+		}
+		std::vector<uint64_t>().swap(container.words);
+		std::vector<uint16_t>().swap(container.wordRanks);
+		return;
+	}
+
+	container.wordRanks.resize(BITSET_WORDS);
+	uint32_t rank = 0;
+	for (size_t i = 0; i < BITSET_WORDS; ++i) {
+		container.wordRanks[i] = (uint16_t)rank;
+		rank += popcount(container.words[i]);
+	}
+}
+
+void Bitmap::refreshRanks() {
+	containerRanks.resize(containers.size());
+	cardinality = 0;
+	for (size_t i = 0; i < containers.size(); ++i) {
+		containerRanks[i] = cardinality;
+		cardinality += containers[i].cardinality;
+	}
+}
+
+void Bitmap::intersect(const Bitmap& a, const Bitmap& b, Bitmap& result) {
+	result.clear();
+	size_t i = 0;
+	size_t j = 0;
+	while (i < a.containers.size() && j < b.containers.size()) {
+		const Container& left = a.containers[i];
+		const Container& right = b.containers[j];
+		if (left.key != right.key) {
+			(left.key < right.key) ? ++i : ++j;
+			continue;
+		}
+
+		Container container;
+		container.key = left.key;
+		if (!left.isBitset() && !right.isBitset()) {
+			std::set_intersection(
+				left.values.begin(), left.values.end(),
+				right.values.begin(), right.values.end(),
+				std::back_inserter(container.values)
+			);
+			container.cardinality = (uint32_t)container.values.size();
+		} else if (left.isBitset() != right.isBitset()) {
+			const Container& array = left.isBitset() ? right : left;
+			const Container& bitset = left.isBitset() ? left : right;
+			for (const uint16_t low : array.values) {
+				if (bitset.words[low >> 6] & ((uint64_t)1 << (low & 63))) {
+					container.values.push_back(low);
+				}
+			}
+			container.cardinality = (uint32_t)container.values.size();
+		} else {
+			container.words.resize(BITSET_WORDS);
+			for (size_t k = 0; k < BITSET_WORDS; ++k) {
+				container.words[k] = left.words[k] & right.words[k];
+				container.cardinality += popcount(container.words[k]);
+			}
+			seal(container);
+		}
+		if (container.cardinality > 0) {
+			result.containers.push_back(std::move(container));
+		}
+		++i;
+		++j;
+	}
+	result.refreshRanks();
+}
+
+void Bitmap::unite(const Bitmap& a, const Bitmap& b, Bitmap& result) {
+	result.clear();
+	size_t i = 0;
+	size_t j = 0;
+	while (i < a.containers.size() || j < b.containers.size()) {
+		if (j == b.containers.size() || (i < a.containers.size() && a.containers[i].key < b.containers[j].key)) {
+			result.containers.push_back(a.containers[i++]);
+			continue;
+		}
+		if (i == a.containers.size() || b.containers[j].key < a.containers[i].key) {
+			result.containers.push_back(b.containers[j++]);
+			continue;
+		}
+
+		const Container& left = a.containers[i++];
+		const Container& right = b.containers[j++];
+		Container container;
+		container.key = left.key;
+		if (!left.isBitset() && !right.isBitset()) {
+			std::set_union(
+				left.values.begin(), left.values.end(),
+				right.values.begin(), right.values.end(),
+				std::back_inserter(container.values)
+			);
+			container.cardinality = (uint32_t)container.values.size();
+			if (container.cardinality > ARRAY_LIMIT) {
+				toBitset(container);
+				seal(container);
+			}
+		} else {
+			// A bitset is involved, so the union is dense as well.
+			container.words = left.isBitset() ? left.words : right.words;
+			const Container& other = left.isBitset() ? right : left;
+			if (other.isBitset()) {
+				for (size_t k = 0; k < BITSET_WORDS; ++k) {
+					container.words[k] |= other.words[k];
+				}
+			} else {
+				for (const uint16_t low : other.values) {
+					container.words[low >> 6] |= (uint64_t)1 << (low & 63);
+				}
+			}
+			for (size_t k = 0; k < BITSET_WORDS; ++k) {
+				container.cardinality += popcount(container.words[k]);
+			}
+			seal(container);
+		}
+		result.containers.push_back(std::move(container));
+	}
+	result.refreshRanks();
+}
+
+uint32_t Bitmap::select(const uint64_t rank) const {
+	// Finds the container holding the rank, and then the word within a bitset.
+	const size_t i = (size_t)(std::upper_bound(containerRanks.begin(), containerRanks.end(), rank) - containerRanks.begin()) - 1;
+	const Container& container = containers[i];
+	const uint32_t localRank = (uint32_t)(rank - containerRanks[i]);
+	uint32_t low;
+	if (!container.isBitset()) {
+		low = container.values[localRank];
+	} else {
+		const size_t word = (size_t)(std::upper_bound(container.wordRanks.begin(), container.wordRanks.end(), localRank) - container.wordRanks.begin()) - 1;
+		low = (uint32_t)((word << 6) + selectInWord(container.words[word], localRank - container.wordRanks[word]));
+	}
+	return ((uint32_t)container.key << 16) | low;
+}
+
+bool Bitmap::contains(const uint32_t position) const {
+	const uint16_t key = (uint16_t)(position >> 16);
+	const uint16_t low = (uint16_t)(position & 0xFFFF);
+	const std::vector<Container>::const_iterator it = std::lower_bound(
+		containers.begin(), containers.end(), key,
+		[](const Container& container, const uint16_t value) { return container.key < value; }
+	);
+	if (it == containers.end() || it->key != key) {
+		return false;
+	}
+	if (it->isBitset()) {
+		return (it->words[low >> 6] >> (low & 63)) & 1;
+	}
+	return std::binary_search(it->values.begin(), it->values.end(), low);
+}
+
+uint64_t Bitmap::memoryBytes() const {
+	uint64_t bytes = containers.capacity() * sizeof(Container) + containerRanks.capacity() * sizeof(uint64_t);
+	for (const Container& container : containers) {
+		bytes += container.values.capacity() * sizeof(uint16_t)
+			+ container.words.capacity() * sizeof(uint64_t)
+			+ container.wordRanks.capacity() * sizeof(uint16_t);
+	}
+	return bytes;
+}
@@ -0,0 +1,134 @@
+// Bitmap.h : declarations for compressed bitmaps of index positions
+
+#pragma once
+
+#ifndef BITMAP_H_
+#define BITMAP_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <vector>      // dynamic containers
+
+/**
+* Compressed set of 32 bit positions, split Roaring-style into containers of 65536 positions that
+* share their high 16 bits. Sparse containers keep their low 16 bits as a sorted array, and dense
+* ones as a bitset, so a bitmap never takes much more than 2 bytes per position nor 8 KiB per
+* container.
+*
+* Besides intersections and unions, bitmaps answer `select(rank)` (the position with a given
+* rank) without walking the set, which allows sampling uniformly from it.
+*/
+class Bitmap {
+
+    private:
+        static const size_t ARRAY_LIMIT = 4096;  // Past this, containers become bitsets (which take as much memory).
+        static const size_t BITSET_WORDS = 1024; // 65536 bits.
+
+        struct Container {
+            uint16_t key = 0;                // High 16 bits of the positions.
+            uint32_t cardinality = 0;
+            std::vector<uint16_t> values;    // Sorted low 16 bits, while an array.
+            std::vector<uint64_t> words;     // Low 16 bits as bits, once a bitset.
+            std::vector<uint16_t> wordRanks; // Set bits before each word of a bitset, for `select()`.
+
+            // @return true if the container is a bitset
+            bool isBitset() const { return !words.empty(); }
+        };
+
+        std::vector<Container> containers;
+        std::vector<uint64_t> containerRanks; // Positions before each container, for `select()`.
+        uint64_t cardinality;
+
+        /**
+        * @brief Turns an array container into a bitset.
+        */
+        static void toBitset(Container&);
+        /**
+        * @brief Turns a bitset container into an array, if it is sparse enough, and computes its word ranks otherwise.
+        */
+        static void seal(Container&);
+        /**
+        * @brief Computes the ranks of the containers after they changed.
+        */
+        void refreshRanks();
+        /**
+        * @return Index of the lowest set bit of a word other than 0.
+        */
+        static unsigned lowestBit(uint64_t);
+
+    public:
+        // == Constructor ==
+        Bitmap();
+
+        /**
+        * @brief Empties the bitmap.
+        */
+        void clear();
+        /**
+        * @brief Adds a position. Positions must be added in increasing order; call `finish()` afterwards.
+        *
+        * @param position Position greater than every position added before.
+        */
+        void add(const uint32_t);
+        /**
+        * @brief Prepares a bitmap built with `add()` for `select()`.
+        */
+        void finish();
+        /**
+        * @brief Computes the positions present in both bitmaps.
+        *
+        * @param a Bitmap.
+        * @param b Bitmap.
+        * @param result Receives the intersection. Must be neither `a` nor `b`.
+        */
+        static void intersect(const Bitmap&, const Bitmap&, Bitmap&);
+        /**
+        * @brief Computes the positions present in either bitmap.
+        *
+        * @param a Bitmap.
+        * @param b Bitmap.
+        * @param result Receives the union. Must be neither `a` nor `b`.
+        */
+        static void unite(const Bitmap&, const Bitmap&, Bitmap&);
+        /**
+        * @param rank Rank, from 0 to `size() - 1`.
+        * @return Position with the given rank, i.e. the `rank + 1`th smallest one.
+        */
+        uint32_t select(const uint64_t) const;
+        /**
+        * @param position Position.
+        * @return true if the position is present.
+        */
+        bool contains(const uint32_t) const;
+        /**
+        * @brief Calls a function with every position, in increasing order.
+        *
+        * @param visit Function taking a position.
+        */
+        template <typename Visit>
+        void forEach(const Visit& visit) const {
+            for (const Container& container : containers) {
+                const uint32_t high = (uint32_t)container.key << 16;
+                if (!container.isBitset()) {
+                    for (const uint16_t low : container.values) {
+                        visit(high | low);
+                    }
+                    continue;
+                }
+                for (size_t i = 0; i < BITSET_WORDS; ++i) {
+                    for (uint64_t word = container.words[i]; word != 0; word &= word - 1) {
+                        visit(high | (uint32_t)((i << 6) + lowestBit(word)));
+                    }
+                }
+            }
+        }
+
+        // @return Amount of positions
+        uint64_t size() const { return cardinality; }
+        // @return true if there are no positions
+        bool empty() const { return cardinality == 0; }
+        // @return Memory taken by the containers, in bytes
+        uint64_t memoryBytes() const;
+};
+
+#endif
@@ -0,0 +1,159 @@
+// ContentCache.cpp : descriptions for the persistent cache of values read from the contents of files
+
+#include "ContentCache.h"
+#include "Hash.h"
+#include "TempFiles.h"
+
+#include <algorithm>   // min
+#include <fstream>     // file streams
+#include <vector>      // dynamic containers
+
+static const size_t HEADER_BYTES = 32; // Magic, version, purpose and amount of records.
+static const size_t RECORD_BYTES = 24; // Key, stamp and value.
+
+static void encode(unsigned char* buffer, uint64_t value) {
+	for (int i = 0; i < 8; ++i) {
+		buffer[i] = (unsigned char)(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static uint64_t decode(const unsigned char* buffer) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; --i) {
+		value = (value << 8) | buffer[i];
+	}
+	return value;
+}
+
+uint64_t ContentCache::keyOf(const DirectoryIdentity& identity) {
+	unsigned char bytes[16];
+	encode(bytes, identity.device);
+	encode(bytes + 8, identity.node);
+	return Hash::fnv1a(std::string_view((const char*)bytes, sizeof(bytes)));
+}
+
+bool ContentCache::find(const uint64_t key, const uint64_t stamp, uint64_t& value) const {
+	const std::unordered_map<uint64_t, Record>::const_iterator it = records.find(key);
+	if (it == records.end() || it->second.stamp != stamp) {
+		return false;
+	}
+	value = it->second.value;
+	return true;
+}
+
+void ContentCache::insert(const uint64_t key, const uint64_t stamp, const uint64_t value) {
+	Record& record = records[key];
+	record.stamp = stamp;
+	record.value = value;
+	record.isUsed = true;
+}
+
+void ContentCache::clear() {
+	records.clear();
+}
+
+bool ContentCache::read(const std::filesystem::path& path, const uint64_t purpose, std::string& error) {
+	records.clear();
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream) {
+		error = "Could not open cache file \"" + path.u8string() + "\"";
+		return false;
+	}
+	if (!TempFiles::isPrivate(path)) {
+		error = "Cache file \"" + path.u8string() + "\" is not private to the user";
+		return false;
+	}
+	unsigned char header[HEADER_BYTES];
+	if (
+		!stream.read((char*)header, sizeof(header)) ||
+		(decode(header) != MAGIC) ||
+		((decode(header + 8) & 0xFFFFFFFF) != VERSION) ||
+		(decode(header + 16) != purpose)
+	) {
+		error = "\"" + path.u8string() + "\" is not a cache file of this kind";
+		return false;
+	}
+
+	// Reads the records in blocks.
+	const uint64_t count = decode(header + 24);
+	std::vector<unsigned char> block(RECORD_BYTES * 4096);
+	records.reserve((size_t)std::min<uint64_t>(count, MAX_RECORDS));
+	for (uint64_t remaining = count; remaining > 0;) {
+		const size_t blockCount = (size_t)std::min<uint64_t>(remaining, 4096);
+		if (!stream.read((char*)block.data(), (std::streamsize)(blockCount * RECORD_BYTES))) {
+			records.clear();
+			error = "Cache file \"" + path.u8string() + "\" is truncated";
+			return false;
+		}
+		for (size_t i = 0; i < blockCount; ++i) {
+			Record& record = records[decode(&block[i * RECORD_BYTES])];
+			record.stamp = decode(&block[i * RECORD_BYTES + 8]);
+			record.value = decode(&block[i * RECORD_BYTES + 16]);
+			record.isUsed = false;
+		}
+		remaining -= blockCount;
+	}
+	return true;
+}
+
+bool ContentCache::write(const std::filesystem::path& path, const uint64_t purpose, std::string& error) const {
+	// Records of files no longer seen (e.g. removed ones) are kept until the cache grows too large.
+	const bool isPruned = (records.size() > MAX_RECORDS);
+	uint64_t count = 0;
+	for (const std::pair<const uint64_t, Record>& record : records) {
+		if (!isPruned || record.second.isUsed) ++count;
+	}
+
+	// Writes a temporary file of its own and renames it, so that an interrupted write keeps the previous cache
+	// and runs writing at once do not write into the same file.
+	const std::filesystem::path temporaryPath = TempFiles::temporaryFor(path);
+	if (!TempFiles::create(temporaryPath)) {
+		error = "Could not create cache file \"" + temporaryPath.u8string() + "\"";
+		return false;
+	}
+	std::error_code errorCode;
+	{
+		std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!stream) {
+			std::filesystem::remove(temporaryPath, errorCode);
+			error = "Could not create cache file \"" + temporaryPath.u8string() + "\"";
+			return false;
+		}
+		unsigned char header[HEADER_BYTES];
+		encode(header, MAGIC);
+		encode(header + 8, VERSION);
+		encode(header + 16, purpose);
+		encode(header + 24, count);
+		stream.write((const char*)header, sizeof(header));
+		std::vector<unsigned char> block;
+		block.reserve(RECORD_BYTES * 4096);
+		for (const std::pair<const uint64_t, Record>& record : records) {
+			if (isPruned && !record.second.isUsed) {
+				continue;
+			}
+			block.resize(block.size() + RECORD_BYTES);
+			encode(&block[block.size() - RECORD_BYTES], record.first);
+			encode(&block[block.size() - 16], record.second.stamp);
+			encode(&block[block.size() - 8], record.second.value);
+			if (block.size() == block.capacity()) {
+				stream.write((const char*)block.data(), (std::streamsize)block.size());
+				block.clear();
+			}
+		}
+		stream.write((const char*)block.data(), (std::streamsize)block.size());
+		if (!stream.flush()) {
+			error = "Could not write cache file \"" + temporaryPath.u8string() + "\"";
+			stream.close();
+			std::filesystem::remove(temporaryPath, errorCode);
+			return false;
+		}
+	}
+	std::filesystem::rename(temporaryPath, path, errorCode);
+	if (errorCode) {
+		error = "Could not replace cache file \"" + path.u8string() + "\": " + errorCode.message();
+		std::filesystem::remove(temporaryPath, errorCode);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+// ContentCache.h : declarations for the persistent cache of values read from the contents of files
+
+#pragma once
+
+#ifndef CONTENTCACHE_H_
+#define CONTENTCACHE_H_
+
+#include <cstddef>       // size_t
+#include <cstdint>       // fixed width integers
+#include <string>        // strings
+#include <unordered_map> // hash tables
+
+#include <filesystem>    // file navigation. C++17 ONLY.
+
+#include "DirectorySource.h"
+
+/**
+* Values computed from the contents of files (e.g. their type or a hash of their bytes), so that each
+* file is read once across runs. Values are keyed by the identity of the file (its device and node, so
+* they survive renames and moves within a device) and hold while its stamp (e.g. its last write time)
+* is unchanged.
+*
+* Cache files store the records as little-endian integers, 24 bytes per record, after a header with the
+* purpose of the cache, so that caches of different values are never mixed up. Lookups may run on several
+* threads at once, as long as nothing is inserted meanwhile.
+*/
+class ContentCache {
+
+    private:
+        static const uint64_t MAGIC = 0x31484341434F4652ULL; // "RFOCACH1"
+        static const uint32_t VERSION = 1;
+
+        struct Record {
+            uint64_t stamp;
+            uint64_t value;
+            bool isUsed; // Whether the record was inserted (or confirmed) since it was read.
+        };
+
+        std::unordered_map<uint64_t, Record> records;
+
+    public:
+        static const size_t MAX_RECORDS = 1 << 22; // Past this, records not used since they were read are not written
+
+        /**
+        * @param identity Identity of a file.
+        * @return Key of the file.
+        */
+        static uint64_t keyOf(const DirectoryIdentity&);
+        /**
+        * @brief Looks up the value of a file.
+        *
+        * @param key Key of the file.
+        * @param stamp Current stamp of the file.
+        * @param value Receives the value.
+        * @return If there is no value for the file, or the file changed since, returns `false`.
+        */
+        bool find(const uint64_t, const uint64_t, uint64_t&) const;
+        /**
+        * @brief Stores the value of a file, replacing the previous one.
+        *
+        * @param key Key of the file.
+        * @param stamp Current stamp of the file.
+        * @param value Value.
+        */
+        void insert(const uint64_t, const uint64_t, const uint64_t);
+        /**
+        * @brief Empties the cache.
+        */
+        void clear();
+        /**
+        * @brief Reads a cache file.
+        *
+        * @param path Path to the cache file.
+        * @param purpose Purpose the file must have been written for.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be read, has another purpose or is not private to the user, returns `false` and
+        * the cache is left empty.
+        */
+        bool read(const std::filesystem::path&, const uint64_t, std::string&);
+        /**
+        * @brief Writes a cache file, replacing the previous one only once it is complete.
+        *
+        * @param path Path to the cache file.
+        * @param purpose Purpose of the cache.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        bool write(const std::filesystem::path&, const uint64_t, std::string&) const;
+
+        // @return Amount of records
+        size_t size() const { return records.size(); }
+};
+
+#endif
@@ -0,0 +1,289 @@
+// ContentType.cpp : descriptions for telling the type of files from their first bytes
+
+#include "ContentType.h"
+#include "Archive.h"
+#include "FileBatches.h"
+
+#include <algorithm>   // find, find_if
+#include <array>       // fixed size arrays
+#include <chrono>      // steady_clock
+#include <cstring>     // memcmp
+#include <memory>      // unique_ptr
+
+#include <filesystem>  // u8path. C++17 ONLY.
+
+using namespace std::string_view_literals;
+
+/**
+* Magic signature: bytes at an offset, each one masked first if there is a mask, and optionally more bytes
+* further on that must match as well.
+*/
+struct Signature {
+    size_t offset;
+    std::string_view bytes;
+    std::string_view mask;     // Empty if the bytes are compared as they are.
+    size_t nextOffset;
+    std::string_view nextBytes; // Empty if there is nothing else to compare.
+    ContentType::Kind kind;
+};
+
+static const Signature SIGNATURES[] = {
+    // ISO base media files (MP4, QuickTime, 3GP, HEIF, AVIF), told apart by their brand.
+    { 4, "ftypavif"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypavis"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypheic"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypheix"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypheis"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypmif1"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypmsf1"sv, {}, 0, {}, ContentType::image },
+    { 4, "ftypM4A "sv, {}, 0, {}, ContentType::audio },
+    { 4, "ftypM4B "sv, {}, 0, {}, ContentType::audio },
+    { 4, "ftypM4P "sv, {}, 0, {}, ContentType::audio },
+    { 4, "ftypF4A "sv, {}, 0, {}, ContentType::audio },
+    { 4, "ftyp"sv, {}, 0, {}, ContentType::video },
+    { 4, "moov"sv, {}, 0, {}, ContentType::video },
+    { 4, "mdat"sv, {}, 0, {}, ContentType::video },
+
+    // Images.
+    { 0, "\xFF\xD8\xFF"sv, {}, 0, {}, ContentType::image },
+    { 0, "\x89PNG\r\n\x1A\n"sv, {}, 0, {}, ContentType::image },
+    { 0, "GIF87a"sv, {}, 0, {}, ContentType::image },
+    { 0, "GIF89a"sv, {}, 0, {}, ContentType::image },
+    { 0, "BM"sv, {}, 6, "\0\0\0\0"sv, ContentType::image },
+    { 0, "II*\0"sv, {}, 0, {}, ContentType::image },
+    { 0, "MM\0*"sv, {}, 0, {}, ContentType::image },
+    { 0, "RIFF"sv, {}, 8, "WEBP"sv, ContentType::image },
+    { 0, "8BPS"sv, {}, 0, {}, ContentType::image },
+    { 0, "\xFF\x0A"sv, {}, 0, {}, ContentType::image },
+    { 0, "\0\0\0\x0CJXL \r\n\x87\n"sv, {}, 0, {}, ContentType::image },
+    { 0, "\0\0\0\x0CjP  \r\n\x87\n"sv, {}, 0, {}, ContentType::image },
+    { 0, "qoif"sv, {}, 0, {}, ContentType::image },
+    { 0, "FUJIFILMCCD-RAW"sv, {}, 0, {}, ContentType::image },
+    { 0, "\0\0\1\0"sv, {}, 0, {}, ContentType::image },
+
+    // Audio.
+    { 0, "ID3"sv, {}, 0, {}, ContentType::audio },
+    { 0, "fLaC"sv, {}, 0, {}, ContentType::audio },
+    { 0, "RIFF"sv, {}, 8, "WAVE"sv, ContentType::audio },
+    { 0, "RF64"sv, {}, 8, "WAVE"sv, ContentType::audio },
+    { 0, "FORM"sv, {}, 8, "AIFF"sv, ContentType::audio },
+    { 0, "FORM"sv, {}, 8, "AIFC"sv, ContentType::audio },
+    { 0, "OggS"sv, {}, 28, "\x80theora"sv, ContentType::video },
+    { 0, "OggS"sv, {}, 0, {}, ContentType::audio },
+    { 0, "MThd"sv, {}, 0, {}, ContentType::audio },
+    { 0, "#!AMR"sv, {}, 0, {}, ContentType::audio },
+    { 0, "MAC "sv, {}, 0, {}, ContentType::audio },
+    { 0, "wvpk"sv, {}, 0, {}, ContentType::audio },
+    { 0, "MPCK"sv, {}, 0, {}, ContentType::audio },
+    { 0, "DSD "sv, {}, 0, {}, ContentType::audio },
+    { 0, ".snd"sv, {}, 0, {}, ContentType::audio },
+    { 0, "\xFF\xE2"sv, "\xFF\xE6"sv, 0, {}, ContentType::audio }, // MPEG audio frames, layers III, II and I.
+    { 0, "\xFF\xE4"sv, "\xFF\xE6"sv, 0, {}, ContentType::audio },
+    { 0, "\xFF\xE6"sv, "\xFF\xE6"sv, 0, {}, ContentType::audio },
+    { 0, "\xFF\xF0"sv, "\xFF\xF6"sv, 0, {}, ContentType::audio }, // AAC in ADTS frames.
+
+    // Video.
+    { 0, "\x1A\x45\xDF\xA3"sv, {}, 0, {}, ContentType::video },
+    { 0, "RIFF"sv, {}, 8, "AVI "sv, ContentType::video },
+    { 0, "FLV\x01"sv, {}, 0, {}, ContentType::video },
+    { 0, "\x30\x26\xB2\x75\x8E\x66\xCF\x11"sv, {}, 0, {}, ContentType::video },
+    { 0, "\0\0\1\xBA"sv, {}, 0, {}, ContentType::video },
+    { 0, "\0\0\1\xB3"sv, {}, 0, {}, ContentType::video },
+    { 0, ".RMF"sv, {}, 0, {}, ContentType::video },
+    { 0, "\x47"sv, {}, 188, "\x47"sv, ContentType::video }, // MPEG transport streams, in 188 and 192 byte packets.
+    { 4, "\x47"sv, {}, 196, "\x47"sv, ContentType::video }
+};
+
+static const size_t SIGNATURE_COUNT = sizeof(SIGNATURES) / sizeof(SIGNATURES[0]);
+static_assert(SIGNATURE_COUNT <= 256, "Signatures are numbered with a byte");
+
+/**
+* Signatures grouped by the offset they start at, in the order those offsets first appear in the table,
+* and by the byte they can start with.
+*/
+struct CompiledSignatures {
+    std::vector<size_t> offsets;
+    std::vector<std::array<std::vector<uint8_t>, 256>> candidates;
+};
+
+static const CompiledSignatures& compiledSignatures() {
+	static const CompiledSignatures COMPILED = []() {
+		CompiledSignatures compiled;
+		for (size_t i = 0; i < SIGNATURE_COUNT; ++i) {
+			const Signature& signature = SIGNATURES[i];
+			const size_t group = (size_t)(std::find(compiled.offsets.begin(), compiled.offsets.end(), signature.offset) - compiled.offsets.begin());
+			if (group == compiled.offsets.size()) {
+				compiled.offsets.push_back(signature.offset);
+				compiled.candidates.emplace_back();
+			}
+
+			// A masked first byte makes the signature a candidate for every byte it matches.
+			const unsigned char first = (unsigned char)signature.bytes[0];
+			const unsigned char mask = signature.mask.empty() ? 0xFF : (unsigned char)signature.mask[0];
+			for (unsigned byte = 0; byte < 256; ++byte) {
+				if ((byte & mask) == first) {
+					compiled.candidates[group][byte].push_back((uint8_t)i);
+				}
+			}
+		}
+		return compiled;
+	}();
+	return COMPILED;
+}
+
+/**
+* @return true if the first bytes of a file match a signature.
+*/
+static bool matches(const Signature& signature, const unsigned char* head, const size_t size) {
+	if (signature.offset + signature.bytes.size() > size) {
+		return false;
+	}
+	for (size_t i = 0; i < signature.bytes.size(); ++i) {
+		unsigned char byte = head[signature.offset + i];
+		if (!signature.mask.empty()) {
+			byte &= (unsigned char)signature.mask[i];
+		}
+		if (byte != (unsigned char)signature.bytes[i]) {
+			return false;
+		}
+	}
+	return signature.nextBytes.empty() || (
+		(signature.nextOffset + signature.nextBytes.size() <= size) &&
+		(memcmp(head + signature.nextOffset, signature.nextBytes.data(), signature.nextBytes.size()) == 0)
+	);
+}
+
+ContentType::Kind ContentType::sniff(const unsigned char* head, const size_t size) {
+	const CompiledSignatures& compiled = compiledSignatures();
+	for (size_t group = 0; group < compiled.offsets.size(); ++group) {
+		if (compiled.offsets[group] >= size) {
+			continue;
+		}
+		for (const uint8_t i : compiled.candidates[group][head[compiled.offsets[group]]]) {
+			if (matches(SIGNATURES[i], head, size)) {
+				return SIGNATURES[i].kind;
+			}
+		}
+	}
+	return unknown;
+}
+
+ContentType::Kind ContentType::ofExtension(std::string_view name) {
+	static const char* const VIDEO[] = { "mp4", "m4v", "mkv", "webm", "avi", "mov", "wmv", "flv", "mpg", "mpeg", "ts", "m2ts", "3gp", "ogv" };
+	static const char* const IMAGE[] = { "jpg", "jpeg", "png", "gif", "bmp", "tif", "tiff", "webp", "heic", "avif", "psd", "jxl", "ico" };
+	static const char* const AUDIO[] = { "mp3", "flac", "ogg", "opus", "wav", "m4a", "aac", "wma", "aif", "aiff", "mid", "midi", "ape", "wv", "amr" };
+
+	const size_t dot = name.rfind('.');
+	if (dot == std::string_view::npos || name.find('/', dot) != std::string_view::npos) {
+		return unknown;
+	}
+	std::string extension(name.substr(dot + 1));
+	for (char& c : extension) {
+		if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+	}
+	const auto isAmong = [&extension](const auto& extensions) {
+		return std::find_if(std::begin(extensions), std::end(extensions), [&extension](const char* candidate) {
+			return extension == candidate;
+		}) != std::end(extensions);
+	};
+	if (isAmong(VIDEO)) return video;
+	if (isAmong(IMAGE)) return image;
+	if (isAmong(AUDIO)) return audio;
+	return unknown;
+}
+
+bool ContentType::parse(const std::string& name, Kind& kind) {
+	for (const Kind candidate : { video, image, audio }) {
+		if (name == nameOf(candidate)) {
+			kind = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* ContentType::nameOf(const Kind kind) {
+	switch (kind) {
+		case video: return "video";
+		case image: return "image";
+		case audio: return "audio";
+		default:    return "unknown";
+	}
+}
+
+void ContentType::classify(
+	const PathIndex& index,
+	const std::vector<std::string>& rootStrings,
+	const DirectorySource& source,
+	const uint8_t kindMask,
+	ContentCache& cache,
+	Bitmap& positions,
+	ScanStats& stats
+) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<uint8_t> kinds(index.size(), unknown);
+
+	// Every thread keeps the types it read or found in the cache, which keeps them, and its counters.
+	struct Found {
+		uint64_t key;
+		uint64_t stamp;
+		uint8_t kind;
+	};
+	struct Worker {
+		std::vector<unsigned char> head = std::vector<unsigned char>(HEAD_BYTES);
+		std::vector<Found> found;
+		uint64_t sniffedFiles = 0;
+		uint64_t cachedTypes = 0;
+	};
+	std::vector<Worker> workers(FileBatches::threadCount(index.size()));
+	FileBatches::run(index, rootStrings, nullptr, [&](const unsigned thread, const uint32_t position, const std::string& path) {
+		Worker& worker = workers[thread];
+		uint8_t& kind = kinds[position];
+
+		// Files inside archives are only known by their name.
+		if (Archive::findSeparator(path) != std::string::npos) {
+			kind = ofExtension(path);
+			return;
+		}
+		const std::filesystem::path filePath = std::filesystem::u8path(path);
+		DirectoryIdentity identity;
+		uint64_t key = 0;
+		uint64_t stamp = 0;
+		const bool isCacheable = source.identify(filePath, identity) && (stamp = source.stamp(filePath)) != 0;
+		if (isCacheable) {
+			key = ContentCache::keyOf(identity);
+			uint64_t value;
+			if (cache.find(key, stamp, value)) {
+				kind = (uint8_t)value;
+				++worker.cachedTypes;
+				worker.found.push_back({ key, stamp, kind });
+				return;
+			}
+		}
+		const std::unique_ptr<SourceFile> file = source.open(filePath);
+		if (file == nullptr) {
+			return;
+		}
+		kind = sniff(worker.head.data(), file->read(0, worker.head.data(), worker.head.size()));
+		++worker.sniffedFiles;
+		if (isCacheable) {
+			worker.found.push_back({ key, stamp, kind });
+		}
+	});
+
+	for (const Worker& worker : workers) {
+		for (const Found& found : worker.found) {
+			cache.insert(found.key, found.stamp, found.kind);
+		}
+		stats.sniffedFiles += worker.sniffedFiles;
+		stats.cachedTypes += worker.cachedTypes;
+	}
+	positions.clear();
+	for (size_t i = 0; i < kinds.size(); ++i) {
+		if ((kindMask >> kinds[i]) & 1) {
+			positions.add((uint32_t)i);
+		}
+	}
+	positions.finish();
+	stats.sniffNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,78 @@
+// ContentType.h : declarations for telling the type of files from their first bytes
+
+#pragma once
+
+#ifndef CONTENTTYPE_H_
+#define CONTENTTYPE_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "ContentCache.h"
+#include "DirectorySource.h"
+#include "PathIndex.h"
+#include "Stats.h"
+
+/**
+* Tells whether files are videos, images or audio from their first bytes rather than from their
+* extension, which may be missing or wrong.
+*
+* The bytes are matched against a table of magic signatures, which is compiled on first use into
+* candidate lists keyed by the byte each signature starts with, so that a file is only compared
+* with the few signatures that can match it. Signatures are tried in the order of the table, so
+* specific ones (e.g. the brands of an MP4 container) come before generic ones.
+*/
+class ContentType {
+
+    public:
+        enum Kind : uint8_t {
+            unknown, // No signature matched, or the file could not be read.
+            video,
+            image,
+            audio
+        };
+
+        static const size_t HEAD_BYTES = 512;        // Bytes read from the start of every file
+        static const uint64_t CACHE_PURPOSE = 0x45505954; // "TYPE", the purpose of type cache files
+
+        /**
+        * @param head First bytes of a file.
+        * @param size Amount of bytes, which may be fewer than `HEAD_BYTES` for short files.
+        * @return Type of the file.
+        */
+        static Kind sniff(const unsigned char*, const size_t);
+        /**
+        * @param name Name of a file.
+        * @return Type the extension of the file stands for, for files that can not be read cheaply (e.g. inside archives).
+        */
+        static Kind ofExtension(std::string_view);
+        /**
+        * @param name Name of a type ("video", "image" or "audio").
+        * @param kind Receives the type.
+        * @return If the name is not a type, returns `false`.
+        */
+        static bool parse(const std::string&, Kind&);
+        // @return Name of a type
+        static const char* nameOf(const Kind);
+
+        /**
+        * @brief Finds the entries of an index of the given types. Files are read on several threads (see `FileBatches`),
+        * unless the cache knows their type; the types read are stored into the cache.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param source Source the files are read from.
+        * @param kindMask Types to find, as bits shifted by their value.
+        * @param cache Types found before, which receives the types read.
+        * @param positions Receives the positions of the entries of those types.
+        * @param stats Receives the amount of files read and found in the cache, and the time taken.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        static void classify(const PathIndex&, const std::vector<std::string>&, const DirectorySource&, const uint8_t, ContentCache&, Bitmap&, ScanStats&);
+};
+
+#endif
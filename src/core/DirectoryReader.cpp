@@ -0,0 +1,131 @@
+// DirectoryReader.cpp : descriptions for directory listings with a deadline
+
+#include "DirectoryReader.h"
+
+#include <algorithm>   // remove_if, count_if
+
+DirectoryReader::DirectoryReader(const std::shared_ptr<const DirectorySource>& source, const std::chrono::milliseconds deadline, const bool keepAbandoned, const bool idleIo)
+	: source(source), deadline(deadline), isKeepingAbandoned(keepAbandoned), isIdleIo(idleIo) {
+}
+
+DirectoryReader::~DirectoryReader() {
+	if (worker) {
+		{
+			const std::lock_guard<std::mutex> lock(worker->mutex);
+			worker->isStopping = true;
+		}
+		worker->condition.notify_all();
+		worker->thread.join();
+	}
+}
+
+void DirectoryReader::work(const std::shared_ptr<Worker> worker, const std::shared_ptr<const DirectorySource> source, const bool idleIo) {
+	const IdleIoScope idleIoScope(idleIo);
+	std::unique_lock<std::mutex> lock(worker->mutex);
+	for (;;) {
+		worker->condition.wait(lock, [&worker]() { return worker->isStopping || worker->request; });
+		if (!worker->request) {
+			return;
+		}
+
+		// Lists without holding the lock, which a hung listing would never release.
+		const std::shared_ptr<Request> request = worker->request;
+		lock.unlock();
+		request->ok = source->list(request->path, request->entries, request->stats, request->error);
+		lock.lock();
+		request->isDone.store(true, std::memory_order_release);
+		worker->request.reset();
+		worker->condition.notify_all();
+	}
+}
+
+DirectoryReader::Outcome DirectoryReader::list(
+	const std::filesystem::path& directory,
+	std::vector<DirectoryEntry>& entries,
+	ScanStats& stats,
+	std::string& error,
+	const size_t tag
+) {
+	// Forgets the abandoned listings that completed, unless they may still be taken.
+	if (!isKeepingAbandoned && !abandoned.empty()) {
+		abandoned.erase(
+			std::remove_if(abandoned.begin(), abandoned.end(), [](const std::shared_ptr<Request>& request) { return request->isDone.load(std::memory_order_acquire); }),
+			abandoned.end()
+		);
+	}
+	const size_t stuckCount = (size_t)std::count_if(abandoned.begin(), abandoned.end(), [](const std::shared_ptr<Request>& request) {
+		return !request->isDone.load(std::memory_order_acquire);
+	});
+	if (stuckCount >= MAX_STUCK_WORKERS) {
+		error = directory.generic_u8string() + ": Not listed, as too many directories are unresponsive";
+		return timedOut;
+	}
+
+	if (!worker) {
+		worker = std::make_shared<Worker>();
+		worker->thread = std::thread(work, worker, source, isIdleIo);
+	}
+	if (!spare) {
+		spare = std::make_shared<Request>();
+	}
+	const std::shared_ptr<Request> request = spare;
+	request->path = directory;
+	request->tag = tag;
+	request->entries.swap(entries);
+	request->stats = ScanStats();
+	request->error.clear();
+	request->isDone.store(false, std::memory_order_relaxed);
+
+	// Hands the listing to the worker and waits for it, at most until the deadline.
+	std::unique_lock<std::mutex> lock(worker->mutex);
+	worker->request = request;
+	worker->condition.notify_all();
+	const bool isDone = worker->condition.wait_for(lock, deadline, [&request]() {
+		return request->isDone.load(std::memory_order_acquire);
+	});
+	if (isDone) {
+		lock.unlock();
+		entries.swap(request->entries);
+		stats.add(request->stats);
+		if (!request->ok) {
+			error = request->error;
+			return failed;
+		}
+		return listed;
+	}
+
+	// Leaves the worker behind to finish the listing on its own, and starts another one next time.
+	worker->isStopping = true;
+	lock.unlock();
+	worker->thread.detach();
+	worker.reset();
+	spare.reset();
+	abandoned.push_back(request);
+	error = directory.generic_u8string() + ": Not listed within " + std::to_string(deadline.count()) + " ms";
+	return timedOut;
+}
+
+bool DirectoryReader::takeLate(std::vector<DirectoryEntry>& entries, ScanStats& stats, bool& ok, size_t& tag, const bool wait) {
+	const std::chrono::steady_clock::time_point giveUp = std::chrono::steady_clock::now() + deadline;
+	for (;;) {
+		for (size_t i = 0; i < abandoned.size(); ++i) {
+			const std::shared_ptr<Request>& request = abandoned[i];
+			if (request->isDone.load(std::memory_order_acquire)) {
+				entries.swap(request->entries);
+				stats.add(request->stats);
+				ok = request->ok;
+				tag = request->tag;
+				abandoned.erase(abandoned.begin() + i);
+				return true;
+			}
+		}
+		if (!wait || abandoned.empty()) {
+			return false;
+		}
+		if (std::chrono::steady_clock::now() >= giveUp) {
+			abandoned.clear();
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(LATE_POLL_MILLISECONDS));
+	}
+}
@@ -0,0 +1,126 @@
+// DirectoryReader.h : declarations for directory listings with a deadline
+
+#pragma once
+
+#ifndef DIRECTORYREADER_H_
+#define DIRECTORYREADER_H_
+
+#include <atomic>             // completion flags
+#include <chrono>             // durations
+#include <condition_variable> // condition variables
+#include <cstddef>            // size_t
+#include <memory>             // shared_ptr
+#include <mutex>              // mutex
+#include <string>             // strings
+#include <thread>             // thread
+#include <vector>             // dynamic containers
+
+#include <filesystem>         // file navigation. C++17 ONLY.
+
+#include "DirectorySource.h"
+#include "Stats.h"
+#include "Throttle.h"
+
+/**
+* Lists directories on a worker thread and gives up on those that are not listed before a deadline,
+* so that a single unresponsive directory (e.g. on a hung network mount) can not stall a scan.
+*
+* A listing can not be interrupted, so the worker of an abandoned listing is left behind to finish
+* it, and a new worker takes over. If abandoned listings are kept, those that complete can still be
+* taken later; otherwise their results are dropped. Workers that are left behind only hold shared
+* state, so the reader may be destroyed while they are still stuck.
+*
+* A reader serves a single thread.
+*/
+class DirectoryReader {
+
+    public:
+        enum Outcome {
+            listed,  // The directory was listed.
+            failed,  // The source could not list the directory.
+            timedOut // The deadline passed first, and the listing was abandoned.
+        };
+
+    private:
+        // A listing, shared with the worker running it.
+        struct Request {
+            std::filesystem::path path;
+            size_t tag = 0;
+            std::vector<DirectoryEntry> entries;
+            ScanStats stats;
+            std::string error;
+            bool ok = false;
+            std::atomic<bool> isDone{false};
+        };
+
+        // A worker thread, and the listing it was handed.
+        struct Worker {
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::shared_ptr<Request> request; // Listing to run, or running.
+            bool isStopping = false;          // Whether to exit once idle.
+            std::thread thread;
+        };
+
+        std::shared_ptr<const DirectorySource> source;
+        std::chrono::milliseconds deadline;
+        bool isKeepingAbandoned;
+        bool isIdleIo;
+
+        std::shared_ptr<Worker> worker;   // Responsive worker, started on the first listing.
+        std::shared_ptr<Request> spare;   // Completed listing, reused for the next one.
+        std::vector<std::shared_ptr<Request>> abandoned; // Abandoned listings, left to the workers behind.
+
+        /**
+        * @brief Runs the listings handed to a worker until it is stopped.
+        *
+        * @param worker Worker.
+        * @param source Source to list from.
+        * @param idleIo Whether to list at idle I/O priority.
+        */
+        static void work(const std::shared_ptr<Worker>, const std::shared_ptr<const DirectorySource>, const bool);
+
+    public:
+        static const size_t MAX_STUCK_WORKERS = 16;   // Past this, listings time out without being tried
+        static const int LATE_POLL_MILLISECONDS = 5;  // Time between checks while waiting for abandoned listings
+
+        // == Constructor ==
+        /**
+        * @param source Source to list from.
+        * @param deadline Time a listing may take.
+        * @param keepAbandoned Whether abandoned listings may still be taken once they complete.
+        * @param idleIo Whether workers list at idle I/O priority.
+        */
+        DirectoryReader(const std::shared_ptr<const DirectorySource>&, const std::chrono::milliseconds, const bool, const bool);
+        ~DirectoryReader();
+
+        DirectoryReader(const DirectoryReader&) = delete;
+        DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+        /**
+        * @brief Lists the entries of a directory, as `DirectorySource::list()` does, unless the deadline passes first.
+        *
+        * @param directory Resolved path of the directory.
+        * @param entries Receives the entries.
+        * @param stats Receives the amount of status calls made beyond the listing itself.
+        * @param error Receives the description of the error, if any.
+        * @param tag Identifies the directory if its listing is abandoned and taken later.
+        */
+        Outcome list(const std::filesystem::path&, std::vector<DirectoryEntry>&, ScanStats&, std::string&, const size_t);
+        /**
+        * @brief Takes an abandoned listing that completed since.
+        *
+        * @param entries Receives the entries.
+        * @param stats Receives the amount of status calls made beyond the listing itself.
+        * @param ok Set to false if the source could not list the directory after all.
+        * @param tag Receives the tag of the directory.
+        * @param wait Whether to wait (up to the deadline) for a listing to complete. If none does, the rest are dropped.
+        * @return If no abandoned listing completed, returns `false`.
+        */
+        bool takeLate(std::vector<DirectoryEntry>&, ScanStats&, bool&, size_t&, const bool);
+
+        // @return true if abandoned listings may still complete
+        bool hasLate() const { return isKeepingAbandoned && !abandoned.empty(); }
+};
+
+#endif
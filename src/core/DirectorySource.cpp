@@ -0,0 +1,350 @@
+// DirectorySource.cpp : descriptions for the sources directory trees are read from
+
+#include "DirectorySource.h"
+
+#include <algorithm>   // min
+#include <cctype>      // tolower
+#include <cstring>     // strcmp, wcscmp, wcslen
+#include <sys/stat.h>  // stat, for device ids and entry types
+
+#ifdef _WIN32
+#include <windows.h>   // FindFirstFileExW, WideCharToMultiByte, GetFileInformationByHandle, GetVolumeInformationW, ReadFile
+#else
+#include <cerrno>      // errno
+#include <dirent.h>    // opendir, readdir
+#include <fcntl.h>     // fstatat flags, open
+#include <unistd.h>    // pread, close
+#endif
+#if defined(__linux__)
+#include <fstream>     // mountinfo
+#include <sys/sysmacros.h> // major, minor
+#include <sys/vfs.h>   // statfs
+#elif defined(__APPLE__)
+#include <sys/mount.h> // statfs
+#endif
+
+/**
+* @return Entry after the last one used, reusing the memory of the entries of previous listings.
+*/
+static DirectoryEntry& nextEntry(std::vector<DirectoryEntry>& entries, size_t& count) {
+	if (count == entries.size()) {
+		entries.emplace_back();
+	}
+	return entries[count++];
+}
+
+bool FileSystemSource::resolve(const std::string& unprocessedPath, std::filesystem::path& path, std::string& error) const {
+	try {
+		path = std::filesystem::canonical(unprocessedPath);
+	}
+	catch (const std::exception& ex) {
+		error = ex.what();
+		return false;
+	}
+	return true;
+}
+
+bool FileSystemSource::list(const std::filesystem::path& directory, std::vector<DirectoryEntry>& entries, ScanStats& stats, std::string& error) const {
+	// Lists through the system rather than std::filesystem::directory_iterator, which builds (and parses)
+	// a whole path for every entry. Names are written into the entries of previous listings, so they
+	// rarely allocate.
+	size_t count = 0;
+
+#ifdef _WIN32
+	// Symbolic links to directories are neither listed nor followed. Their attributes tell them apart
+	// from the links to files, so no further calls are needed.
+	const std::wstring pattern = (directory / L"*").native();
+	WIN32_FIND_DATAW data;
+	HANDLE handle = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (handle == INVALID_HANDLE_VALUE) {
+		error = directory.u8string() + ": " + std::error_code((int)GetLastError(), std::system_category()).message();
+		return false;
+	}
+	do {
+		if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0) {
+			continue;
+		}
+		DirectoryEntry& entry = nextEntry(entries, count);
+		const int nameLength = (int)wcslen(data.cFileName);
+		const int byteCount = WideCharToMultiByte(CP_UTF8, 0, data.cFileName, nameLength, NULL, 0, NULL, NULL);
+		entry.name.resize(byteCount);
+		WideCharToMultiByte(CP_UTF8, 0, data.cFileName, nameLength, &entry.name[0], byteCount, NULL, NULL);
+
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+			entry.type = DirectoryEntry::file;
+		} else if (
+			(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) &&
+			(data.dwReserved0 == IO_REPARSE_TAG_SYMLINK)
+		) {
+			entry.type = DirectoryEntry::other;
+		} else {
+			entry.type = DirectoryEntry::directory;
+		}
+	} while (FindNextFileW(handle, &data));
+	const DWORD code = GetLastError();
+	FindClose(handle);
+	entries.resize(count);
+	if (code != ERROR_NO_MORE_FILES) {
+		error = directory.u8string() + ": " + std::error_code((int)code, std::system_category()).message();
+		return false;
+	}
+#else
+	DIR* stream = opendir(directory.c_str());
+	if (stream == nullptr) {
+		error = directory.u8string() + ": " + std::error_code(errno, std::generic_category()).message();
+		return false;
+	}
+	const int descriptor = dirfd(stream);
+
+	errno = 0;
+	while (const dirent* item = readdir(stream)) {
+		if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+			continue;
+		}
+
+		// The listing usually tells the type of an entry, except for the target of a symbolic link and
+		// on filesystems that do not report types. Symbolic links to directories are neither listed nor followed.
+		unsigned char type = item->d_type;
+		struct stat status;
+		if (type == DT_UNKNOWN) {
+			++stats.statCalls;
+			if (fstatat(descriptor, item->d_name, &status, AT_SYMLINK_NOFOLLOW) == 0) {
+				type = S_ISLNK(status.st_mode) ? DT_LNK : S_ISDIR(status.st_mode) ? DT_DIR : DT_REG;
+			}
+		}
+		DirectoryEntry& entry = nextEntry(entries, count);
+		entry.name.assign(item->d_name);
+		if (type == DT_LNK) {
+			++stats.statCalls;
+			const bool isDirectory = (fstatat(descriptor, item->d_name, &status, 0) == 0) && S_ISDIR(status.st_mode);
+			entry.type = isDirectory ? DirectoryEntry::other : DirectoryEntry::file;
+		} else {
+			entry.type = (type == DT_DIR) ? DirectoryEntry::directory : DirectoryEntry::file;
+		}
+		errno = 0;
+	}
+	const int code = errno;
+	closedir(stream);
+	entries.resize(count);
+	if (code != 0) {
+		error = directory.u8string() + ": " + std::error_code(code, std::generic_category()).message();
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+uint64_t FileSystemSource::device(const std::filesystem::path& path) const {
+	DirectoryIdentity identity;
+	return identify(path, identity) ? identity.device : 0;
+}
+
+bool FileSystemSource::identify(const std::filesystem::path& path, DirectoryIdentity& identity) const {
+#ifdef _WIN32
+	// The status of a file does not tell its id on Windows, so it is read from a handle, which directories
+	// only give with backup semantics. Volumes (rather than drive letters) tell mounted folders apart.
+	HANDLE handle = CreateFileW(
+		path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL
+	);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	BY_HANDLE_FILE_INFORMATION information;
+	const bool isRead = (GetFileInformationByHandle(handle, &information) != 0);
+	CloseHandle(handle);
+	if (!isRead) {
+		return false;
+	}
+	identity.device = (uint64_t)information.dwVolumeSerialNumber;
+	identity.node = ((uint64_t)information.nFileIndexHigh << 32) | information.nFileIndexLow;
+#else
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) {
+		return false;
+	}
+	identity.device = (uint64_t)status.st_dev;
+	identity.node = (uint64_t)status.st_ino;
+#endif
+	return true;
+}
+
+#if defined(__linux__)
+/**
+* @return Type of the filesystem mounted on a device, with its subtype (e.g. "fuse.sshfs"), as listed in
+* `/proc/self/mountinfo`, or an empty string if it is not listed.
+*/
+static std::string mountedType(const dev_t device) {
+	std::ifstream stream("/proc/self/mountinfo");
+	const std::string deviceNumbers = std::to_string(major(device)) + ":" + std::to_string(minor(device));
+	std::string line;
+	while (std::getline(stream, line)) {
+		// Fields are "id parent major:minor root point options [optional...] - type source superOptions".
+		const size_t third = line.find(' ', line.find(' ') + 1) + 1;
+		const size_t separator = line.find(" - ");
+		if (
+			(third == 0) ||
+			(separator == std::string::npos) ||
+			(line.compare(third, deviceNumbers.size() + 1, deviceNumbers + " ") != 0)
+		) {
+			continue;
+		}
+		const size_t typeStart = separator + 3;
+		return line.substr(typeStart, line.find(' ', typeStart) - typeStart);
+	}
+	return std::string();
+}
+#endif
+
+std::string FileSystemSource::filesystemType(const std::filesystem::path& path) const {
+	std::string type;
+#ifdef _WIN32
+	wchar_t volume[MAX_PATH + 1];
+	if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH + 1)) {
+		return type;
+	}
+	if (GetDriveTypeW(volume) == DRIVE_REMOTE) {
+		return "network";
+	}
+	wchar_t name[MAX_PATH + 1];
+	if (!GetVolumeInformationW(volume, NULL, 0, NULL, NULL, NULL, name, MAX_PATH + 1)) {
+		return type;
+	}
+	for (const wchar_t* c = name; *c != L'\0'; ++c) {
+		type.push_back((char)tolower((int)*c));
+	}
+#elif defined(__linux__)
+	// Names the magic numbers of the filesystems worth telling apart, local and remote, real and pseudo.
+	static const struct { uint64_t magic; const char* name; } TYPES[] = {
+		{ 0x6969, "nfs" }, { 0x517B, "smb" }, { 0xFF534D42, "cifs" }, { 0xFE534D42, "smb2" },
+		{ 0x65735546, "fuse" }, { 0x00C36400, "ceph" }, { 0x01021997, "9p" }, { 0x0187, "autofs" },
+		{ 0x9FA0, "proc" }, { 0x62656572, "sysfs" }, { 0x01021994, "tmpfs" }, { 0x1CD1, "devpts" },
+		{ 0x63677270, "cgroup2" }, { 0x27E0EB, "cgroup" }, { 0x64626720, "debugfs" }, { 0x73636673, "securityfs" },
+		{ 0x794C7630, "overlay" }, { 0x73717368, "squashfs" }, { 0x9660, "iso9660" },
+		{ 0xEF53, "ext4" }, { 0x58465342, "xfs" }, { 0x9123683E, "btrfs" }, { 0x2FC12FC1, "zfs" },
+		{ 0x4D44, "vfat" }, { 0x2011BAB0, "exfat" }, { 0x5346544E, "ntfs" }, { 0xF2F52010, "f2fs" },
+	};
+	struct statfs status;
+	if (statfs(path.c_str(), &status) != 0) {
+		return type;
+	}
+	const uint64_t magic = (uint64_t)(uint32_t)status.f_type;
+	for (const auto& known : TYPES) {
+		if (known.magic == magic) {
+			type = known.name;
+			break;
+		}
+	}
+
+	// Every FUSE filesystem shares a magic number, but mounts tell their subtype.
+	struct stat deviceStatus;
+	if (type == "fuse" && stat(path.c_str(), &deviceStatus) == 0) {
+		const std::string subtype = mountedType(deviceStatus.st_dev);
+		if (!subtype.empty()) {
+			type = subtype;
+		}
+	}
+#elif defined(__APPLE__)
+	struct statfs status;
+	if (statfs(path.c_str(), &status) != 0) {
+		return type;
+	}
+	for (const char* c = status.f_fstypename; *c != '\0'; ++c) {
+		type.push_back((char)tolower((unsigned char)*c));
+	}
+#else
+	(void)path;
+#endif
+	return type;
+}
+
+uint64_t FileSystemSource::stamp(const std::filesystem::path& path) const {
+	std::error_code code;
+	const std::filesystem::file_time_type time = std::filesystem::last_write_time(path, code);
+	return code ? 0 : (uint64_t)time.time_since_epoch().count();
+}
+
+uint64_t FileSystemSource::fileSize(const std::filesystem::path& path) const {
+	std::error_code code;
+	const uintmax_t size = std::filesystem::file_size(path, code);
+	return code ? 0 : (uint64_t)size;
+}
+
+/**
+* File of the real filesystem, read with positional reads, so that it keeps no offset of its own.
+*/
+class NativeFile : public SourceFile {
+
+    private:
+#ifdef _WIN32
+        HANDLE handle;
+#else
+        int descriptor;
+#endif
+        uint64_t fileSize;
+
+    public:
+#ifdef _WIN32
+        NativeFile(const HANDLE handle, const uint64_t fileSize) : handle(handle), fileSize(fileSize) {}
+        ~NativeFile() override { CloseHandle(handle); }
+#else
+        NativeFile(const int descriptor, const uint64_t fileSize) : descriptor(descriptor), fileSize(fileSize) {}
+        ~NativeFile() override { close(descriptor); }
+#endif
+
+        size_t read(const uint64_t offset, void* buffer, const size_t size) override {
+            size_t count = 0;
+            while (count < size) {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                position.Offset = (DWORD)((offset + count) & 0xFFFFFFFF);
+                position.OffsetHigh = (DWORD)((offset + count) >> 32);
+                DWORD chunk = 0;
+                if (!ReadFile(handle, (char*)buffer + count, (DWORD)std::min<size_t>(size - count, 1 << 30), &chunk, &position) || chunk == 0) {
+                    break;
+                }
+#else
+                const ssize_t chunk = pread(descriptor, (char*)buffer + count, size - count, (off_t)(offset + count));
+                if (chunk < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (chunk <= 0) {
+                    break;
+                }
+#endif
+                count += (size_t)chunk;
+            }
+            return count;
+        }
+
+        uint64_t size() const override {
+            return fileSize;
+        }
+};
+
+std::unique_ptr<SourceFile> FileSystemSource::open(const std::filesystem::path& path) const {
+#ifdef _WIN32
+	const HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size)) {
+		CloseHandle(handle);
+		return nullptr;
+	}
+	return std::make_unique<NativeFile>(handle, (uint64_t)size.QuadPart);
+#else
+	const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (descriptor < 0) {
+		return nullptr;
+	}
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+		close(descriptor);
+		return nullptr;
+	}
+	return std::make_unique<NativeFile>(descriptor, (uint64_t)status.st_size);
+#endif
+}
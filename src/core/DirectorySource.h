@@ -0,0 +1,148 @@
+// DirectorySource.h : declarations for the sources directory trees are read from
+
+#pragma once
+
+#ifndef DIRECTORYSOURCE_H_
+#define DIRECTORYSOURCE_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <memory>      // unique_ptr
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "Stats.h"
+
+/**
+* Entry of a listed directory.
+*/
+struct DirectoryEntry {
+    enum Type {
+        file,      // Listed, if it passes the filters.
+        directory, // Descended into, if it passes the filters.
+        other      // Ignored (e.g. symbolic links to directories).
+    };
+
+    std::string name; // Name in UTF8 format.
+    Type type = file;
+};
+
+/**
+* File opened for reading from a source, at any offset.
+*/
+class SourceFile {
+
+    public:
+        virtual ~SourceFile() = default;
+
+        /**
+        * @brief Reads bytes from an offset.
+        *
+        * @param offset Offset of the first byte.
+        * @param buffer Receives the bytes.
+        * @param size Amount of bytes to read.
+        * @return Amount of bytes read, fewer than requested only past the end of the file or on errors.
+        */
+        virtual size_t read(const uint64_t, void*, const size_t) = 0;
+        // @return Size of the file in bytes
+        virtual uint64_t size() const = 0;
+};
+
+/**
+* Identity of a directory, which tells the devices (and filesystems) a scan crosses into and the
+* directories it reaches twice (e.g. through a bind mount or a junction).
+*/
+struct DirectoryIdentity {
+    uint64_t device = 0; // Device holding the directory.
+    uint64_t node = 0;   // Id of the directory within its device, or 0 if unknown.
+};
+
+/**
+* Where the scanner reads directory trees from. The scanner only ever lists one directory at a
+* time and builds relative paths itself, so a source only has to answer a handful of questions.
+*
+* Every method must be safe to call from several threads at once, as roots on different
+* devices are scanned concurrently.
+*/
+class DirectorySource {
+
+    public:
+        virtual ~DirectorySource() {}
+
+        /**
+        * @brief Turns a user provided path into the absolute path roots and blacklisted directories are identified by.
+        *
+        * @param unprocessedPath Absolute or relative path.
+        * @param path Receives the resolved path.
+        * @param error Receives the description of the error, if any.
+        * @return If the path does not exist, returns `false`.
+        */
+        virtual bool resolve(const std::string&, std::filesystem::path&, std::string&) const = 0;
+        /**
+        * @brief Lists the entries of a directory, in no particular order.
+        *
+        * @param directory Resolved path of the directory.
+        * @param entries Receives the entries, replacing the previous ones (whose memory may be reused).
+        * @param stats Receives the amount of status calls made beyond the listing itself.
+        * @param error Receives the description of the error, if any.
+        * @return If the directory could not be listed, returns `false`.
+        */
+        virtual bool list(const std::filesystem::path&, std::vector<DirectoryEntry>&, ScanStats&, std::string&) const = 0;
+        /**
+        * @param path Resolved path.
+        * @return Id of the device holding the path, or 0 if unknown. Roots on different devices are scanned concurrently.
+        */
+        virtual uint64_t device(const std::filesystem::path&) const = 0;
+        /**
+        * @param path Resolved path of a directory or a file.
+        * @param identity Receives the identity of the directory or file, with the same device as `device()`.
+        * @return If the path could not be identified, returns `false`.
+        */
+        virtual bool identify(const std::filesystem::path&, DirectoryIdentity&) const = 0;
+        /**
+        * @param path Resolved path of a directory.
+        * @return Lowercase name of the type of filesystem holding the directory (e.g. "nfs" or "fuse.sshfs"), or an
+        * empty string if unknown.
+        */
+        virtual std::string filesystemType(const std::filesystem::path&) const = 0;
+        /**
+        * @param path Resolved path of a root directory or a file.
+        * @return Value that changes whenever the path does (e.g. its last write time), or 0 if unknown. Used to
+        * detect stale shared indexes and changed files, and to order playlists by time.
+        */
+        virtual uint64_t stamp(const std::filesystem::path&) const = 0;
+        /**
+        * @param path Resolved path of a file.
+        * @return Size of the file in bytes, or 0 if unknown.
+        */
+        virtual uint64_t fileSize(const std::filesystem::path&) const = 0;
+        /**
+        * @param path Resolved path of a file.
+        * @return File opened for reading, or `nullptr` if it could not be opened.
+        */
+        virtual std::unique_ptr<SourceFile> open(const std::filesystem::path&) const = 0;
+};
+
+/**
+* The real filesystem. Symbolic links to directories are not followed, which keeps scans from looping.
+*
+* Filesystem types come from `statfs` on Linux, refined with `/proc/self/mountinfo` for FUSE filesystems,
+* which all share a single magic number. On Windows, volumes on network drives are of type "network", and
+* the rest are named after their filesystem (e.g. "ntfs").
+*/
+class FileSystemSource : public DirectorySource {
+
+    public:
+        bool resolve(const std::string&, std::filesystem::path&, std::string&) const override;
+        bool list(const std::filesystem::path&, std::vector<DirectoryEntry>&, ScanStats&, std::string&) const override;
+        uint64_t device(const std::filesystem::path&) const override;
+        bool identify(const std::filesystem::path&, DirectoryIdentity&) const override;
+        std::string filesystemType(const std::filesystem::path&) const override;
+        uint64_t stamp(const std::filesystem::path&) const override;
+        uint64_t fileSize(const std::filesystem::path&) const override;
+        std::unique_ptr<SourceFile> open(const std::filesystem::path&) const override;
+};
+
+#endif
@@ -0,0 +1,282 @@
+// Duplicates.cpp : descriptions for finding files with the same contents
+
+#include "Duplicates.h"
+#include "Archive.h"
+#include "FileBatches.h"
+#include "Hash.h"
+
+#include <algorithm>   // sort, lower_bound, min
+#include <chrono>      // steady_clock
+#include <memory>      // unique_ptr
+
+#include <filesystem>  // u8path. C++17 ONLY.
+
+static const uint64_t UNKNOWN_SIZE = UINT64_MAX;    // Size of the files inside archives, which are never compared.
+static const uint64_t WHOLE_FLAG = (uint64_t)1 << 63; // Marks cached values that hash a whole file rather than a sample.
+
+/**
+* What is known about the contents of a file of a shared size.
+*/
+enum DigestState : uint8_t {
+    unread,  // The file could not be read.
+    sampled, // The digest hashes the size and both ends of the file.
+    whole    // The digest hashes the whole file.
+};
+
+/**
+* @brief Hashes a whole file, reading it in blocks.
+*
+* @param file File.
+* @param size Size the file must have.
+* @param buffer Reused for the blocks.
+* @param digest Receives the hash, without its highest bit.
+* @return If the file could not be read, or its size changed, returns `false`.
+*/
+static bool hashWhole(SourceFile& file, const uint64_t size, std::vector<unsigned char>& buffer, uint64_t& digest) {
+	StreamHash hash;
+	uint64_t offset = 0;
+	while (offset < size) {
+		const size_t count = file.read(offset, buffer.data(), (size_t)std::min<uint64_t>(buffer.size(), size - offset));
+		if (count == 0) {
+			return false;
+		}
+		hash.update(buffer.data(), count);
+		offset += count;
+	}
+	unsigned char extra;
+	if (file.read(size, &extra, 1) != 0) {
+		return false;
+	}
+	digest = hash.digest() >> 1;
+	return true;
+}
+
+void Duplicates::find(
+	const PathIndex& index,
+	const std::vector<std::string>& rootStrings,
+	const DirectorySource& source,
+	ContentCache& cache,
+	Bitmap& positions,
+	ScanStats& stats
+) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Every thread keeps the values it read or found in the cache, which keeps them, and its counters.
+	// Whole hashes are kept apart, so that they replace the samples of the same files.
+	struct Found {
+		uint64_t key;
+		uint64_t stamp;
+		uint64_t value;
+	};
+	struct Worker {
+		std::vector<unsigned char> buffer;
+		std::vector<Found> found;
+		std::vector<Found> hashed;
+		uint64_t sampledFiles = 0;
+		uint64_t hashedFiles = 0;
+		uint64_t hashedBytes = 0;
+		uint64_t cachedHashes = 0;
+	};
+	std::vector<Worker> workers(FileBatches::threadCount(index.size()));
+
+	// Reads the size of every file, and sorts them by size.
+	struct Sized {
+		uint64_t size;
+		uint32_t position;
+	};
+	std::vector<Sized> sized(index.size());
+	FileBatches::run(index, rootStrings, nullptr, [&](const unsigned, const uint32_t position, const std::string& path) {
+		const bool isArchived = (Archive::findSeparator(path) != std::string::npos);
+		sized[position] = { isArchived ? UNKNOWN_SIZE : source.fileSize(std::filesystem::u8path(path)), position };
+	});
+	std::sort(sized.begin(), sized.end(), [](const Sized& a, const Sized& b) {
+		return (a.size != b.size) ? (a.size < b.size) : (a.position < b.position);
+	});
+
+	// Only files of a shared size are candidates, kept by position along with their size and digest.
+	std::vector<uint32_t> candidates;
+	for (size_t i = 0; i < sized.size();) {
+		size_t end = i + 1;
+		while (end < sized.size() && sized[end].size == sized[i].size) {
+			++end;
+		}
+		if (end - i >= 2 && sized[i].size != UNKNOWN_SIZE) {
+			for (size_t j = i; j < end; ++j) {
+				candidates.push_back(sized[j].position);
+			}
+		}
+		i = end;
+	}
+	std::sort(candidates.begin(), candidates.end());
+	std::vector<uint64_t> sizes(candidates.size());
+	for (const Sized& entry : sized) {
+		const std::vector<uint32_t>::const_iterator it = std::lower_bound(candidates.begin(), candidates.end(), entry.position);
+		if (it != candidates.end() && *it == entry.position) {
+			sizes[it - candidates.begin()] = entry.size;
+		}
+	}
+	std::vector<Sized>().swap(sized);
+	const auto slotOf = [&candidates](const uint32_t position) {
+		return (size_t)(std::lower_bound(candidates.begin(), candidates.end(), position) - candidates.begin());
+	};
+	std::vector<uint64_t> digests(candidates.size(), 0);
+	std::vector<uint8_t> states(candidates.size(), unread);
+	const auto identify = [&source](const std::filesystem::path& filePath, uint64_t& key, uint64_t& stamp) {
+		DirectoryIdentity identity;
+		if (!source.identify(filePath, identity) || (stamp = source.stamp(filePath)) == 0) {
+			return false;
+		}
+		key = ContentCache::keyOf(identity);
+		return true;
+	};
+
+	// Samples every candidate, unless the cache knows it. Small files are hashed whole at once.
+	FileBatches::run(index, rootStrings, &candidates, [&](const unsigned thread, const uint32_t position, const std::string& path) {
+		Worker& worker = workers[thread];
+		const size_t slot = slotOf(position);
+		const uint64_t size = sizes[slot];
+		const std::filesystem::path filePath = std::filesystem::u8path(path);
+		uint64_t key = 0;
+		uint64_t stamp = 0;
+		const bool isCacheable = identify(filePath, key, stamp);
+		uint64_t value;
+		if (isCacheable && cache.find(key, stamp, value)) {
+			digests[slot] = value & ~WHOLE_FLAG;
+			states[slot] = (value & WHOLE_FLAG) ? whole : sampled;
+			++worker.cachedHashes;
+			worker.found.push_back({ key, stamp, value });
+			return;
+		}
+		const std::unique_ptr<SourceFile> file = source.open(filePath);
+		if (file == nullptr) {
+			return;
+		}
+		worker.buffer.resize(SAMPLE_BYTES * 2);
+		if (size <= SAMPLE_BYTES * 2) {
+			if (!hashWhole(*file, size, worker.buffer, digests[slot])) {
+				return;
+			}
+			states[slot] = whole;
+			++worker.hashedFiles;
+		} else {
+			if (
+				file->read(0, worker.buffer.data(), SAMPLE_BYTES) != SAMPLE_BYTES ||
+				file->read(size - SAMPLE_BYTES, worker.buffer.data() + SAMPLE_BYTES, SAMPLE_BYTES) != SAMPLE_BYTES
+			) {
+				return;
+			}
+			StreamHash hash(size);
+			hash.update(worker.buffer.data(), SAMPLE_BYTES * 2);
+			digests[slot] = hash.digest() >> 1;
+			states[slot] = sampled;
+			++worker.sampledFiles;
+		}
+		worker.hashedBytes += std::min<uint64_t>(size, SAMPLE_BYTES * 2);
+		if (isCacheable) {
+			worker.found.push_back({ key, stamp, digests[slot] | ((states[slot] == whole) ? WHOLE_FLAG : 0) });
+		}
+	});
+
+	// Groups the candidates by size. A sampled file is hashed whole if another file of its size has the same sample,
+	// or if any has been hashed whole, as it could be a copy of that one.
+	std::vector<size_t> order(candidates.size());
+	for (size_t slot = 0; slot < order.size(); ++slot) {
+		order[slot] = slot;
+	}
+	std::sort(order.begin(), order.end(), [&sizes](const size_t a, const size_t b) {
+		return (sizes[a] != sizes[b]) ? (sizes[a] < sizes[b]) : (a < b);
+	});
+	const auto forEachGroup = [&](const auto& visit) {
+		for (size_t i = 0; i < order.size();) {
+			size_t end = i + 1;
+			while (end < order.size() && sizes[order[end]] == sizes[order[i]]) {
+				++end;
+			}
+			visit(i, end);
+			i = end;
+		}
+	};
+	std::vector<uint32_t> unresolved;
+	std::vector<size_t> group;
+	forEachGroup([&](const size_t first, const size_t last) {
+		bool isAnyWhole = false;
+		group.clear();
+		for (size_t i = first; i < last; ++i) {
+			if (states[order[i]] == whole) isAnyWhole = true;
+			if (states[order[i]] == sampled) group.push_back(order[i]);
+		}
+		std::sort(group.begin(), group.end(), [&digests](const size_t a, const size_t b) {
+			return (digests[a] != digests[b]) ? (digests[a] < digests[b]) : (a < b);
+		});
+		for (size_t i = 0; i < group.size(); ++i) {
+			const bool isShared =
+				(i > 0 && digests[group[i - 1]] == digests[group[i]]) ||
+				(i + 1 < group.size() && digests[group[i + 1]] == digests[group[i]]);
+			if (isAnyWhole || isShared) {
+				unresolved.push_back(candidates[group[i]]);
+			}
+		}
+	});
+	std::sort(unresolved.begin(), unresolved.end());
+	FileBatches::run(index, rootStrings, &unresolved, [&](const unsigned thread, const uint32_t position, const std::string& path) {
+		Worker& worker = workers[thread];
+		const size_t slot = slotOf(position);
+		const std::filesystem::path filePath = std::filesystem::u8path(path);
+		const std::unique_ptr<SourceFile> file = source.open(filePath);
+		worker.buffer.resize(READ_BYTES);
+		if (file == nullptr || !hashWhole(*file, sizes[slot], worker.buffer, digests[slot])) {
+			states[slot] = unread;
+			return;
+		}
+		states[slot] = whole;
+		++worker.hashedFiles;
+		worker.hashedBytes += sizes[slot];
+		uint64_t key;
+		uint64_t stamp;
+		if (identify(filePath, key, stamp)) {
+			worker.hashed.push_back({ key, stamp, digests[slot] | WHOLE_FLAG });
+		}
+	});
+
+	// Files hashed whole with the same hash and size are copies of the first of them.
+	std::vector<uint64_t> copyWords((index.size() + 63) / 64, 0);
+	forEachGroup([&](const size_t first, const size_t last) {
+		group.clear();
+		for (size_t i = first; i < last; ++i) {
+			if (states[order[i]] == whole) group.push_back(order[i]);
+		}
+		std::sort(group.begin(), group.end(), [&digests](const size_t a, const size_t b) {
+			return (digests[a] != digests[b]) ? (digests[a] < digests[b]) : (a < b);
+		});
+		for (size_t i = 1; i < group.size(); ++i) {
+			if (digests[group[i - 1]] == digests[group[i]]) {
+				const uint32_t position = candidates[group[i]];
+				copyWords[position >> 6] |= (uint64_t)1 << (position & 63);
+				++stats.duplicateFiles;
+			}
+		}
+	});
+
+	for (const Worker& worker : workers) {
+		for (const Found& found : worker.found) {
+			cache.insert(found.key, found.stamp, found.value);
+		}
+	}
+	for (const Worker& worker : workers) {
+		for (const Found& found : worker.hashed) {
+			cache.insert(found.key, found.stamp, found.value);
+		}
+		stats.sampledFiles += worker.sampledFiles;
+		stats.hashedFiles += worker.hashedFiles;
+		stats.hashedBytes += worker.hashedBytes;
+		stats.cachedHashes += worker.cachedHashes;
+	}
+	positions.clear();
+	for (size_t i = 0; i < index.size(); ++i) {
+		if (((copyWords[i >> 6] >> (i & 63)) & 1) == 0) {
+			positions.add((uint32_t)i);
+		}
+	}
+	positions.finish();
+	stats.hashNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,53 @@
+// Duplicates.h : declarations for finding files with the same contents
+
+#pragma once
+
+#ifndef DUPLICATES_H_
+#define DUPLICATES_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "ContentCache.h"
+#include "DirectorySource.h"
+#include "PathIndex.h"
+#include "Stats.h"
+
+/**
+* Finds the files of an index whose bytes are the same as those of another file, so that picks can
+* skip all but one copy of each.
+*
+* Only files that share their size can be copies, so sizes are compared first and most files are never
+* read. Files of a shared size are sampled next (their first and last `SAMPLE_BYTES`, hashed along with
+* the size), and only files whose sample is shared too are hashed whole. Files are read on several
+* threads (see `FileBatches`) and hashed with `StreamHash`.
+*
+* Samples and hashes are cached by the identity and stamp of each file, so later runs only read the files
+* that are new or changed. Files inside archives, and files that can not be read, are never copies.
+*/
+class Duplicates {
+
+    public:
+        static const size_t SAMPLE_BYTES = 4096;           // Bytes hashed at each end of a file before it is hashed whole
+        static const size_t READ_BYTES = 1 << 20;          // Bytes read at once while hashing a whole file
+        static const uint64_t CACHE_PURPOSE = 0x48534148; // "HASH", the purpose of hash cache files
+
+        /**
+        * @brief Finds one entry of every set of files with the same contents, along with every file that has no copies.
+        * The first entry of a set, by position, stands for it.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param source Source the files are read from.
+        * @param cache Samples and hashes found before, which receives the ones read.
+        * @param positions Receives the positions of the entries that are not copies of an earlier one.
+        * @param stats Receives the amount of files and bytes hashed, of hashes found in the cache, and of copies.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        static void find(const PathIndex&, const std::vector<std::string>&, const DirectorySource&, ContentCache&, Bitmap&, ScanStats&);
+};
+
+#endif
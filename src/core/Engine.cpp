@@ -0,0 +1,1002 @@
+// Engine.cpp : descriptions for the headless scan, index and pick engine
+
+#include "Engine.h"
+#include "Archive.h"
+#include "Hash.h"
+#include "TempFiles.h"
+#include "Trace.h"
+#include "Allocations.h"
+
+#include <algorithm>   // shuffle, mismatch
+#include <chrono>      // chrono, system_clock, steady_clock
+#include <condition_variable> // condition variables
+#include <cstdio>      // snprintf
+#include <deque>       // stable queues
+#include <fstream>     // extracted files
+#include <map>         // ordered maps
+#include <mutex>       // mutex
+#include <set>         // ordered sets
+#include <thread>      // thread
+#include <unordered_set> // unordered sets
+#include <utility>     // pair
+
+Engine::Engine() {
+	// Sets the shuffle index to 0
+	shuffleIndex = 0;
+
+	// Filters are off until enabled.
+	isFilterIndexEnabled = false;
+	isFiltered = false;
+	isTrigramIndexEnabled = false;
+	isStratifiedPlaylist = false;
+	playlistSeed = 0;
+	isNewOnly = false;
+	typeMask = 0;
+	isDeduplicated = false;
+	isOrdered = false;
+	orderKey = SortedOrder::natural;
+	isOrderedPlaylist = false;
+
+	// Initializes a random seed.
+	randomEngine.seed((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+bool Engine::setRoot(const std::string& unprocessedDirectoryPath, std::string& error) {
+	return setRoots(std::vector<std::string>{ unprocessedDirectoryPath }, error);
+}
+
+bool Engine::setRoots(const std::vector<std::string>& unprocessedDirectoryPaths, std::string& error) {
+	std::vector<std::filesystem::path> directories;
+	std::vector<std::string> unprocessedPaths = unprocessedDirectoryPaths;
+
+	// Uses the current path if no directory was provided, and the resolved paths if they were.
+	if (unprocessedPaths.empty()) {
+		unprocessedPaths.emplace_back();
+	}
+	for (const std::string& unprocessedDirectoryPath : unprocessedPaths) {
+		std::filesystem::path directory;
+		if (!scanner.getSource().resolve(unprocessedDirectoryPath.empty() ? "." : unprocessedDirectoryPath, directory, error)) {
+			return false;
+		}
+		if (std::find(directories.begin(), directories.end(), directory) == directories.end()) {
+			directories.push_back(directory);
+		}
+	}
+	if (directories.size() > MAX_ROOTS) {
+		error = "Too many root directories";
+		return false;
+	}
+
+	// Nested roots would store the same files twice.
+	for (size_t i = 0; i < directories.size(); ++i) {
+		for (size_t j = 0; j < directories.size(); ++j) {
+			if (i == j) continue;
+			const std::filesystem::path& outer = directories[i];
+			const std::filesystem::path& inner = directories[j];
+			if (std::mismatch(outer.begin(), outer.end(), inner.begin(), inner.end()).first == outer.end()) {
+				error = "Root directory \"" + inner.generic_u8string() + "\" is inside root directory \"" + outer.generic_u8string() + "\"";
+				return false;
+			}
+		}
+	}
+
+	// Initializes the string paths.
+	rootDirectories = directories;
+	rootDirectoryStrings.clear();
+	for (const std::filesystem::path& directory : rootDirectories) {
+		rootDirectoryStrings.push_back(directory.generic_u8string() + "/");
+	}
+
+	return true;
+}
+
+bool Engine::configure(const ScanOptions& scanOptions, std::string& error) {
+	options = scanOptions;
+	if (!scanner.configure(options, error)) {
+		return false;
+	}
+	setMemoryBudget(options.memoryBudget);
+	return true;
+}
+
+void Engine::setSource(const std::shared_ptr<const DirectorySource>& source) {
+	scanner.setSource(source);
+}
+
+void Engine::setMemoryBudget(const uint64_t budget) {
+	options.memoryBudget = budget;
+	relativePathStrings.setMemoryBudget(budget);
+}
+
+ScanResult Engine::scan(const ProgressCallback& progress) {
+	ScanResult result;
+
+	// Attaches to an index already published by another process, if it is still fresh.
+	if (options.share) {
+		sharedIndex = std::make_unique<SharedIndex>(buildScanSignature());
+		if (sharedIndex->attach(relativePathStrings)) {
+			result.rootCounts.resize(rootDirectories.size());
+			bool isValid = true;
+			for (size_t i = 0; i < relativePathStrings.size() && isValid; ++i) {
+				const uint16_t rootId = relativePathStrings.root(i);
+				isValid = (rootId < rootDirectories.size());
+				if (isValid) ++result.rootCounts[rootId].fileCount;
+			}
+			// Only the directories recorded when it was published are checked, rather than going through the index.
+			const DirectorySource& source = scanner.getSource();
+			isValid = isValid && sharedIndex->isFresh([this, &source](const uint16_t rootId, std::string_view path, const uint64_t stamp) {
+				return
+					(rootId < rootDirectoryStrings.size()) &&
+					(source.stamp(std::filesystem::u8path(rootDirectoryStrings[rootId] + std::string(path))) == stamp);
+			});
+			if (isValid) {
+				result.fileCount = relativePathStrings.size();
+				result.stats.pathBytes = relativePathStrings.pathBytes();
+				result.isSharedAttached = true;
+				result.sharedGeneration = sharedIndex->getGeneration();
+				if (!buildPickIndexes(result.error)) {
+					result.ok = false;
+				}
+				result.stats.add(typeStats);
+				result.stats.add(hashStats);
+				resetPicks();
+				return result;
+			}
+			relativePathStrings.clear();
+			result = ScanResult();
+		}
+	}
+
+	result = scanRoots(progress);
+
+	// Publishes the index for other processes and serves this one from shared memory as well.
+	// Partial indexes are never published.
+	if (
+		options.share &&
+		result.ok &&
+		!result.isCancelled &&
+		result.skippedDirectories.empty()
+	) {
+		std::vector<SharedStamp> stamps;
+		getTreeStamps(stamps);
+		if (sharedIndex->publish(relativePathStrings, stamps)) {
+			result.sharedGeneration = sharedIndex->getGeneration();
+		} else {
+			result.sharedError = sharedIndex->getError();
+		}
+	}
+
+	if (!buildPickIndexes(result.error)) {
+		result.ok = false;
+	}
+	result.stats.add(typeStats);
+	result.stats.add(hashStats);
+	resetPicks();
+	return result;
+}
+
+ScanResult Engine::readList(const std::string& listPath) {
+	ScanResult result;
+	PathList list;
+	if (!list.open(listPath, result.error)) {
+		result.ok = false;
+		return result;
+	}
+	{
+		const Trace::Span span("ingest", "scan", listPath);
+		result = scanner.ingest(list, rootDirectoryStrings, relativePathStrings);
+	}
+
+	if (!buildPickIndexes(result.error)) {
+		result.ok = false;
+	}
+	result.stats.add(typeStats);
+	result.stats.add(hashStats);
+	resetPicks();
+	return result;
+}
+
+ScanResult Engine::scanRoots(const ProgressCallback& progress) {
+	ScanContext context;
+	context.progress = progress;
+	context.directoryBucket.setRate(options.directoryRate);
+	context.entryBucket.setRate(options.entryRate);
+	std::vector<std::unique_ptr<ScanCheckpoint>> checkpoints = createCheckpoints();
+	const auto checkpointOf = [&checkpoints](const size_t rootId) {
+		return checkpoints.empty() ? nullptr : checkpoints[rootId].get();
+	};
+
+	// A single root needs neither workers nor merging, unless its mounts are scanned apart.
+	if (rootDirectories.size() == 1 && !scanner.getIsSplittingDevices()) {
+		const Trace::Span span("scan root", "scan", rootDirectoryStrings[0]);
+		ScanResult result = scanner.scan(rootDirectories[0], 0, relativePathStrings, context, checkpointOf(0));
+		RootScanCounts counts;
+		counts.fileCount = result.fileCount;
+		counts.directoryCount = result.directoryCount;
+		result.rootCounts.push_back(counts);
+		closeCheckpoints(checkpoints, result);
+		return result;
+	}
+
+	const std::chrono::steady_clock::time_point scanStart = std::chrono::steady_clock::now();
+
+	// Scans are queued by device, so that each disk is read by a single worker and disks do not contend. Jobs live
+	// in a deque, which never moves them, while workers hold on to them.
+	struct ScanJob {
+		uint16_t rootId = 0;
+		PendingDirectory start;
+		bool isRoot = true;
+		PathIndex index;
+		ScanResult result;
+	};
+	struct DeviceQueue {
+		std::deque<ScanJob*> pending;
+		bool hasWorker = false;
+	};
+	std::deque<ScanJob> jobs;
+	std::map<uint64_t, DeviceQueue> devices;
+	std::set<std::pair<uint64_t, uint64_t>> handedOffDirectories;
+	std::vector<std::thread> workers;
+	size_t activeWorkers = 0;
+	std::mutex jobMutex;
+	std::condition_variable workersDone;
+
+	// Roots (and the mounts found below them) share the memory budget while being scanned.
+	const uint64_t partialBudget = (options.memoryBudget != 0)
+		? std::max<uint64_t>(options.memoryBudget / rootDirectories.size(), Scanner::MIN_MEMORY_BUDGET)
+		: 0;
+
+	// Runs the jobs of a device until there are none left, and then lets a new worker take over if more come.
+	std::function<void(uint64_t)> work = [&](const uint64_t device) {
+		Trace::nameThread("scan worker");
+		while (true) {
+			ScanJob* job;
+			{
+				const std::lock_guard<std::mutex> lock(jobMutex);
+				DeviceQueue& queue = devices[device];
+				if (queue.pending.empty()) {
+					queue.hasWorker = false;
+					if (--activeWorkers == 0) {
+						workersDone.notify_all();
+					}
+					return;
+				}
+				job = queue.pending.front();
+				queue.pending.pop_front();
+			}
+			if (job->isRoot) {
+				const Trace::Span span("scan root", "scan", rootDirectoryStrings[job->rootId]);
+				job->result = scanner.scan(job->start.path, job->rootId, job->index, context, checkpointOf(job->rootId));
+			} else {
+				const std::string detail = rootDirectoryStrings[job->rootId] + "/" + job->start.relativePath;
+				const Trace::Span span("scan mount", "scan", detail);
+				job->result = scanner.scanSubtree(job->start, job->rootId, job->index, context);
+			}
+		}
+	};
+	const auto enqueue = [&](const uint64_t device, const uint16_t rootId, PendingDirectory&& start, const bool isRoot) {
+		jobs.emplace_back();
+		ScanJob& job = jobs.back();
+		job.rootId = rootId;
+		job.start = std::move(start);
+		job.isRoot = isRoot;
+		job.index.setMemoryBudget(partialBudget);
+		DeviceQueue& queue = devices[device];
+		queue.pending.push_back(&job);
+		if (!queue.hasWorker) {
+			queue.hasWorker = true;
+			++activeWorkers;
+			workers.emplace_back(work, device);
+		}
+	};
+	context.handOff = [&](const uint16_t rootId, PendingDirectory&& start, const DirectoryIdentity& identity) {
+		const std::lock_guard<std::mutex> lock(jobMutex);
+		if (!handedOffDirectories.emplace(identity.device, identity.node).second) {
+			return false;
+		}
+		enqueue(identity.device, rootId, std::move(start), false);
+		return true;
+	};
+	{
+		const std::lock_guard<std::mutex> lock(jobMutex);
+		for (size_t rootId = 0; rootId < rootDirectories.size(); ++rootId) {
+			enqueue(scanner.getSource().device(rootDirectories[rootId]), (uint16_t)rootId, PendingDirectory{ rootDirectories[rootId], std::string(), 0 }, true);
+		}
+	}
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		workersDone.wait(lock, [&activeWorkers]() { return activeWorkers == 0; });
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	// Merges the partial indexes in root order, each root followed by its mounts in path order, so the merged
+	// index does not depend on timing.
+	const Trace::Span span("merge", "scan");
+	const AllocationCounts mergeStart = Allocations::thread();
+	std::vector<std::vector<ScanJob*>> jobsByRoot(rootDirectories.size());
+	for (ScanJob& job : jobs) {
+		jobsByRoot[job.rootId].push_back(&job);
+	}
+	ScanResult result;
+	relativePathStrings.clear();
+	for (size_t rootId = 0; rootId < rootDirectories.size(); ++rootId) {
+		std::vector<ScanJob*>& rootJobs = jobsByRoot[rootId];
+		std::sort(rootJobs.begin(), rootJobs.end(), [](const ScanJob* a, const ScanJob* b) {
+			return (a->isRoot != b->isRoot) ? a->isRoot : (a->start.relativePath < b->start.relativePath);
+		});
+		RootScanCounts counts;
+		for (ScanJob* job : rootJobs) {
+			const ScanResult& partialResult = job->result;
+			if (!partialResult.ok && result.ok) {
+				result.ok = false;
+				result.error = rootDirectoryStrings[rootId] + ": " + partialResult.error;
+			}
+			counts.fileCount += partialResult.fileCount;
+			counts.directoryCount += partialResult.directoryCount;
+			result.stats.add(partialResult.stats);
+			result.skippedDirectories.insert(result.skippedDirectories.end(), partialResult.skippedDirectories.begin(), partialResult.skippedDirectories.end());
+
+			try {
+				relativePathStrings.append(job->index);
+			}
+			catch (const std::exception& ex) {
+				if (result.ok) {
+					result.ok = false;
+					result.error = ex.what();
+				}
+			}
+			job->index.clear();
+		}
+		result.rootCounts.push_back(counts);
+		result.fileCount += counts.fileCount;
+		result.directoryCount += counts.directoryCount;
+	}
+	result.isCancelled = context.isCancelled;
+	result.spilledCount = relativePathStrings.spilledSize();
+
+	// Partial indexes were alive at the same time, and then the merged one grew while they were cleared.
+	result.stats.wallNanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - scanStart).count();
+	result.stats.pathBytes = relativePathStrings.pathBytes();
+	result.stats.peakIndexBytes = std::max(result.stats.peakIndexBytes, relativePathStrings.getPeakMemoryBytes());
+
+	// Workers counted their own allocations, and the merge adds those of this thread.
+	const AllocationCounts mergeCounts = Allocations::thread() - mergeStart;
+	result.stats.allocations += mergeCounts.allocations;
+	result.stats.allocatedBytes += mergeCounts.bytes;
+
+	closeCheckpoints(checkpoints, result);
+	return result;
+}
+
+std::vector<std::unique_ptr<ScanCheckpoint>> Engine::createCheckpoints() const {
+	std::vector<std::unique_ptr<ScanCheckpoint>> checkpoints;
+	std::filesystem::path directory;
+	std::string error;
+	if (
+		!(options.checkpoint || options.resume) ||
+		!TempFiles::directory(directory, error)
+	) {
+		return checkpoints;
+	}
+
+	// Names each journal after the options and its root, so that only the same scan resumes from it.
+	const uint64_t signatureHash = Hash::fnv1a(buildScanSignature());
+	for (const std::string& rootDirectoryString : rootDirectoryStrings) {
+		const uint64_t rootHash = Hash::fnv1a(rootDirectoryString, signatureHash);
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)rootHash);
+		checkpoints.push_back(std::make_unique<ScanCheckpoint>(directory / (std::string("rfopener-scan-") + hex + ".ckpt"), rootHash));
+	}
+	return checkpoints;
+}
+
+void Engine::closeCheckpoints(std::vector<std::unique_ptr<ScanCheckpoint>>& checkpoints, ScanResult& result) {
+	for (const std::unique_ptr<ScanCheckpoint>& checkpoint : checkpoints) {
+		result.resumedFileCount += checkpoint->getRestoredCount();
+		if (result.checkpointError.empty()) {
+			result.checkpointError = checkpoint->getError();
+		}
+	}
+
+	// Journals of completed roots are kept until every root completed.
+	if (result.ok && !result.isCancelled) {
+		for (const std::unique_ptr<ScanCheckpoint>& checkpoint : checkpoints) {
+			checkpoint->discard();
+		}
+	}
+}
+
+bool Engine::loadIndex(const std::string& path, std::string& error) {
+	IndexFileHeader header;
+	if (!IndexFile::read(path, relativePathStrings, header, error)) {
+		relativePathStrings.clear();
+		filterIndex.clear();
+		trigramIndex.clear();
+		matchPositions.clear();
+		currentSnapshot.clear();
+		snapshotDiff = SnapshotDiff();
+		newPositions.clear();
+		typePositions.clear();
+		distinctPositions.clear();
+		sortedOrder.clear();
+		history.clear();
+		applyFilters();
+		strata.clear();
+		resetPicks();
+		return false;
+	}
+
+	// The index refers to the roots it was scanned from.
+	rootDirectories.clear();
+	rootDirectoryStrings.clear();
+	for (const std::string& root : header.roots) {
+		rootDirectories.push_back(std::filesystem::u8path(root));
+		rootDirectoryStrings.push_back(root);
+	}
+
+	const bool isIndexed = buildPickIndexes(error);
+	resetPicks();
+	return isIndexed;
+}
+
+bool Engine::writeIndex(const std::string& path, std::string& error) const {
+	IndexFileHeader header;
+	header.roots = rootDirectoryStrings;
+	header.shardIndex = options.shardIndex;
+	header.shardCount = options.shardCount;
+	return IndexFile::write(path, relativePathStrings, header, error);
+}
+
+void Engine::enableFilterIndex() {
+	isFilterIndexEnabled = true;
+}
+
+void Engine::enableTrigramIndex() {
+	isTrigramIndexEnabled = true;
+}
+
+bool Engine::buildPickIndexes(std::string& error) {
+	bool isBuilt = true;
+	try {
+		if (isFilterIndexEnabled) {
+			const Trace::Span span("filter index", "scan");
+			filterIndex.build(relativePathStrings);
+		}
+		if (isTrigramIndexEnabled) {
+			const Trace::Span span("trigram index", "scan");
+			trigramIndex.build(relativePathStrings);
+			if (!matchQuery.empty()) {
+				trigramIndex.match(matchQuery, relativePathStrings, matchPositions);
+			}
+		}
+	}
+	catch (const std::exception& ex) {
+		filterIndex.clear();
+		trigramIndex.clear();
+		matchPositions.clear();
+		error = ex.what();
+		isBuilt = false;
+	}
+	if (!snapshotPath.empty()) {
+		const Trace::Span span("snapshot", "scan");
+		try {
+			currentSnapshot.build(relativePathStrings, rootDirectoryStrings, scanner.getSource());
+			Snapshot::diff(previousSnapshot, currentSnapshot, snapshotDiff);
+			Bitmap::unite(snapshotDiff.added, snapshotDiff.changed, newPositions);
+		}
+		catch (const std::exception& ex) {
+			currentSnapshot.clear();
+			snapshotDiff = SnapshotDiff();
+			newPositions.clear();
+			error = ex.what();
+			isBuilt = false;
+		}
+	}
+	if (typeMask != 0) {
+		const Trace::Span span("sniff", "scan");
+		typeStats = ScanStats();
+		try {
+			ContentType::classify(relativePathStrings, rootDirectoryStrings, scanner.getSource(), typeMask, typeCache, typePositions, typeStats);
+		}
+		catch (const std::exception& ex) {
+			typePositions.clear();
+			error = ex.what();
+			isBuilt = false;
+		}
+		typeCacheError.clear();
+		if (!typeCachePath.empty()) {
+			typeCache.write(typeCachePath, ContentType::CACHE_PURPOSE, typeCacheError);
+		}
+	}
+	if (isDeduplicated) {
+		const Trace::Span span("dedupe", "scan");
+		hashStats = ScanStats();
+		try {
+			Duplicates::find(relativePathStrings, rootDirectoryStrings, scanner.getSource(), hashCache, distinctPositions, hashStats);
+		}
+		catch (const std::exception& ex) {
+			distinctPositions.clear();
+			error = ex.what();
+			isBuilt = false;
+		}
+		hashCacheError.clear();
+		if (!hashCachePath.empty()) {
+			hashCache.write(hashCachePath, Duplicates::CACHE_PURPOSE, hashCacheError);
+		}
+	}
+	if (isOrdered) {
+		const Trace::Span span("sort", "scan");
+		try {
+			sortedOrder.build(relativePathStrings, rootDirectoryStrings, scanner.getSource(), orderKey);
+		}
+		catch (const std::exception& ex) {
+			sortedOrder.clear();
+			error = ex.what();
+			isBuilt = false;
+		}
+	}
+	if (history.isOpen()) {
+		const Trace::Span span("history", "scan");
+		try {
+			isBuilt = history.reconcile(relativePathStrings, rootDirectoryStrings, error) && isBuilt;
+		}
+		catch (const std::exception& ex) {
+			history.clear();
+			error = ex.what();
+			isBuilt = false;
+		}
+	}
+	applyFilters();
+	return buildStrata(error) && isBuilt;
+}
+
+bool Engine::enableSnapshot(const std::string& path, std::string& error) {
+	snapshotPath = path;
+	previousSnapshot.clear();
+	std::error_code errorCode;
+	if (!std::filesystem::exists(std::filesystem::u8path(path), errorCode)) {
+		return true;
+	}
+	return previousSnapshot.read(path, error);
+}
+
+void Engine::restrictToNew() {
+	isNewOnly = true;
+}
+
+void Engine::restrictToTypes(const std::vector<ContentType::Kind>& kinds) {
+	typeMask = 0;
+	for (const ContentType::Kind kind : kinds) {
+		typeMask |= (uint8_t)(1 << kind);
+	}
+
+	// The cache is shared by every run of the user. A missing or damaged one is simply started over.
+	typeCache.clear();
+	typeCachePath.clear();
+	std::filesystem::path directory;
+	std::string error;
+	if (typeMask == 0 || !TempFiles::directory(directory, error)) {
+		return;
+	}
+	typeCachePath = directory / "types.cache";
+	typeCache.read(typeCachePath, ContentType::CACHE_PURPOSE, error);
+}
+
+void Engine::collapseDuplicates() {
+	isDeduplicated = true;
+
+	// The cache is shared by every run of the user. A missing or damaged one is simply started over.
+	hashCache.clear();
+	hashCachePath.clear();
+	std::filesystem::path directory;
+	std::string error;
+	if (!TempFiles::directory(directory, error)) {
+		return;
+	}
+	hashCachePath = directory / "hashes.cache";
+	hashCache.read(hashCachePath, Duplicates::CACHE_PURPOSE, error);
+}
+
+bool Engine::writeSnapshot(std::string& error) const {
+	if (snapshotPath.empty()) {
+		return true;
+	}
+	if (currentSnapshot.size() != relativePathStrings.size()) {
+		error = "The index could not be compared with the previous snapshot";
+		return false;
+	}
+	return currentSnapshot.write(snapshotPath, error);
+}
+
+void Engine::setOrder(const SortedOrder::Key key) {
+	isOrdered = true;
+	orderKey = key;
+}
+
+bool Engine::enableHistory(const std::string& path, std::string& error) {
+	return history.open(path, error);
+}
+
+bool Engine::recordOpen(const size_t position, std::string& error) {
+	if (!history.isOpen()) {
+		return true;
+	}
+	const std::string& rootString = getRootString(position);
+	return history.recordOpen(position, History::idOf(rootString, relativePathStrings[position]), error);
+}
+
+const HistoryRecord* Engine::findHistory(const size_t position) const {
+	if (!history.isOpen()) {
+		return nullptr;
+	}
+	const std::string& rootString = getRootString(position);
+	return history.find(History::idOf(rootString, relativePathStrings[position]));
+}
+
+void Engine::stratify(const StratifyOptions& stratify) {
+	stratifyOptions = stratify;
+}
+
+bool Engine::buildStrata(std::string& error) {
+	if (stratifyOptions.grouping == StratifyOptions::none) {
+		return true;
+	}
+	const Trace::Span span("strata", "pick");
+	try {
+		strata.build(relativePathStrings, isFiltered ? &pickablePositions : nullptr, stratifyOptions);
+	}
+	catch (const std::exception& ex) {
+		strata.clear();
+		error = ex.what();
+		return false;
+	}
+	return true;
+}
+
+bool Engine::setMatch(const std::string& query, std::string& error) {
+	const Trace::Span span("match", "pick", query);
+	bool isMatched = true;
+	matchQuery = query;
+	matchPositions.clear();
+	if (!matchQuery.empty()) {
+		try {
+			trigramIndex.match(matchQuery, relativePathStrings, matchPositions);
+		}
+		catch (const std::exception& ex) {
+			matchQuery.clear();
+			error = ex.what();
+			isMatched = false;
+		}
+	}
+	applyFilters();
+	isMatched = buildStrata(error) && isMatched;
+	resetPicks();
+	return isMatched;
+}
+
+bool Engine::setFilters(const std::vector<PickFilter>& filters, std::string& error) {
+	pickFilters = filters;
+	applyFilters();
+	const bool isStratified = buildStrata(error);
+	resetPicks();
+	return isStratified;
+}
+
+void Engine::applyFilters() {
+	isFiltered = !pickFilters.empty() || !matchQuery.empty() || isNewOnly || typeMask != 0 || isDeduplicated;
+	pickablePositions.clear();
+	if (!isFiltered) {
+		return;
+	}
+
+	// Entries must match every filter and the query, be new if only new entries are picked, be of the given types,
+	// and not be copies of an earlier entry.
+	bool isNarrowed = false;
+	Bitmap matches;
+	Bitmap intersection;
+	const auto narrow = [&](const Bitmap& positions) {
+		if (!isNarrowed) {
+			pickablePositions = positions;
+			isNarrowed = true;
+			return;
+		}
+		Bitmap::intersect(pickablePositions, positions, intersection);
+		std::swap(pickablePositions, intersection);
+	};
+	for (const PickFilter& filter : pickFilters) {
+		filterIndex.match(filter, matches);
+		narrow(matches);
+	}
+	if (!matchQuery.empty()) {
+		narrow(matchPositions);
+	}
+	if (isNewOnly) {
+		narrow(newPositions);
+	}
+	if (typeMask != 0) {
+		narrow(typePositions);
+	}
+	if (isDeduplicated) {
+		narrow(distinctPositions);
+	}
+}
+
+void Engine::seed(const unsigned int value) {
+	randomEngine.seed(value);
+}
+
+bool Engine::pickRandom(size_t& position) {
+	if (getPickableCount() == 0) {
+		return false;
+	}
+	if (history.isQueued()) {
+		position = history.pick(randomEngine);
+		return true;
+	}
+	position = positionOf(strata.empty() ? distribution(randomEngine) : strata.pick(randomEngine));
+	return true;
+}
+
+void Engine::shuffle() {
+	const Trace::Span span("shuffle", "pick");
+	shuffleIndex = 0;
+
+	// Ordered playlists take the pickable positions in sorted order.
+	if (isOrdered && sortedOrder.size() == relativePathStrings.size()) {
+		shuffleOrder.clear();
+		shufflePermutation.reset(0, 0);
+		isStratifiedPlaylist = false;
+		isOrderedPlaylist = true;
+		orderedPlaylist.clear();
+		if (isFiltered) {
+			std::vector<bool> isPickable(relativePathStrings.size(), false);
+			pickablePositions.forEach([&](const uint32_t position) { isPickable[position] = true; });
+			orderedPlaylist.reserve(getPickableCount());
+			for (size_t i = 0; i < sortedOrder.size(); ++i) {
+				if (isPickable[sortedOrder[i]]) orderedPlaylist.push_back((uint32_t)sortedOrder[i]);
+			}
+		}
+		return;
+	}
+
+	// Stratified playlists are computed on demand from the strata.
+	if (!strata.empty()) {
+		shuffleOrder.clear();
+		shufflePermutation.reset(0, 0);
+		isStratifiedPlaylist = true;
+		playlistSeed = ((uint64_t)randomEngine() << 32) ^ randomEngine();
+		return;
+	}
+
+	// Keeping the order of a spilled index in memory would defeat the memory budget.
+	// Both shuffle ranks among the pickable entries, which are the positions themselves unless filtered.
+	if (relativePathStrings.isSpilled()) {
+		shuffleOrder.clear();
+		shufflePermutation.reset(getPickableCount(), ((uint64_t)randomEngine() << 32) ^ randomEngine());
+		return;
+	}
+	shufflePermutation.reset(0, 0);
+
+	// Shuffles positions rather than the paths themselves, which may live in read-only shared memory.
+	shuffleOrder.resize(getPickableCount());
+	for (size_t i = 0; i < shuffleOrder.size(); ++i) {
+		shuffleOrder[i] = (uint32_t)i;
+	}
+	std::shuffle(
+		shuffleOrder.begin(),
+		shuffleOrder.end(),
+		randomEngine
+	);
+}
+
+bool Engine::pickCurrent(size_t& position) const {
+	if (getPickableCount() == 0) {
+		return false;
+	}
+	if (isOrderedPlaylist) {
+		position = isFiltered ? orderedPlaylist[shuffleIndex] : sortedOrder[shuffleIndex];
+	} else if (isStratifiedPlaylist) {
+		position = positionOf(strata.playlistRank(shuffleIndex, playlistSeed));
+	} else if (!shuffleOrder.empty()) {
+		position = positionOf(shuffleOrder[shuffleIndex]);
+	} else if (!shufflePermutation.empty()) {
+		position = positionOf(shufflePermutation(shuffleIndex));
+	} else {
+		position = positionOf(shuffleIndex);
+	}
+	return true;
+}
+
+bool Engine::pickSequential(const bool backwards, size_t& position) {
+	if (getPickableCount() == 0) {
+		return false;
+	}
+
+	// Adjusts the shuffle index, looping back to the opposite end.
+	const size_t shuffleLastIndex = getPickableCount() - 1;
+	if (backwards) {
+		shuffleIndex = (shuffleIndex == 0) ? shuffleLastIndex : shuffleIndex - 1;
+	} else {
+		shuffleIndex = (shuffleIndex == shuffleLastIndex) ? 0 : shuffleIndex + 1;
+	}
+
+	return pickCurrent(position);
+}
+
+void Engine::buildAbsolutePath(const size_t position, std::string& absolutePath) const {
+	// The root is looked up first, as the view into a spilled entry only lasts until the following lookup.
+	absolutePath.assign(rootDirectoryStrings[relativePathStrings.root(position)]);
+	const std::string_view relativePath = relativePathStrings[position];
+	absolutePath.append(relativePath.data(), relativePath.size());
+}
+
+bool Engine::buildLaunchPath(const size_t position, std::string& launchPath, std::string& error) const {
+	buildAbsolutePath(position, launchPath);
+
+	// Paths that do not lead into an archive file are opened as they are.
+	const size_t separator = Archive::findSeparator(launchPath);
+	if (separator == std::string::npos) {
+		return true;
+	}
+	const std::filesystem::path archivePath = std::filesystem::u8path(launchPath.substr(0, separator));
+	const std::string innerPath = launchPath.substr(separator + std::char_traits<char>::length(Archive::SEPARATOR));
+	const DirectorySource& source = scanner.getSource();
+	const std::unique_ptr<SourceFile> file = source.open(archivePath);
+	if (file == nullptr) {
+		return true;
+	}
+
+	// Finds the entry again, since the index only keeps its name.
+	const Archive::Format format = Archive::formatOf(archivePath.filename().u8string());
+	std::vector<ArchiveEntry> entries;
+	if (!Archive::list(*file, format, entries, error)) {
+		error = archivePath.u8string() + ": " + error;
+		return false;
+	}
+	const std::vector<ArchiveEntry>::const_iterator entry = std::find_if(entries.begin(), entries.end(), [&innerPath](const ArchiveEntry& candidate) {
+		return candidate.name == innerPath;
+	});
+	if (entry == entries.end()) {
+		error = archivePath.u8string() + ": \"" + innerPath + "\" is no longer in the archive";
+		return false;
+	}
+
+	// Extracts the entry under its own name, so that it opens with the right program, into a directory of the
+	// private directory of the user named after the entry and the stamp of the archive. An entry extracted before
+	// is reused if it still checks out.
+	std::filesystem::path temporaryDirectory;
+	if (!TempFiles::directory(temporaryDirectory, error)) {
+		return false;
+	}
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)Hash::fnv1a(launchPath, source.stamp(archivePath)));
+	const std::filesystem::path directory = temporaryDirectory / "archives" / hex;
+	const size_t slash = innerPath.rfind('/');
+	const std::filesystem::path extractedPath = directory / std::filesystem::u8path(innerPath.substr((slash == std::string::npos) ? 0 : slash + 1));
+	bool isReused;
+	{
+		std::ifstream extracted(extractedPath, std::ios::binary);
+		isReused = extracted && TempFiles::isPrivate(extractedPath) && Archive::isExtracted(extracted, format, *entry);
+	}
+	if (!isReused) {
+		std::error_code errorCode;
+		std::filesystem::create_directories(directory, errorCode);
+		const std::filesystem::path partialPath = TempFiles::temporaryFor(extractedPath);
+		bool isExtracted = TempFiles::create(partialPath);
+		if (isExtracted) {
+			std::ofstream output(partialPath, std::ios::binary | std::ios::trunc);
+			isExtracted = output && Archive::extract(*file, format, *entry, output, error);
+		}
+		if (isExtracted) {
+			std::filesystem::rename(partialPath, extractedPath, errorCode);
+			if (errorCode) {
+				error = "Could not write \"" + extractedPath.u8string() + "\"";
+				isExtracted = false;
+			}
+		} else if (error.empty()) {
+			error = "Could not write \"" + partialPath.u8string() + "\"";
+		}
+		if (!isExtracted) {
+			std::filesystem::remove(partialPath, errorCode);
+			error = archivePath.u8string() + ": " + error;
+			return false;
+		}
+	}
+	launchPath = extractedPath.u8string();
+	return true;
+}
+
+size_t Engine::getLongestPathLength() const {
+	size_t longestRootLength = 0;
+	for (const std::string& rootDirectoryString : rootDirectoryStrings) {
+		longestRootLength = std::max(longestRootLength, rootDirectoryString.size());
+	}
+	return longestRootLength + relativePathStrings.getLongestPathLength();
+}
+
+void Engine::resetPicks() {
+	// Sets the distribution.
+	if (getPickableCount() != 0) {
+		distribution = std::uniform_int_distribution<size_t>(0, getPickableCount() - 1);
+	}
+	shuffleOrder.clear();
+	shufflePermutation.reset(0, 0);
+	isStratifiedPlaylist = false;
+	isOrderedPlaylist = false;
+	orderedPlaylist.clear();
+	shuffleIndex = 0;
+	if (history.isOpen()) {
+		history.buildQueue(isFiltered ? &pickablePositions : nullptr);
+	}
+}
+
+std::string Engine::buildScanSignature() const {
+	std::string signature;
+	for (const std::string& rootDirectoryString : rootDirectoryStrings) {
+		signature += "r" + rootDirectoryString + "\n";
+	}
+	signature += std::to_string(scanner.getDepth()) + (options.checkCaps ? "\ncaps" : "\nnocaps");
+	signature += "\ns" + std::to_string(options.shardIndex) + "/" + std::to_string(options.shardCount);
+	for (const std::filesystem::path& directory : scanner.getDirectoryBlacklist()) {
+		signature += "\nx" + directory.generic_u8string();
+	}
+	for (const std::string& extension : scanner.getExtensionWhitelist()) {
+		signature += "\ne" + extension;
+	}
+	if (options.oneFileSystem) {
+		signature += "\nonefs";
+	}
+	if (options.archives) {
+		signature += "\narchives";
+	}
+	for (const std::string& type : options.skippedFilesystemTypes) {
+		signature += "\nt" + type;
+	}
+	return signature;
+}
+
+void Engine::getTreeStamps(std::vector<SharedStamp>& stamps) const {
+	// Takes the stamps (e.g. last write times) of every root, every directory holding indexed files and every
+	// directory above them, and every indexed archive.
+	const DirectorySource& source = scanner.getSource();
+	std::unordered_set<std::string> directories;
+	std::string previousDirectory;
+	uint16_t previousRootId = UINT16_MAX;
+	stamps.clear();
+	const auto addStamp = [&](const uint16_t rootId, const std::string& directory) {
+		stamps.push_back(SharedStamp{ rootId, directory, source.stamp(std::filesystem::u8path(rootDirectoryStrings[rootId] + directory)) });
+	};
+	for (uint16_t rootId = 0; rootId < rootDirectoryStrings.size(); ++rootId) {
+		addStamp(rootId, "");
+	}
+	for (size_t i = 0; i < relativePathStrings.size(); ++i) {
+		const uint16_t rootId = relativePathStrings.root(i);
+		const std::string_view path = relativePathStrings[i];
+		const size_t separator = Archive::findSeparator(path);
+		const std::string_view outerPath = path.substr(0, separator);
+		const size_t nameStart = outerPath.rfind('/');
+		std::string directory((nameStart == std::string_view::npos) ? std::string_view() : outerPath.substr(0, nameStart));
+
+		// Files mostly follow the other files of their directory, which was already stamped.
+		if (rootId == previousRootId && directory == previousDirectory && separator == std::string_view::npos) {
+			continue;
+		}
+		previousRootId = rootId;
+		previousDirectory = directory;
+		if (separator != std::string_view::npos) {
+			const std::string archivePath(outerPath);
+			if (directories.insert(std::to_string(rootId) + '/' + archivePath).second) {
+				addStamp(rootId, archivePath);
+			}
+		}
+
+		// Stamps the directory and those above it, up to the first one already stamped.
+		while (!directory.empty() && directories.insert(std::to_string(rootId) + '/' + directory).second) {
+			addStamp(rootId, directory);
+			const size_t slash = directory.rfind('/');
+			directory.resize((slash == std::string::npos) ? 0 : slash);
+		}
+	}
+}
@@ -0,0 +1,456 @@
+// Engine.h : declarations for the headless scan, index and pick engine
+
+#pragma once
+
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <cstdint>     // fixed width integers
+#include <memory>      // unique_ptr
+#include <random>      // default_random_engine
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "Bitmap.h"
+#include "ContentCache.h"
+#include "ContentType.h"
+#include "DirectorySource.h"
+#include "Duplicates.h"
+#include "FilterIndex.h"
+#include "History.h"
+#include "IndexFile.h"
+#include "PathIndex.h"
+#include "PathList.h"
+#include "Permutation.h"
+#include "Scanner.h"
+#include "SharedIndex.h"
+#include "Snapshot.h"
+#include "SortedOrder.h"
+#include "Strata.h"
+#include "TrigramIndex.h"
+
+/**
+* Entry point of the rfopener core library. Scans one or more root directories into a single
+* index and picks entries from it, either at random or as a shuffled playlist.
+*
+* The engine performs no console I/O and never ends the process: every operation reports
+* its errors through its return value. Positions returned by picks refer to the index and
+* are turned into paths with `path()` or `buildAbsolutePath()`.
+*/
+class Engine {
+
+    private:
+        // Root directories, by root id.
+        std::vector<std::filesystem::path> rootDirectories;
+        std::vector<std::string> rootDirectoryStrings;
+
+        // Scanning.
+        Scanner scanner;
+        ScanOptions options;
+
+        // Path string index.
+        PathIndex relativePathStrings;
+
+        // Shared memory index, if enabled.
+        std::unique_ptr<SharedIndex> sharedIndex;
+
+        // Pick filters, if the filter index is enabled. Picks draw ranks within the matching positions.
+        bool isFilterIndexEnabled;
+        FilterIndex filterIndex;
+        std::vector<PickFilter> pickFilters;
+        Bitmap pickablePositions;
+        bool isFiltered;
+
+        // Strata, if picks are stratified, built over the pickable entries. Stratified playlists are computed on demand.
+        StratifyOptions stratifyOptions;
+        Strata strata;
+        bool isStratifiedPlaylist;
+        uint64_t playlistSeed;
+
+        // Substring match, if the trigram index is enabled.
+        bool isTrigramIndexEnabled;
+        TrigramIndex trigramIndex;
+        std::string matchQuery;
+        Bitmap matchPositions;
+
+        // Snapshot of the previous run and of this one, if enabled, and the entries that are new since then.
+        // Picks can be restricted to new entries, which counts as a filter.
+        std::string snapshotPath;
+        Snapshot previousSnapshot;
+        Snapshot currentSnapshot;
+        SnapshotDiff snapshotDiff;
+        Bitmap newPositions;
+        bool isNewOnly;
+
+        // Types picks are restricted to, if any, as bits shifted by their value, and the entries of those types.
+        // Types read from files are cached in the temporary directory across runs.
+        uint8_t typeMask;
+        Bitmap typePositions;
+        ContentCache typeCache;
+        std::filesystem::path typeCachePath;
+        std::string typeCacheError;
+        ScanStats typeStats;
+
+        // Whether copies of files are left out of picks, and the entries that are not copies of an earlier one.
+        // Samples and hashes read from files are cached in the temporary directory across runs.
+        bool isDeduplicated;
+        Bitmap distinctPositions;
+        ContentCache hashCache;
+        std::filesystem::path hashCachePath;
+        std::string hashCacheError;
+        ScanStats hashStats;
+
+        // Open history, if fair rotation is enabled. Random picks come from its queue.
+        History history;
+
+        // Sorted order, if playlists are ordered rather than shuffled, built over every entry. Filtered playlists
+        // keep the pickable positions in that order.
+        bool isOrdered;
+        SortedOrder::Key orderKey;
+        SortedOrder sortedOrder;
+        std::vector<uint32_t> orderedPlaylist;
+        bool isOrderedPlaylist;
+
+        // Shuffle order and index. Spilled indexes are shuffled with a permutation computed on demand instead.
+        std::vector<uint32_t> shuffleOrder;
+        Permutation shufflePermutation;
+        size_t shuffleIndex;
+
+        // Random.
+        std::default_random_engine randomEngine;
+        std::uniform_int_distribution<size_t> distribution;
+
+        /**
+        * @brief Builds a string identifying the root directory and the scan options.
+        */
+        std::string buildScanSignature() const;
+        /**
+        * @brief Takes the stamps used to detect changes in the root directories: those of the roots, the directories
+        * holding indexed files and every directory above them, and the indexed archives.
+        *
+        * @param stamps Receives the stamps.
+        */
+        void getTreeStamps(std::vector<SharedStamp>&) const;
+        /**
+        * @brief Scans every root directory, concurrently across devices, and merges the results into the index.
+        * Each device is read by a single worker, which scans its roots one after another and, if devices are split,
+        * the mounts of its device found below other roots.
+        *
+        * @param progress Optional progress callback.
+        */
+        ScanResult scanRoots(const ProgressCallback&);
+        /**
+        * @brief Creates a checkpoint journal for every root, in the temporary directory, if checkpoints are enabled.
+        *
+        * @return Journals by root id, or none.
+        */
+        std::vector<std::unique_ptr<ScanCheckpoint>> createCheckpoints() const;
+        /**
+        * @brief Reports how the checkpoints of a scan went, and removes them once the scan completed.
+        *
+        * @param checkpoints Journals by root id.
+        * @param result Result of the scan.
+        */
+        static void closeCheckpoints(std::vector<std::unique_ptr<ScanCheckpoint>>&, ScanResult&);
+        /**
+        * @brief Prepares picks after the index changed.
+        */
+        void resetPicks();
+        /**
+        * @brief Rebuilds the filter and trigram indexes after the index changed, if enabled, matches the query again,
+        * compares the index with the previous snapshot, tells the type of the files, finds copies, reconciles the history and sorts the entries.
+        *
+        * @param error Receives the description of the error, if any.
+        * @return If a spilled entry could not be read, returns `false`.
+        */
+        bool buildPickIndexes(std::string&);
+        /**
+        * @brief Computes the pickable positions from the pick filters, the match, the new entries, the types and the copies.
+        */
+        void applyFilters();
+        /**
+        * @brief Groups the pickable entries into strata, if picks are stratified.
+        *
+        * @param error Receives the description of the error, if any.
+        * @return If a spilled entry could not be read, returns `false` and picks are no longer stratified.
+        */
+        bool buildStrata(std::string&);
+        /**
+        * @param rank Rank among the pickable entries.
+        * @return Position of the entry in the index.
+        */
+        size_t positionOf(const size_t rank) const { return isFiltered ? pickablePositions.select(rank) : rank; }
+
+    public:
+        static const size_t MAX_ROOTS = 65535; // Maximum amount of root directories, as root ids are 16 bits wide
+
+        // == Constructor ==
+        Engine();
+
+        /**
+        * @brief Sets where directory trees are read from, which is the filesystem by default.
+        * Must be called before setting the roots and configuring.
+        *
+        * @param source Directory source, e.g. a `MemorySource` for tests and benchmarks.
+        */
+        void setSource(const std::shared_ptr<const DirectorySource>&);
+        /**
+        * @brief Sets a single root directory.
+        *
+        * @param unprocessedDirectoryPath Absolute or relative path to the root directory. If empty, the current path is used.
+        * @param error Receives the description of the error, if any.
+        * @return If the path could not be resolved, returns `false`.
+        */
+        bool setRoot(const std::string&, std::string&);
+        /**
+        * @brief Sets several root directories. Repeated roots are ignored, and roots may not contain each other.
+        *
+        * @param unprocessedDirectoryPaths Absolute or relative paths to the root directories. If empty, the current path is used.
+        * @param error Receives the description of the error, if any.
+        * @return If a path could not be resolved or roots overlap, returns `false`.
+        */
+        bool setRoots(const std::vector<std::string>&, std::string&);
+        /**
+        * @brief Validates and stores the scan options.
+        *
+        * @param scanOptions Scan options.
+        * @param error Receives the description of the error, if any.
+        * @return If the options could not be used, returns `false`.
+        */
+        bool configure(const ScanOptions&, std::string&);
+        /**
+        * @brief Sets the amount of memory the index may take before spilling to disk. Also set by `configure()`.
+        *
+        * @param budget Budget in bytes, or 0 for no limit.
+        */
+        void setMemoryBudget(const uint64_t);
+        /**
+        * @brief Fills the index by scanning the root directories, or by attaching to a shared index if enabled.
+        * Roots on different devices are scanned concurrently, one worker per device.
+        *
+        * @param progress Optional progress callback.
+        */
+        ScanResult scan(const ProgressCallback& = ProgressCallback());
+        /**
+        * @brief Fills the index from a list of paths instead of scanning, applying the same filters. See `Scanner::ingest()`.
+        *
+        * @param listPath Path to the list, or `PathList::STANDARD_INPUT`.
+        */
+        ScanResult readList(const std::string&);
+        /**
+        * @brief Fills the index from an index file instead of scanning. The root directories are taken from the file.
+        *
+        * @param path Path to the index file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be read, returns `false`.
+        */
+        bool loadIndex(const std::string&, std::string&);
+        /**
+        * @brief Writes the index into an index file, which is a shard if the scan was sharded.
+        *
+        * @param path Path to the index file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        bool writeIndex(const std::string&, std::string&) const;
+        /**
+        * @brief Indexes the extensions and top-level directories of the entries, so that picks can be
+        * filtered with `setFilters()` without rescanning. Must be called before filling the index.
+        */
+        void enableFilterIndex();
+        /**
+        * @brief Restricts picks to the entries that match every filter, and goes back to the first playlist entry.
+        * Requires `enableFilterIndex()`.
+        *
+        * @param filters Filters. If empty, every entry can be picked.
+        * @param error Receives the description of the error, if any.
+        * @return If a spilled entry could not be read while stratifying, returns `false`.
+        */
+        bool setFilters(const std::vector<PickFilter>&, std::string&);
+        /**
+        * @brief Spreads picks over directories rather than over files: random picks choose a directory first,
+        * and playlists go round robin over directories. Must be called before filling the index.
+        *
+        * @param stratify Grouping and weighting of the directories.
+        */
+        void stratify(const StratifyOptions&);
+        /**
+        * @brief Indexes the trigrams of the paths, so that picks can be restricted with `setMatch()` without
+        * comparing every path. Must be called before filling the index.
+        */
+        void enableTrigramIndex();
+        /**
+        * @brief Restricts picks to the entries whose relative path contains a text, ignoring ASCII case, on top
+        * of the filters, and goes back to the first playlist entry. Requires `enableTrigramIndex()`.
+        *
+        * @param query Text. If empty, the match is cleared.
+        * @param error Receives the description of the error, if any.
+        * @return If a spilled entry could not be read, returns `false` and clears the match.
+        */
+        bool setMatch(const std::string&, std::string&);
+        /**
+        * @brief Compares the index with a snapshot of the previous run whenever it is filled, so that new and
+        * changed entries are known. The snapshot is replaced by `writeSnapshot()`. Must be called before filling the index.
+        *
+        * @param path Path to the snapshot file. If it does not exist, every entry is new.
+        * @param error Receives the description of the error, if any.
+        * @return If the file exists but could not be read, returns `false`.
+        */
+        bool enableSnapshot(const std::string&, std::string&);
+        /**
+        * @brief Restricts picks to the entries added or changed since the previous snapshot, on top of the filters
+        * and the match. Requires `enableSnapshot()`. Must be called before filling the index.
+        */
+        void restrictToNew();
+        /**
+        * @brief Restricts picks to the files of the given types, told from their first bytes rather than their extension,
+        * on top of the rest of filters. Files are read once the index is filled, unless the type cache already knows them.
+        * Must be called before filling the index.
+        *
+        * @param kinds Types. If empty, files of any type can be picked.
+        */
+        void restrictToTypes(const std::vector<ContentType::Kind>&);
+        /**
+        * @brief Leaves out of picks every file with the same contents as an earlier entry, on top of the rest of filters.
+        * Files are compared once the index is filled, reading only those that share their size with another one and
+        * that the hash cache does not know yet. Must be called before filling the index.
+        */
+        void collapseDuplicates();
+        /**
+        * @brief Replaces the snapshot file with a snapshot of the index.
+        *
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        bool writeSnapshot(std::string&) const;
+        /**
+        * @brief Makes playlists go through the entries in order rather than shuffled. Must be called before filling the index.
+        *
+        * @param key Key to sort the entries by.
+        */
+        void setOrder(const SortedOrder::Key);
+        /**
+        * @brief Makes random picks rotate fairly: they come from the files opened the fewest rounds, as
+        * recorded by `recordOpen()` in a history file that persists across runs. Takes precedence over
+        * stratified random picks. Must be called before filling the index.
+        *
+        * @param path Path to the history file, which is created if it does not exist.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be opened or is not a history file, returns `false`.
+        */
+        bool enableHistory(const std::string&, std::string&);
+        /**
+        * @brief Records in the history that an entry was opened, if fair rotation is enabled.
+        *
+        * @param position Position of the entry.
+        * @param error Receives the description of the error, if any.
+        * @return If the history could not grow, returns `false`.
+        */
+        bool recordOpen(const size_t, std::string&);
+        /**
+        * @param position Position of an entry.
+        * @return History record of the entry, or `nullptr` if fair rotation is disabled.
+        */
+        const HistoryRecord* findHistory(const size_t) const;
+        /**
+        * @brief Reseeds the random engine, making picks reproducible.
+        *
+        * @param seed Seed.
+        */
+        void seed(const unsigned int);
+
+        /**
+        * @brief Picks a random entry.
+        *
+        * @param position Receives the position of the entry.
+        * @return If no entries can be picked, returns `false`.
+        */
+        bool pickRandom(size_t&);
+        /**
+        * @brief Shuffles the playlist, or sorts it if an order is set, and goes back to its first entry.
+        */
+        void shuffle();
+        /**
+        * @brief Picks the current playlist entry.
+        *
+        * @param position Receives the position of the entry.
+        * @return If no entries can be picked, returns `false`.
+        */
+        bool pickCurrent(size_t&) const;
+        /**
+        * @brief Moves to the following or previous playlist entry, looping at both ends, and picks it.
+        *
+        * @param backwards Whether to go backwards.
+        * @param position Receives the position of the entry.
+        * @return If no entries can be picked, returns `false`.
+        */
+        bool pickSequential(const bool, size_t&);
+
+        /**
+        * @brief Builds the absolute path of an entry.
+        *
+        * @param position Position of the entry.
+        * @param absolutePath Receives the path.
+        */
+        void buildAbsolutePath(const size_t, std::string&) const;
+        /**
+        * @brief Builds the path a picked entry is opened from: its absolute path or, for a file inside an archive,
+        * the path it is extracted to. Only that entry is extracted, into the temporary directory, where it is
+        * kept (and reused) until the archive changes.
+        *
+        * @param position Position of the entry.
+        * @param launchPath Receives the path.
+        * @param error Receives the description of the error, if any.
+        * @return If the entry could not be extracted, returns `false`.
+        */
+        bool buildLaunchPath(const size_t, std::string&, std::string&) const;
+        /**
+        * @return Length in bytes of the longest absolute path `buildAbsolutePath()` may build. Reserving it
+        * once keeps later picks from allocating.
+        */
+        size_t getLongestPathLength() const;
+
+        // @return Amount of indexed entries
+        size_t size() const { return relativePathStrings.size(); }
+        // @return Amount of entries that match the pick filters and the match
+        size_t getPickableCount() const { return isFiltered ? (size_t)pickablePositions.size() : relativePathStrings.size(); }
+        // @return Relative path of an entry
+        std::string_view path(const size_t position) const { return relativePathStrings[position]; }
+        // @return Position within the playlist
+        size_t getPlaylistIndex() const { return shuffleIndex; }
+        // @return Root directories as UTF8 strings ending in a separator, by root id
+        const std::vector<std::string>& getRootStrings() const { return rootDirectoryStrings; }
+        // @return Root directory of an entry as a UTF8 string ending in a separator
+        const std::string& getRootString(const size_t position) const { return rootDirectoryStrings[relativePathStrings.root(position)]; }
+        // @return Scanner, with the parsed options
+        const Scanner& getScanner() const { return scanner; }
+        // @return Index
+        const PathIndex& getIndex() const { return relativePathStrings; }
+        // @return Filter index, empty unless enabled
+        const FilterIndex& getFilterIndex() const { return filterIndex; }
+        // @return Strata of the pickable entries, empty unless picks are stratified
+        const Strata& getStrata() const { return strata; }
+        // @return Trigram index, empty unless enabled
+        const TrigramIndex& getTrigramIndex() const { return trigramIndex; }
+        // @return Differences between the index and the previous snapshot, empty unless enabled
+        const SnapshotDiff& getDiff() const { return snapshotDiff; }
+        // @return true if a previous snapshot was found
+        bool hasPreviousSnapshot() const { return !previousSnapshot.empty(); }
+        // @return Open history, closed unless fair rotation is enabled
+        const History& getHistory() const { return history; }
+        // @return Text paths must contain to be picked, or empty if any path can be
+        const std::string& getMatch() const { return matchQuery; }
+        // @return Amount of files whose type was read or found in the cache, and the time it took
+        const ScanStats& getTypeStats() const { return typeStats; }
+        // @return Why the type cache could not be written, if it could not
+        const std::string& getTypeCacheError() const { return typeCacheError; }
+        // @return Amount of files hashed, found in the cache and found to be copies, and the time it took
+        const ScanStats& getHashStats() const { return hashStats; }
+        // @return Why the hash cache could not be written, if it could not
+        const std::string& getHashCacheError() const { return hashCacheError; }
+};
+
+#endif
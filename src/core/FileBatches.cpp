@@ -0,0 +1,92 @@
+// FileBatches.cpp : descriptions for reading the files of an index on several threads
+
+#include "FileBatches.h"
+
+#include <algorithm>   // min, max
+#include <condition_variable> // condition variables
+#include <deque>       // queues
+#include <mutex>       // mutex
+#include <thread>      // thread
+
+unsigned FileBatches::threadCount(const size_t fileCount) {
+	const size_t batchCount = (fileCount + BATCH_SIZE - 1) / BATCH_SIZE;
+	const unsigned threads = std::min<unsigned>((unsigned)MAX_THREADS, std::max<unsigned>((unsigned)MIN_THREADS, std::thread::hardware_concurrency()));
+	return (unsigned)std::min<size_t>(threads, batchCount);
+}
+
+void FileBatches::run(const PathIndex& index, const std::vector<std::string>& rootStrings, const std::vector<uint32_t>* positions, const Visit& visit) {
+	const size_t fileCount = (positions != nullptr) ? positions->size() : index.size();
+	const unsigned threads = threadCount(fileCount);
+
+	struct Batch {
+		std::vector<uint32_t> positions;
+		std::vector<std::string> paths;
+	};
+	std::deque<Batch> queue;
+	std::mutex mutex;
+	std::condition_variable isQueued;
+	std::condition_variable isTaken;
+	bool isDone = false;
+
+	// Every thread visits the files of a batch and goes on with the next one.
+	const auto work = [&](const unsigned thread) {
+		for (;;) {
+			Batch batch;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				isQueued.wait(lock, [&]() { return !queue.empty() || isDone; });
+				if (queue.empty()) {
+					return;
+				}
+				batch = std::move(queue.front());
+				queue.pop_front();
+			}
+			isTaken.notify_one();
+			for (size_t i = 0; i < batch.paths.size(); ++i) {
+				visit(thread, batch.positions[i], batch.paths[i]);
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned thread = 0; thread < threads; ++thread) {
+		workers.emplace_back(work, thread);
+	}
+	const auto stopWorkers = [&]() {
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			isDone = true;
+		}
+		isQueued.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	};
+
+	// Queues a few batches per thread at most.
+	try {
+		for (size_t first = 0; first < fileCount; first += BATCH_SIZE) {
+			Batch batch;
+			const size_t last = std::min(fileCount, first + BATCH_SIZE);
+			batch.positions.resize(last - first);
+			batch.paths.resize(last - first);
+			for (size_t i = first; i < last; ++i) {
+				const uint32_t position = (positions != nullptr) ? (*positions)[i] : (uint32_t)i;
+				// The root is looked up first, as the view into a spilled entry only lasts until the following lookup.
+				std::string& path = batch.paths[i - first];
+				path.assign(rootStrings[index.root(position)]);
+				path.append(index[position]);
+				batch.positions[i - first] = position;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			isTaken.wait(lock, [&]() { return queue.size() < (size_t)threads * 4; });
+			queue.push_back(std::move(batch));
+			lock.unlock();
+			isQueued.notify_one();
+		}
+	}
+	catch (...) {
+		stopWorkers();
+		throw;
+	}
+	stopWorkers();
+}
@@ -0,0 +1,53 @@
+// FileBatches.h : declarations for reading the files of an index on several threads
+
+#pragma once
+
+#ifndef FILEBATCHES_H_
+#define FILEBATCHES_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <functional>  // function
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include "PathIndex.h"
+
+/**
+* Hands the absolute paths of the entries of an index to a pool of threads, a batch at a time, so that
+* files are read (or their status is) concurrently, which keeps several requests in flight on disks and
+* network shares that serve them in parallel.
+*
+* Paths are built on the calling thread, as lookups into the index are not thread-safe, and only a few
+* batches per thread are queued at once, so paths never pile up in memory while files are read.
+*/
+class FileBatches {
+
+    public:
+        static const size_t BATCH_SIZE = 256;  // Files handed to a thread at once
+        static const unsigned MIN_THREADS = 4; // Threads, at least, as they mostly wait for I/O
+        static const unsigned MAX_THREADS = 16; // Threads, at most
+
+        /**
+        * Called with every file: the thread it runs on (from 0 to `threadCount()` - 1), its position and its absolute path.
+        */
+        typedef std::function<void(const unsigned, const uint32_t, const std::string&)> Visit;
+
+        /**
+        * @param fileCount Amount of files to visit.
+        * @return Amount of threads that visit them.
+        */
+        static unsigned threadCount(const size_t);
+        /**
+        * @brief Visits entries of an index on several threads, and returns once every one was visited.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param positions Positions of the entries to visit, in increasing order, or `nullptr` to visit every entry.
+        * @param visit Function called with every entry.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        static void run(const PathIndex&, const std::vector<std::string>&, const std::vector<uint32_t>*, const Visit&);
+};
+
+#endif
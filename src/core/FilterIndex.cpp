@@ -0,0 +1,103 @@
+// FilterIndex.cpp : descriptions for the bitmaps that filter picks without rescanning
+
+#include "FilterIndex.h"
+#include "Scanner.h"
+
+#include <unordered_map> // directory ids
+
+void FilterIndex::build(const PathIndex& index) {
+	clear();
+
+	// Extensions are few, so they are looked up linearly. Directories may be many, but the entries of a
+	// top-level directory are contiguous after a scan, so the last one is checked first.
+	std::unordered_map<std::string, uint32_t> directoryIds;
+	uint32_t lastDirectoryId = 0;
+	for (size_t position = 0; position < index.size(); ++position) {
+		const std::string_view path = index[position];
+		const size_t nameStart = path.rfind('/') + 1; // 0 if there is no separator
+		const std::string_view extension = Scanner::extensionOf(path.substr(nameStart));
+		const size_t separator = path.find('/');
+		const std::string_view directory = (separator == std::string_view::npos) ? std::string_view() : path.substr(0, separator);
+
+		size_t extensionId = 0;
+		while (extensionId < extensions.size() && extensions[extensionId] != extension) {
+			++extensionId;
+		}
+		if (extensionId == extensions.size()) {
+			extensions.emplace_back(extension);
+			extensionBitmaps.emplace_back();
+		}
+		extensionBitmaps[extensionId].add((uint32_t)position);
+
+		if (directories.empty() || directories[lastDirectoryId] != directory) {
+			const std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> inserted =
+				directoryIds.emplace(std::string(directory), (uint32_t)directories.size());
+			if (inserted.second) {
+				directories.emplace_back(directory);
+				directoryBitmaps.emplace_back();
+			}
+			lastDirectoryId = inserted.first->second;
+		}
+		directoryBitmaps[lastDirectoryId].add((uint32_t)position);
+	}
+
+	for (Bitmap& bitmap : extensionBitmaps) {
+		bitmap.finish();
+	}
+	for (Bitmap& bitmap : directoryBitmaps) {
+		bitmap.finish();
+	}
+}
+
+void FilterIndex::clear() {
+	extensions.clear();
+	extensionBitmaps.clear();
+	directories.clear();
+	directoryBitmaps.clear();
+}
+
+void FilterIndex::uniteKeys(const std::vector<std::string>& keys, const std::vector<std::string>& names, const std::vector<Bitmap>& bitmaps, Bitmap& result) {
+	result.clear();
+	Bitmap united;
+	for (const std::string& key : keys) {
+		for (size_t i = 0; i < names.size(); ++i) {
+			if (names[i] == key) {
+				Bitmap::unite(result, bitmaps[i], united);
+				std::swap(result, united);
+			}
+		}
+	}
+}
+
+void FilterIndex::match(const PickFilter& filter, Bitmap& result) const {
+	// Every entry has exactly one extension, so uniting all of them matches everything.
+	std::vector<std::string> extensionKeys;
+	if (filter.extensions.empty()) {
+		extensionKeys = extensions;
+	} else {
+		for (const std::string& extension : filter.extensions) {
+			extensionKeys.push_back(extension.empty() ? extension : Scanner::EXTENSION_DOT + extension);
+		}
+	}
+	uniteKeys(extensionKeys, extensions, extensionBitmaps, result);
+	if (filter.directories.empty()) {
+		return;
+	}
+
+	Bitmap directoryMatches;
+	uniteKeys(filter.directories, directories, directoryBitmaps, directoryMatches);
+	Bitmap extensionMatches;
+	std::swap(result, extensionMatches);
+	Bitmap::intersect(extensionMatches, directoryMatches, result);
+}
+
+uint64_t FilterIndex::memoryBytes() const {
+	uint64_t bytes = 0;
+	for (const Bitmap& bitmap : extensionBitmaps) {
+		bytes += bitmap.memoryBytes();
+	}
+	for (const Bitmap& bitmap : directoryBitmaps) {
+		bytes += bitmap.memoryBytes();
+	}
+	return bytes;
+}
@@ -0,0 +1,80 @@
+// FilterIndex.h : declarations for the bitmaps that filter picks without rescanning
+
+#pragma once
+
+#ifndef FILTERINDEX_H_
+#define FILTERINDEX_H_
+
+#include <cstdint>     // fixed width integers
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "PathIndex.h"
+
+/**
+* Filter applied to picks. An entry matches if its extension is any of the listed ones and its
+* top-level directory is any of the listed ones. An empty list matches everything.
+*/
+struct PickFilter {
+    std::vector<std::string> extensions;  // Extensions without the dot. An empty string stands for no extension.
+    std::vector<std::string> directories; // Names of top-level directories, under any root.
+};
+
+/**
+* Bitmaps of the positions of an index, one per extension and one per top-level directory, so
+* that picks can be filtered by intersecting and uniting bitmaps instead of rescanning.
+*/
+class FilterIndex {
+
+    private:
+        // Extensions (including the dot, as in `Scanner::extensionOf()`) and their positions.
+        std::vector<std::string> extensions;
+        std::vector<Bitmap> extensionBitmaps;
+
+        // Top-level directories and their positions. Entries right under a root are kept under an empty name.
+        std::vector<std::string> directories;
+        std::vector<Bitmap> directoryBitmaps;
+
+        /**
+        * @brief Unites the bitmaps of the listed keys.
+        *
+        * @param keys Keys to look up.
+        * @param names Known keys.
+        * @param bitmaps Bitmaps of the known keys.
+        * @param result Receives the union.
+        */
+        static void uniteKeys(const std::vector<std::string>&, const std::vector<std::string>&, const std::vector<Bitmap>&, Bitmap&);
+
+    public:
+        /**
+        * @brief Builds the bitmaps of every entry of an index.
+        *
+        * @param index Index.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void build(const PathIndex&);
+        /**
+        * @brief Empties the bitmaps.
+        */
+        void clear();
+        /**
+        * @brief Finds the positions of the entries that match a filter.
+        *
+        * @param filter Filter.
+        * @param result Receives the positions.
+        */
+        void match(const PickFilter&, Bitmap&) const;
+
+        // @return true if no entries are indexed
+        bool empty() const { return extensions.empty(); }
+        // @return Indexed extensions, including the dot
+        const std::vector<std::string>& getExtensions() const { return extensions; }
+        // @return Indexed top-level directories
+        const std::vector<std::string>& getDirectories() const { return directories; }
+        // @return Memory taken by the bitmaps, in bytes
+        uint64_t memoryBytes() const;
+};
+
+#endif
@@ -0,0 +1,168 @@
+// Hash.h : stable, non-cryptographic hashes
+
+#pragma once
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <array>       // fixed size arrays
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <cstring>     // memcpy
+#include <string_view> // non-owning string views
+
+class Hash {
+    private:
+        static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+        static const uint64_t FNV_PRIME = 1099511628211ULL;
+    public:
+        /**
+        * @brief Computes the 64 bit FNV-1a hash of a string. The result is the same on every platform
+        * and in every run, so it may be stored or compared across machines.
+        *
+        * @param bytes String.
+        * @param hash Hash of the bytes that come before, to hash a string in parts. Defaults to the hash of nothing.
+        */
+        static uint64_t fnv1a(std::string_view bytes, uint64_t hash = FNV_OFFSET) {
+            for (const char c : bytes) {
+                hash = (hash ^ (unsigned char)c) * FNV_PRIME;
+            }
+            return hash;
+        }
+        /**
+        * @brief Computes the CRC-32 (as in zip, gzip and PNG) of a run of bytes, to check data rather than to hash it.
+        *
+        * @param bytes Bytes.
+        * @param size Amount of bytes.
+        * @param crc CRC of the bytes that come before, to check data in parts. Defaults to the CRC of nothing.
+        */
+        static uint32_t crc32(const void* bytes, const size_t size, uint32_t crc = 0) {
+            static const std::array<uint32_t, 256> TABLE = []() {
+                std::array<uint32_t, 256> table{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t value = i;
+                    for (int bit = 0; bit < 8; ++bit) {
+                        value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+                    }
+                    table[i] = value;
+                }
+                return table;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i) {
+                crc = TABLE[(crc ^ ((const unsigned char*)bytes)[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+};
+
+/**
+* 64 bit hash of bytes fed in parts, as XXH64 computes it: four independent lanes take 8 bytes each per
+* round, so the processor works on all of them at once and large files hash at several GB/s, far faster
+* than they are read. Words are read in the byte order of the processor, so hashes are only meant to be
+* compared on the machine that computed them.
+*/
+class StreamHash {
+
+    private:
+        static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+        static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+        static const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+        static const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+        static const uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+        static const size_t STRIPE_BYTES = 32;
+
+        uint64_t seed;
+        uint64_t lanes[4];
+        unsigned char pending[STRIPE_BYTES]; // Bytes fed after the last whole stripe.
+        size_t pendingSize;
+        uint64_t totalSize;
+
+        static uint64_t rotate(const uint64_t value, const int bits) { return (value << bits) | (value >> (64 - bits)); }
+        static uint64_t read64(const unsigned char* bytes) { uint64_t value; memcpy(&value, bytes, 8); return value; }
+        static uint64_t read32(const unsigned char* bytes) { uint32_t value; memcpy(&value, bytes, 4); return value; }
+        static uint64_t round(const uint64_t lane, const uint64_t input) { return rotate(lane + input * PRIME_2, 31) * PRIME_1; }
+        static uint64_t merge(const uint64_t hash, const uint64_t lane) { return (hash ^ round(0, lane)) * PRIME_1 + PRIME_4; }
+
+        void consume(const unsigned char* stripe) {
+            for (int i = 0; i < 4; ++i) {
+                lanes[i] = round(lanes[i], read64(stripe + i * 8));
+            }
+        }
+
+    public:
+        // == Constructor ==
+        /**
+        * @param seed Seed, which makes a different hash of the same bytes.
+        */
+        explicit StreamHash(const uint64_t seed = 0) : seed(seed) {
+            lanes[0] = seed + PRIME_1 + PRIME_2;
+            lanes[1] = seed + PRIME_2;
+            lanes[2] = seed;
+            lanes[3] = seed - PRIME_1;
+            pendingSize = 0;
+            totalSize = 0;
+        }
+
+        /**
+        * @brief Feeds bytes.
+        *
+        * @param bytes Bytes.
+        * @param size Amount of bytes.
+        */
+        void update(const void* bytes, size_t size) {
+            const unsigned char* input = (const unsigned char*)bytes;
+            totalSize += size;
+            if (pendingSize > 0) {
+                const size_t taken = (size < STRIPE_BYTES - pendingSize) ? size : STRIPE_BYTES - pendingSize;
+                memcpy(pending + pendingSize, input, taken);
+                pendingSize += taken;
+                input += taken;
+                size -= taken;
+                if (pendingSize < STRIPE_BYTES) {
+                    return;
+                }
+                consume(pending);
+                pendingSize = 0;
+            }
+            for (; size >= STRIPE_BYTES; input += STRIPE_BYTES, size -= STRIPE_BYTES) {
+                consume(input);
+            }
+            memcpy(pending, input, size);
+            pendingSize = size;
+        }
+        /**
+        * @return Hash of the bytes fed so far.
+        */
+        uint64_t digest() const {
+            uint64_t hash;
+            if (totalSize >= STRIPE_BYTES) {
+                hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+                for (int i = 0; i < 4; ++i) {
+                    hash = merge(hash, lanes[i]);
+                }
+            } else {
+                hash = seed + PRIME_5;
+            }
+            hash += totalSize;
+            size_t i = 0;
+            for (; i + 8 <= pendingSize; i += 8) {
+                hash = rotate(hash ^ round(0, read64(pending + i)), 27) * PRIME_1 + PRIME_4;
+            }
+            if (i + 4 <= pendingSize) {
+                hash = rotate(hash ^ (read32(pending + i) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+                i += 4;
+            }
+            for (; i < pendingSize; ++i) {
+                hash = rotate(hash ^ (pending[i] * PRIME_5), 11) * PRIME_1;
+            }
+            hash ^= hash >> 33;
+            hash *= PRIME_2;
+            hash ^= hash >> 29;
+            hash *= PRIME_3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+};
+
+#endif
@@ -0,0 +1,182 @@
+// History.cpp : descriptions for the persistent open history used by fair rotation
+
+#include "History.h"
+#include "Hash.h"
+
+#include <algorithm>   // min, max, sort, swap
+#include <chrono>      // system_clock
+
+History::History() {
+	baseRound = 0;
+	lowestRound = 0;
+}
+
+bool History::open(const std::string& path, std::string& error) {
+	return table.open(path, MAGIC, (uint32_t)sizeof(HistoryRecord), error);
+}
+
+uint64_t History::idOf(const std::string_view rootString, const std::string_view relativePath) {
+	const uint64_t id = Hash::fnv1a(relativePath, Hash::fnv1a(rootString));
+
+	// 0 marks empty slots of the table.
+	return (id == 0) ? 1 : id;
+}
+
+bool History::reconcile(const PathIndex& index, const std::vector<std::string>& rootStrings, std::string& error) {
+	rounds.assign(index.size(), (uint32_t)NOT_QUEUED);
+	order.clear();
+
+	// Records of files that were never opened and are no longer indexed (e.g. removed ones) would otherwise pile
+	// up, so they are dropped once the records outnumber twice the files indexed.
+	const bool isPruned = (table.size() > 2 * (uint64_t)index.size() + PRUNE_SLACK);
+	std::vector<uint64_t> ids;
+	if (isPruned) {
+		ids.reserve(index.size());
+	}
+
+	// Finds the files that were seen before, and the lowest round among them.
+	std::vector<size_t> newPositions;
+	std::vector<uint64_t> newIds;
+	uint32_t floorRound = NOT_QUEUED;
+	for (size_t i = 0; i < index.size(); ++i) {
+		// The root is looked up first, as the view into a spilled entry only lasts until the following lookup.
+		const std::string& rootString = rootStrings[index.root(i)];
+		const uint64_t id = idOf(rootString, index[i]);
+		if (isPruned) {
+			ids.push_back(id);
+		}
+		const HistoryRecord* record = table.find<HistoryRecord>(id);
+		if (record != nullptr) {
+			rounds[i] = record->round;
+			floorRound = std::min(floorRound, record->round);
+		} else {
+			newPositions.push_back(i);
+			newIds.push_back(id);
+		}
+	}
+	if (floorRound == NOT_QUEUED) {
+		floorRound = 0;
+	}
+	if (isPruned) {
+		std::sort(ids.begin(), ids.end());
+		const bool isRetained = table.retain([&ids](const void* data) {
+			const HistoryRecord* record = (const HistoryRecord*)data;
+			return record->openCount > 0 || std::binary_search(ids.begin(), ids.end(), record->fileId);
+		}, error);
+		if (!isRetained) {
+			rounds.clear();
+			return false;
+		}
+	}
+
+	// Adds the new files to the current rotation, so that they are recorded before any pick.
+	for (size_t i = 0; i < newPositions.size(); ++i) {
+		HistoryRecord* record = table.insert<HistoryRecord>(newIds[i], error);
+		if (record == nullptr) {
+			rounds.clear();
+			return false;
+		}
+		record->round = floorRound;
+		rounds[newPositions[i]] = floorRound;
+	}
+	return true;
+}
+
+void History::clear() {
+	rounds.clear();
+	order.clear();
+	places.clear();
+	roundStarts.clear();
+	baseRound = 0;
+	lowestRound = 0;
+}
+
+void History::buildQueue(const Bitmap* positions) {
+	order.clear();
+	places.assign(rounds.size(), (uint32_t)NOT_QUEUED);
+	roundStarts.clear();
+	baseRound = 0;
+	lowestRound = 0;
+	if (positions != nullptr) {
+		positions->forEach([&](const uint32_t position) {
+			if (position < rounds.size()) order.push_back(position);
+		});
+	} else {
+		order.resize(rounds.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = (uint32_t)i;
+		}
+	}
+	if (order.empty()) {
+		return;
+	}
+
+	// Counting sort by round.
+	baseRound = NOT_QUEUED;
+	uint32_t topRound = 0;
+	for (const uint32_t position : order) {
+		baseRound = std::min(baseRound, rounds[position]);
+		topRound = std::max(topRound, rounds[position]);
+	}
+	const size_t roundCount = (size_t)(topRound - baseRound) + 1;
+	roundStarts.reserve(roundCount + 64); // Leaves room for new rounds, so that opens do not allocate.
+	roundStarts.assign(roundCount + 1, 0);
+	for (const uint32_t position : order) {
+		++roundStarts[rounds[position] - baseRound + 1];
+	}
+	for (size_t k = 1; k <= roundCount; ++k) {
+		roundStarts[k] += roundStarts[k - 1];
+	}
+	std::vector<uint32_t> sorted(order.size());
+	std::vector<uint64_t> next(roundStarts.begin(), roundStarts.end() - 1);
+	for (const uint32_t position : order) {
+		const uint64_t place = next[rounds[position] - baseRound]++;
+		sorted[place] = position;
+		places[position] = (uint32_t)place;
+	}
+	order.swap(sorted);
+}
+
+size_t History::pick(std::default_random_engine& randomEngine) const {
+	const uint64_t start = roundStarts[lowestRound];
+	std::uniform_int_distribution<uint64_t> distribution(0, roundStarts[lowestRound + 1] - start - 1);
+	return order[(size_t)(start + distribution(randomEngine))];
+}
+
+bool History::recordOpen(const size_t position, const uint64_t fileId, std::string& error) {
+	if (position >= rounds.size()) {
+		return true;
+	}
+	HistoryRecord* record = table.insert<HistoryRecord>(fileId, error);
+	if (record == nullptr) {
+		return false;
+	}
+	record->lastOpened = (int64_t)std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+	++record->openCount;
+	record->round = rounds[position] + 1;
+
+	// Moves the file to the end of its round, and the end of its round back over it.
+	const uint32_t place = places[position];
+	if (place != NOT_QUEUED) {
+		const size_t k = rounds[position] - baseRound;
+		if (k + 2 == roundStarts.size()) {
+			roundStarts.push_back(order.size());
+		}
+		const uint64_t last = --roundStarts[k + 1];
+		const uint32_t other = order[(size_t)last];
+		std::swap(order[place], order[(size_t)last]);
+		places[other] = place;
+		places[position] = (uint32_t)last;
+		while (roundStarts[lowestRound] == roundStarts[lowestRound + 1]) {
+			++lowestRound;
+		}
+	}
+	rounds[position] = record->round;
+	return true;
+}
+
+const HistoryRecord* History::find(const uint64_t fileId) const {
+	return table.find<HistoryRecord>(fileId);
+}
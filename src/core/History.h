@@ -0,0 +1,129 @@
+// History.h : declarations for the persistent open history used by fair rotation
+
+#pragma once
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <random>      // default_random_engine
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "MappedTable.h"
+#include "PathIndex.h"
+
+/**
+* Record of the history table, keyed by the id of a file.
+*/
+struct HistoryRecord {
+    uint64_t fileId;
+    int64_t lastOpened; // Seconds since the epoch, or 0 if never opened.
+    uint32_t openCount;
+    uint32_t round;     // Rotation round the file is in, i.e. how many times it went through the rotation.
+};
+
+/**
+* Open history of the files, kept in a memory-mapped table so that it survives across runs, and
+* the rotation queue built from it. Files move to the following round whenever they are opened,
+* and picks come from the lowest round among the pickable files, so every file is opened once
+* before any is opened twice.
+*
+* The queue keeps the pickable positions sorted by round, with the start of every round, so that
+* picks and opens take constant time: an opened file swaps places with the last file of its round,
+* whose end then moves back by one.
+*/
+class History {
+
+    private:
+        static const uint64_t MAGIC = 0x3154534948464F52ULL; // "RFOHIST1"
+        static const uint32_t NOT_QUEUED = UINT32_MAX;
+        static const uint64_t PRUNE_SLACK = 1024; // Records allowed past twice the indexed files before pruning
+
+        MappedTable table;
+
+        // Round of every entry of the index, by position.
+        std::vector<uint32_t> rounds;
+
+        // Queue: pickable positions sorted by round, where the positions in round `baseRound + k` are
+        // `[roundStarts[k], roundStarts[k + 1])`, and the place of every position within it.
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> places;
+        std::vector<uint64_t> roundStarts;
+        uint32_t baseRound;
+        size_t lowestRound; // Lowest round with positions, relative to `baseRound`.
+
+    public:
+        // == Constructor ==
+        History();
+
+        /**
+        * @brief Opens a history file, creating it if it does not exist.
+        *
+        * @param path Path to the file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be mapped or is not a history file, returns `false`.
+        */
+        bool open(const std::string&, std::string&);
+        /**
+        * @brief Matches the entries of an index against the history. Files without a record are added to
+        * the lowest round among the files that have one, so that they join the current rotation. Records
+        * of files never opened and no longer indexed are dropped once they pile up.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param error Receives the description of the error, if any.
+        * @return If the table could not grow or be pruned, returns `false`.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        bool reconcile(const PathIndex&, const std::vector<std::string>&, std::string&);
+        /**
+        * @brief Forgets the rounds of the index and empties the queue, keeping the table open.
+        */
+        void clear();
+        /**
+        * @brief Builds the rotation queue.
+        *
+        * @param positions Pickable positions, or `nullptr` if every entry can be picked.
+        */
+        void buildQueue(const Bitmap*);
+        /**
+        * @brief Picks a random file among the ones in the lowest round. The queue must not be empty.
+        *
+        * @param randomEngine Random engine.
+        * @return Position of the file.
+        */
+        size_t pick(std::default_random_engine&) const;
+        /**
+        * @brief Records that a file was opened, and moves it to the following round.
+        *
+        * @param position Position of the file.
+        * @param fileId Id of the file.
+        * @param error Receives the description of the error, if any.
+        * @return If the table could not grow, returns `false`.
+        */
+        bool recordOpen(const size_t, const uint64_t, std::string&);
+        /**
+        * @param fileId Id of a file.
+        * @return Record of the file, or `nullptr` if there is none.
+        */
+        const HistoryRecord* find(const uint64_t) const;
+        /**
+        * @param rootString Root directory of a file.
+        * @param relativePath Path of the file relative to the root directory.
+        * @return Id of the file, which only depends on its path and stays the same across runs. Never 0.
+        */
+        static uint64_t idOf(std::string_view, std::string_view);
+
+        // @return true if a history file is open
+        bool isOpen() const { return table.isOpen(); }
+        // @return true if the queue has positions to pick
+        bool isQueued() const { return !order.empty(); }
+        // @return Amount of records
+        uint64_t size() const { return table.size(); }
+};
+
+#endif
@@ -0,0 +1,473 @@
+// IndexFile.cpp : descriptions for index files, shards and their merging
+
+#include "IndexFile.h"
+#include "Hash.h"
+#include "SpillFile.h"
+#include "TempFiles.h"
+
+#include <algorithm>   // find, sort
+#include <memory>      // unique_ptr
+#include <queue>       // priority_queue
+
+// == Little-endian encoding ==
+
+static void writeInteger(std::ostream& stream, uint64_t value, const int bytes) {
+	char buffer[8];
+	for (int i = 0; i < bytes; ++i) {
+		buffer[i] = (char)(value & 0xFF);
+		value >>= 8;
+	}
+	stream.write(buffer, bytes);
+}
+
+static bool readInteger(std::istream& stream, uint64_t& value, const int bytes) {
+	unsigned char buffer[8];
+	if (!stream.read((char*)buffer, bytes)) {
+		return false;
+	}
+	value = 0;
+	for (int i = bytes - 1; i >= 0; --i) {
+		value = (value << 8) | buffer[i];
+	}
+	return true;
+}
+
+/**
+* @return Whether an entry sorts strictly after another one.
+*/
+static bool isAfter(const uint16_t rootId, std::string_view path, const uint16_t previousRoot, std::string_view previousPath) {
+	return (rootId != previousRoot) ? (rootId > previousRoot) : (path.compare(previousPath) > 0);
+}
+
+
+
+IndexFileReader::IndexFileReader() {
+	remaining = 0;
+	hasPrevious = false;
+	previousRoot = 0;
+}
+
+bool IndexFileReader::open(const std::string& path) {
+	stream.open(std::filesystem::u8path(path), std::ios::binary);
+	if (!stream) {
+		error = "Could not open index file \"" + path + "\"";
+		return false;
+	}
+
+	uint64_t magic, version, shardIndex, shardCount, rootCount;
+	if (
+		!readInteger(stream, magic, 8) ||
+		!readInteger(stream, version, 4) ||
+		(magic != IndexFile::MAGIC) ||
+		(version != IndexFile::VERSION)
+	) {
+		error = "\"" + path + "\" is not an index file";
+		return false;
+	}
+	if (
+		!readInteger(stream, shardIndex, 4) ||
+		!readInteger(stream, shardCount, 4) ||
+		!readInteger(stream, rootCount, 4) ||
+		(shardCount == 0) ||
+		(shardIndex >= shardCount) ||
+		(rootCount == 0) ||
+		(rootCount > 65535)
+	) {
+		error = "Index file \"" + path + "\" has a corrupt header";
+		return false;
+	}
+	header.shardIndex = (uint32_t)shardIndex;
+	header.shardCount = (uint32_t)shardCount;
+
+	header.roots.clear();
+	for (uint64_t i = 0; i < rootCount; ++i) {
+		uint64_t length;
+		if (!readInteger(stream, length, 4) || length > IndexFile::MAX_PATH_BYTES) {
+			error = "Index file \"" + path + "\" has a corrupt header";
+			return false;
+		}
+		std::string root((size_t)length, '\0');
+		if (!stream.read(&root[0], (std::streamsize)length)) {
+			error = "Index file \"" + path + "\" has a corrupt header";
+			return false;
+		}
+		header.roots.push_back(root);
+	}
+
+	if (!readInteger(stream, header.entryCount, 8)) {
+		error = "Index file \"" + path + "\" has a corrupt header";
+		return false;
+	}
+	remaining = header.entryCount;
+	return true;
+}
+
+bool IndexFileReader::next(uint16_t& rootId, std::string& path) {
+	if (remaining == 0) {
+		return false;
+	}
+
+	uint64_t root, length;
+	if (
+		!readInteger(stream, root, 2) ||
+		!readInteger(stream, length, 4) ||
+		(root >= header.roots.size()) ||
+		(length > IndexFile::MAX_PATH_BYTES)
+	) {
+		error = "Index file is truncated or corrupt";
+		remaining = 0;
+		return false;
+	}
+	path.resize((size_t)length);
+	if (length > 0 && !stream.read(&path[0], (std::streamsize)length)) {
+		error = "Index file is truncated";
+		remaining = 0;
+		return false;
+	}
+	rootId = (uint16_t)root;
+
+	// Merging relies on the order, so it is verified rather than assumed.
+	if (hasPrevious && !isAfter(rootId, path, previousRoot, previousPath)) {
+		error = "Index file is not sorted";
+		remaining = 0;
+		return false;
+	}
+	hasPrevious = true;
+	previousRoot = rootId;
+	previousPath = path;
+
+	--remaining;
+	return true;
+}
+
+
+
+IndexFileWriter::IndexFileWriter() {
+	entryCount = 0;
+	rootCount = 0;
+	hasPrevious = false;
+	previousRoot = 0;
+}
+
+IndexFileWriter::~IndexFileWriter() {
+	// A file that was never completed leaves the previous one in place.
+	if (stream.is_open()) {
+		stream.close();
+		std::error_code errorCode;
+		std::filesystem::remove(temporaryPath, errorCode);
+	}
+}
+
+bool IndexFileWriter::open(const std::string& path, const IndexFileHeader& header) {
+	// Writes a temporary file, renamed over the index file once complete, so that the index file may also be
+	// one being read (e.g. an input of a merge).
+	filePath = std::filesystem::u8path(path);
+	temporaryPath = TempFiles::temporaryFor(filePath);
+	stream.open(temporaryPath, std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		error = "Could not create index file \"" + path + "\"";
+		return false;
+	}
+
+	writeInteger(stream, IndexFile::MAGIC, 8);
+	writeInteger(stream, IndexFile::VERSION, 4);
+	writeInteger(stream, header.shardIndex, 4);
+	writeInteger(stream, header.shardCount, 4);
+	writeInteger(stream, header.roots.size(), 4);
+	for (const std::string& root : header.roots) {
+		writeInteger(stream, root.size(), 4);
+		stream.write(root.data(), (std::streamsize)root.size());
+	}
+	countPosition = stream.tellp();
+	writeInteger(stream, 0, 8);
+
+	rootCount = (uint32_t)header.roots.size();
+	entryCount = 0;
+	if (!stream) {
+		error = "Could not write index file \"" + path + "\"";
+		return false;
+	}
+	return true;
+}
+
+bool IndexFileWriter::write(const uint16_t rootId, std::string_view path) {
+	if (rootId >= rootCount) {
+		error = "Entry refers to an unknown root";
+		return false;
+	}
+	if (hasPrevious && !isAfter(rootId, path, previousRoot, previousPath)) {
+		error = "Entries are not sorted";
+		return false;
+	}
+	hasPrevious = true;
+	previousRoot = rootId;
+	previousPath.assign(path.data(), path.size());
+
+	writeInteger(stream, rootId, 2);
+	writeInteger(stream, path.size(), 4);
+	stream.write(path.data(), (std::streamsize)path.size());
+	++entryCount;
+	return true;
+}
+
+bool IndexFileWriter::close() {
+	// Fills in the entry count, now that it is known.
+	stream.seekp(countPosition);
+	writeInteger(stream, entryCount, 8);
+	stream.close();
+	std::error_code errorCode;
+	if (stream.fail()) {
+		error = "Could not write index file \"" + filePath.u8string() + "\"";
+		std::filesystem::remove(temporaryPath, errorCode);
+		return false;
+	}
+	std::filesystem::rename(temporaryPath, filePath, errorCode);
+	if (errorCode) {
+		error = "Could not replace index file \"" + filePath.u8string() + "\": " + errorCode.message();
+		std::filesystem::remove(temporaryPath, errorCode);
+		return false;
+	}
+	return true;
+}
+
+
+
+bool IndexFile::write(const std::string& path, const PathIndex& index, const IndexFileHeader& header, std::string& error) {
+	// Sorts the positions of the entries held in memory rather than the paths themselves.
+	const size_t spilledCount = index.spilledSize();
+	std::vector<uint32_t> order(index.size() - spilledCount);
+	for (size_t i = 0; i < order.size(); ++i) {
+		order[i] = (uint32_t)i;
+	}
+	std::sort(order.begin(), order.end(), [&index, spilledCount](const uint32_t a, const uint32_t b) {
+		return isAfter(index.root(spilledCount + b), index[spilledCount + b], index.root(spilledCount + a), index[spilledCount + a]);
+	});
+
+	// Every spilled chunk is already sorted, and so are the entries held in memory now.
+	struct Run {
+		uint64_t next;
+		uint64_t end;
+		bool isMemory;
+	};
+	std::vector<Run> runs;
+	const SpillFile* spill = index.getSpill();
+	for (size_t chunk = 0; spill != nullptr && chunk < spill->getChunkCount(); ++chunk) {
+		runs.push_back(Run{ spill->chunkBegin(chunk), spill->chunkEnd(chunk), false });
+	}
+	runs.push_back(Run{ 0, order.size(), true });
+
+	// Copies the head of every run, as views into spilled entries do not outlive the following lookup.
+	struct Head {
+		uint16_t rootId;
+		std::string path;
+	};
+	std::vector<Head> heads(runs.size());
+	const auto readHead = [&index, &order, &runs, &heads, spilledCount](const size_t run) {
+		const size_t position = runs[run].isMemory ? spilledCount + order[(size_t)runs[run].next] : (size_t)runs[run].next;
+		heads[run].rootId = index.root(position);
+		heads[run].path.assign(index[position]);
+		++runs[run].next;
+	};
+
+	IndexFileWriter writer;
+	if (!writer.open(path, header)) {
+		error = writer.getError();
+		return false;
+	}
+
+	// Merges the runs, writing repeated entries once.
+	const auto isGreater = [&heads](const size_t a, const size_t b) {
+		return isAfter(heads[a].rootId, heads[a].path, heads[b].rootId, heads[b].path);
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(isGreater)> queue(isGreater);
+	try {
+		for (size_t run = 0; run < runs.size(); ++run) {
+			if (runs[run].next < runs[run].end) {
+				readHead(run);
+				queue.push(run);
+			}
+		}
+
+		bool hasWritten = false;
+		uint16_t lastRoot = 0;
+		std::string lastPath;
+		while (!queue.empty()) {
+			const size_t smallest = queue.top();
+			queue.pop();
+			const Head& head = heads[smallest];
+
+			if (!hasWritten || head.rootId != lastRoot || head.path != lastPath) {
+				if (!writer.write(head.rootId, head.path)) {
+					error = writer.getError();
+					return false;
+				}
+				hasWritten = true;
+				lastRoot = head.rootId;
+				lastPath = head.path;
+			}
+
+			if (runs[smallest].next < runs[smallest].end) {
+				readHead(smallest);
+				queue.push(smallest);
+			}
+		}
+	}
+	catch (const std::exception& ex) {
+		error = ex.what();
+		return false;
+	}
+
+	if (!writer.close()) {
+		error = writer.getError();
+		return false;
+	}
+	return true;
+}
+
+bool IndexFile::read(const std::string& path, PathIndex& index, IndexFileHeader& header, std::string& error) {
+	index.clear();
+
+	IndexFileReader reader;
+	if (!reader.open(path)) {
+		error = reader.getError();
+		return false;
+	}
+	header = reader.getHeader();
+
+	uint16_t rootId;
+	std::string relativePath;
+	try {
+		while (reader.next(rootId, relativePath)) {
+			index.add(relativePath, rootId);
+		}
+	}
+	catch (const std::exception& ex) {
+		error = ex.what();
+		return false;
+	}
+	if (!reader.getError().empty()) {
+		error = reader.getError();
+		return false;
+	}
+	return true;
+}
+
+bool IndexFile::merge(const std::vector<std::string>& inputs, const std::string& output, uint64_t& entryCount, std::string& error) {
+	if (inputs.empty()) {
+		error = "No index files to merge";
+		return false;
+	}
+
+	// Opens every input and reads its first entry. Inputs must be the shards of a single tree, each given once.
+	struct Head {
+		uint16_t rootId;
+		std::string path;
+		size_t input;
+	};
+	std::vector<std::unique_ptr<IndexFileReader>> readers;
+	std::vector<Head> heads;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		readers.push_back(std::make_unique<IndexFileReader>());
+		IndexFileReader& reader = *readers.back();
+		if (!reader.open(inputs[i])) {
+			error = reader.getError();
+			return false;
+		}
+		const IndexFileHeader& first = readers[0]->getHeader();
+		if (reader.getHeader().roots != first.roots) {
+			error = "\"" + inputs[i] + "\" was scanned from other root directories than \"" + inputs[0] + "\"";
+			return false;
+		}
+		if (reader.getHeader().shardCount != first.shardCount) {
+			error = "\"" + inputs[i] + "\" was split into another amount of shards than \"" + inputs[0] + "\"";
+			return false;
+		}
+		for (size_t j = 0; j < i; ++j) {
+			if (readers[j]->getHeader().shardIndex == reader.getHeader().shardIndex) {
+				error = "\"" + inputs[i] + "\" holds the same shard (" + std::to_string(reader.getHeader().shardIndex + 1) + "/"
+					+ std::to_string(first.shardCount) + ") as \"" + inputs[j] + "\"";
+				return false;
+			}
+		}
+		Head head;
+		head.input = i;
+		if (reader.next(head.rootId, head.path)) {
+			heads.push_back(head);
+		} else if (!reader.getError().empty()) {
+			error = "\"" + inputs[i] + "\": " + reader.getError();
+			return false;
+		}
+	}
+
+	// Shards are given once each, so as many inputs as shards means none is missing.
+	const uint32_t shardCount = readers[0]->getHeader().shardCount;
+	if (inputs.size() != shardCount) {
+		std::vector<bool> isGiven(shardCount, false);
+		for (const std::unique_ptr<IndexFileReader>& reader : readers) {
+			isGiven[reader->getHeader().shardIndex] = true;
+		}
+		const size_t missing = (size_t)(std::find(isGiven.begin(), isGiven.end(), false) - isGiven.begin());
+		error = "Shard " + std::to_string(missing + 1) + "/" + std::to_string(shardCount) + " is missing";
+		if (inputs.size() + 1 < shardCount) {
+			error += ", along with " + std::to_string(shardCount - inputs.size() - 1) + " more";
+		}
+		return false;
+	}
+
+	IndexFileHeader header;
+	header.roots = readers[0]->getHeader().roots;
+	IndexFileWriter writer;
+	if (!writer.open(output, header)) {
+		error = writer.getError();
+		return false;
+	}
+
+	// Repeatedly writes the smallest head and replaces it with the following entry of the same input.
+	const auto isGreater = [&heads](const size_t a, const size_t b) {
+		return isAfter(heads[a].rootId, heads[a].path, heads[b].rootId, heads[b].path);
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(isGreater)> queue(isGreater);
+	for (size_t i = 0; i < heads.size(); ++i) {
+		queue.push(i);
+	}
+
+	bool hasWritten = false;
+	uint16_t lastRoot = 0;
+	std::string lastPath;
+	while (!queue.empty()) {
+		const size_t smallest = queue.top();
+		queue.pop();
+		Head& head = heads[smallest];
+
+		if (!hasWritten || head.rootId != lastRoot || head.path != lastPath) {
+			if (!writer.write(head.rootId, head.path)) {
+				error = writer.getError();
+				return false;
+			}
+			hasWritten = true;
+			lastRoot = head.rootId;
+			lastPath = head.path;
+		}
+
+		IndexFileReader& reader = *readers[head.input];
+		if (reader.next(head.rootId, head.path)) {
+			queue.push(smallest);
+		} else if (!reader.getError().empty()) {
+			error = "\"" + inputs[head.input] + "\": " + reader.getError();
+			return false;
+		}
+	}
+
+	// Inputs are closed first, as the merged file may replace one of them.
+	readers.clear();
+	if (!writer.close()) {
+		error = writer.getError();
+		return false;
+	}
+	entryCount = writer.getEntryCount();
+	return true;
+}
+
+bool IndexFile::isInShard(std::string_view name, const uint32_t shardIndex, const uint32_t shardCount) {
+	return (Hash::fnv1a(name) % shardCount) == shardIndex;
+}
@@ -0,0 +1,180 @@
+// IndexFile.h : declarations for index files, shards and their merging
+
+#pragma once
+
+#ifndef INDEXFILE_H_
+#define INDEXFILE_H_
+
+#include <cstdint>     // fixed width integers
+#include <fstream>     // file streams
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "PathIndex.h"
+
+/**
+* Header of an index file.
+*
+* An index file stores the root directories followed by entries sorted by root id and then by
+* path bytes, which allows merging several files in a single streaming pass. Integers are
+* stored in little-endian byte order, so files can be exchanged between machines.
+*/
+struct IndexFileHeader {
+    std::vector<std::string> roots; // Root directories as UTF8 strings ending in a separator, by root id.
+    uint32_t shardIndex = 0;        // Shard the file holds (0-based).
+    uint32_t shardCount = 1;        // Amount of shards the tree was split into.
+    uint64_t entryCount = 0;        // Amount of entries.
+};
+
+/**
+* Reads the entries of an index file one at a time.
+*/
+class IndexFileReader {
+
+    private:
+        std::ifstream stream;
+        IndexFileHeader header;
+        uint64_t remaining;
+        std::string error;
+
+        // Last entry read, to verify the order.
+        bool hasPrevious;
+        uint16_t previousRoot;
+        std::string previousPath;
+
+    public:
+        // == Constructor ==
+        IndexFileReader();
+
+        /**
+        * @brief Opens an index file and reads its header.
+        *
+        * @param path Path to the index file.
+        * @return If the file could not be read, returns `false`.
+        */
+        bool open(const std::string&);
+        /**
+        * @brief Reads the next entry.
+        *
+        * @param rootId Receives the root id of the entry.
+        * @param path Receives the relative path of the entry.
+        * @return At the end of the file or on error (see `getError()`), returns `false`.
+        */
+        bool next(uint16_t&, std::string&);
+
+        // @return Header of the file
+        const IndexFileHeader& getHeader() const { return header; }
+        // @return Description of the last error, or an empty string
+        const std::string& getError() const { return error; }
+};
+
+/**
+* Writes sorted entries into an index file one at a time. Entries go into a temporary file, which only replaces
+* the index file once it is complete.
+*/
+class IndexFileWriter {
+
+    private:
+        std::filesystem::path filePath;
+        std::filesystem::path temporaryPath;
+        std::ofstream stream;
+        std::streampos countPosition;
+        uint64_t entryCount;
+        uint32_t rootCount;
+        std::string error;
+
+        // Last entry written, to enforce the order.
+        bool hasPrevious;
+        uint16_t previousRoot;
+        std::string previousPath;
+
+    public:
+        // == Constructor ==
+        IndexFileWriter();
+        // == Destructor ==
+        ~IndexFileWriter();
+
+        /**
+        * @brief Creates an index file and writes its header. The entry count is filled in by `close()`.
+        *
+        * @param path Path to the index file.
+        * @param header Header to write.
+        * @return If the file could not be written, returns `false`.
+        */
+        bool open(const std::string&, const IndexFileHeader&);
+        /**
+        * @brief Writes an entry. Entries must be written sorted by root id and path bytes.
+        *
+        * @param rootId Root id of the entry.
+        * @param path Relative path of the entry.
+        * @return If the entry is out of order or could not be written, returns `false`.
+        */
+        bool write(const uint16_t, std::string_view);
+        /**
+        * @brief Completes the header, closes the file and puts it in place of the index file.
+        *
+        * @return If the file could not be written, returns `false`.
+        */
+        bool close();
+
+        // @return Amount of entries written so far
+        uint64_t getEntryCount() const { return entryCount; }
+        // @return Description of the last error, or an empty string
+        const std::string& getError() const { return error; }
+};
+
+class IndexFile {
+
+    public:
+        static const uint64_t MAGIC = 0x31454c49464f4652; // "RFOFILE1"
+        static const uint32_t VERSION = 1;
+        static const uint32_t MAX_PATH_BYTES = 1 << 20;    // Longer paths are considered corrupt
+
+        /**
+        * @brief Writes an index into an index file, sorting its entries. Chunks spilled by the index are
+        * merged with the entries held in memory in a single streaming pass.
+        *
+        * @param path Path to the index file.
+        * @param index Index to write.
+        * @param header Header to write. Its entry count is ignored.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        static bool write(const std::string&, const PathIndex&, const IndexFileHeader&, std::string&);
+        /**
+        * @brief Reads an index file into an index.
+        *
+        * @param path Path to the index file.
+        * @param index Index that will receive the entries. It is cleared first, and spills according to its memory budget.
+        * @param header Receives the header of the file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be read, returns `false`.
+        */
+        static bool read(const std::string&, PathIndex&, IndexFileHeader&, std::string&);
+        /**
+        * @brief Merges several index files (typically the shards of a tree) into a single one with a streaming
+        * k-way merge, holding one entry per input in memory. Repeated entries are written once.
+        *
+        * @param inputs Paths to the index files to merge. They must have been scanned from the same roots, and
+        * hold every shard of them once.
+        * @param output Path to the merged index file. It may be one of the inputs.
+        * @param entryCount Receives the amount of merged entries.
+        * @param error Receives the description of the error, if any.
+        * @return If a file could not be read or written, or the inputs are not the shards of a single tree, returns
+        * `false`.
+        */
+        static bool merge(const std::vector<std::string>&, const std::string&, uint64_t&, std::string&);
+        /**
+        * @brief Determines whether a top-level entry belongs to a shard, by a stable hash of its name.
+        *
+        * @param name Name of the top-level entry, in UTF8 format.
+        * @param shardIndex Shard (0-based).
+        * @param shardCount Amount of shards.
+        */
+        static bool isInShard(std::string_view, const uint32_t, const uint32_t);
+};
+
+#endif
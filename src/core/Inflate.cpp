@@ -0,0 +1,315 @@
+// Inflate.cpp : descriptions for decompressing deflate streams
+
+#include "Inflate.h"
+
+#include <algorithm>   // min
+#include <cstdint>     // fixed width integers
+#include <cstring>     // memmove
+#include <utility>     // pair
+#include <vector>      // dynamic containers
+
+static const int MAX_BITS = 15;          // Longest code
+static const int MAX_LENGTH_CODES = 286; // Literal and length codes, including the two that are never used
+static const int MAX_DISTANCE_CODES = 30;
+static const int FIXED_LENGTH_CODES = 288;
+
+// Bases and extra bits of length codes 257 to 285, and of distance codes 0 to 29.
+static const uint16_t LENGTH_BASES[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DISTANCE_BASES[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DISTANCE_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order in which the lengths of the code length codes are stored.
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+/**
+* Canonical Huffman code, as the amount of codes of every length and the symbols in code order.
+*/
+struct Huffman {
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[FIXED_LENGTH_CODES];
+
+    /**
+    * @brief Builds the code from the length of the code of every symbol.
+    *
+    * @return false if the lengths describe more codes than there are. Incomplete codes are allowed.
+    */
+    bool build(const uint8_t* lengths, const int symbolCount) {
+        for (int length = 0; length <= MAX_BITS; ++length) {
+            count[length] = 0;
+        }
+        for (int i = 0; i < symbolCount; ++i) {
+            ++count[lengths[i]];
+        }
+        int left = 1;
+        for (int length = 1; length <= MAX_BITS; ++length) {
+            left = (left << 1) - count[length];
+            if (left < 0) {
+                return false;
+            }
+        }
+        uint16_t offsets[MAX_BITS + 1];
+        offsets[1] = 0;
+        for (int length = 1; length < MAX_BITS; ++length) {
+            offsets[length + 1] = offsets[length] + count[length];
+        }
+        for (int i = 0; i < symbolCount; ++i) {
+            if (lengths[i] != 0) {
+                symbol[offsets[lengths[i]]++] = (uint16_t)i;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+* Thrown, and caught by `Inflate::run()`, when the stream can not be decompressed.
+*/
+struct InflateError {
+    const char* message;
+};
+
+/**
+* State of a decompression.
+*/
+class Inflater {
+
+    private:
+        const Inflate::Reader& reader;
+        const Inflate::Writer& writer;
+
+        std::vector<unsigned char> input;
+        size_t inputPosition;
+        size_t inputSize;
+        uint32_t bitBuffer;
+        int bitCount;
+
+        // Output not written yet, preceded by the window it may refer back to.
+        std::vector<unsigned char> output;
+        size_t windowSize;
+
+    public:
+        Inflater(const Inflate::Reader& reader, const Inflate::Writer& writer) : reader(reader), writer(writer) {
+            input.resize(Inflate::CHUNK_BYTES);
+            inputPosition = 0;
+            inputSize = 0;
+            bitBuffer = 0;
+            bitCount = 0;
+            output.reserve(Inflate::WINDOW_BYTES + Inflate::CHUNK_BYTES + 258);
+            windowSize = 0;
+        }
+
+        int byte() {
+            if (inputPosition == inputSize) {
+                inputSize = reader(input.data(), input.size());
+                inputPosition = 0;
+                if (inputSize == 0) {
+                    throw InflateError{ "Compressed data is truncated" };
+                }
+            }
+            return input[inputPosition++];
+        }
+
+        int bits(const int count) {
+            while (bitCount < count) {
+                bitBuffer |= (uint32_t)byte() << bitCount;
+                bitCount += 8;
+            }
+            const int value = (int)(bitBuffer & ((1u << count) - 1));
+            bitBuffer >>= count;
+            bitCount -= count;
+            return value;
+        }
+
+        int decode(const Huffman& huffman) {
+            int code = 0;  // Bits read so far.
+            int first = 0; // First code of the current length.
+            int index = 0; // Index of the first code of the current length among the symbols.
+            for (int length = 1; length <= MAX_BITS; ++length) {
+                code |= bits(1);
+                const int count = huffman.count[length];
+                if (code - count < first) {
+                    return huffman.symbol[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            throw InflateError{ "Compressed data holds an invalid code" };
+        }
+
+        void put(const unsigned char value) {
+            output.push_back(value);
+            if (output.size() >= windowSize + Inflate::CHUNK_BYTES) {
+                flush(false);
+            }
+        }
+
+        /**
+        * @brief Writes the pending output, keeping the window.
+        *
+        * @param isFinal Whether the stream ended, so the window is written as well.
+        */
+        void flush(const bool isFinal) {
+            const size_t keep = isFinal ? 0 : std::min<size_t>(output.size(), (size_t)Inflate::WINDOW_BYTES);
+            if (output.size() > windowSize && !writer(output.data() + windowSize, output.size() - windowSize)) {
+                throw InflateError{ "Decompressed data could not be written" };
+            }
+            memmove(output.data(), output.data() + output.size() - keep, keep);
+            output.resize(keep);
+            windowSize = keep;
+        }
+
+        void stored() {
+            // Stored blocks start at a byte boundary, with their length and its complement.
+            bitBuffer = 0;
+            bitCount = 0;
+            int length = byte();
+            length |= byte() << 8;
+            int complement = byte();
+            complement |= byte() << 8;
+            if (length != (~complement & 0xFFFF)) {
+                throw InflateError{ "Compressed data holds a stored block of invalid length" };
+            }
+            for (int i = 0; i < length; ++i) {
+                put((unsigned char)byte());
+            }
+        }
+
+        void codes(const Huffman& lengthCode, const Huffman& distanceCode) {
+            while (true) {
+                const int symbol = decode(lengthCode);
+                if (symbol < 256) {
+                    put((unsigned char)symbol);
+                } else if (symbol == 256) {
+                    return;
+                } else {
+                    const int lengthIndex = symbol - 257;
+                    if (lengthIndex >= 29) {
+                        throw InflateError{ "Compressed data holds an invalid length" };
+                    }
+                    const int length = LENGTH_BASES[lengthIndex] + bits(LENGTH_EXTRA[lengthIndex]);
+                    const int distanceIndex = decode(distanceCode);
+                    if (distanceIndex >= MAX_DISTANCE_CODES) {
+                        throw InflateError{ "Compressed data holds an invalid distance" };
+                    }
+                    const size_t distance = DISTANCE_BASES[distanceIndex] + bits(DISTANCE_EXTRA[distanceIndex]);
+                    if (distance > output.size()) {
+                        throw InflateError{ "Compressed data refers back too far" };
+                    }
+                    // Copies a byte at a time, since a match may overlap the bytes it produces.
+                    for (int i = 0; i < length; ++i) {
+                        put(output[output.size() - distance]);
+                    }
+                }
+            }
+        }
+
+        void fixed() {
+            static const std::pair<Huffman, Huffman> CODES = []() {
+                std::pair<Huffman, Huffman> codes;
+                uint8_t lengths[FIXED_LENGTH_CODES];
+                for (int i = 0; i < FIXED_LENGTH_CODES; ++i) {
+                    lengths[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+                }
+                codes.first.build(lengths, FIXED_LENGTH_CODES);
+                for (int i = 0; i < MAX_DISTANCE_CODES; ++i) {
+                    lengths[i] = 5;
+                }
+                codes.second.build(lengths, MAX_DISTANCE_CODES);
+                return codes;
+            }();
+            codes(CODES.first, CODES.second);
+        }
+
+        void dynamic() {
+            const int lengthCount = bits(5) + 257;
+            const int distanceCount = bits(5) + 1;
+            const int codeLengthCount = bits(4) + 4;
+            if (lengthCount > MAX_LENGTH_CODES || distanceCount > MAX_DISTANCE_CODES) {
+                throw InflateError{ "Compressed data holds too many codes" };
+            }
+
+            // Reads the code that the lengths of the other two are coded with.
+            uint8_t lengths[MAX_LENGTH_CODES + MAX_DISTANCE_CODES] = {};
+            for (int i = 0; i < codeLengthCount; ++i) {
+                lengths[CODE_LENGTH_ORDER[i]] = (uint8_t)bits(3);
+            }
+            Huffman lengthLengthCode;
+            if (!lengthLengthCode.build(lengths, 19)) {
+                throw InflateError{ "Compressed data holds an invalid code" };
+            }
+
+            // Reads the lengths of both codes, which repeats may run across.
+            int index = 0;
+            while (index < lengthCount + distanceCount) {
+                int symbol = decode(lengthLengthCode);
+                if (symbol < 16) {
+                    lengths[index++] = (uint8_t)symbol;
+                    continue;
+                }
+                uint8_t length = 0;
+                int repeat;
+                if (symbol == 16) {
+                    if (index == 0) {
+                        throw InflateError{ "Compressed data repeats a length that does not exist" };
+                    }
+                    length = lengths[index - 1];
+                    repeat = 3 + bits(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + bits(3);
+                } else {
+                    repeat = 11 + bits(7);
+                }
+                if (index + repeat > lengthCount + distanceCount) {
+                    throw InflateError{ "Compressed data holds too many lengths" };
+                }
+                while (repeat-- > 0) {
+                    lengths[index++] = length;
+                }
+            }
+            if (lengths[256] == 0) {
+                throw InflateError{ "Compressed data holds no end of block code" };
+            }
+
+            Huffman lengthCode;
+            Huffman distanceCode;
+            if (!lengthCode.build(lengths, lengthCount) || !distanceCode.build(lengths + lengthCount, distanceCount)) {
+                throw InflateError{ "Compressed data holds an invalid code" };
+            }
+            codes(lengthCode, distanceCode);
+        }
+
+        void run() {
+            bool isLast;
+            do {
+                isLast = (bits(1) != 0);
+                switch (bits(2)) {
+                    case 0: stored(); break;
+                    case 1: fixed(); break;
+                    case 2: dynamic(); break;
+                    default: throw InflateError{ "Compressed data holds an invalid block type" };
+                }
+            } while (!isLast);
+            flush(true);
+        }
+};
+
+bool Inflate::run(const Reader& read, const Writer& write, std::string& error) {
+	try {
+		Inflater inflater(read, write);
+		inflater.run();
+	} catch (const InflateError& inflateError) {
+		error = inflateError.message;
+		return false;
+	}
+	return true;
+}
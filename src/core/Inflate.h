@@ -0,0 +1,42 @@
+// Inflate.h : declarations for decompressing deflate streams
+
+#pragma once
+
+#ifndef INFLATE_H_
+#define INFLATE_H_
+
+#include <cstddef>     // size_t
+#include <functional>  // function
+#include <string>      // strings
+
+/**
+* Decompressor for raw deflate streams (RFC 1951), as stored in zip archives. It streams both ways,
+* holding the input in small reads and keeping only the 32 KiB window of the output, so entries of
+* any size are decompressed in constant memory.
+*
+* Codes are decoded a bit at a time, which is slower than table driven decoders, but entries are only
+* decompressed when picked, and media files are usually stored rather than deflated.
+*/
+class Inflate {
+
+    public:
+        // Fills a buffer with up to `size` bytes of the stream, and returns how many. 0 ends the stream.
+        typedef std::function<size_t(unsigned char*, size_t)> Reader;
+        // Takes decompressed bytes. Returning false stops decompressing.
+        typedef std::function<bool(const unsigned char*, size_t)> Writer;
+
+        static const size_t WINDOW_BYTES = 32768; // Farthest a match may reach back
+        static const size_t CHUNK_BYTES = 65536;  // Bytes read or written at a time
+
+        /**
+        * @brief Decompresses a stream.
+        *
+        * @param read Reads the compressed stream.
+        * @param write Takes the decompressed bytes.
+        * @param error Receives the description of the error, if any.
+        * @return If the stream is malformed or truncated, or writing failed, returns `false`.
+        */
+        static bool run(const Reader&, const Writer&, std::string&);
+};
+
+#endif
@@ -0,0 +1,48 @@
+// Json.h : helpers for writing JSON text
+
+#pragma once
+
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <cstdio>      // snprintf
+#include <string>      // strings
+#include <string_view> // non-owning string views
+
+class Json {
+    public:
+        /**
+        * @brief Appends a string escaped to be quoted in JSON. Prometheus label values use the same escapes.
+        *
+        * @param text Receives the escaped string.
+        * @param value UTF8 string to escape.
+        */
+        static void appendEscaped(std::string& text, std::string_view value) {
+            for (const char c : value) {
+                switch (c) {
+                    case '"':  text += "\\\""; break;
+                    case '\\': text += "\\\\"; break;
+                    case '\n': text += "\\n";  break;
+                    default:
+                        if ((unsigned char)c < 0x20) {
+                            char code[8];
+                            snprintf(code, sizeof(code), "\\u%04x", (unsigned int)c);
+                            text += code;
+                        } else {
+                            text += c;
+                        }
+                }
+            }
+        }
+        /**
+        * @param value UTF8 string to escape.
+        * @return String escaped to be quoted in JSON.
+        */
+        static std::string escape(std::string_view value) {
+            std::string text;
+            appendEscaped(text, value);
+            return text;
+        }
+};
+
+#endif
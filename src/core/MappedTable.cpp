@@ -0,0 +1,357 @@
+// MappedTable.cpp : descriptions for the memory-mapped table of fixed size records
+
+#include "MappedTable.h"
+#include "TempFiles.h"
+
+#include <algorithm>   // max, swap
+#include <cstring>     // memcpy
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#ifdef _WIN32
+#include <windows.h>   // Windows API functions
+#else
+#include <cerrno>      // errno
+#include <cstdio>      // rename
+#include <fcntl.h>     // open
+#include <sys/file.h>  // flock
+#include <sys/mman.h>  // mmap, msync
+#include <sys/stat.h>  // fstat, fchmod
+#include <unistd.h>    // ftruncate, close
+#endif
+
+/**
+* @return Well mixed 64 bits (SplitMix64 finalizer), so that similar keys land in distant slots.
+*/
+static uint64_t spread(uint64_t value) {
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
+MappedTable::MappedTable() {
+	magic = 0;
+	recordSize = 0;
+	address = nullptr;
+	mappedSize = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+	fileDescriptor = -1;
+}
+
+MappedTable::~MappedTable() {
+	close();
+}
+
+bool MappedTable::open(const std::string& path, const uint64_t tableMagic, const uint32_t size, std::string& error) {
+	close();
+	filePath = path;
+	magic = tableMagic;
+	recordSize = size;
+	if (!openFile(false, error) || !map(HEADER_SIZE + (size_t)INITIAL_CAPACITY * recordSize, error)) {
+		close();
+		return false;
+	}
+
+	// A new file is zeroed, so it has no magic yet.
+	Header* fileHeader = header();
+	if (fileHeader->magic == 0) {
+		fileHeader->version = VERSION;
+		fileHeader->recordSize = recordSize;
+		fileHeader->count = 0;
+		fileHeader->capacity = INITIAL_CAPACITY;
+		fileHeader->magic = magic;
+		return true;
+	}
+	if (
+		(fileHeader->magic != magic) ||
+		(fileHeader->version != VERSION) ||
+		(fileHeader->recordSize != recordSize) ||
+		(fileHeader->capacity == 0) ||
+		((fileHeader->capacity & (fileHeader->capacity - 1)) != 0) ||
+		(mappedSize < HEADER_SIZE + fileHeader->capacity * recordSize)
+	) {
+		error = path + " is not a compatible table";
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedTable::close() {
+	if (isOpen()) {
+		std::string error;
+		flush(error);
+	}
+	unmap();
+	closeFile();
+}
+
+uint64_t MappedTable::keyOf(const unsigned char* record) {
+	uint64_t key;
+	memcpy(&key, record, sizeof(key));
+	return key;
+}
+
+uint64_t MappedTable::probe(const uint64_t key) const {
+	const uint64_t mask = header()->capacity - 1;
+	uint64_t i = spread(key) & mask;
+	for (uint64_t slotKey = keyOf(slot(i)); slotKey != 0 && slotKey != key; slotKey = keyOf(slot(i))) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+void* MappedTable::find(const uint64_t key) const {
+	if (!isOpen() || key == 0) {
+		return nullptr;
+	}
+	unsigned char* record = slot(probe(key));
+	return (keyOf(record) == key) ? record : nullptr;
+}
+
+void* MappedTable::insert(const uint64_t key, std::string& error) {
+	if (!isOpen() || key == 0) {
+		error = "Invalid table key";
+		return nullptr;
+	}
+	unsigned char* record = slot(probe(key));
+	if (keyOf(record) == key) {
+		return record;
+	}
+	if ((header()->count + 1) * 4 > header()->capacity * 3) {
+		if (!rebuild(header()->capacity * 2, [](const void*) { return true; }, error)) {
+			return nullptr;
+		}
+		record = slot(probe(key));
+	}
+	memcpy(record, &key, sizeof(key));
+	++header()->count;
+	return record;
+}
+
+bool MappedTable::retain(const Keep& isKept, std::string& error) {
+	if (!isOpen()) {
+		return true;
+	}
+	uint64_t keptCount = 0;
+	for (uint64_t i = 0; i < header()->capacity; ++i) {
+		if (keyOf(slot(i)) != 0 && isKept(slot(i))) ++keptCount;
+	}
+	if (keptCount == header()->count) {
+		return true;
+	}
+	uint64_t capacity = INITIAL_CAPACITY;
+	while ((keptCount + 1) * 4 > capacity * 3) {
+		capacity *= 2;
+	}
+	return rebuild(capacity, isKept, error);
+}
+
+bool MappedTable::rebuild(const uint64_t capacity, const Keep& isKept, std::string& error) {
+	MappedTable table;
+	table.filePath = TempFiles::temporaryFor(std::filesystem::u8path(filePath)).u8string();
+	table.magic = magic;
+	table.recordSize = recordSize;
+	const auto discard = [&table]() {
+		const std::filesystem::path temporaryPath = std::filesystem::u8path(table.filePath);
+		table.close();
+		std::error_code errorCode;
+		std::filesystem::remove(temporaryPath, errorCode);
+	};
+	if (!table.openFile(true, error) || !table.map(HEADER_SIZE + (size_t)capacity * recordSize, error)) {
+		discard();
+		return false;
+	}
+
+	// The new file is zeroed, so only the header and the records kept are written.
+	Header* fileHeader = table.header();
+	fileHeader->version = VERSION;
+	fileHeader->recordSize = recordSize;
+	fileHeader->count = 0;
+	fileHeader->capacity = capacity;
+	fileHeader->magic = magic;
+	for (uint64_t i = 0; i < header()->capacity; ++i) {
+		if (keyOf(slot(i)) != 0 && isKept(slot(i))) {
+			memcpy(table.slot(table.probe(keyOf(slot(i)))), slot(i), recordSize);
+			++fileHeader->count;
+		}
+	}
+	if (!table.flush(error) || !replaceWith(table, error)) {
+		discard();
+		return false;
+	}
+	return true;
+}
+
+
+
+#ifdef _WIN32
+
+bool MappedTable::openFile(const bool isNew, std::string& error) {
+	// Sharing nothing but renames locks the file, so that only one process uses the table at a time.
+	const HANDLE file = CreateFileW(
+		std::filesystem::u8path(filePath).wstring().c_str(),
+		GENERIC_READ | GENERIC_WRITE, FILE_SHARE_DELETE, NULL,
+		isNew ? CREATE_NEW : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+	);
+	if (file == INVALID_HANDLE_VALUE) {
+		error = (GetLastError() == ERROR_SHARING_VIOLATION) ? filePath + " is in use by another process" : "Could not open " + filePath;
+		return false;
+	}
+	fileHandle = file;
+	return true;
+}
+
+bool MappedTable::map(const size_t minimumSize, std::string& error) {
+	// Mapping past the end of the file extends it with zeros.
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx((HANDLE)fileHandle, &fileSize)) {
+		error = "Could not read the size of " + filePath;
+		return false;
+	}
+	const unsigned long long size = std::max<unsigned long long>((unsigned long long)fileSize.QuadPart, minimumSize);
+	const HANDLE mapping = CreateFileMappingW(
+		(HANDLE)fileHandle, NULL, PAGE_READWRITE,
+		(DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL
+	);
+	if (mapping == NULL) {
+		error = "Could not map " + filePath;
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		error = "Could not map " + filePath;
+		return false;
+	}
+	mappingHandle = mapping;
+	address = (unsigned char*)view;
+	mappedSize = (size_t)size;
+	return true;
+}
+
+void MappedTable::unmap() {
+	if (address != nullptr) UnmapViewOfFile(address);
+	if (mappingHandle != nullptr) CloseHandle((HANDLE)mappingHandle);
+	address = nullptr;
+	mappingHandle = nullptr;
+	mappedSize = 0;
+}
+
+void MappedTable::closeFile() {
+	if (fileHandle != nullptr) CloseHandle((HANDLE)fileHandle);
+	fileHandle = nullptr;
+}
+
+bool MappedTable::replaceWith(MappedTable& table, std::string& error) {
+	// An open file can not be replaced, so this one is closed first. Another process may open it meanwhile, in
+	// which case the rename fails and the table is reopened as it was.
+	unmap();
+	closeFile();
+	const std::wstring path = std::filesystem::u8path(filePath).wstring();
+	const bool isReplaced = MoveFileExW(std::filesystem::u8path(table.filePath).wstring().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+	if (!isReplaced) {
+		error = "Could not replace " + filePath;
+		if (openFile(false, error)) {
+			map(HEADER_SIZE + (size_t)INITIAL_CAPACITY * recordSize, error);
+		}
+		return false;
+	}
+	std::swap(fileHandle, table.fileHandle);
+	std::swap(mappingHandle, table.mappingHandle);
+	std::swap(address, table.address);
+	std::swap(mappedSize, table.mappedSize);
+	return true;
+}
+
+bool MappedTable::flush(std::string& error) {
+	if (!isOpen()) {
+		return true;
+	}
+	if (!FlushViewOfFile(address, mappedSize) || !FlushFileBuffers((HANDLE)fileHandle)) {
+		error = "Could not write " + filePath;
+		return false;
+	}
+	return true;
+}
+
+#else
+
+bool MappedTable::openFile(const bool isNew, std::string& error) {
+	fileDescriptor = ::open(filePath.c_str(), isNew ? (O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW) : (O_RDWR | O_CREAT), 0644);
+	if (fileDescriptor < 0) {
+		error = "Could not open " + filePath;
+		return false;
+	}
+
+	// Nothing else coordinates the changes of several processes, so only one may use the table at a time.
+	if (flock(fileDescriptor, LOCK_EX | LOCK_NB) != 0) {
+		error = (errno == EWOULDBLOCK) ? filePath + " is in use by another process" : "Could not lock " + filePath;
+		closeFile();
+		return false;
+	}
+	return true;
+}
+
+bool MappedTable::map(const size_t minimumSize, std::string& error) {
+	// Growing the file extends it with zeros.
+	struct stat status;
+	if (fstat(fileDescriptor, &status) != 0) {
+		error = "Could not read the size of " + filePath;
+		return false;
+	}
+	const size_t size = std::max<size_t>((size_t)status.st_size, minimumSize);
+	if ((size_t)status.st_size < size && ftruncate(fileDescriptor, (off_t)size) != 0) {
+		error = "Could not grow " + filePath;
+		return false;
+	}
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+	if (view == MAP_FAILED) {
+		error = "Could not map " + filePath;
+		return false;
+	}
+	address = (unsigned char*)view;
+	mappedSize = size;
+	return true;
+}
+
+void MappedTable::unmap() {
+	if (address != nullptr) munmap(address, mappedSize);
+	address = nullptr;
+	mappedSize = 0;
+}
+
+void MappedTable::closeFile() {
+	if (fileDescriptor >= 0) ::close(fileDescriptor);
+	fileDescriptor = -1;
+}
+
+bool MappedTable::replaceWith(MappedTable& table, std::string& error) {
+	// This file stays open and locked until the other one is in its place, so no other process gets in between.
+	struct stat status;
+	if (fstat(fileDescriptor, &status) == 0) {
+		fchmod(table.fileDescriptor, status.st_mode & 07777);
+	}
+	if (rename(table.filePath.c_str(), filePath.c_str()) != 0) {
+		error = "Could not replace " + filePath;
+		return false;
+	}
+	std::swap(fileDescriptor, table.fileDescriptor);
+	std::swap(address, table.address);
+	std::swap(mappedSize, table.mappedSize);
+	return true;
+}
+
+bool MappedTable::flush(std::string& error) {
+	if (!isOpen()) {
+		return true;
+	}
+	if (msync(address, mappedSize, MS_SYNC) != 0) {
+		error = "Could not write " + filePath;
+		return false;
+	}
+	return true;
+}
+
+#endif
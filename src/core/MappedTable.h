@@ -0,0 +1,166 @@
+// MappedTable.h : declarations for the memory-mapped table of fixed size records
+
+#pragma once
+
+#ifndef MAPPEDTABLE_H_
+#define MAPPEDTABLE_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <functional>  // function objects
+#include <string>      // strings
+
+/**
+* Hash table of fixed size records kept in a memory-mapped file, so that it persists across runs
+* without being read or written as a whole. Every record starts with its 64 bit key, where 0 marks
+* an empty slot; slots are found by linear probing, and the table is rehashed into a file twice as
+* large, which then replaces it, when it is more than 3/4 full.
+*
+* Changes reach the file through the mapping, and `flush()` forces them to disk. The file is locked
+* while open, so that a single process uses it at a time.
+*/
+class MappedTable {
+
+    public:
+        typedef std::function<bool(const void*)> Keep;
+
+    private:
+        static const uint32_t VERSION = 1;
+        static const uint64_t INITIAL_CAPACITY = 1024;
+        static const size_t HEADER_SIZE = 64; // Bytes before the first slot, which keeps slots aligned.
+
+        // Layout of the beginning of the file.
+        struct Header {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t recordSize;
+            uint64_t count;
+            uint64_t capacity; // Power of 2.
+        };
+
+        std::string filePath;
+        uint64_t magic;
+        uint32_t recordSize;
+        unsigned char* address;
+        size_t mappedSize;
+        void* fileHandle;    // Only used on Windows.
+        void* mappingHandle; // Only used on Windows.
+        int fileDescriptor;  // Only used elsewhere.
+
+        // @return Header at the beginning of the mapping
+        Header* header() const { return (Header*)address; }
+        // @return Slot at the given index
+        unsigned char* slot(const uint64_t i) const { return address + HEADER_SIZE + (size_t)i * recordSize; }
+        // @return Key of a record
+        static uint64_t keyOf(const unsigned char*);
+        /**
+        * @return Index of the slot holding a key, or of the empty slot where it would go.
+        */
+        uint64_t probe(const uint64_t) const;
+        /**
+        * @brief Rehashes the records to keep into a new file, which then replaces the file of the table, so that
+        * an interrupted rehash leaves the table as it was. Invalidates pointers to records.
+        *
+        * @param capacity Capacity of the new table, a power of 2 that fits the records to keep.
+        * @param isKept Tells whether a record is kept.
+        * @param error Receives the description of the error, if any.
+        * @return If the new file could not be written, returns `false` and the table is left as it was.
+        */
+        bool rebuild(const uint64_t, const Keep&, std::string&);
+
+        // == Platform functions ==
+        /**
+        * @brief Opens the file and locks it.
+        *
+        * @param isNew Whether the file must be created, rather than opened or created if needed.
+        */
+        bool openFile(const bool, std::string&);
+        /**
+        * @brief Maps the given amount of bytes of the open file, growing it if needed.
+        */
+        bool map(const size_t, std::string&);
+        /**
+        * @brief Unmaps the file, keeping it open.
+        */
+        void unmap();
+        /**
+        * @brief Closes the file.
+        */
+        void closeFile();
+        /**
+        * @brief Renames the file of another table over the file of this one, and takes its place.
+        */
+        bool replaceWith(MappedTable&, std::string&);
+
+    public:
+        // == Constructor ==
+        MappedTable();
+        ~MappedTable();
+        MappedTable(const MappedTable&) = delete;
+        MappedTable& operator=(const MappedTable&) = delete;
+
+        /**
+        * @brief Opens a table, creating it if the file does not exist.
+        *
+        * @param path Path to the file.
+        * @param tableMagic Magic number identifying the kind of records.
+        * @param size Size of a record in bytes, at least 8, starting with its key.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be mapped, is in use by another process or holds another kind of table, returns
+        * `false`.
+        */
+        bool open(const std::string&, const uint64_t, const uint32_t, std::string&);
+        /**
+        * @brief Flushes and closes the table.
+        */
+        void close();
+        /**
+        * @param key Key other than 0.
+        * @return Record with the given key, or `nullptr` if there is none. Valid until the following insertion.
+        */
+        void* find(const uint64_t) const;
+        /**
+        * @brief Finds a record, or inserts a zeroed one with the given key.
+        *
+        * @param key Key other than 0.
+        * @param error Receives the description of the error, if any.
+        * @return Record, or `nullptr` if the table could not grow. Valid until the following insertion.
+        */
+        void* insert(const uint64_t, std::string&);
+        /**
+        * @brief Drops the records that are not to be kept, and shrinks the table to fit the others. Invalidates
+        * pointers to records.
+        *
+        * @param isKept Tells whether a record is kept.
+        * @param error Receives the description of the error, if any.
+        * @return If the table could not be rewritten, returns `false` and every record is kept.
+        */
+        bool retain(const Keep&, std::string&);
+        /**
+        * @brief Forces the changes to disk.
+        *
+        * @param error Receives the description of the error, if any.
+        * @return If the changes could not be written, returns `false`.
+        */
+        bool flush(std::string&);
+
+        // @return true if a table is open
+        bool isOpen() const { return address != nullptr; }
+        // @return Amount of records
+        uint64_t size() const { return isOpen() ? header()->count : 0; }
+        // @return Path to the file
+        const std::string& getPath() const { return filePath; }
+
+        /**
+        * @return Record with the given key, or `nullptr` if there is none. Valid until the following insertion.
+        */
+        template <typename Record>
+        Record* find(const uint64_t key) const { return (Record*)find(key); }
+        /**
+        * @return Record with the given key, inserted if there is none, or `nullptr` if the table could not grow.
+        */
+        template <typename Record>
+        Record* insert(const uint64_t key, std::string& error) { return (Record*)insert(key, error); }
+};
+
+#endif
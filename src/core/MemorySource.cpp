@@ -0,0 +1,287 @@
+// MemorySource.cpp : descriptions for the in-memory directory source
+
+#include "MemorySource.h"
+#include "Hash.h"
+
+#include <algorithm>   // min
+#include <cstring>     // memcpy
+#include <thread>      // sleep_for
+
+MemorySource::MemorySource() {
+	version = 0;
+	directoryLatency = 0;
+	entryLatency = 0;
+	errorRate = 0;
+	errorSeed = 0;
+	listCount = 0;
+	clear();
+}
+
+std::string MemorySource::normalize(const std::string& unprocessedPath) {
+	const std::string absolutePath = (!unprocessedPath.empty() && unprocessedPath[0] == '/') ? unprocessedPath : "/" + unprocessedPath;
+	std::string path = std::filesystem::u8path(absolutePath).lexically_normal().generic_u8string();
+	while (path.size() > 1 && path.back() == '/') {
+		path.pop_back();
+	}
+	return path;
+}
+
+void MemorySource::addEntry(const std::string& path, const DirectoryEntry::Type type) {
+	if (path == "/") {
+		return;
+	}
+
+	const size_t separator = path.rfind('/');
+	const std::string parent = (separator == 0) ? "/" : path.substr(0, separator);
+	DirectoryEntry entry;
+	entry.name = path.substr(separator + 1);
+	entry.type = type;
+
+	// Creates missing ancestors first, and never lists an entry twice.
+	if (directories.find(parent) == directories.end()) {
+		addEntry(parent, DirectoryEntry::directory);
+	}
+	std::vector<DirectoryEntry>& siblings = directories[parent];
+	for (const DirectoryEntry& sibling : siblings) {
+		if (sibling.name == entry.name) {
+			return;
+		}
+	}
+	siblings.push_back(entry);
+	if (type == DirectoryEntry::directory) {
+		directories[path];
+	}
+	++version;
+}
+
+void MemorySource::addFile(const std::string& path) {
+	addEntry(normalize(path), DirectoryEntry::file);
+}
+
+void MemorySource::addFile(const std::string& unprocessedPath, const std::string& bytes) {
+	const std::string path = normalize(unprocessedPath);
+	addEntry(path, DirectoryEntry::file);
+	contents[path] = bytes;
+}
+
+void MemorySource::addDirectory(const std::string& path) {
+	addEntry(normalize(path), DirectoryEntry::directory);
+}
+
+void MemorySource::clear() {
+	directories.clear();
+	directories["/"];
+	failures.clear();
+	stalls.clear();
+	mounts.clear();
+	binds.clear();
+	contents.clear();
+	++version;
+}
+
+void MemorySource::setLatency(const std::chrono::microseconds perDirectory, const std::chrono::microseconds perEntry) {
+	directoryLatency = (int64_t)perDirectory.count();
+	entryLatency = (int64_t)perEntry.count();
+}
+
+void MemorySource::failDirectory(const std::string& path, const std::string& message) {
+	failures[normalize(path)] = message;
+}
+
+void MemorySource::stallDirectory(const std::string& path, const std::chrono::microseconds duration) {
+	stalls[normalize(path)] = duration;
+}
+
+void MemorySource::mountDevice(const std::string& unprocessedPath, const uint64_t device, const std::string& type) {
+	const std::string path = normalize(unprocessedPath);
+	addEntry(path, DirectoryEntry::directory);
+	mounts[path] = Mount{ device, type };
+}
+
+void MemorySource::bindDirectory(const std::string& unprocessedPath, const std::string& target) {
+	const std::string path = normalize(unprocessedPath);
+	addEntry(path, DirectoryEntry::directory);
+	binds[path] = normalize(target);
+}
+
+/**
+* @return true if a normalized path is another one or lies below it.
+*/
+static bool isWithin(const std::string& path, const std::string& ancestor) {
+	return (path.compare(0, ancestor.size(), ancestor) == 0) && (
+		(path.size() == ancestor.size()) ||
+		(ancestor == "/") ||
+		(path[ancestor.size()] == '/')
+	);
+}
+
+std::string MemorySource::follow(const std::string& unprocessedPath) const {
+	std::string path = unprocessedPath;
+	if (binds.empty()) {
+		return path;
+	}
+
+	// Replaces the deepest bound directory until none is left. Targets may lead into other bound directories,
+	// but a path can not be bound to itself forever.
+	for (size_t step = 0; step <= binds.size(); ++step) {
+		std::map<std::string, std::string>::const_iterator deepest = binds.end();
+		for (std::map<std::string, std::string>::const_iterator it = binds.begin(); it != binds.end(); ++it) {
+			if (isWithin(path, it->first) && (deepest == binds.end() || it->first.size() > deepest->first.size())) {
+				deepest = it;
+			}
+		}
+		if (deepest == binds.end()) {
+			break;
+		}
+		path = normalize(deepest->second + path.substr(deepest->first.size()));
+	}
+	return path;
+}
+
+const MemorySource::Mount* MemorySource::mountOf(const std::string& path) const {
+	const Mount* mount = nullptr;
+	size_t mountLength = 0;
+	for (const std::pair<const std::string, Mount>& candidate : mounts) {
+		if (isWithin(path, candidate.first) && (mount == nullptr || candidate.first.size() > mountLength)) {
+			mount = &candidate.second;
+			mountLength = candidate.first.size();
+		}
+	}
+	return mount;
+}
+
+void MemorySource::setErrorRate(const double rate, const uint64_t seed) {
+	errorRate = (uint32_t)((rate < 0) ? 0 : (rate > 1) ? 1000000 : rate * 1000000);
+	errorSeed = seed;
+}
+
+bool MemorySource::resolve(const std::string& unprocessedPath, std::filesystem::path& path, std::string& error) const {
+	const std::string normalized = normalize(unprocessedPath);
+	if (directories.find(normalized) == directories.end()) {
+		error = "No such directory: " + normalized;
+		return false;
+	}
+	path = std::filesystem::u8path(normalized);
+	return true;
+}
+
+bool MemorySource::list(const std::filesystem::path& directory, std::vector<DirectoryEntry>& entries, ScanStats&, std::string& error) const {
+	entries.clear();
+	++listCount;
+	const std::string path = normalize(directory.generic_u8string());
+
+	const std::map<std::string, std::vector<DirectoryEntry>>::const_iterator it = directories.find(follow(path));
+	if (it == directories.end()) {
+		error = path + ": No such directory";
+		return false;
+	}
+
+	// Waits as long as the directory would take to be listed.
+	const int64_t latency = directoryLatency.load() + entryLatency.load() * (int64_t)it->second.size();
+	if (latency > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds(latency));
+	}
+	const std::map<std::string, std::chrono::microseconds>::const_iterator stall = stalls.find(path);
+	if (stall != stalls.end()) {
+		std::this_thread::sleep_for(stall->second);
+	}
+
+	// Fails explicitly chosen directories, and then a share of the rest.
+	const std::map<std::string, std::string>::const_iterator failure = failures.find(path);
+	if (failure != failures.end()) {
+		error = path + ": " + failure->second;
+		return false;
+	}
+	const uint32_t rate = errorRate.load();
+	if (rate > 0 && ((Hash::fnv1a(path) ^ errorSeed.load()) * 0x9e3779b97f4a7c15ULL >> 32) % 1000000 < rate) {
+		error = path + ": Injected error";
+		return false;
+	}
+
+	entries = it->second;
+	return true;
+}
+
+uint64_t MemorySource::device(const std::filesystem::path& path) const {
+	DirectoryIdentity identity;
+	return identify(path, identity) ? identity.device : 0;
+}
+
+bool MemorySource::identify(const std::filesystem::path& entry, DirectoryIdentity& identity) const {
+	const std::string path = follow(normalize(entry.generic_u8string()));
+	if (directories.find(path) == directories.end() && !isFile(path)) {
+		return false;
+	}
+	const Mount* mount = mountOf(path);
+	identity.device = (mount != nullptr) ? mount->device : 0;
+	identity.node = Hash::fnv1a(path);
+	return true;
+}
+
+std::string MemorySource::filesystemType(const std::filesystem::path& directory) const {
+	const Mount* mount = mountOf(follow(normalize(directory.generic_u8string())));
+	return (mount != nullptr) ? mount->type : "memfs";
+}
+
+uint64_t MemorySource::stamp(const std::filesystem::path&) const {
+	return version;
+}
+
+uint64_t MemorySource::fileSize(const std::filesystem::path& file) const {
+	const std::map<std::string, std::string>::const_iterator it = contents.find(follow(normalize(file.generic_u8string())));
+	return (it != contents.end()) ? (uint64_t)it->second.size() : 0;
+}
+
+/**
+* File held in memory, read from the contents it was opened with.
+*/
+class MemoryFile : public SourceFile {
+
+    private:
+        const std::string& bytes;
+
+    public:
+        explicit MemoryFile(const std::string& bytes) : bytes(bytes) {}
+
+        size_t read(const uint64_t offset, void* buffer, const size_t size) override {
+            if (offset >= bytes.size()) {
+                return 0;
+            }
+            const size_t count = std::min<size_t>(size, bytes.size() - (size_t)offset);
+            memcpy(buffer, bytes.data() + offset, count);
+            return count;
+        }
+
+        uint64_t size() const override {
+            return bytes.size();
+        }
+};
+
+bool MemorySource::isFile(const std::string& path) const {
+	const size_t separator = path.rfind('/');
+	if (separator == std::string::npos) {
+		return false;
+	}
+	const std::map<std::string, std::vector<DirectoryEntry>>::const_iterator parent = directories.find((separator == 0) ? "/" : path.substr(0, separator));
+	if (parent == directories.end()) {
+		return false;
+	}
+	for (const DirectoryEntry& entry : parent->second) {
+		if (entry.type == DirectoryEntry::file && path.compare(separator + 1, std::string::npos, entry.name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::unique_ptr<SourceFile> MemorySource::open(const std::filesystem::path& file) const {
+	static const std::string EMPTY;
+	const std::string path = follow(normalize(file.generic_u8string()));
+	const std::map<std::string, std::string>::const_iterator it = contents.find(path);
+	if (it != contents.end()) {
+		return std::make_unique<MemoryFile>(it->second);
+	}
+
+	// Files added without contents are empty.
+	return isFile(path) ? std::make_unique<MemoryFile>(EMPTY) : nullptr;
+}
@@ -0,0 +1,166 @@
+// MemorySource.h : declarations for the in-memory directory source
+
+#pragma once
+
+#ifndef MEMORYSOURCE_H_
+#define MEMORYSOURCE_H_
+
+#include <atomic>      // atomic counters
+#include <chrono>      // durations
+#include <map>         // ordered maps
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include "DirectorySource.h"
+
+/**
+* Virtual directory tree held in memory, for deterministic tests and benchmarks of the scan,
+* filter and index code without touching disk. Listing can be slowed down, stalled and made to
+* fail, to simulate slow or hung network directories. Directories can be mounted as other devices
+* and filesystem types, and bound to other directories, to simulate mounts and bind mount loops.
+*
+* Paths are absolute and '/'-separated (e.g. "/music/album/track.mp3"); relative ones are
+* taken from "/". The tree, the mounts and the failing and stalled directories must be set up before
+* scanning, while the latency and the error rate may be changed at any time. Unless mounted otherwise,
+* directories are on device 0, of type "memfs".
+*/
+class MemorySource : public DirectorySource {
+
+    private:
+        // Entries of every directory, by normalized path.
+        std::map<std::string, std::vector<DirectoryEntry>> directories;
+        uint64_t version;
+
+        // Injected latency and errors.
+        std::atomic<int64_t> directoryLatency;
+        std::atomic<int64_t> entryLatency;
+        std::map<std::string, std::string> failures;
+        std::map<std::string, std::chrono::microseconds> stalls;
+        std::atomic<uint32_t> errorRate; // Per million listings.
+        std::atomic<uint64_t> errorSeed;
+
+        // Mounted devices and bound directories, by normalized path.
+        struct Mount {
+            uint64_t device;
+            std::string type;
+        };
+        std::map<std::string, Mount> mounts;
+        std::map<std::string, std::string> binds;
+
+        // Contents of the files that have any, by normalized path.
+        std::map<std::string, std::string> contents;
+
+        mutable std::atomic<uint64_t> listCount;
+
+        /**
+        * @return Absolute, '/'-separated path without a trailing separator ("/" for the root).
+        */
+        static std::string normalize(const std::string&);
+        /**
+        * @brief Adds an entry to its parent directory, creating missing ancestors.
+        *
+        * @param path Normalized path of the entry.
+        * @param type Type of the entry.
+        */
+        void addEntry(const std::string&, const DirectoryEntry::Type);
+        /**
+        * @param path Normalized path.
+        * @return Path with every bound directory it goes through replaced by its target.
+        */
+        std::string follow(const std::string&) const;
+        /**
+        * @param path Normalized path, with bound directories followed.
+        * @return Mount holding the path, or `nullptr` for the default one.
+        */
+        const Mount* mountOf(const std::string&) const;
+        /**
+        * @param path Normalized path, with bound directories followed.
+        * @return true if the path is a file.
+        */
+        bool isFile(const std::string&) const;
+
+    public:
+        // == Constructor ==
+        MemorySource();
+
+        /**
+        * @brief Adds a file, creating missing parent directories.
+        *
+        * @param path Path of the file.
+        */
+        void addFile(const std::string&);
+        /**
+        * @brief Adds a file with contents, creating missing parent directories. Other files are empty.
+        *
+        * @param path Path of the file.
+        * @param bytes Contents of the file.
+        */
+        void addFile(const std::string&, const std::string&);
+        /**
+        * @brief Adds a directory, creating missing parent directories.
+        *
+        * @param path Path of the directory.
+        */
+        void addDirectory(const std::string&);
+        /**
+        * @brief Removes every entry.
+        */
+        void clear();
+        /**
+        * @brief Delays every listing, as a slow network directory would.
+        *
+        * @param perDirectory Delay of every listing.
+        * @param perEntry Additional delay per listed entry.
+        */
+        void setLatency(const std::chrono::microseconds, const std::chrono::microseconds);
+        /**
+        * @brief Makes listing a directory fail.
+        *
+        * @param path Path of the directory.
+        * @param message Description of the error.
+        */
+        void failDirectory(const std::string&, const std::string&);
+        /**
+        * @brief Makes listing a directory take much longer than the rest, as a directory on a hung mount would.
+        *
+        * @param path Path of the directory.
+        * @param duration Delay of every listing of the directory.
+        */
+        void stallDirectory(const std::string&, const std::chrono::microseconds);
+        /**
+        * @brief Mounts a directory (and everything below it, down to other mounts) as another device, creating it if needed.
+        *
+        * @param path Path of the directory.
+        * @param device Device id.
+        * @param type Filesystem type (e.g. "nfs").
+        */
+        void mountDevice(const std::string&, const uint64_t, const std::string&);
+        /**
+        * @brief Binds a directory to another, as a bind mount would: listing it lists the target. Creates it if needed.
+        *
+        * @param path Path of the directory.
+        * @param target Path of the target directory.
+        */
+        void bindDirectory(const std::string&, const std::string&);
+        /**
+        * @brief Makes a share of the directories fail to be listed. Which ones only depends on their path and the seed.
+        *
+        * @param rate Share of directories, from 0 to 1.
+        * @param seed Seed.
+        */
+        void setErrorRate(const double, const uint64_t);
+
+        // @return Amount of listings so far
+        uint64_t getListCount() const { return listCount.load(); }
+
+        bool resolve(const std::string&, std::filesystem::path&, std::string&) const override;
+        bool list(const std::filesystem::path&, std::vector<DirectoryEntry>&, ScanStats&, std::string&) const override;
+        uint64_t device(const std::filesystem::path&) const override;
+        bool identify(const std::filesystem::path&, DirectoryIdentity&) const override;
+        std::string filesystemType(const std::filesystem::path&) const override;
+        uint64_t stamp(const std::filesystem::path&) const override;
+        uint64_t fileSize(const std::filesystem::path&) const override;
+        std::unique_ptr<SourceFile> open(const std::filesystem::path&) const override;
+};
+
+#endif
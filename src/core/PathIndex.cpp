@@ -0,0 +1,177 @@
+// PathIndex.cpp : descriptions for the compact path index
+
+#include "PathIndex.h"
+#include "SpillFile.h"
+
+#include <algorithm>   // sort, max
+
+#include <filesystem>  // temporary directory. C++17 ONLY.
+
+PathIndex::PathIndex() {
+	memoryBudget = 0;
+	clear();
+}
+
+PathIndex::~PathIndex() {
+}
+
+void PathIndex::clear() {
+	arena.clear();
+	offsets.assign(1, 0);
+	rootIds.clear();
+	spill.reset();
+	spilledCount = 0;
+	peakMemoryBytes = memoryBytes();
+	longestPathLength = 0;
+	isView = false;
+	refreshOwned();
+}
+
+void PathIndex::setMemoryBudget(const uint64_t budget) {
+	memoryBudget = budget;
+}
+
+void PathIndex::reserve(const size_t count, const uint64_t bytes) {
+	// Entries past the budget are spilled anyway, so the room is scaled down to it, accounted as in `add()`.
+	const uint64_t neededBytes = bytes + (uint64_t)count * (sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint32_t));
+	const double scale = (memoryBudget != 0 && neededBytes > memoryBudget) ? (double)memoryBudget / (double)neededBytes : 1.0;
+	arena.reserve(arena.size() + (size_t)((double)bytes * scale));
+	offsets.reserve(offsets.size() + (size_t)((double)count * scale));
+	rootIds.reserve(rootIds.size() + (size_t)((double)count * scale));
+	refreshOwned();
+	peakMemoryBytes = std::max(peakMemoryBytes, memoryBytes());
+}
+
+void PathIndex::add(std::string_view path, const uint16_t rootId) {
+	arena.append(path.data(), path.size());
+	offsets.push_back(arena.size());
+	rootIds.push_back(rootId);
+	refreshOwned();
+	longestPathLength = std::max(longestPathLength, path.size());
+	peakMemoryBytes = std::max(peakMemoryBytes, memoryBytes());
+
+	// Accounts for the arena, both tables and the positions sorted while spilling.
+	if (
+		(memoryBudget != 0) &&
+		(arena.size() + offsets.size() * sizeof(uint64_t) + rootIds.size() * (sizeof(uint16_t) + sizeof(uint32_t)) >= memoryBudget)
+	) {
+		spillMemory();
+	}
+}
+
+void PathIndex::append(const PathIndex& other) {
+	// Entries that may be spilled are copied one at a time.
+	if (other.isSpilled() || memoryBudget != 0) {
+		for (size_t i = 0; i < other.size(); ++i) {
+			const uint16_t rootId = other.root(i);
+			add(other[i], rootId);
+		}
+		return;
+	}
+
+	// Shifts the offsets of the other index past the current arena.
+	const uint64_t base = arena.size();
+	arena.append(other.data(), (size_t)other.arenaBytes());
+	offsets.reserve(offsets.size() + other.size());
+	for (size_t i = 1; i <= other.size(); ++i) {
+		offsets.push_back(base + other.offsetTable()[i]);
+	}
+	rootIds.insert(rootIds.end(), other.rootTable(), other.rootTable() + other.size());
+	refreshOwned();
+	longestPathLength = std::max(longestPathLength, other.getLongestPathLength());
+	peakMemoryBytes = std::max(peakMemoryBytes, memoryBytes());
+}
+
+void PathIndex::attach(const char* externalArena, const uint64_t* externalOffsets, const uint16_t* externalRoots, const size_t externalCount) {
+	// Releases the owned storage, since it will not be used while attached.
+	std::string().swap(arena);
+	std::vector<uint64_t>().swap(offsets);
+	std::vector<uint16_t>().swap(rootIds);
+	spill.reset();
+	spilledCount = 0;
+
+	arenaData = externalArena;
+	offsetData = externalOffsets;
+	rootData = externalRoots;
+	count = externalCount;
+	isView = true;
+
+	longestPathLength = 0;
+	for (size_t i = 0; i < count; ++i) {
+		longestPathLength = std::max(longestPathLength, (size_t)(offsetData[i + 1] - offsetData[i]));
+	}
+}
+
+bool PathIndex::isContained(const std::string_view path) {
+#ifdef _WIN32
+	// Drive letters and backslashes could lead out of the root as well.
+	if (path.find_first_of(":\\") != std::string_view::npos) {
+		return false;
+	}
+#endif
+	size_t start = 0;
+	for (;;) {
+		const size_t end = path.find('/', start);
+		const std::string_view component = path.substr(start, (end == std::string_view::npos) ? std::string_view::npos : end - start);
+		if (component.empty() || component == "." || component == "..") {
+			return false;
+		}
+		if (end == std::string_view::npos) {
+			return true;
+		}
+		start = end + 1;
+	}
+}
+
+uint64_t PathIndex::pathBytes() const {
+	return (spill ? spill->getPathBytes() : 0) + arenaBytes();
+}
+
+void PathIndex::refreshOwned() {
+	arenaData = arena.data();
+	offsetData = offsets.data();
+	rootData = rootIds.data();
+	count = offsets.size() - 1;
+}
+
+void PathIndex::spillMemory() {
+	if (!spill) {
+		spill = std::make_unique<SpillFile>();
+		spill->open(std::filesystem::temp_directory_path());
+	}
+
+	// Sorts positions rather than the paths themselves, so that chunks can be merged later on.
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < order.size(); ++i) {
+		order[i] = (uint32_t)i;
+	}
+	const auto pathAt = [this](const uint32_t i) {
+		return std::string_view(arena.data() + offsets[i], (size_t)(offsets[i + 1] - offsets[i]));
+	};
+	std::sort(order.begin(), order.end(), [this, &pathAt](const uint32_t a, const uint32_t b) {
+		return (rootIds[a] != rootIds[b]) ? (rootIds[a] < rootIds[b]) : (pathAt(a) < pathAt(b));
+	});
+
+	spill->beginChunk();
+	for (const uint32_t i : order) {
+		spill->write(rootIds[i], pathAt(i));
+	}
+	spill->endChunk();
+	spilledCount = (size_t)spill->size();
+
+	arena.clear();
+	offsets.assign(1, 0);
+	rootIds.clear();
+	refreshOwned();
+}
+
+std::string_view PathIndex::spilledPath(const size_t i) const {
+	uint16_t rootId;
+	return spill->lookup(i, rootId);
+}
+
+uint16_t PathIndex::spilledRoot(const size_t i) const {
+	uint16_t rootId;
+	spill->lookup(i, rootId);
+	return rootId;
+}
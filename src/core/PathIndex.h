@@ -0,0 +1,162 @@
+// PathIndex.h : declarations for the compact path index
+
+#pragma once
+
+#ifndef PATHINDEX_H_
+#define PATHINDEX_H_
+
+#include <cstdint>     // fixed width integers
+#include <memory>      // unique_ptr
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+class SpillFile;
+
+/**
+* Stores relative path strings back to back in a single arena, plus an offsets array
+* where entry `i` spans `[offsets[i], offsets[i + 1])`, and the id of the root directory
+* each entry is relative to.
+*
+* The index either owns its storage or is a read-only view over external memory
+* (e.g. a shared memory segment), in which case it must not be modified.
+*
+* An owned index may be given a memory budget. Whenever the entries held in memory exceed it,
+* they are sorted and spilled as a chunk to a temporary file, so the first `spilledSize()`
+* entries live on disk and the rest in memory. Views returned for spilled entries are only
+* valid until the following lookup, and lookups are not thread-safe.
+*/
+class PathIndex {
+
+    private:
+        // Owned storage.
+        std::string arena;
+        std::vector<uint64_t> offsets;
+        std::vector<uint16_t> rootIds;
+
+        // Active storage (owned or external).
+        const char* arenaData;
+        const uint64_t* offsetData;
+        const uint16_t* rootData;
+        size_t count;
+        bool isView;
+
+        // Spilled entries, if the memory budget was exceeded.
+        std::unique_ptr<SpillFile> spill;
+        size_t spilledCount;
+        uint64_t memoryBudget;
+        uint64_t peakMemoryBytes;
+        size_t longestPathLength;
+
+        /**
+        * @brief Points the active storage at the owned containers.
+        */
+        void refreshOwned();
+        /**
+        * @brief Sorts the entries held in memory and moves them into a new chunk of the spill file.
+        */
+        void spillMemory();
+        /**
+        * @return Path of a spilled entry.
+        */
+        std::string_view spilledPath(const size_t) const;
+        /**
+        * @return Root id of a spilled entry.
+        */
+        uint16_t spilledRoot(const size_t) const;
+
+    public:
+        // == Constructor ==
+        PathIndex();
+        PathIndex(const PathIndex&) = delete;
+        PathIndex& operator=(const PathIndex&) = delete;
+        ~PathIndex();
+
+        /**
+        * @brief Empties the index and returns to owned storage. The memory budget is kept.
+        */
+        void clear();
+        /**
+        * @brief Sets the amount of memory the entries may take before being spilled to disk.
+        *
+        * @param budget Budget in bytes, or 0 for no limit.
+        */
+        void setMemoryBudget(const uint64_t);
+        /**
+        * @brief Reserves room for the paths about to be added, so that the storage is not grown (and copied) as they are.
+        * Never reserves past the memory budget.
+        *
+        * @param count Amount of paths.
+        * @param bytes Bytes taken by the paths.
+        */
+        void reserve(const size_t, const uint64_t);
+        /**
+        * @brief Appends a path to the index.
+        *
+        * @param path Relative path in UTF8 format.
+        * @param rootId Id of the root directory the path is relative to. Defaults to 0.
+        * @throws std::runtime_error If the spill file could not be written.
+        */
+        void add(std::string_view, const uint16_t = 0);
+        /**
+        * @brief Appends all paths of another index.
+        *
+        * @param other Index to copy the paths from.
+        * @throws std::runtime_error If a spill file could not be read or written.
+        */
+        void append(const PathIndex&);
+        /**
+        * @brief Turns the index into a read-only view over external memory.
+        *
+        * @param arena Concatenated path bytes.
+        * @param offsets Array of `count + 1` offsets into the arena.
+        * @param roots Array of `count` root ids.
+        * @param count Amount of paths.
+        */
+        void attach(const char*, const uint64_t*, const uint16_t*, const size_t);
+        /**
+        * @param path Relative path.
+        * @return Whether a relative path stays below its root: it is not absolute, and has no empty, `.` or `..`
+        * component.
+        */
+        static bool isContained(std::string_view);
+
+        // @return Amount of stored paths
+        size_t size() const { return spilledCount + count; }
+        // @return true if no paths are stored
+        bool empty() const { return size() == 0; }
+        // @return true if the index is a view over external memory
+        bool isAttached() const { return isView; }
+        // @return true if some paths were spilled to disk
+        bool isSpilled() const { return spilledCount != 0; }
+        // @return Amount of paths spilled to disk, which come before the ones held in memory
+        size_t spilledSize() const { return spilledCount; }
+        // @return Path stored at the given position
+        std::string_view operator[](const size_t i) const {
+            if (i < spilledCount) return spilledPath(i);
+            const size_t j = i - spilledCount;
+            return std::string_view(arenaData + offsetData[j], (size_t)(offsetData[j + 1] - offsetData[j]));
+        }
+        // @return Id of the root directory of the path stored at the given position
+        uint16_t root(const size_t i) const { return (i < spilledCount) ? spilledRoot(i) : rootData[i - spilledCount]; }
+        // @return Pointer to the concatenated path bytes held in memory
+        const char* data() const { return arenaData; }
+        // @return Pointer to the `size() - spilledSize() + 1` offsets of the paths held in memory
+        const uint64_t* offsetTable() const { return offsetData; }
+        // @return Pointer to the `size() - spilledSize()` root ids of the paths held in memory
+        const uint16_t* rootTable() const { return rootData; }
+        // @return Amount of bytes taken by the concatenated paths held in memory
+        uint64_t arenaBytes() const { return offsetData[count]; }
+        // @return Amount of bytes taken by every path, spilled or not
+        uint64_t pathBytes() const;
+        // @return Memory currently reserved by the owned storage, in bytes
+        uint64_t memoryBytes() const { return arena.capacity() + offsets.capacity() * sizeof(uint64_t) + rootIds.capacity() * sizeof(uint16_t); }
+        // @return Length in bytes of the longest stored path, so that path buffers can be sized once
+        size_t getLongestPathLength() const { return longestPathLength; }
+        // @return Peak of `memoryBytes()` since the index was last cleared
+        uint64_t getPeakMemoryBytes() const { return peakMemoryBytes; }
+        // @return Spill file, or `nullptr` if nothing was spilled
+        const SpillFile* getSpill() const { return spill.get(); }
+};
+
+#endif
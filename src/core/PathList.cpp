@@ -0,0 +1,277 @@
+// PathList.cpp : descriptions for reading lists of paths
+
+#include "PathList.h"
+
+#include <algorithm>   // min
+#include <cstring>     // memchr, memmove
+
+#include <filesystem>  // u8path. C++17 ONLY.
+
+#ifdef _WIN32
+#include <fcntl.h>     // _O_BINARY
+#include <io.h>        // _setmode, _fileno
+#include <windows.h>   // Windows API functions
+#else
+#include <fcntl.h>     // open
+#include <sys/mman.h>  // mmap, madvise
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // close
+#endif
+
+PathList::PathList() {
+	data = nullptr;
+	size = 0;
+	position = 0;
+	delimiter = '\n';
+	address = nullptr;
+	mappedSize = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+	fileDescriptor = -1;
+	stream = nullptr;
+	isStreamOwned = false;
+	isEnd = false;
+}
+
+PathList::~PathList() {
+	close();
+}
+
+bool PathList::open(const std::string& path, std::string& openError) {
+	close();
+
+	// Regular files are mapped, and anything else streamed.
+	bool isMapped = false;
+	if (path != STANDARD_INPUT && !map(path, isMapped)) {
+		openError = "Could not open " + path;
+		return false;
+	}
+	if (isMapped) {
+		data = (const char*)address;
+		size = mappedSize;
+		isEnd = true;
+	} else {
+		if (!openStream(path)) {
+			openError = "Could not open " + path;
+			return false;
+		}
+		buffer.resize(BLOCK_SIZE);
+		if (!refill()) {
+			openError = error;
+			close();
+			return false;
+		}
+	}
+	findDelimiter();
+	return true;
+}
+
+void PathList::close() {
+	unmap();
+	if (stream != nullptr && isStreamOwned) {
+		std::fclose(stream);
+	}
+	stream = nullptr;
+	isStreamOwned = false;
+	isEnd = false;
+	std::vector<char>().swap(buffer);
+	data = nullptr;
+	size = 0;
+	position = 0;
+	delimiter = '\n';
+	error.clear();
+}
+
+bool PathList::next(std::string_view& path) {
+	for (;;) {
+		const char* begin = data + position;
+		const size_t rest = size - position;
+		const char* end = (rest != 0) ? (const char*)std::memchr(begin, delimiter, rest) : nullptr;
+		if (end != nullptr) {
+			position = (size_t)(end - data) + 1;
+		} else if (!isEnd) {
+			// The path goes on in the following block.
+			if (!refill()) {
+				return false;
+			}
+			continue;
+		} else if (rest != 0) {
+			// The last path may have no delimiter after it.
+			end = data + size;
+			position = size;
+		} else {
+			return false;
+		}
+
+		size_t length = (size_t)(end - begin);
+		if (delimiter == '\n') {
+			while (length != 0 && begin[length - 1] == '\r') {
+				--length;
+			}
+		}
+		if (length != 0) {
+			path = std::string_view(begin, length);
+			return true;
+		}
+	}
+}
+
+bool PathList::refill() {
+	// A path longer than the whole buffer grows it.
+	const size_t rest = size - position;
+	if (rest != 0 && position != 0) {
+		std::memmove(buffer.data(), data + position, rest);
+	}
+	if (rest == buffer.size()) {
+		buffer.resize(buffer.size() * 2);
+	}
+	const size_t count = std::fread(buffer.data() + rest, 1, buffer.size() - rest, stream);
+	if (count < buffer.size() - rest) {
+		if (std::ferror(stream)) {
+			error = "Could not read the list";
+			return false;
+		}
+		isEnd = true;
+	}
+	data = buffer.data();
+	size = rest + count;
+	position = 0;
+	return true;
+}
+
+bool PathList::estimate(size_t& count, uint64_t& bytes) const {
+	if (address == nullptr) {
+		return false;
+	}
+	const size_t sampleSize = (std::min)(size, (size_t)BLOCK_SIZE);
+	size_t sampleCount = 0;
+	for (const char* found = data; (found = (const char*)std::memchr(found, delimiter, sampleSize - (size_t)(found - data))) != nullptr; ++found) {
+		++sampleCount;
+	}
+	count = (size_t)((double)(sampleCount + 1) * ((double)size / (double)sampleSize));
+	bytes = size;
+	return true;
+}
+
+void PathList::findDelimiter() {
+	const bool isNulSeparated = (size != 0) && (std::memchr(data, '\0', (std::min)(size, (size_t)BLOCK_SIZE)) != nullptr);
+	delimiter = isNulSeparated ? '\0' : '\n';
+}
+
+
+
+#ifdef _WIN32
+
+bool PathList::map(const std::string& path, bool& isMapped) {
+	isMapped = false;
+	const HANDLE file = CreateFileW(
+		std::filesystem::u8path(path).wstring().c_str(),
+		GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL
+	);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	// Pipes and devices are streamed instead, and empty files need no mapping.
+	LARGE_INTEGER fileSize;
+	if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return true;
+	}
+	if (fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		isMapped = true;
+		return true;
+	}
+	const HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = (mapping != NULL) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (view == NULL) {
+		if (mapping != NULL) CloseHandle(mapping);
+		CloseHandle(file);
+		return true;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	address = view;
+	mappedSize = (size_t)fileSize.QuadPart;
+	isMapped = true;
+	return true;
+}
+
+void PathList::unmap() {
+	if (address != nullptr) UnmapViewOfFile(address);
+	if (mappingHandle != nullptr) CloseHandle((HANDLE)mappingHandle);
+	if (fileHandle != nullptr) CloseHandle((HANDLE)fileHandle);
+	address = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	mappedSize = 0;
+}
+
+bool PathList::openStream(const std::string& path) {
+	if (path == STANDARD_INPUT) {
+		// Keeps carriage returns and NUL characters as they are.
+		_setmode(_fileno(stdin), _O_BINARY);
+		stream = stdin;
+		isStreamOwned = false;
+	} else {
+		stream = _wfopen(std::filesystem::u8path(path).wstring().c_str(), L"rb");
+		isStreamOwned = true;
+	}
+	return (stream != nullptr);
+}
+
+#else
+
+bool PathList::map(const std::string& path, bool& isMapped) {
+	isMapped = false;
+	const int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+
+	// Pipes and devices are streamed instead, and empty files need no mapping.
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+		::close(descriptor);
+		return true;
+	}
+	if (status.st_size == 0) {
+		::close(descriptor);
+		isMapped = true;
+		return true;
+	}
+	void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (view == MAP_FAILED) {
+		::close(descriptor);
+		return true;
+	}
+	madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL);
+	fileDescriptor = descriptor;
+	address = view;
+	mappedSize = (size_t)status.st_size;
+	isMapped = true;
+	return true;
+}
+
+void PathList::unmap() {
+	if (address != nullptr) munmap(address, mappedSize);
+	if (fileDescriptor >= 0) ::close(fileDescriptor);
+	address = nullptr;
+	fileDescriptor = -1;
+	mappedSize = 0;
+}
+
+bool PathList::openStream(const std::string& path) {
+	if (path == STANDARD_INPUT) {
+		stream = stdin;
+		isStreamOwned = false;
+	} else {
+		stream = std::fopen(path.c_str(), "rb");
+		isStreamOwned = true;
+	}
+	return (stream != nullptr);
+}
+
+#endif
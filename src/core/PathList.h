@@ -0,0 +1,124 @@
+// PathList.h : declarations for reading lists of paths
+
+#pragma once
+
+#ifndef PATHLIST_H_
+#define PATHLIST_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <cstdio>      // FILE
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+/**
+* Reads a list of paths, one per line or separated by NUL characters (as `find -print0` writes them),
+* from a file or from the standard input.
+*
+* Regular files are mapped into memory and split in place, so paths are never copied. The standard
+* input, and anything else that can not be mapped (e.g. a pipe), is read in large blocks instead.
+* Delimiters are found with `memchr`, which the C library vectorizes.
+*
+* The delimiter is NUL if the first block holds any, and a newline otherwise, in which case carriage
+* returns before it are dropped as well. Empty lines are skipped.
+*/
+class PathList {
+
+    private:
+        // Bytes being split, either the mapping or the buffer, and where the next path starts.
+        const char* data;
+        size_t size;
+        size_t position;
+        char delimiter;
+
+        // Mapped file.
+        void* address;
+        size_t mappedSize;
+        void* fileHandle;    // Only used on Windows.
+        void* mappingHandle; // Only used on Windows.
+        int fileDescriptor;  // Only used elsewhere.
+
+        // Streamed input, and whether it was all read.
+        FILE* stream;
+        bool isStreamOwned;
+        bool isEnd;
+        std::vector<char> buffer;
+
+        std::string error;
+
+        /**
+        * @brief Moves the rest of the buffer to its beginning and reads the following block after it.
+        *
+        * @return If the input could not be read, returns `false`.
+        */
+        bool refill();
+        /**
+        * @brief Chooses the delimiter from the first bytes.
+        */
+        void findDelimiter();
+
+        // == Platform functions ==
+        /**
+        * @brief Maps a regular file.
+        *
+        * @param path Path to the file.
+        * @param isMapped Set to true if the file was mapped, and to false if it must be streamed instead.
+        * @return If the file could not be opened, returns `false`.
+        */
+        bool map(const std::string&, bool&);
+        /**
+        * @brief Unmaps and closes the file, if mapped.
+        */
+        void unmap();
+        /**
+        * @brief Opens a file, or the standard input, as a stream.
+        *
+        * @param path Path to the file, or `STANDARD_INPUT`.
+        * @return If the file could not be opened, returns `false`.
+        */
+        bool openStream(const std::string&);
+
+    public:
+        static const size_t BLOCK_SIZE = 1 << 22; // Bytes read at once from streams, and searched for NUL characters
+        static constexpr const char* STANDARD_INPUT = "-"; // Path that stands for the standard input
+
+        // == Constructor ==
+        PathList();
+        PathList(const PathList&) = delete;
+        PathList& operator=(const PathList&) = delete;
+        ~PathList();
+
+        /**
+        * @brief Opens a list, closing the previous one.
+        *
+        * @param path Path to the list, or `STANDARD_INPUT`.
+        * @param error Receives the description of the error, if any.
+        * @return If the list could not be opened, returns `false`.
+        */
+        bool open(const std::string&, std::string&);
+        /**
+        * @brief Closes the list.
+        */
+        void close();
+        /**
+        * @brief Reads the following path. The view lasts until the following call.
+        *
+        * @param path Receives the path.
+        * @return Once every path was read, or if the list could not be read, returns `false`.
+        */
+        bool next(std::string_view&);
+        /**
+        * @brief Estimates the size of a mapped list from the paths in its first block, so that storage can be reserved.
+        *
+        * @param count Receives the estimated amount of paths.
+        * @param bytes Receives the size of the list, close to the bytes taken by the paths.
+        * @return If the list is streamed, and its size is unknown, returns `false`.
+        */
+        bool estimate(size_t&, uint64_t&) const;
+
+        // @return Why the list could not be read, if it could not
+        const std::string& getError() const { return error; }
+};
+
+#endif
@@ -0,0 +1,84 @@
+// Permutation.h : random permutations computed on demand
+
+#pragma once
+
+#ifndef PERMUTATION_H_
+#define PERMUTATION_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+
+/**
+* Random permutation of `[0, size)` that takes constant memory, for indexes too large to keep
+* a shuffled order of their positions.
+*
+* Positions are encrypted with a small Feistel network over the smallest even amount of bits
+* covering the size, and re-encrypted while they fall outside of it (cycle walking), which
+* keeps the mapping a bijection.
+*/
+class Permutation {
+
+    private:
+        static const int ROUNDS = 4;
+
+        uint64_t count;
+        int halfBits;
+        uint64_t halfMask;
+        uint64_t keys[ROUNDS];
+
+        // @return Well mixed 64 bits (SplitMix64 finalizer)
+        static uint64_t mix(uint64_t value) {
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+
+        // @return One pass of the Feistel network
+        uint64_t encrypt(uint64_t value) const {
+            uint64_t left = value >> halfBits;
+            uint64_t right = value & halfMask;
+            for (int round = 0; round < ROUNDS; ++round) {
+                const uint64_t next = left ^ (mix(right ^ keys[round]) & halfMask);
+                left = right;
+                right = next;
+            }
+            return (left << halfBits) | right;
+        }
+
+    public:
+        // == Constructor ==
+        Permutation() { reset(0, 0); }
+
+        /**
+        * @brief Picks a new permutation.
+        *
+        * @param size Amount of positions.
+        * @param seed Seed the permutation is derived from.
+        */
+        void reset(const uint64_t size, const uint64_t seed) {
+            count = size;
+            halfBits = 1;
+            while (halfBits < 32 && (1ULL << (2 * halfBits)) < count) {
+                ++halfBits;
+            }
+            halfMask = (1ULL << halfBits) - 1;
+            for (int round = 0; round < ROUNDS; ++round) {
+                keys[round] = mix(seed + (uint64_t)round * 0x9e3779b97f4a7c15ULL);
+            }
+        }
+
+        // @return Amount of positions, or 0 if no permutation was picked
+        uint64_t size() const { return count; }
+        // @return true if no permutation was picked
+        bool empty() const { return count == 0; }
+        // @return Position found at the given place of the permutation
+        size_t operator()(const uint64_t i) const {
+            uint64_t value = encrypt(i);
+            while (value >= count) {
+                value = encrypt(value);
+            }
+            return (size_t)value;
+        }
+};
+
+#endif
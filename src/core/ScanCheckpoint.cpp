@@ -0,0 +1,223 @@
+// ScanCheckpoint.cpp : descriptions for the checkpoints of an interrupted scan
+
+#include "ScanCheckpoint.h"
+#include "Hash.h"
+#include "TempFiles.h"
+
+static const size_t HEADER_BYTES = 24;        // Magic, version and signature hash.
+static const size_t RECORD_HEADER_BYTES = 24; // Payload size, checksum and amount of paths.
+
+static void put(std::string& bytes, uint64_t value, const int width) {
+	for (int i = 0; i < width; ++i) {
+		bytes.push_back((char)(value & 0xFF));
+		value >>= 8;
+	}
+}
+
+static uint64_t get(const unsigned char* bytes, const int width) {
+	uint64_t value = 0;
+	for (int i = width - 1; i >= 0; --i) {
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+ScanCheckpoint::ScanCheckpoint(const std::filesystem::path& filePath, const uint64_t signatureHash)
+	: filePath(filePath), signatureHash(signatureHash) {
+	isStarted = false;
+	isFailed = false;
+	recordPathCount = 0;
+	restoredCount = 0;
+}
+
+void ScanCheckpoint::appendPath(const std::string_view path) {
+	put(record, path.size(), 4);
+	record.append(path);
+	++recordPathCount;
+}
+
+bool ScanCheckpoint::restore(
+	const std::filesystem::path& root,
+	const uint16_t rootId,
+	PathIndex& index,
+	std::vector<PendingDirectory>& frontier,
+	uint64_t& fileCount,
+	uint64_t& directoryCount
+) {
+	restoredCount = 0;
+	std::error_code errorCode;
+	const uint64_t fileSize = std::filesystem::file_size(filePath, errorCode);
+	if (errorCode || !TempFiles::isPrivate(filePath)) {
+		return false;
+	}
+	std::ifstream input(filePath, std::ios::binary);
+	unsigned char header[HEADER_BYTES];
+	if (
+		!input.read((char*)header, sizeof(header)) ||
+		(get(header, 8) != MAGIC) ||
+		(get(header + 8, 8) != VERSION) ||
+		(get(header + 16, 8) != signatureHash)
+	) {
+		return false;
+	}
+
+	// Walks a payload, calling a function with every path, and returns false if it is malformed or leads out of the root.
+	std::vector<PendingDirectory> committedFrontier;
+	uint64_t committedFiles = 0;
+	uint64_t committedDirectories = 0;
+	const auto parse = [&](const std::string& payload, const uint64_t pathCount, const auto& visit) {
+		const unsigned char* bytes = (const unsigned char*)payload.data();
+		size_t cursor = 0;
+		const auto take = [&](const size_t width) {
+			return (cursor + width <= payload.size()) ? (cursor += width, true) : false;
+		};
+		for (uint64_t i = 0; i < pathCount; ++i) {
+			if (!take(4)) return false;
+			const size_t length = (size_t)get(bytes + cursor - 4, 4);
+			if (!take(length)) return false;
+			const std::string_view path(payload.data() + cursor - length, length);
+			if (!PathIndex::isContained(path)) return false;
+			visit(path);
+		}
+		if (!take(24)) return false;
+		committedFiles = get(bytes + cursor - 24, 8);
+		committedDirectories = get(bytes + cursor - 16, 8);
+		const uint64_t frontierCount = get(bytes + cursor - 8, 8);
+		committedFrontier.clear();
+		for (uint64_t i = 0; i < frontierCount; ++i) {
+			if (!take(8)) return false;
+			const int depth = (int)get(bytes + cursor - 8, 4);
+			const size_t length = (size_t)get(bytes + cursor - 4, 4);
+			if (!take(length)) return false;
+			if (length != 0 && (payload[cursor - 1] != '/' || !PathIndex::isContained(std::string_view(payload.data() + cursor - length, length - 1)))) {
+				return false;
+			}
+			PendingDirectory directory;
+			directory.relativePath.assign(payload, cursor - length, length);
+			directory.path = directory.relativePath.empty()
+				? root
+				: root / std::filesystem::u8path(directory.relativePath.substr(0, length - 1));
+			directory.depth = depth;
+			committedFrontier.push_back(std::move(directory));
+		}
+		return cursor == payload.size();
+	};
+
+	// Applies records until the first one that is truncated or damaged.
+	bool isRestored = false;
+	uint64_t offset = HEADER_BYTES;
+	std::string payload;
+	unsigned char recordHeader[RECORD_HEADER_BYTES];
+	while (input.read((char*)recordHeader, sizeof(recordHeader))) {
+		offset += RECORD_HEADER_BYTES;
+		const uint64_t payloadBytes = get(recordHeader, 8);
+		const uint64_t checksum = get(recordHeader + 8, 8);
+		const uint64_t pathCount = get(recordHeader + 16, 8);
+		if (payloadBytes > fileSize - offset) {
+			break;
+		}
+		payload.resize((size_t)payloadBytes);
+		if (
+			!input.read(&payload[0], (std::streamsize)payloadBytes) ||
+			(Hash::fnv1a(payload) != checksum) ||
+			!parse(payload, pathCount, [](std::string_view) {})
+		) {
+			break;
+		}
+		offset += payloadBytes;
+		parse(payload, pathCount, [&](const std::string_view path) { index.add(path, rootId); });
+		frontier.swap(committedFrontier);
+		fileCount = committedFiles;
+		directoryCount = committedDirectories;
+		isRestored = true;
+	}
+
+	if (!isRestored) {
+		index.clear();
+		frontier.clear();
+		return false;
+	}
+	restoredCount = index.size();
+	return true;
+}
+
+void ScanCheckpoint::commit(const PathIndex& index, const std::vector<PendingDirectory>& frontier, const uint64_t fileCount, const uint64_t directoryCount) {
+	// Starts the journal with every path found so far. It is written aside and renamed, so that the journal
+	// of a previous run survives until the new one can replace it.
+	if (!isStarted) {
+		const std::filesystem::path temporaryPath = TempFiles::temporaryFor(filePath);
+		if (!TempFiles::create(temporaryPath)) {
+			isFailed = true;
+			error = "Could not create checkpoint file \"" + temporaryPath.u8string() + "\"";
+			return;
+		}
+		{
+			std::ofstream temporary(temporaryPath, std::ios::binary | std::ios::trunc);
+			std::string header;
+			put(header, MAGIC, 8);
+			put(header, VERSION, 8);
+			put(header, signatureHash, 8);
+			temporary.write(header.data(), (std::streamsize)header.size());
+			record.clear();
+			recordPathCount = 0;
+			for (size_t i = 0; i < index.size(); ++i) {
+				appendPath(index[i]);
+			}
+			if (!temporary) {
+				isFailed = true;
+				error = "Could not create checkpoint file \"" + temporaryPath.u8string() + "\"";
+			}
+		}
+		if (isFailed) {
+			std::error_code ignored;
+			std::filesystem::remove(temporaryPath, ignored);
+			return;
+		}
+		std::error_code errorCode;
+		std::filesystem::rename(temporaryPath, filePath, errorCode);
+		if (!errorCode) {
+			stream.open(filePath, std::ios::binary | std::ios::app);
+		}
+		if (errorCode || !stream) {
+			isFailed = true;
+			error = "Could not create checkpoint file \"" + filePath.u8string() + "\"";
+			std::filesystem::remove(temporaryPath, errorCode);
+			return;
+		}
+		isStarted = true;
+	}
+
+	// Completes the record with the counters and the frontier.
+	put(record, fileCount, 8);
+	put(record, directoryCount, 8);
+	put(record, frontier.size(), 8);
+	for (const PendingDirectory& directory : frontier) {
+		put(record, (uint64_t)directory.depth, 4);
+		put(record, directory.relativePath.size(), 4);
+		record.append(directory.relativePath);
+	}
+	std::string recordHeader;
+	put(recordHeader, record.size(), 8);
+	put(recordHeader, Hash::fnv1a(record), 8);
+	put(recordHeader, recordPathCount, 8);
+	stream.write(recordHeader.data(), (std::streamsize)recordHeader.size());
+	stream.write(record.data(), (std::streamsize)record.size());
+	if (!stream.flush()) {
+		isFailed = true;
+		error = "Could not write checkpoint file \"" + filePath.u8string() + "\"";
+	}
+	record.clear();
+	recordPathCount = 0;
+	nextCommit = std::chrono::steady_clock::now() + std::chrono::seconds(INTERVAL_SECONDS);
+}
+
+void ScanCheckpoint::discard() {
+	if (stream.is_open()) {
+		stream.close();
+	}
+	isStarted = false;
+	record.clear();
+	recordPathCount = 0;
+	std::error_code errorCode;
+	std::filesystem::remove(filePath, errorCode);
+}
@@ -0,0 +1,135 @@
+// ScanCheckpoint.h : declarations for the checkpoints of an interrupted scan
+
+#pragma once
+
+#ifndef SCANCHECKPOINT_H_
+#define SCANCHECKPOINT_H_
+
+#include <chrono>      // steady clock
+#include <cstdint>     // fixed width integers
+#include <fstream>     // file streams
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "PathIndex.h"
+
+/**
+* Directory waiting to be listed by a scan. Relative paths are built by concatenation, so they never
+* depend on how the source resolves links.
+*/
+struct PendingDirectory {
+    std::filesystem::path path;
+    std::string relativePath; // Empty for the root, and ending in a separator otherwise.
+    int depth;                // Depth of the entries of the directory.
+};
+
+/**
+* Journal of the progress of the scan of a single root, from which an interrupted scan can resume.
+*
+* The journal is an append-only file. Once a root holds enough files, every commit appends a record
+* with the files found since the previous commit and the whole frontier (the directories waiting to be
+* listed), so each path is written once and a commit costs about as much as the frontier, which a
+* depth-first scan keeps small. Commits happen between directories only, when the index and the
+* frontier agree with each other.
+*
+* Records carry a checksum. Restoring stops at the first truncated or damaged record, so a journal cut
+* short by a crash still resumes from its last complete commit.
+*
+* Failing to write a checkpoint never fails the scan: checkpoints stop and `getError()` tells why.
+*/
+class ScanCheckpoint {
+
+    private:
+        static const uint64_t MAGIC = 0x3154504B434F4652ULL; // "RFOCKPT1"
+        static const uint32_t VERSION = 1;
+
+        std::filesystem::path filePath;
+        uint64_t signatureHash;
+        std::ofstream stream;
+        bool isStarted;       // Whether the journal has been created by this scan.
+        bool isFailed;        // Whether a write failed, which stops checkpoints.
+        std::string error;
+
+        // Record being built: the files found since the previous commit.
+        std::string record;
+        uint64_t recordPathCount;
+        std::chrono::steady_clock::time_point nextCommit;
+
+        uint64_t restoredCount;
+
+        /**
+        * @brief Appends a path to the record being built.
+        *
+        * @param path Relative path.
+        */
+        void appendPath(std::string_view);
+
+    public:
+        static const uint64_t FILE_THRESHOLD = 100000; // Files a root must hold before it is checkpointed
+        static const int INTERVAL_SECONDS = 5;         // Time between commits
+
+        // == Constructor ==
+        /**
+        * @param filePath Path of the journal.
+        * @param signatureHash Hash of the root and the scan options, which a journal must match to be restored.
+        */
+        ScanCheckpoint(const std::filesystem::path&, const uint64_t);
+
+        /**
+        * @brief Restores the last complete commit of the journal, if there is one that matches the signature.
+        *
+        * @param root Resolved path to the root directory.
+        * @param rootId Id of the root directory, stored along each path.
+        * @param index Empty index that receives the committed paths.
+        * @param frontier Receives the directories that were waiting to be listed.
+        * @param fileCount Receives the amount of committed files.
+        * @param directoryCount Receives the amount of committed subdirectories.
+        * @return true if a commit was restored. Otherwise, the index and frontier are left empty.
+        */
+        bool restore(const std::filesystem::path&, const uint16_t, PathIndex&, std::vector<PendingDirectory>&, uint64_t&, uint64_t&);
+        /**
+        * @brief Records a file found by the scan. Does nothing before the first commit, which takes the whole index.
+        *
+        * @param path Relative path.
+        */
+        void add(std::string_view path) {
+            if (isStarted) appendPath(path);
+        }
+        /**
+        * @param now Current time.
+        * @param fileCount Files the root holds so far.
+        * @return true if a commit is due.
+        */
+        bool isDue(const std::chrono::steady_clock::time_point now, const uint64_t fileCount) const {
+            if (isFailed) return false;
+            return isStarted ? (now >= nextCommit) : (fileCount >= FILE_THRESHOLD);
+        }
+        /**
+        * @brief Appends a record to the journal, creating it first (with every path of the index) if needed.
+        *
+        * @param index Index of the root.
+        * @param frontier Directories waiting to be listed.
+        * @param fileCount Files the root holds so far.
+        * @param directoryCount Subdirectories found so far.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void commit(const PathIndex&, const std::vector<PendingDirectory>&, const uint64_t, const uint64_t);
+        /**
+        * @brief Closes and removes the journal, once the scan it belongs to is no longer needed.
+        */
+        void discard();
+
+        // @return true if this scan wrote the journal
+        bool getIsStarted() const { return isStarted; }
+        // @return Amount of files restored from the journal
+        uint64_t getRestoredCount() const { return restoredCount; }
+        // @return Description of the last error, if any
+        const std::string& getError() const { return error; }
+        // @return Path of the journal
+        const std::filesystem::path& getPath() const { return filePath; }
+};
+
+#endif
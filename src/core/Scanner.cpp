@@ -0,0 +1,744 @@
+// Scanner.cpp : descriptions for the directory scanner
+
+#include "Scanner.h"
+#include "IndexFile.h"
+#include "Allocations.h"
+#include "Trace.h"
+
+#include <algorithm>   // find, reverse, count, replace
+#include <chrono>      // steady_clock
+#include <map>         // ordered maps
+#include <set>         // ordered sets
+#include <thread>      // sleep_for
+#include <utility>     // pair
+
+Scanner::Scanner() {
+	depth = DEPTH_DEFAULT;
+	checkCaps = true;
+	isDepthCapped = false;
+	shardIndex = 0;
+	shardCount = 1;
+	isResuming = false;
+	listTimeout = std::chrono::milliseconds(0);
+	isRetryingSkipped = false;
+	isIdleIo = false;
+	backoffThreshold = std::chrono::milliseconds(0);
+	isOneFileSystem = false;
+	isSplittingDevices = false;
+	isExpandingArchives = false;
+	source = std::make_shared<FileSystemSource>();
+}
+
+bool Scanner::configure(const ScanOptions& options, std::string& error) {
+	checkCaps = options.checkCaps;
+
+	// Validates (and adjusts, if necessary) the allowed depth value.
+	depth = adjustDepth(options.depth, checkCaps, isDepthCapped);
+
+	// Validates the memory budget.
+	if (
+		(options.memoryBudget != 0) &&
+		(options.memoryBudget < MIN_MEMORY_BUDGET)
+	) {
+		error = "Memory budget must be at least " + std::to_string(MIN_MEMORY_BUDGET) + " bytes";
+		return false;
+	}
+
+	// Validates the shard.
+	if (
+		(options.shardCount == 0) ||
+		(options.shardIndex >= options.shardCount)
+	) {
+		error = "Shard " + std::to_string(options.shardIndex + 1) + " of " + std::to_string(options.shardCount) + " does not exist";
+		return false;
+	}
+	shardIndex = options.shardIndex;
+	shardCount = options.shardCount;
+	isResuming = options.resume;
+	listTimeout = std::chrono::milliseconds(options.listTimeout);
+	isRetryingSkipped = options.retrySkipped;
+	isIdleIo = options.idleIo;
+	backoffThreshold = std::chrono::milliseconds(options.backoffThreshold);
+	isOneFileSystem = options.oneFileSystem;
+	skippedFilesystemTypes = options.skippedFilesystemTypes;
+	isSplittingDevices = options.splitDevices;
+	isExpandingArchives = options.archives;
+
+	// Parses blacklisted directories.
+	directoryBlacklist.clear();
+	for (const std::string& forbiddenDirectory : options.excludedDirectories) {
+		std::filesystem::path directory;
+		if (!source->resolve(forbiddenDirectory, directory, error)) {
+			error = "Blacklisted directory \"" + forbiddenDirectory + "\": " + error;
+			return false;
+		}
+		directoryBlacklist.push_back(directory);
+	}
+
+	// Parses whitelisted extensions.
+	// Includes a dot at the beginning for std::filesystem::path::extension compatibility.
+	extensionWhitelist.clear();
+	for (const std::string& allowedExtension : options.extensions) {
+		extensionWhitelist.push_back(
+			EXTENSION_DOT + allowedExtension
+		);
+	}
+
+	return true;
+}
+
+/**
+* @brief Sleeps for a while, in short steps, so that a cancelled scan stops soon.
+*
+* @param duration Time to sleep.
+* @param context State shared with the rest of workers.
+* @return Time slept, in nanoseconds.
+*/
+static uint64_t pause(const std::chrono::nanoseconds duration, const ScanContext& context) {
+	if (duration.count() <= 0) {
+		return 0;
+	}
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const std::chrono::steady_clock::time_point end = start + duration;
+	for (std::chrono::steady_clock::time_point now = start; now < end && !context.isStopped.load(std::memory_order_relaxed); now = std::chrono::steady_clock::now()) {
+		std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(end - now, std::chrono::milliseconds(Scanner::PAUSE_STEP_MILLISECONDS)));
+	}
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+* @brief Commits the progress of a scan. Directories handed off to other workers are committed as if they were
+* still waiting to be listed, since their files are not in the index, so resuming scans them again.
+*
+* @param checkpoint Journal.
+* @param index Index of the root.
+* @param frontier Directories waiting to be listed.
+* @param handedOff Directories handed off to other workers.
+* @param result Result so far.
+*/
+static void commitCheckpoint(
+	ScanCheckpoint& checkpoint,
+	const PathIndex& index,
+	const std::vector<PendingDirectory>& frontier,
+	const std::vector<PendingDirectory>& handedOff,
+	const ScanResult& result
+) {
+	if (handedOff.empty()) {
+		checkpoint.commit(index, frontier, result.fileCount, result.directoryCount);
+		return;
+	}
+	std::vector<PendingDirectory> pending(frontier);
+	pending.insert(pending.end(), handedOff.begin(), handedOff.end());
+	checkpoint.commit(index, pending, result.fileCount, result.directoryCount);
+}
+
+/**
+* @brief Turns runtime flags into the template arguments of a `ScanPolicy`, one flag at a time.
+*
+* Every flag doubles the scan loops compiled: the 4 flags of a `ScanPolicy` make 16. Rarely used options that
+* cost a single predictable branch per file, such as expanding archives, are tested at runtime instead.
+*
+* @param scan Called with a default constructed policy.
+*/
+template <bool... Chosen, typename Scan>
+static ScanResult dispatchPolicy(const Scan& scan) {
+	return scan(ScanPolicy<Chosen...>());
+}
+template <bool... Chosen, typename Scan, typename... Flags>
+static ScanResult dispatchPolicy(const Scan& scan, const bool flag, const Flags... flags) {
+	return flag
+		? dispatchPolicy<Chosen..., true>(scan, flags...)
+		: dispatchPolicy<Chosen..., false>(scan, flags...);
+}
+
+ScanResult Scanner::scan(const std::filesystem::path& rootDirectory, const uint16_t rootId, PathIndex& index, ScanContext& context, ScanCheckpoint* checkpoint) const {
+	return scanSubtree(PendingDirectory{ rootDirectory, std::string(), 0 }, rootId, index, context, checkpoint);
+}
+
+ScanResult Scanner::scanSubtree(const PendingDirectory& start, const uint16_t rootId, PathIndex& index, ScanContext& context, ScanCheckpoint* checkpoint) const {
+	// Determines once which filters must be applied, rather than for every entry.
+	return dispatchPolicy(
+		[&](auto policy) { return traverse<decltype(policy)>(start, rootId, index, context, checkpoint); },
+		(shardCount > 1),
+		(directoryBlacklist.size() > 0),
+		(extensionWhitelist.size() > 0),
+		(bool)context.progress
+	);
+}
+
+template <class Policy>
+ScanResult Scanner::traverse(const PendingDirectory& start, const uint16_t rootId, PathIndex& index, ScanContext& context, ScanCheckpoint* checkpoint) const {
+	ScanResult result;
+
+	// Clears the index.
+	index.clear();
+
+	// Directories waiting to be listed, either the start or those left by an interrupted scan.
+	std::vector<PendingDirectory> frontier;
+	if (
+		(checkpoint != nullptr) &&
+		isResuming &&
+		checkpoint->restore(start.path, rootId, index, frontier, result.fileCount, result.directoryCount)
+	) {
+		context.fileCount.fetch_add(result.fileCount, std::memory_order_relaxed);
+		context.directoryCount.fetch_add(result.directoryCount, std::memory_order_relaxed);
+	} else {
+		frontier.push_back(start);
+	}
+
+	// Identifies directories to tell the devices and filesystems they are on, and those reached twice. The start is
+	// always scanned, and the filesystem of every other device is checked once.
+	const bool isIdentifying = getIsIdentifying();
+	const bool isHandingOff = getIsSplittingDevices() && (bool)context.handOff;
+	DirectoryIdentity startIdentity;
+	std::set<std::pair<uint64_t, uint64_t>> visitedDirectories;
+	std::map<uint64_t, bool> isDeviceSkipped;
+	std::vector<PendingDirectory> handedOff;
+	if (isIdentifying && source->identify(start.path, startIdentity)) {
+		++result.stats.statCalls;
+		visitedDirectories.emplace(startIdentity.device, startIdentity.node);
+		isDeviceSkipped[startIdentity.device] = false;
+	}
+	std::vector<DirectoryEntry> entries;
+	std::vector<ArchiveEntry> archiveEntries;
+	std::string relativePath;
+
+	// With a deadline, directories are listed on a worker that is left behind if it hangs.
+	std::unique_ptr<DirectoryReader> reader;
+	if (listTimeout.count() > 0) {
+		reader = std::make_unique<DirectoryReader>(source, listTimeout, isRetryingSkipped, isIdleIo);
+	}
+
+	// Lowers the I/O priority of this thread while it scans, and backs off from a busy disk.
+	const IdleIoScope idleIoScope(isIdleIo);
+	LatencyBackoff backoff(backoffThreshold);
+	std::vector<PendingDirectory> skippedDirectories;
+	std::vector<bool> isLate;
+
+	uint64_t entryCount = 0;
+	ScanStats& stats = result.stats;
+	const std::chrono::steady_clock::time_point scanStart = std::chrono::steady_clock::now();
+	const bool isTraced = Trace::isEnabled();
+	const AllocationCounts allocationStart = Allocations::thread();
+
+	try {
+		while (!frontier.empty() || (reader != nullptr && reader->hasLate())) {
+			// Stops if the scan was cancelled.
+			if (context.isStopped.load(std::memory_order_relaxed)) {
+				break;
+			}
+
+			// Takes skipped directories listed since, waiting for them once the rest is done, and otherwise the next one.
+			PendingDirectory directory;
+			DirectoryReader::Outcome outcome = DirectoryReader::listed;
+			size_t lateTag = 0;
+			bool isLateListed = false;
+			std::chrono::steady_clock::time_point listStart = std::chrono::steady_clock::now();
+			if (reader != nullptr && reader->hasLate() && reader->takeLate(entries, stats, isLateListed, lateTag, frontier.empty())) {
+				if (!isLateListed) {
+					continue;
+				}
+				directory = skippedDirectories[lateTag];
+				isLate[lateTag] = true;
+				++stats.lateDirectories;
+			} else if (frontier.empty()) {
+				break;
+			} else {
+				directory = std::move(frontier.back());
+				frontier.pop_back();
+				stats.throttleNanoseconds += pause(context.directoryBucket.take(1), context);
+				listStart = std::chrono::steady_clock::now();
+				if (reader != nullptr) {
+					outcome = reader->list(directory.path, entries, stats, result.error, skippedDirectories.size());
+				} else if (!source->list(directory.path, entries, stats, result.error)) {
+					outcome = DirectoryReader::failed;
+				}
+			}
+			const std::chrono::steady_clock::time_point listEnd = std::chrono::steady_clock::now();
+			stats.listNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(listEnd - listStart).count();
+			if (isTraced) {
+				Trace::record("list", "scan", listStart, listEnd, directory.relativePath);
+			}
+			if (outcome == DirectoryReader::timedOut) {
+				skippedDirectories.push_back(std::move(directory));
+				isLate.push_back(false);
+				result.error.clear();
+				continue;
+			}
+			if (outcome == DirectoryReader::failed) {
+				result.ok = false;
+				break;
+			}
+			++stats.listedDirectories;
+			stats.seenEntries += entries.size();
+			const size_t firstChild = frontier.size();
+
+			for (const DirectoryEntry& entry : entries) {
+				// Reports progress and lets the caller cancel.
+				if constexpr (Policy::isReporting) {
+					if (++entryCount % PROGRESS_INTERVAL == 0) {
+						ScanProgress current;
+						current.fileCount = context.fileCount.load(std::memory_order_relaxed);
+						current.directoryCount = context.directoryCount.load(std::memory_order_relaxed);
+
+						const std::lock_guard<std::mutex> lock(context.progressMutex);
+						if (!context.isStopped && !context.progress(current)) {
+							context.isCancelled = true;
+							context.isStopped = true;
+							break;
+						}
+					}
+				}
+
+				// Skips top-level entries (and everything below them) that belong to other shards.
+				if constexpr (Policy::isSharding) {
+					if (
+						(directory.depth == 0) &&
+						!IndexFile::isInShard(entry.name, shardIndex, shardCount)
+					) {
+						++stats.shardRejects;
+						continue;
+					}
+				}
+
+				// Do not list directories.
+				if (entry.type == DirectoryEntry::directory) {
+					// Skip this directory if maximum depth has been reached.
+					if (directory.depth >= depth) {
+						++stats.depthRejects;
+						continue;
+					}
+
+					// Skip this directory if blacklisted.
+					std::filesystem::path childPath = directory.path / std::filesystem::u8path(entry.name);
+					if constexpr (Policy::isBlacklisting) {
+						if (isDirectoryBlacklisted(childPath)) {
+							++stats.blacklistRejects;
+							continue;
+						}
+					}
+
+					// Skip this directory if it is on another device or filesystem than allowed, or was reached before.
+					DirectoryIdentity identity;
+					const bool isIdentified = isIdentifying && source->identify(childPath, identity);
+					if (isIdentified) {
+						++stats.statCalls;
+						if (!visitedDirectories.emplace(identity.device, identity.node).second) {
+							++stats.loopRejects;
+							continue;
+						}
+						if (identity.device != startIdentity.device) {
+							if (isOneFileSystem) {
+								++stats.deviceRejects;
+								continue;
+							}
+							const std::map<uint64_t, bool>::iterator skipped = isDeviceSkipped.find(identity.device);
+							if (
+								(skipped == isDeviceSkipped.end())
+									? (isDeviceSkipped[identity.device] = isFilesystemSkipped(source->filesystemType(childPath)))
+									: skipped->second
+							) {
+								++stats.filesystemRejects;
+								continue;
+							}
+						}
+					}
+
+					// Hands directories on other devices to the workers of their devices, which may have taken them before.
+					PendingDirectory child{ std::move(childPath), directory.relativePath + entry.name + '/', directory.depth + 1 };
+					if (isHandingOff && isIdentified && identity.device != startIdentity.device) {
+						if (checkpoint != nullptr) {
+							handedOff.push_back(child);
+						}
+						if (!context.handOff(rootId, std::move(child), identity)) {
+							if (checkpoint != nullptr) {
+								handedOff.pop_back();
+							}
+							++stats.loopRejects;
+							continue;
+						}
+					} else {
+						frontier.push_back(std::move(child));
+					}
+
+					// Count directory.
+					++result.directoryCount;
+					context.directoryCount.fetch_add(1, std::memory_order_relaxed);
+				}
+				// Do list files.
+				else if (entry.type == DirectoryEntry::file) {
+					// List the files inside archives instead, unless they can not be read.
+					if (isExpandingArchives) {
+						const Archive::Format format = Archive::formatOf(entry.name);
+						if (
+							(format != Archive::none) &&
+							expandArchive(directory, entry.name, format, rootId, index, context, checkpoint, result, archiveEntries)
+						) {
+							continue;
+						}
+					}
+
+					// Ignore if extension whitelist is enabled and the current file's extension does not match any.
+					if constexpr (Policy::isFiltering) {
+						if (!isExtensionWhitelisted(extensionOf(entry.name))) {
+							++stats.extensionRejects;
+							continue;
+						}
+					}
+
+					// Stores the file path, relative to the root directory, in UTF8 format.
+					relativePath.assign(directory.relativePath).append(entry.name);
+					index.add(relativePath, rootId);
+					if (checkpoint != nullptr) {
+						checkpoint->add(relativePath);
+					}
+
+					// Count file.
+					++result.fileCount;
+					context.fileCount.fetch_add(1, std::memory_order_relaxed);
+				}
+				else {
+					++stats.otherRejects;
+				}
+			}
+
+			// Lists subdirectories in the order they were found.
+			std::reverse(frontier.begin() + firstChild, frontier.end());
+
+			// Pays for the entries, and backs off while listings are slow.
+			stats.throttleNanoseconds += pause(context.entryBucket.take((double)entries.size()) + backoff.update(listEnd - listStart), context);
+			if (isTraced) {
+				Trace::record("filter", "scan", listEnd, std::chrono::steady_clock::now(), directory.relativePath);
+			}
+
+			// Commits the progress between directories, where the index and the frontier agree.
+			if (
+				(checkpoint != nullptr) &&
+				!context.isStopped.load(std::memory_order_relaxed) &&
+				checkpoint->isDue(listEnd, result.fileCount)
+			) {
+				commitCheckpoint(*checkpoint, index, frontier, handedOff, result);
+			}
+		}
+
+		// A completed root is committed as such, so that resuming does not scan it again.
+		if (
+			(checkpoint != nullptr) &&
+			checkpoint->getIsStarted() &&
+			result.ok &&
+			frontier.empty() &&
+			!context.isStopped.load(std::memory_order_relaxed)
+		) {
+			commitCheckpoint(*checkpoint, index, frontier, handedOff, result);
+		}
+	} catch (const std::exception& ex) {
+		result.ok = false;
+		result.error = ex.what();
+	}
+
+	// Reports the directories that were never listed.
+	for (size_t i = 0; i < skippedDirectories.size(); ++i) {
+		if (!isLate[i]) {
+			result.skippedDirectories.push_back(skippedDirectories[i].path.generic_u8string());
+			++stats.skippedDirectories;
+		}
+	}
+
+	result.isCancelled = context.isCancelled;
+	result.spilledCount = index.spilledSize();
+	stats.wallNanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - scanStart).count();
+	stats.pathBytes = index.pathBytes();
+	stats.peakIndexBytes = index.getPeakMemoryBytes();
+	const AllocationCounts allocationCounts = Allocations::thread() - allocationStart;
+	stats.allocations = allocationCounts.allocations;
+	stats.allocatedBytes = allocationCounts.bytes;
+	return result;
+}
+
+/**
+* @return Whether a character separates the directories of a listed path.
+*/
+static bool isSeparator(const char character) {
+#ifdef _WIN32
+	return (character == '/') || (character == '\\');
+#else
+	return (character == '/');
+#endif
+}
+
+/**
+* @return Whether a listed path is absolute, rather than relative to the working directory.
+*/
+static bool isAbsolutePath(std::string_view path) {
+#ifdef _WIN32
+	// Drive letters and network shares.
+	return
+		((path.size() >= 3) && (path[1] == ':') && isSeparator(path[2])) ||
+		((path.size() >= 2) && isSeparator(path[0]) && isSeparator(path[1]));
+#else
+	return !path.empty() && isSeparator(path[0]);
+#endif
+}
+
+ScanResult Scanner::ingest(PathList& list, const std::vector<std::string>& rootStrings, PathIndex& index) const {
+	ScanResult result;
+	result.rootCounts.resize(rootStrings.size());
+	ScanStats& stats = result.stats;
+	const std::chrono::steady_clock::time_point ingestStart = std::chrono::steady_clock::now();
+	const AllocationCounts allocationStart = Allocations::thread();
+
+	// Clears the index.
+	index.clear();
+
+	// Relative paths are taken from the working directory, and paths are compared with the roots and the
+	// blacklisted directories as prefixes.
+	std::filesystem::path workingDirectory;
+	if (!source->resolve(".", workingDirectory, result.error)) {
+		result.ok = false;
+		return result;
+	}
+	std::string workingPrefix = workingDirectory.generic_u8string();
+	if (workingPrefix.empty() || workingPrefix.back() != '/') {
+		workingPrefix += '/';
+	}
+	std::vector<std::string> blacklistPrefixes;
+	for (const std::filesystem::path& directory : directoryBlacklist) {
+		blacklistPrefixes.push_back(directory.generic_u8string() + '/');
+	}
+
+	// Reserves the storage of mapped lists at once.
+	size_t listCount;
+	uint64_t listBytes;
+	if (list.estimate(listCount, listBytes)) {
+		index.reserve(listCount, listBytes);
+	}
+
+	ScanContext context;
+	std::vector<ArchiveEntry> archiveEntries;
+	std::string absolutePath;
+	std::string_view line;
+	try {
+		while (list.next(line)) {
+			++stats.seenEntries;
+
+			// Makes the path absolute, with forward slashes, dropping the leading "./" of relative paths.
+			absolutePath.clear();
+			if (!isAbsolutePath(line)) {
+				while ((line.size() >= 2) && (line[0] == '.') && isSeparator(line[1])) {
+					line.remove_prefix(2);
+				}
+				absolutePath.assign(workingPrefix);
+			}
+			absolutePath.append(line);
+#ifdef _WIN32
+			std::replace(absolutePath.begin(), absolutePath.end(), '\\', '/');
+#endif
+
+			// Finds the root the path is below, if any. Roots are never nested.
+			uint16_t rootId = 0;
+			while (
+				(rootId < rootStrings.size()) &&
+				(absolutePath.compare(0, rootStrings[rootId].size(), rootStrings[rootId]) != 0)
+			) {
+				++rootId;
+			}
+			if (rootId == rootStrings.size()) {
+				++stats.rootRejects;
+				continue;
+			}
+			const std::string_view relativePath = std::string_view(absolutePath).substr(rootStrings[rootId].size());
+			if (relativePath.empty() || relativePath.back() == '/') {
+				++stats.otherRejects;
+				continue;
+			}
+			if (!PathIndex::isContained(relativePath)) {
+				++stats.rootRejects;
+				continue;
+			}
+
+			// Applies the filters a scan applies to the directories above the file, and to the file.
+			const std::string_view outerPath = relativePath.substr(0, Archive::findSeparator(relativePath));
+			if (
+				(shardCount > 1) &&
+				!IndexFile::isInShard(outerPath.substr(0, outerPath.find('/')), shardIndex, shardCount)
+			) {
+				++stats.shardRejects;
+				continue;
+			}
+			const size_t nameStart = outerPath.rfind('/') + 1;
+			const int fileDepth = (int)std::count(outerPath.begin(), outerPath.end(), '/');
+			if (fileDepth > depth) {
+				++stats.depthRejects;
+				continue;
+			}
+			bool isBlacklisted = false;
+			for (const std::string& prefix : blacklistPrefixes) {
+				if (absolutePath.compare(0, prefix.size(), prefix) == 0) {
+					isBlacklisted = true;
+					break;
+				}
+			}
+			if (isBlacklisted) {
+				++stats.blacklistRejects;
+				continue;
+			}
+			if (isExpandingArchives && outerPath.size() == relativePath.size()) {
+				const std::string name(relativePath.substr(nameStart));
+				const Archive::Format format = Archive::formatOf(name);
+				const uint64_t fileCount = result.fileCount;
+				if (format != Archive::none) {
+					const PendingDirectory directory{
+						std::filesystem::u8path(absolutePath.substr(0, absolutePath.size() - name.size())),
+						std::string(relativePath.substr(0, nameStart)),
+						fileDepth
+					};
+					if (expandArchive(directory, name, format, rootId, index, context, nullptr, result, archiveEntries)) {
+						result.rootCounts[rootId].fileCount += result.fileCount - fileCount;
+						continue;
+					}
+				}
+			}
+			if (!extensionWhitelist.empty()) {
+				const size_t slash = relativePath.rfind('/');
+				if (!isExtensionWhitelisted(extensionOf(relativePath.substr((slash == std::string_view::npos) ? 0 : slash + 1)))) {
+					++stats.extensionRejects;
+					continue;
+				}
+			}
+
+			// Stores the file path, relative to the root directory, in UTF8 format.
+			index.add(relativePath, rootId);
+			++result.fileCount;
+			++result.rootCounts[rootId].fileCount;
+		}
+		if (!list.getError().empty()) {
+			result.ok = false;
+			result.error = list.getError();
+		}
+	} catch (const std::exception& ex) {
+		result.ok = false;
+		result.error = ex.what();
+	}
+
+	result.spilledCount = index.spilledSize();
+	stats.wallNanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - ingestStart).count();
+	stats.pathBytes = index.pathBytes();
+	stats.peakIndexBytes = index.getPeakMemoryBytes();
+	const AllocationCounts allocationCounts = Allocations::thread() - allocationStart;
+	stats.allocations = allocationCounts.allocations;
+	stats.allocatedBytes = allocationCounts.bytes;
+	return result;
+}
+
+int Scanner::adjustDepth(const int depth, const bool checkCaps, bool& capped) {
+	capped = false;
+	if (depth < MIN_DEPTH) {
+		return DEPTH_DEFAULT;
+	} else if (
+		(depth > MAX_DEPTH) &&
+		checkCaps
+	) {
+		capped = true;
+		return MAX_DEPTH;
+	}
+	else return depth;
+}
+
+bool Scanner::isDirectoryBlacklisted(const std::filesystem::path& directory) const {
+	const std::vector<std::filesystem::path>::const_iterator it = std::find(
+		directoryBlacklist.begin(),
+		directoryBlacklist.end(),
+		directory
+	);
+	return (it != directoryBlacklist.end());
+}
+
+void Scanner::setSource(const std::shared_ptr<const DirectorySource>& directorySource) {
+	source = directorySource;
+}
+
+std::string_view Scanner::extensionOf(std::string_view name) {
+	// Names starting with their only dot, and the special names "." and "..", have no extension.
+	const size_t dot = name.rfind(EXTENSION_DOT);
+	if (
+		(dot == std::string_view::npos) ||
+		(dot == 0) ||
+		(name == "..")
+	) {
+		return std::string_view();
+	}
+	return name.substr(dot);
+}
+
+bool Scanner::isFilesystemSkipped(const std::string& type) const {
+	for (const std::string& skippedType : skippedFilesystemTypes) {
+		const bool isPrefix = !skippedType.empty() && skippedType.back() == '*';
+		if (
+			isPrefix
+				? (type.compare(0, skippedType.size() - 1, skippedType, 0, skippedType.size() - 1) == 0)
+				: (type == skippedType)
+		) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Scanner::expandArchive(
+	const PendingDirectory& directory,
+	const std::string& name,
+	const Archive::Format format,
+	const uint16_t rootId,
+	PathIndex& index,
+	ScanContext& context,
+	ScanCheckpoint* checkpoint,
+	ScanResult& result,
+	std::vector<ArchiveEntry>& entries
+) const {
+	// Reads the listing of the archive, rather than its contents.
+	const std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+	const std::unique_ptr<SourceFile> file = source->open(directory.path / std::filesystem::u8path(name));
+	std::string error;
+	const bool isListed = (file != nullptr) && Archive::list(*file, format, entries, error);
+	const std::chrono::steady_clock::time_point readEnd = std::chrono::steady_clock::now();
+	ScanStats& stats = result.stats;
+	stats.archiveNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(readEnd - readStart).count();
+	if (Trace::isEnabled()) {
+		Trace::record("archive", "scan", readStart, readEnd, name);
+	}
+	if (!isListed) {
+		return false;
+	}
+	++stats.expandedArchives;
+	stats.archiveEntries += entries.size();
+
+	std::string relativePath = directory.relativePath + name + Archive::SEPARATOR;
+	const size_t prefixLength = relativePath.size();
+	for (const ArchiveEntry& entry : entries) {
+		if (!extensionWhitelist.empty()) {
+			const size_t slash = entry.name.rfind('/');
+			if (!isExtensionWhitelisted(extensionOf(std::string_view(entry.name).substr((slash == std::string::npos) ? 0 : slash + 1)))) {
+				++stats.extensionRejects;
+				continue;
+			}
+		}
+		relativePath.resize(prefixLength);
+		relativePath.append(entry.name);
+		index.add(relativePath, rootId);
+		if (checkpoint != nullptr) {
+			checkpoint->add(relativePath);
+		}
+		++result.fileCount;
+		context.fileCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+bool Scanner::isExtensionWhitelisted(std::string_view extension) const {
+	const std::vector<std::string>::const_iterator it = std::find(
+		extensionWhitelist.begin(),
+		extensionWhitelist.end(),
+		extension
+	);
+	return (it != extensionWhitelist.end());
+}
@@ -0,0 +1,303 @@
+// Scanner.h : declarations for the directory scanner
+
+#pragma once
+
+#ifndef SCANNER_H_
+#define SCANNER_H_
+
+#include <atomic>      // counters shared between workers
+#include <chrono>      // durations
+#include <cstdint>     // fixed width integers
+#include <functional>  // function
+#include <memory>      // shared_ptr
+#include <mutex>       // mutex
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+#include "Archive.h"
+#include "DirectoryReader.h"
+#include "DirectorySource.h"
+#include "PathIndex.h"
+#include "PathList.h"
+#include "ScanCheckpoint.h"
+#include "Stats.h"
+#include "Throttle.h"
+
+/**
+* Options for a scan, as provided by the user.
+*/
+struct ScanOptions {
+    std::vector<std::string> excludedDirectories; // Absolute or relative paths of directories to skip.
+    std::vector<std::string> extensions;          // Allowed extensions, without the dot. If empty, all are allowed.
+    int depth = 5;                                // Maximum (inclusive) depth.
+    bool checkCaps = true;                        // Whether the soft cap for depth is enabled.
+    uint64_t memoryBudget = 256 << 20;            // Bytes the index may take in memory before spilling to disk. 0 for no limit.
+    bool share = false;                           // Whether to attach to (or publish) a shared memory index.
+    uint32_t shardIndex = 0;                      // Shard to scan (0-based), among the top-level entries of each root.
+    uint32_t shardCount = 1;                      // Amount of shards. 1 scans everything.
+    bool checkpoint = true;                       // Whether large roots are checkpointed, so that an interrupted scan can resume.
+    bool resume = false;                          // Whether to resume from the checkpoints of an interrupted scan.
+    uint32_t listTimeout = 0;                     // Milliseconds a directory may take to be listed before it is skipped. 0 waits forever.
+    bool retrySkipped = false;                    // Whether skipped directories are still taken if listed before the rest of the scan completes.
+    bool idleIo = false;                          // Whether directories are listed at idle I/O priority.
+    double directoryRate = 0;                     // Directories listed per second, across roots. 0 for no limit.
+    double entryRate = 0;                         // Entries listed per second, across roots. 0 for no limit.
+    uint32_t backoffThreshold = 0;                // Milliseconds a listing may take before the scan backs off. 0 never backs off.
+    bool oneFileSystem = false;                   // Whether directories on other devices than their root's are skipped.
+    std::vector<std::string> skippedFilesystemTypes; // Filesystem types to skip (e.g. "nfs"). A trailing '*' matches any suffix (e.g. "fuse.*").
+    bool splitDevices = false;                    // Whether mounts below the roots are scanned by the worker of their own device.
+    bool archives = false;                        // Whether the files inside zip and tar archives are indexed instead of the archives.
+};
+
+/**
+* Counters reported while a scan is in progress.
+*/
+struct ScanProgress {
+    uint64_t fileCount = 0;
+    uint64_t directoryCount = 0;
+};
+
+/**
+* Called periodically during a scan. Returning `false` cancels the scan.
+*/
+typedef std::function<bool(const ScanProgress&)> ProgressCallback;
+
+/**
+* State shared by the workers of a scan.
+*/
+struct ScanContext {
+    std::atomic<uint64_t> fileCount{0};      // Stored files, across all roots.
+    std::atomic<uint64_t> directoryCount{0}; // Scanned subdirectories, across all roots.
+    std::atomic<bool> isStopped{false};      // Whether workers must stop.
+    std::atomic<bool> isCancelled{false};
+    std::mutex progressMutex;                // Serializes calls to the progress callback.
+    ProgressCallback progress;
+    TokenBucket directoryBucket;             // Caps listed directories per second.
+    TokenBucket entryBucket;                 // Caps listed entries per second.
+
+    // Takes a directory on another device off the worker that found it, to be scanned by the worker of its device.
+    // Returns false if the directory was taken before, which means it was reached twice.
+    std::function<bool(const uint16_t, PendingDirectory&&, const DirectoryIdentity&)> handOff;
+};
+
+/**
+* Filters a scan applies, fixed at compile time so that each combination gets its own scan loop
+* that only tests what it was configured with.
+*/
+template <bool Sharding, bool Blacklisting, bool Filtering, bool Reporting>
+struct ScanPolicy {
+    static constexpr bool isSharding = Sharding;         // Top-level entries are filtered by shard.
+    static constexpr bool isBlacklisting = Blacklisting; // Directories are checked against the blacklist.
+    static constexpr bool isFiltering = Filtering;       // Files are checked against the extension whitelist.
+    static constexpr bool isReporting = Reporting;       // Progress is reported to a callback.
+};
+
+/**
+* Counters for a single root directory.
+*/
+struct RootScanCounts {
+    uint64_t fileCount = 0;
+    uint64_t directoryCount = 0;
+};
+
+/**
+* Outcome of a scan.
+*/
+struct ScanResult {
+    bool ok = true;                 // Whether the scan completed without errors.
+    std::string error;              // Description of the error, if any.
+    uint64_t fileCount = 0;         // Stored files.
+    uint64_t directoryCount = 0;    // Scanned subdirectories.
+    std::vector<RootScanCounts> rootCounts; // Counters per root directory, by root id.
+    uint64_t spilledCount = 0;      // Entries spilled to disk because the memory budget was exceeded.
+    bool isCancelled = false;       // Whether the progress callback cancelled the scan.
+    bool isSharedAttached = false;  // Whether the index was attached from shared memory instead of scanned.
+    uint64_t sharedGeneration = 0;  // Generation of the shared index in use, or 0.
+    std::string sharedError;        // Why sharing the index did not work, if it did not.
+    uint64_t resumedFileCount = 0;  // Files restored from checkpoints rather than scanned.
+    std::string checkpointError;    // Why checkpoints stopped being written, if they did.
+    std::vector<std::string> skippedDirectories; // Directories skipped because they were not listed in time.
+    ScanStats stats;                // Counters and timers.
+};
+
+class Scanner {
+
+    private:
+        // Where trees are read from.
+        std::shared_ptr<const DirectorySource> source;
+
+        // Directory paths.
+        std::vector<std::filesystem::path> directoryBlacklist;
+
+        // Extensions.
+        std::vector<std::string> extensionWhitelist;
+
+        // Limits.
+        int depth;
+        bool checkCaps;
+        bool isDepthCapped;
+
+        // Sharding.
+        uint32_t shardIndex;
+        uint32_t shardCount;
+
+        // Checkpoints.
+        bool isResuming;
+
+        // Deadlines.
+        std::chrono::milliseconds listTimeout;
+        bool isRetryingSkipped;
+
+        // Throttling.
+        bool isIdleIo;
+        std::chrono::milliseconds backoffThreshold;
+
+        // Devices and filesystems.
+        bool isOneFileSystem;
+        std::vector<std::string> skippedFilesystemTypes;
+        bool isSplittingDevices;
+
+        // Archives.
+        bool isExpandingArchives;
+
+        /**
+        * @brief Determines whether a directory is blacklisted.
+        *
+        * @param directory Directory.
+        */
+        bool isDirectoryBlacklisted(const std::filesystem::path&) const;
+        /**
+        * @brief Determines whether an extension is whitelisted.
+        *
+        * @param extension Extension.
+        */
+        bool isExtensionWhitelisted(std::string_view) const;
+        /**
+        * @brief Determines whether a type of filesystem is skipped.
+        *
+        * @param type Filesystem type.
+        */
+        bool isFilesystemSkipped(const std::string&) const;
+        /**
+        * @brief Stores the files inside an archive that pass the extension whitelist, as "archive!/inner/path".
+        *
+        * @param directory Directory holding the archive.
+        * @param name Name of the archive.
+        * @param format Format of the archive.
+        * @param rootId Id of the root directory, stored along each path.
+        * @param index Index that receives the relative paths.
+        * @param context State shared with the rest of workers.
+        * @param checkpoint Journal the paths are recorded into, or `nullptr`.
+        * @param result Result whose counters are updated.
+        * @param entries Reused for the entries of the archive.
+        * @return If the archive could not be read, returns `false`, and it is taken as a plain file.
+        */
+        bool expandArchive(const PendingDirectory&, const std::string&, const Archive::Format, const uint16_t, PathIndex&, ScanContext&, ScanCheckpoint*, ScanResult&, std::vector<ArchiveEntry>&) const;
+        /**
+        * @brief Reads the paths below a directory, with the filters in use chosen at compile time. See `scan()`.
+        *
+        * @tparam Policy Filters in use, as a `ScanPolicy`.
+        */
+        template <class Policy>
+        ScanResult traverse(const PendingDirectory&, const uint16_t, PathIndex&, ScanContext&, ScanCheckpoint*) const;
+
+    public:
+        // Soft limits and default values
+        static const int MIN_DEPTH = 0;     // Minimum (inclusive) depth
+        static const int MAX_DEPTH = 10;    // Maximum (inclusive) depth the recursive iterator is allowed to reach
+        static const int DEPTH_DEFAULT = 5; // Default depth the recursive iterator is allowed to reach
+
+        static const int PROGRESS_INTERVAL = 1024; // Amount of entries between progress reports
+        static const int PAUSE_STEP_MILLISECONDS = 50; // Longest sleep while throttled, between checks for cancellation
+
+        static const uint64_t MIN_MEMORY_BUDGET = 1 << 20; // Minimum memory budget, other than no limit
+
+        static const char EXTENSION_DOT = '.';
+
+        // == Constructor ==
+        Scanner();
+
+        /**
+        * @brief Validates and stores the options for the following scans.
+        *
+        * @param options Scan options.
+        * @param error Receives the description of the error, if any.
+        * @return If the options could not be used, returns `false`.
+        */
+        bool configure(const ScanOptions&, std::string&);
+        /**
+        * @brief Sets where trees are read from, which is the filesystem by default. Takes effect on the following `configure()`.
+        *
+        * @param source Directory source.
+        */
+        void setSource(const std::shared_ptr<const DirectorySource>&);
+        /**
+        * @brief Reads the paths of a root directory by listing one directory at a time, depth first, and stores them
+        * into an index. Several roots may be scanned concurrently as long as they share the context.
+        *
+        * @param root Resolved path to the root directory.
+        * @param rootId Id of the root directory, stored along each path.
+        * @param index Index that will receive the relative paths. It is cleared first.
+        * @param context State shared with the rest of workers.
+        * @param checkpoint Journal the progress is committed to (and, when resuming, restored from), or `nullptr`.
+        */
+        ScanResult scan(const std::filesystem::path&, const uint16_t, PathIndex&, ScanContext&, ScanCheckpoint* = nullptr) const;
+        /**
+        * @brief Reads the paths below a directory of a root, as `scan()` does, such as one handed off by another worker.
+        * The directory itself is not counted.
+        *
+        * @param start Directory, with its path relative to the root.
+        * @param rootId Id of the root directory, stored along each path.
+        * @param index Index that will receive the relative paths. It is cleared first.
+        * @param context State shared with the rest of workers.
+        * @param checkpoint Journal the progress is committed to (and, when resuming, restored from), or `nullptr`.
+        * Only for roots.
+        */
+        ScanResult scanSubtree(const PendingDirectory&, const uint16_t, PathIndex&, ScanContext&, ScanCheckpoint* = nullptr) const;
+        /**
+        * @brief Reads the paths of a list instead of listing directories, and stores the files below the root directories
+        * that pass the filters (shard, depth, blacklist and extensions) into an index, expanding archives if enabled.
+        * Paths may be absolute or relative to the working directory, and are taken as listed, without status calls.
+        *
+        * @param list Open list.
+        * @param rootStrings Root directories, ending with a slash, by root id.
+        * @param index Index that will receive the relative paths. It is cleared first.
+        */
+        ScanResult ingest(PathList&, const std::vector<std::string>&, PathIndex&) const;
+
+        // @return Where trees are read from
+        const DirectorySource& getSource() const { return *source; }
+        // @return Adjusted maximum depth
+        int getDepth() const { return depth; }
+        // @return true if the requested depth exceeded the soft cap
+        bool getIsDepthCapped() const { return isDepthCapped; }
+        // @return Resolved blacklisted directories
+        const std::vector<std::filesystem::path>& getDirectoryBlacklist() const { return directoryBlacklist; }
+        // @return Whitelisted extensions, including the dot
+        const std::vector<std::string>& getExtensionWhitelist() const { return extensionWhitelist; }
+        // @return true if directories are identified, to tell devices, filesystems and loops apart
+        bool getIsIdentifying() const { return isOneFileSystem || isSplittingDevices || !skippedFilesystemTypes.empty(); }
+        // @return true if mounts below the roots may be handed off to the workers of their devices
+        bool getIsSplittingDevices() const { return isSplittingDevices && !isOneFileSystem; }
+
+        /**
+        * @brief Adjusts a depth value.
+        *
+        * @param depth Initial depth.
+        * @param checkCaps Whether to check for the soft cap for the levels of depth while adjusting.
+        * @param capped Set to true if the soft cap was applied.
+        */
+        static int adjustDepth(const int, const bool, bool&);
+        /**
+        * @brief Finds the extension of a file name the way `std::filesystem::path::extension()` does.
+        *
+        * @param name File name.
+        * @return Extension including the dot, or an empty view.
+        */
+        static std::string_view extensionOf(std::string_view);
+};
+
+#endif
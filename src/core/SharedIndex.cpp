@@ -0,0 +1,507 @@
+// SharedIndex.cpp : descriptions for the shared memory path index
+
+#include "SharedIndex.h"
+#include "Hash.h"
+
+#include <cstring>     // memcpy
+#include <chrono>      // milliseconds
+#include <thread>      // sleep_for
+
+#ifdef _WIN32
+#include <vector>      // dynamic containers
+#include <windows.h>   // Windows API functions
+#include <aclapi.h>    // GetSecurityInfo
+#else
+#include <cerrno>      // errno
+#include <filesystem>  // file navigation. C++17 ONLY.
+#include <fcntl.h>     // O_* flags
+#include <sys/mman.h>  // shm_open, mmap
+#include <sys/stat.h>  // fstat, fchmod
+#include <unistd.h>    // ftruncate, close
+#endif
+
+SharedIndex::SharedIndex(const std::string& signature) {
+	// Derives a stable name from the signature, so that processes with the same root and options meet.
+	const uint64_t hash = Hash::fnv1a(signature);
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+#ifdef _WIN32
+	baseName = std::string("rfopener-") + hex;
+#else
+	// Every user has segments of their own, which no other user can write or take over.
+	baseName = std::string("rfopener-") + std::to_string((unsigned long)geteuid()) + "-" + hex;
+#endif
+
+	attachedGeneration = 0;
+}
+
+SharedIndex::~SharedIndex() {
+	closeMapping(segment);
+	closeMapping(control);
+}
+
+bool SharedIndex::attach(PathIndex& index) {
+	if (!openControl()) {
+		return false;
+	}
+	const ControlBlock* block = (const ControlBlock*)control.address;
+
+	// A generation may be replaced (and its name removed) between reading its number and opening it.
+	for (int attempt = 0; attempt < ATTACH_RETRIES; ++attempt) {
+		const uint64_t generation = block->publishedGeneration.load(std::memory_order_acquire);
+		if (generation == 0) {
+			error = "No index has been published yet";
+			return false;
+		}
+
+		Mapping candidate;
+		if (!openMapping(segmentName(generation), false, candidate)) {
+			// Retries only if a newer generation replaced the one that went missing.
+			if (block->publishedGeneration.load(std::memory_order_acquire) == generation) {
+				error = "Published index is no longer available";
+				return false;
+			}
+			continue;
+		}
+
+		// Validates the segment before trusting any of its contents.
+		const SegmentHeader* header = (const SegmentHeader*)candidate.address;
+		const uint64_t maximumCount = candidate.size / (sizeof(uint64_t) + sizeof(uint16_t));
+		if (
+			(candidate.size < sizeof(SegmentHeader)) ||
+			(header->magic != SEGMENT_MAGIC) ||
+			(header->generation != generation) ||
+			(header->count >= maximumCount) ||
+			(header->stampCount >= maximumCount - header->count) ||
+			(header->arenaBytes > candidate.size) ||
+			(header->stampBytes > candidate.size) ||
+			(segmentSize(header->count, header->arenaBytes, header->stampCount, header->stampBytes) > candidate.size)
+		) {
+			closeMapping(candidate);
+			error = "Published index is malformed";
+			return false;
+		}
+		const uint64_t* offsets = (const uint64_t*)(header + 1);
+		StampTable stamps;
+		stamps.count = header->stampCount;
+		stamps.stamps = offsets + header->count + 1;
+		stamps.offsets = stamps.stamps + stamps.count;
+		const uint16_t* roots = (const uint16_t*)(stamps.offsets + stamps.count + 1);
+		stamps.roots = roots + header->count;
+		const char* arena = (const char*)(stamps.roots + stamps.count);
+		stamps.arena = arena + header->arenaBytes;
+
+		// Paths (and the paths of the stamps, which may be a root itself) must be in order and stay below their root.
+		const auto isValid = [](const uint64_t* pathOffsets, const char* pathArena, const uint64_t count, const uint64_t bytes, const bool isRootAllowed) {
+			if (pathOffsets[0] != 0 || pathOffsets[count] != bytes) {
+				return false;
+			}
+			for (uint64_t i = 0; i < count; ++i) {
+				if (pathOffsets[i] > pathOffsets[i + 1]) {
+					return false;
+				}
+			}
+			for (uint64_t i = 0; i < count; ++i) {
+				const std::string_view path(pathArena + pathOffsets[i], (size_t)(pathOffsets[i + 1] - pathOffsets[i]));
+				if (!(isRootAllowed && path.empty()) && !PathIndex::isContained(path)) {
+					return false;
+				}
+			}
+			return true;
+		};
+		if (
+			!isValid(offsets, arena, header->count, header->arenaBytes, false) ||
+			!isValid(stamps.offsets, stamps.arena, stamps.count, header->stampBytes, true)
+		) {
+			closeMapping(candidate);
+			error = "Published index is malformed";
+			return false;
+		}
+
+		// Swaps the previous mapping (if any) for the new one.
+		index.attach(arena, offsets, roots, (size_t)header->count);
+		closeMapping(segment);
+		segment = candidate;
+		stampTable = stamps;
+		attachedGeneration = generation;
+		return true;
+	}
+
+	error = "Published index kept changing while attaching";
+	return false;
+}
+
+bool SharedIndex::isFresh(const StampCheck& isUnchanged) const {
+	for (uint64_t i = 0; i < stampTable.count; ++i) {
+		const std::string_view path(stampTable.arena + stampTable.offsets[i], (size_t)(stampTable.offsets[i + 1] - stampTable.offsets[i]));
+		if (!isUnchanged(stampTable.roots[i], path, stampTable.stamps[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SharedIndex::publish(PathIndex& index, const std::vector<SharedStamp>& stamps) {
+	if (!openControl()) {
+		return false;
+	}
+	ControlBlock* block = (ControlBlock*)control.address;
+
+	// Reserves a generation number no other publisher will use.
+	const uint64_t generation = block->nextGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+	const std::string name = segmentName(generation);
+
+	const uint64_t count = index.size();
+	const uint64_t arenaBytes = index.pathBytes();
+	const uint64_t stampCount = stamps.size();
+	uint64_t stampBytes = 0;
+	for (const SharedStamp& stamp : stamps) {
+		stampBytes += stamp.path.size();
+	}
+	const size_t size = (size_t)segmentSize(count, arenaBytes, stampCount, stampBytes);
+
+	// Builds the new generation. A leftover segment with the same name is never reused.
+	Mapping candidate;
+	bool existed = false;
+	if (!createMapping(name, size, candidate, existed) || existed) {
+		closeMapping(candidate);
+		removeName(name);
+		if (!createMapping(name, size, candidate, existed) || existed) {
+			closeMapping(candidate);
+			error = "Could not create shared segment " + name;
+			return false;
+		}
+	}
+
+	SegmentHeader* header = (SegmentHeader*)candidate.address;
+	uint64_t* offsets = (uint64_t*)(header + 1);
+	uint64_t* stampValues = offsets + count + 1;
+	uint64_t* stampOffsets = stampValues + stampCount;
+	uint16_t* roots = (uint16_t*)(stampOffsets + stampCount + 1);
+	uint16_t* stampRoots = roots + count;
+	char* arena = (char*)(stampRoots + stampCount);
+	char* stampArena = arena + arenaBytes;
+	if (!index.isSpilled()) {
+		memcpy(offsets, index.offsetTable(), (size_t)((count + 1) * sizeof(uint64_t)));
+		memcpy(roots, index.rootTable(), (size_t)(count * sizeof(uint16_t)));
+		memcpy(arena, index.data(), (size_t)arenaBytes);
+	} else {
+		// Spilled entries are read back one at a time. The segment is pageable, unlike the owned index.
+		try {
+			offsets[0] = 0;
+			for (size_t i = 0; i < count; ++i) {
+				roots[i] = index.root(i);
+				const std::string_view path = index[i];
+				memcpy(arena + offsets[i], path.data(), path.size());
+				offsets[i + 1] = offsets[i] + path.size();
+			}
+		}
+		catch (const std::exception& ex) {
+			closeMapping(candidate);
+			removeName(name);
+			error = ex.what();
+			return false;
+		}
+	}
+	stampOffsets[0] = 0;
+	for (size_t i = 0; i < stampCount; ++i) {
+		stampValues[i] = stamps[i].stamp;
+		stampRoots[i] = stamps[i].rootId;
+		memcpy(stampArena + stampOffsets[i], stamps[i].path.data(), stamps[i].path.size());
+		stampOffsets[i + 1] = stampOffsets[i] + stamps[i].path.size();
+	}
+	header->generation = generation;
+	header->count = count;
+	header->arenaBytes = arenaBytes;
+	header->stampCount = stampCount;
+	header->stampBytes = stampBytes;
+	header->magic = SEGMENT_MAGIC;
+
+	// Swaps the generation in, unless a newer one was published in the meantime.
+	uint64_t previous = block->publishedGeneration.load(std::memory_order_relaxed);
+	while (
+		(previous < generation) &&
+		!block->publishedGeneration.compare_exchange_weak(previous, generation, std::memory_order_release, std::memory_order_relaxed)
+	) {}
+	if (previous < generation) {
+		// Readers that already mapped the previous generation keep using it.
+		if (previous != 0) {
+			removeName(segmentName(previous));
+		}
+	} else {
+		removeName(name);
+	}
+
+	// Serves this process from the segment too, releasing the private copy.
+	index.attach(arena, offsets, roots, (size_t)count);
+	closeMapping(segment);
+	segment = candidate;
+	stampTable = StampTable();
+	stampTable.stamps = stampValues;
+	stampTable.offsets = stampOffsets;
+	stampTable.roots = stampRoots;
+	stampTable.arena = stampArena;
+	stampTable.count = stampCount;
+	attachedGeneration = generation;
+	return true;
+}
+
+bool SharedIndex::openControl() {
+	if (control.address != nullptr) {
+		return true;
+	}
+
+	// Only segments owned by the user (or, on Windows, by the default owner of their objects) are used.
+#ifdef _WIN32
+	static const char* const PREFIXES[] = { "Global\\", "Local\\" };
+	std::string controlName;
+	bool existed = false;
+	for (const char* prefix : PREFIXES) {
+		controlName = prefix + baseName;
+		if (createMapping(controlName, sizeof(ControlBlock), control, existed)) {
+			baseName = controlName;
+			break;
+		}
+	}
+#else
+	const std::string controlName = "/" + baseName;
+	bool existed = false;
+	if (createMapping(controlName, sizeof(ControlBlock), control, existed)) {
+		baseName = controlName;
+	}
+#endif
+	if (control.address == nullptr || control.size < sizeof(ControlBlock)) {
+		closeMapping(control);
+		error = "Could not open the shared control segment";
+		return false;
+	}
+
+	ControlBlock* block = (ControlBlock*)control.address;
+	if (!existed) {
+		block->nextGeneration.store(0, std::memory_order_relaxed);
+		block->publishedGeneration.store(0, std::memory_order_relaxed);
+		block->magic.store(CONTROL_MAGIC, std::memory_order_release);
+		return true;
+	}
+
+	// Waits for the creator to finish initializing the control segment.
+	for (int attempt = 0; attempt < ATTACH_RETRIES; ++attempt) {
+		if (block->magic.load(std::memory_order_acquire) == CONTROL_MAGIC) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1 << attempt));
+	}
+	closeMapping(control);
+	error = "Shared control segment is not initialized";
+	return false;
+}
+
+uint64_t SharedIndex::segmentSize(const uint64_t count, const uint64_t arenaBytes, const uint64_t stampCount, const uint64_t stampBytes) {
+	return
+		sizeof(SegmentHeader) +
+		(count + 1) * sizeof(uint64_t) + (2 * stampCount + 1) * sizeof(uint64_t) +
+		(count + stampCount) * sizeof(uint16_t) +
+		arenaBytes + stampBytes;
+}
+
+std::string SharedIndex::segmentName(const uint64_t generation) const {
+	return baseName + "-" + std::to_string(generation);
+}
+
+
+
+#ifdef _WIN32
+
+/**
+* @param handle Handle to a named mapping, opened with `READ_CONTROL` access.
+* @return Whether the mapping is owned by the default owner of the objects this process creates.
+*/
+static bool isOwned(const HANDLE handle) {
+	PSID owner = NULL;
+	PSECURITY_DESCRIPTOR descriptor = NULL;
+	if (GetSecurityInfo(handle, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION, &owner, NULL, NULL, NULL, &descriptor) != ERROR_SUCCESS) {
+		return false;
+	}
+	bool isOwner = false;
+	HANDLE token;
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+		DWORD length = 0;
+		GetTokenInformation(token, TokenOwner, NULL, 0, &length);
+		std::vector<unsigned char> buffer(length);
+		if (length != 0 && GetTokenInformation(token, TokenOwner, buffer.data(), length, &length)) {
+			isOwner = (EqualSid(owner, ((const TOKEN_OWNER*)buffer.data())->Owner) != FALSE);
+		}
+		CloseHandle(token);
+	}
+	LocalFree(descriptor);
+	return isOwner;
+}
+
+bool SharedIndex::createMapping(const std::string& name, const size_t size, Mapping& mapping, bool& existed) {
+	const unsigned long long size64 = size;
+	HANDLE handle = CreateFileMappingA(
+		INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(size64 >> 32), (DWORD)(size64 & 0xFFFFFFFF),
+		name.c_str()
+	);
+	if (handle == NULL) {
+		return false;
+	}
+	existed = (GetLastError() == ERROR_ALREADY_EXISTS);
+	if (existed && !isOwned(handle)) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	void* address = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, size);
+	if (address == NULL) {
+		CloseHandle(handle);
+		return false;
+	}
+	mapping.address = address;
+	mapping.size = size;
+	mapping.handle = handle;
+	return true;
+}
+
+bool SharedIndex::openMapping(const std::string& name, const bool writable, Mapping& mapping) {
+	HANDLE handle = OpenFileMappingA((writable ? FILE_MAP_WRITE : FILE_MAP_READ) | READ_CONTROL, FALSE, name.c_str());
+	if (handle == NULL) {
+		return false;
+	}
+	if (!isOwned(handle)) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	void* address = MapViewOfFile(handle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (address == NULL || VirtualQuery(address, &info, sizeof(info)) == 0) {
+		if (address != NULL) UnmapViewOfFile(address);
+		CloseHandle(handle);
+		return false;
+	}
+	mapping.address = address;
+	mapping.size = info.RegionSize;
+	mapping.handle = handle;
+	return true;
+}
+
+void SharedIndex::closeMapping(Mapping& mapping) {
+	if (mapping.address != nullptr) UnmapViewOfFile(mapping.address);
+	if (mapping.handle != nullptr) CloseHandle((HANDLE)mapping.handle);
+	mapping = Mapping();
+}
+
+void SharedIndex::removeName(const std::string&) {
+	// Named mappings disappear with their last handle.
+}
+
+bool SharedIndex::purge(uint64_t& removedCount, std::string&) {
+	// Named mappings disappear with their last handle, so there is never anything left to remove.
+	removedCount = 0;
+	return true;
+}
+
+#else
+
+static const char* const SEGMENT_DIRECTORY = "/dev/shm"; // Where segments show up as files, as on Linux
+
+/**
+* @param status Status of a segment.
+* @return Whether the segment is owned by the user, and no other user may open it.
+*/
+static bool isOwned(const struct stat& status) {
+	return (status.st_uid == geteuid()) && ((status.st_mode & 077) == 0);
+}
+
+bool SharedIndex::createMapping(const std::string& name, const size_t size, Mapping& mapping, bool& existed) {
+	const mode_t mode = 0600;
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+	existed = (fd < 0 && errno == EEXIST);
+	if (existed) {
+		fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd < 0) {
+			return false;
+		}
+
+		// The creator may not have sized the segment yet.
+		struct stat status;
+		for (int attempt = 0; attempt < ATTACH_RETRIES; ++attempt) {
+			if (fstat(fd, &status) == 0 && (size_t)status.st_size >= size) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1 << attempt));
+		}
+		if (fstat(fd, &status) != 0 || !isOwned(status) || (size_t)status.st_size < size) {
+			close(fd);
+			return false;
+		}
+	} else if (fd < 0) {
+		return false;
+	} else if (fchmod(fd, mode) != 0 || ftruncate(fd, (off_t)size) != 0) {
+		// Explicit mode, so that the umask can not leave the segment unwritable.
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	mapping.address = address;
+	mapping.size = size;
+	return true;
+}
+
+bool SharedIndex::openMapping(const std::string& name, const bool writable, Mapping& mapping) {
+	const int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !isOwned(status) || status.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	void* address = mmap(nullptr, (size_t)status.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	mapping.address = address;
+	mapping.size = (size_t)status.st_size;
+	return true;
+}
+
+void SharedIndex::closeMapping(Mapping& mapping) {
+	if (mapping.address != nullptr) munmap(mapping.address, mapping.size);
+	mapping = Mapping();
+}
+
+void SharedIndex::removeName(const std::string& name) {
+	shm_unlink(name.c_str());
+}
+
+bool SharedIndex::purge(uint64_t& removedCount, std::string& error) {
+	removedCount = 0;
+
+	// There is no portable way to list segments, but they show up as files where they are kept in a file system.
+	std::error_code errorCode;
+	std::filesystem::directory_iterator it(SEGMENT_DIRECTORY, errorCode);
+	if (errorCode) {
+		error = "Shared segments can not be listed on this system";
+		return false;
+	}
+	const std::string prefix = "rfopener-" + std::to_string((unsigned long)geteuid()) + "-";
+	for (; it != std::filesystem::directory_iterator(); it.increment(errorCode)) {
+		const std::string name = it->path().filename().string();
+		if (name.compare(0, prefix.size(), prefix) == 0 && shm_unlink(("/" + name).c_str()) == 0) {
+			++removedCount;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,167 @@
+// SharedIndex.h : declarations for the shared memory path index
+
+#pragma once
+
+#ifndef SHAREDINDEX_H_
+#define SHAREDINDEX_H_
+
+#include <atomic>      // lock-free counters inside shared memory
+#include <cstdint>     // fixed width integers
+#include <functional>  // function objects
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "PathIndex.h"
+
+/**
+* Stamp (e.g. last write time) of a directory or archive an index was built from.
+*/
+struct SharedStamp {
+    uint16_t rootId;
+    std::string path; // Relative to the root directory, which is the empty path.
+    uint64_t stamp;
+};
+
+/**
+* Publishes a `PathIndex` into named shared memory so that concurrent processes working
+* on the same root (and with the same filters) can attach to it instead of scanning.
+*
+* A small control segment holds the published generation number. Each generation lives in
+* its own data segment, which is completely written before the control segment points at it,
+* so readers never observe a partially built index. Readers map data segments read-only and
+* keep their mapping even after a newer generation replaces it.
+*
+* Every generation also holds the stamps of the directories its index was built from, so that
+* attaching processes can tell whether it is still fresh without going through the index.
+*
+* Segments are only shared between the processes of one user: they are created private to it,
+* segments owned by anyone else are never used, and attached paths must stay below their root.
+* Elsewhere than on Windows, segments outlive the processes that use them until purged.
+*/
+class SharedIndex {
+
+    public:
+        typedef std::function<bool(const uint16_t, std::string_view, const uint64_t)> StampCheck;
+
+    private:
+        static const uint64_t CONTROL_MAGIC = 0x314c5254434f4652; // "RFOCTRL1"
+        static const uint64_t SEGMENT_MAGIC = 0x34304d48534f4652; // "RFOSHM04"
+        static const int ATTACH_RETRIES = 8;
+
+        // Layout of the control segment.
+        struct ControlBlock {
+            std::atomic<uint64_t> magic;
+            std::atomic<uint64_t> nextGeneration;
+            std::atomic<uint64_t> publishedGeneration;
+        };
+
+        // Layout of the beginning of a data segment, followed by the offsets of the paths, the stamps and the offsets
+        // of their paths, the root ids of both, and the path bytes of both.
+        struct SegmentHeader {
+            uint64_t magic;
+            uint64_t generation;
+            uint64_t count;
+            uint64_t arenaBytes;
+            uint64_t stampCount;
+            uint64_t stampBytes;
+        };
+
+        // Stamps of the attached generation, inside its segment.
+        struct StampTable {
+            const uint64_t* stamps = nullptr;
+            const uint64_t* offsets = nullptr;
+            const uint16_t* roots = nullptr;
+            const char* arena = nullptr;
+            uint64_t count = 0;
+        };
+
+        /**
+        * @param count Amount of paths.
+        * @param arenaBytes Amount of path bytes.
+        * @param stampCount Amount of stamps.
+        * @param stampBytes Amount of path bytes of the stamps.
+        * @return Size of a data segment.
+        */
+        static uint64_t segmentSize(const uint64_t, const uint64_t, const uint64_t, const uint64_t);
+
+        // A mapped named segment.
+        struct Mapping {
+            void* address = nullptr;
+            size_t size = 0;
+            void* handle = nullptr; // Only used on Windows, where the name lives as long as a handle does.
+        };
+
+        std::string baseName;
+        std::string error;
+        Mapping control;
+        Mapping segment;
+        StampTable stampTable;
+        uint64_t attachedGeneration;
+
+        /**
+        * @brief Opens (or creates) the control segment.
+        *
+        * @return If the control segment could not be used, returns `false`.
+        */
+        bool openControl();
+        /**
+        * @param generation Generation number.
+        * @return Name of the data segment for a generation.
+        */
+        std::string segmentName(const uint64_t) const;
+
+        // == Platform functions ==
+        static bool createMapping(const std::string&, const size_t, Mapping&, bool&);
+        static bool openMapping(const std::string&, const bool, Mapping&);
+        static void closeMapping(Mapping&);
+        static void removeName(const std::string&);
+
+    public:
+        // == Constructor ==
+        /**
+        * @param signature String identifying the root directory and the scan options.
+        */
+        SharedIndex(const std::string&);
+        ~SharedIndex();
+
+        /**
+        * @brief Attaches an index to the latest published generation. Whether it is still fresh is told by `isFresh()`.
+        *
+        * @param index Index that will become a read-only view over the segment.
+        * @return If no generation was available, returns `false`.
+        */
+        bool attach(PathIndex&);
+        /**
+        * @brief Checks the stamps the attached generation was published with, stopping at the first one that changed.
+        *
+        * @param isUnchanged Tells whether a directory (by root id and relative path) still has the given stamp.
+        * @return Whether every directory still has its stamp.
+        */
+        bool isFresh(const StampCheck&) const;
+        /**
+        * @brief Copies an index into a new generation and swaps it in. On success, the index
+        * becomes a view over the new segment.
+        *
+        * @param index Index to publish.
+        * @param stamps Stamps of the directories of the index, checked by the processes that attach to it.
+        * @return If an error was found, returns `false`.
+        */
+        bool publish(PathIndex&, const std::vector<SharedStamp>&);
+        /**
+        * @brief Removes every segment of the user, whatever the root and options they were published for. Processes
+        * attached to them keep their mappings.
+        *
+        * @param removedCount Receives the amount of segments removed.
+        * @param error Receives the description of the error, if any.
+        * @return If the segments could not be listed, returns `false`.
+        */
+        static bool purge(uint64_t&, std::string&);
+
+        // @return Generation the index is attached to, or 0
+        uint64_t getGeneration() const { return attachedGeneration; }
+        // @return Description of the last error
+        const std::string& getError() const { return error; }
+};
+
+#endif
@@ -0,0 +1,199 @@
+// Snapshot.cpp : descriptions for the snapshots of an index and the differences between them
+
+#include "Snapshot.h"
+#include "Archive.h"
+#include "FileBatches.h"
+#include "Hash.h"
+
+#include <algorithm>   // min
+#include <filesystem>  // u8path, rename. C++17 ONLY.
+#include <fstream>     // file streams
+
+static const size_t ENTRY_BYTES = 16; // Bytes of an entry in a snapshot file.
+
+static void encode(unsigned char* buffer, uint64_t value) {
+	for (int i = 0; i < 8; ++i) {
+		buffer[i] = (unsigned char)(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static uint64_t decode(const unsigned char* buffer) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; --i) {
+		value = (value << 8) | buffer[i];
+	}
+	return value;
+}
+
+void Snapshot::build(const PathIndex& index, const std::vector<std::string>& rootStrings, const DirectorySource& source) {
+	entries.resize(index.size());
+
+	// Stamps take a status call each, so they are read on several threads, each filling the entries it is handed.
+	FileBatches::run(index, rootStrings, nullptr, [&](const unsigned, const uint32_t position, const std::string& path) {
+		Entry& entry = entries[position];
+		entry.pathHash = Hash::fnv1a(path);
+		entry.position = position;
+
+		// Files inside archives change along with their archive.
+		const size_t separator = Archive::findSeparator(path);
+		entry.stamp = source.stamp(std::filesystem::u8path((separator == std::string::npos) ? path : path.substr(0, separator)));
+	});
+	sortByHash(entries);
+}
+
+void Snapshot::clear() {
+	entries.clear();
+}
+
+void Snapshot::sortByHash(std::vector<Entry>& unsorted) {
+	// Least significant digit first, which keeps the order of the previous passes among equal digits.
+	std::vector<Entry> sorted(unsorted.size());
+	std::vector<size_t> starts(1 << 16);
+	for (int shift = 0; shift < 64; shift += 16) {
+		starts.assign(starts.size(), 0);
+		for (const Entry& entry : unsorted) {
+			++starts[(size_t)((entry.pathHash >> shift) & 0xFFFF)];
+		}
+
+		// Digits every hash shares leave the order as it is.
+		if (starts[(size_t)((unsorted.empty() ? 0 : unsorted[0].pathHash >> shift) & 0xFFFF)] == unsorted.size()) {
+			continue;
+		}
+		size_t start = 0;
+		for (size_t& count : starts) {
+			const size_t digitCount = count;
+			count = start;
+			start += digitCount;
+		}
+		for (const Entry& entry : unsorted) {
+			sorted[starts[(size_t)((entry.pathHash >> shift) & 0xFFFF)]++] = entry;
+		}
+		unsorted.swap(sorted);
+	}
+}
+
+bool Snapshot::read(const std::string& path, std::string& error) {
+	entries.clear();
+	std::ifstream stream(std::filesystem::u8path(path), std::ios::binary);
+	if (!stream) {
+		error = "Could not open snapshot file \"" + path + "\"";
+		return false;
+	}
+	unsigned char header[24];
+	if (
+		!stream.read((char*)header, sizeof(header)) ||
+		(decode(header) != MAGIC) ||
+		((decode(header + 8) & 0xFFFFFFFF) != VERSION)
+	) {
+		error = "\"" + path + "\" is not a snapshot file";
+		return false;
+	}
+
+	// Reads the entries in blocks, checking that they are sorted.
+	const uint64_t count = decode(header + 16);
+	std::vector<unsigned char> block(ENTRY_BYTES * 4096);
+	entries.reserve((size_t)std::min<uint64_t>(count, (uint64_t)1 << 24));
+	for (uint64_t remaining = count; remaining > 0;) {
+		const size_t blockCount = (size_t)std::min<uint64_t>(remaining, 4096);
+		if (!stream.read((char*)block.data(), (std::streamsize)(blockCount * ENTRY_BYTES))) {
+			entries.clear();
+			error = "Snapshot file \"" + path + "\" is truncated";
+			return false;
+		}
+		for (size_t i = 0; i < blockCount; ++i) {
+			Entry entry;
+			entry.pathHash = decode(&block[i * ENTRY_BYTES]);
+			entry.stamp = decode(&block[i * ENTRY_BYTES + 8]);
+			entry.position = 0;
+			if (!entries.empty() && entry.pathHash < entries.back().pathHash) {
+				entries.clear();
+				error = "Snapshot file \"" + path + "\" is not sorted";
+				return false;
+			}
+			entries.push_back(entry);
+		}
+		remaining -= blockCount;
+	}
+	return true;
+}
+
+bool Snapshot::write(const std::string& path, std::string& error) const {
+	// Writes a temporary file and renames it, so that an interrupted write keeps the previous snapshot.
+	const std::filesystem::path finalPath = std::filesystem::u8path(path);
+	std::filesystem::path temporaryPath = finalPath;
+	temporaryPath += ".tmp";
+	{
+		std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!stream) {
+			error = "Could not create snapshot file \"" + path + "\"";
+			return false;
+		}
+		unsigned char header[24];
+		encode(header, MAGIC);
+		encode(header + 8, VERSION);
+		encode(header + 16, entries.size());
+		stream.write((const char*)header, sizeof(header));
+		std::vector<unsigned char> block;
+		block.reserve(ENTRY_BYTES * 4096);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			block.resize(block.size() + ENTRY_BYTES);
+			encode(&block[block.size() - ENTRY_BYTES], entries[i].pathHash);
+			encode(&block[block.size() - 8], entries[i].stamp);
+			if (block.size() == block.capacity() || i + 1 == entries.size()) {
+				stream.write((const char*)block.data(), (std::streamsize)block.size());
+				block.clear();
+			}
+		}
+		if (!stream.flush()) {
+			error = "Could not write snapshot file \"" + path + "\"";
+			return false;
+		}
+	}
+	std::error_code errorCode;
+	std::filesystem::rename(temporaryPath, finalPath, errorCode);
+	if (errorCode) {
+		error = "Could not replace snapshot file \"" + path + "\": " + errorCode.message();
+		return false;
+	}
+	return true;
+}
+
+void Snapshot::diff(const Snapshot& previous, const Snapshot& current, SnapshotDiff& diff) {
+	// Marks the positions first, as the merge visits them in hash order and bitmaps are built in position order.
+	std::vector<uint64_t> addedWords((current.entries.size() + 63) / 64, 0);
+	std::vector<uint64_t> changedWords(addedWords.size(), 0);
+	diff.removedCount = 0;
+	size_t i = 0;
+	size_t j = 0;
+	while (i < previous.entries.size() || j < current.entries.size()) {
+		if (j == current.entries.size() || (i < previous.entries.size() && previous.entries[i].pathHash < current.entries[j].pathHash)) {
+			++diff.removedCount;
+			++i;
+			continue;
+		}
+		const Entry& entry = current.entries[j++];
+		if (i == previous.entries.size() || entry.pathHash < previous.entries[i].pathHash) {
+			addedWords[entry.position >> 6] |= (uint64_t)1 << (entry.position & 63);
+			continue;
+		}
+		if (entry.stamp != previous.entries[i].stamp) {
+			changedWords[entry.position >> 6] |= (uint64_t)1 << (entry.position & 63);
+		}
+		++i;
+	}
+
+	diff.added.clear();
+	diff.changed.clear();
+	for (size_t k = 0; k < addedWords.size(); ++k) {
+		if ((addedWords[k] | changedWords[k]) == 0) {
+			continue;
+		}
+		for (unsigned bit = 0; bit < 64; ++bit) {
+			if ((addedWords[k] >> bit) & 1) diff.added.add((uint32_t)((k << 6) + bit));
+			if ((changedWords[k] >> bit) & 1) diff.changed.add((uint32_t)((k << 6) + bit));
+		}
+	}
+	diff.added.finish();
+	diff.changed.finish();
+}
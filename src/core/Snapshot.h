@@ -0,0 +1,98 @@
+// Snapshot.h : declarations for the snapshots of an index and the differences between them
+
+#pragma once
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "DirectorySource.h"
+#include "PathIndex.h"
+
+/**
+* Differences between the entries of an index and a previous snapshot.
+*/
+struct SnapshotDiff {
+    Bitmap added;             // Positions of the entries missing from the previous snapshot.
+    Bitmap changed;           // Positions of the entries whose stamp changed since the previous snapshot.
+    uint64_t removedCount = 0; // Entries of the previous snapshot missing from the index.
+};
+
+/**
+* Summary of the entries of an index: a hash of the absolute path and a stamp of every entry, sorted
+* by hash. Two snapshots are compared with a single linear merge, and snapshots are sorted with a
+* radix sort, so both take time proportional to the amount of entries.
+*
+* Snapshot files store the hashes and stamps as little-endian integers, 16 bytes per entry, so they
+* are much smaller than index files, but paths can not be recovered from them.
+*/
+class Snapshot {
+
+    private:
+        static const uint64_t MAGIC = 0x3150414E534F4652ULL; // "RFOSNAP1"
+        static const uint32_t VERSION = 1;
+
+        struct Entry {
+            uint64_t pathHash;
+            uint64_t stamp;    // Last write time, or 0 if unknown.
+            uint32_t position; // Position in the index, only known for snapshots built from it.
+        };
+
+        std::vector<Entry> entries; // Sorted by path hash.
+
+        /**
+        * @brief Sorts entries by path hash, 16 bits at a time.
+        */
+        static void sortByHash(std::vector<Entry>&);
+
+    public:
+        /**
+        * @brief Takes a snapshot of an index, reading the stamp of every entry from a source on several threads.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param source Source the stamps are read from.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void build(const PathIndex&, const std::vector<std::string>&, const DirectorySource&);
+        /**
+        * @brief Empties the snapshot.
+        */
+        void clear();
+        /**
+        * @brief Reads a snapshot file.
+        *
+        * @param path Path to the snapshot file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be read or is not a snapshot file, returns `false`.
+        */
+        bool read(const std::string&, std::string&);
+        /**
+        * @brief Writes a snapshot file, replacing the previous one only once it is complete.
+        *
+        * @param path Path to the snapshot file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        bool write(const std::string&, std::string&) const;
+        /**
+        * @brief Compares a snapshot of an index with a previous one.
+        *
+        * @param previous Previous snapshot.
+        * @param current Snapshot built from the index.
+        * @param diff Receives the differences, by position in the index.
+        */
+        static void diff(const Snapshot&, const Snapshot&, SnapshotDiff&);
+
+        // @return Amount of entries
+        size_t size() const { return entries.size(); }
+        // @return true if there are no entries
+        bool empty() const { return entries.empty(); }
+};
+
+#endif
@@ -0,0 +1,169 @@
+// SortedOrder.cpp : descriptions for the sorted orders of the entries of an index
+
+#include "SortedOrder.h"
+#include "Archive.h"
+#include "FileBatches.h"
+
+#include <algorithm>   // sort, merge, copy, min
+#include <cstring>     // memcmp
+#include <thread>      // thread
+
+#include <filesystem>  // u8path. C++17 ONLY.
+
+/**
+* @return First 8 bytes of a key as a big-endian number, padded with zeros.
+*/
+static uint64_t packPrefix(std::string_view key) {
+	uint64_t prefix = 0;
+	for (size_t i = 0; i < 8; ++i) {
+		prefix = (prefix << 8) | ((i < key.size()) ? (unsigned char)key[i] : 0);
+	}
+	return prefix;
+}
+
+void SortedOrder::encode(std::string_view relativePath, const uint16_t rootId, const bool isNatural, std::string& key) {
+	key.clear();
+	key.push_back((char)(rootId >> 8));
+	key.push_back((char)(rootId & 0xFF));
+	if (!isNatural) {
+		key.append(relativePath.data(), relativePath.size());
+		return;
+	}
+
+	// Separators sort before any other byte, so that a directory comes before its siblings that extend its name.
+	// Digit runs become '0', their amount of significant digits and those digits, so longer numbers sort later.
+	// Keys never hold 0 bytes past the root id, which keeps zero padding below any byte.
+	for (size_t i = 0; i < relativePath.size();) {
+		const char c = relativePath[i];
+		if (c >= '0' && c <= '9') {
+			size_t end = i;
+			while (end < relativePath.size() && relativePath[end] >= '0' && relativePath[end] <= '9') {
+				++end;
+			}
+			size_t start = i;
+			while (start + 1 < end && relativePath[start] == '0') {
+				++start;
+			}
+			const size_t digitCount = std::min<size_t>(end - start, 255);
+			key.push_back('0');
+			key.push_back((char)digitCount);
+			key.append(relativePath.data() + end - digitCount, digitCount);
+			i = end;
+			continue;
+		}
+		if (c == '/' || c == '\\') {
+			key.push_back('\x01');
+		} else if (c >= 'A' && c <= 'Z') {
+			key.push_back((char)(c - 'A' + 'a'));
+		} else {
+			key.push_back(c);
+		}
+		++i;
+	}
+}
+
+template <typename Less>
+void SortedOrder::parallelSort(std::vector<Item>& items, const Less& less) {
+	const size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), items.size() / MIN_CHUNK);
+	if (threadCount <= 1) {
+		std::sort(items.begin(), items.end(), less);
+		return;
+	}
+
+	// Sorts a chunk per thread.
+	std::vector<size_t> bounds(threadCount + 1);
+	for (size_t k = 0; k <= threadCount; ++k) {
+		bounds[k] = items.size() * k / threadCount;
+	}
+	std::vector<std::thread> workers;
+	for (size_t k = 0; k < threadCount; ++k) {
+		workers.emplace_back([&items, &bounds, &less, k]() {
+			std::sort(items.begin() + bounds[k], items.begin() + bounds[k + 1], less);
+		});
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	// Merges pairs of chunks concurrently, halving the chunks every round.
+	std::vector<Item> merged(items.size());
+	while (bounds.size() > 2) {
+		std::vector<size_t> mergedBounds{ 0 };
+		workers.clear();
+		for (size_t k = 0; k + 1 < bounds.size(); k += 2) {
+			const size_t first = bounds[k];
+			const size_t middle = bounds[k + 1];
+			const size_t last = (k + 2 < bounds.size()) ? bounds[k + 2] : middle;
+			workers.emplace_back([&items, &merged, &less, first, middle, last]() {
+				std::merge(
+					items.begin() + first, items.begin() + middle,
+					items.begin() + middle, items.begin() + last,
+					merged.begin() + first, less
+				);
+			});
+			mergedBounds.push_back(last);
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		items.swap(merged);
+		bounds.swap(mergedBounds);
+	}
+}
+
+void SortedOrder::build(const PathIndex& index, const std::vector<std::string>& rootStrings, const DirectorySource& source, const Key key) {
+	std::vector<Item> items(index.size());
+
+	// Numeric keys are read from the source, one status call per entry, on several threads.
+	if (key == writeTime || key == fileSize) {
+		FileBatches::run(index, rootStrings, nullptr, [&](const unsigned, const uint32_t position, const std::string& path) {
+			// Files inside archives take the time and size of their archive.
+			const size_t separator = Archive::findSeparator(path);
+			const std::filesystem::path filePath = std::filesystem::u8path((separator == std::string::npos) ? path : path.substr(0, separator));
+			items[position].prefix = (key == writeTime) ? source.stamp(filePath) : source.fileSize(filePath);
+			items[position].position = position;
+		});
+		parallelSort(items, [](const Item& a, const Item& b) {
+			return (a.prefix != b.prefix) ? (a.prefix < b.prefix) : (a.position < b.position);
+		});
+	} else {
+		// String keys live back to back in an arena, like the paths themselves.
+		std::string arena;
+		std::vector<uint64_t> offsets(index.size() + 1);
+		arena.reserve((size_t)index.pathBytes() + index.size() * 2);
+		std::string encoded;
+		for (size_t i = 0; i < index.size(); ++i) {
+			const uint16_t rootId = index.root(i);
+			encode(index[i], rootId, key == natural, encoded);
+			offsets[i] = arena.size();
+			arena.append(encoded);
+			items[i].prefix = packPrefix(encoded);
+			items[i].position = (uint32_t)i;
+		}
+		offsets[index.size()] = arena.size();
+
+		// Only keys that share their first 8 bytes are compared past them.
+		const char* arenaData = arena.data();
+		const uint64_t* offsetData = offsets.data();
+		parallelSort(items, [arenaData, offsetData](const Item& a, const Item& b) {
+			if (a.prefix != b.prefix) {
+				return a.prefix < b.prefix;
+			}
+			const uint64_t aStart = std::min<uint64_t>(offsetData[a.position] + 8, offsetData[a.position + 1]);
+			const uint64_t bStart = std::min<uint64_t>(offsetData[b.position] + 8, offsetData[b.position + 1]);
+			const std::string_view aRest(arenaData + aStart, (size_t)(offsetData[a.position + 1] - aStart));
+			const std::string_view bRest(arenaData + bStart, (size_t)(offsetData[b.position + 1] - bStart));
+			const int comparison = aRest.compare(bRest);
+			return (comparison != 0) ? (comparison < 0) : (a.position < b.position);
+		});
+	}
+
+	positions.resize(items.size());
+	for (size_t i = 0; i < items.size(); ++i) {
+		positions[i] = items[i].position;
+	}
+}
+
+void SortedOrder::clear() {
+	positions.clear();
+}
@@ -0,0 +1,85 @@
+// SortedOrder.h : declarations for the sorted orders of the entries of an index
+
+#pragma once
+
+#ifndef SORTEDORDER_H_
+#define SORTEDORDER_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "DirectorySource.h"
+#include "PathIndex.h"
+
+/**
+* Positions of the entries of an index sorted by a key, for ordered playlists.
+*
+* Keys are computed once per entry before sorting: numbers for times and sizes, and byte strings
+* for paths, where natural keys are pre-tokenized so that plain byte comparisons put "ep2" before
+* "ep10". Sorting moves 16 byte items (the first 8 bytes of the key and a position) rather than
+* paths, compares the rest of a string key only when the first 8 bytes tie, and runs on several
+* threads.
+*/
+class SortedOrder {
+
+    public:
+        enum Key {
+            natural,   // Relative path, ignoring ASCII case and comparing digit runs as numbers.
+            writeTime, // Last write time, oldest first.
+            fileSize,  // Size in bytes, smallest first.
+            path       // Relative path bytes.
+        };
+
+    private:
+        static const size_t MIN_CHUNK = 1 << 16; // Entries sorted by a thread, at least.
+
+        struct Item {
+            uint64_t prefix;   // First 8 bytes of the key, big-endian, or the whole key if it is a number.
+            uint32_t position;
+        };
+
+        std::vector<uint32_t> positions;
+
+        /**
+        * @brief Builds the string key of an entry: its root id followed by its path, tokenized if natural.
+        *
+        * @param relativePath Relative path.
+        * @param rootId Root id.
+        * @param isNatural Whether to build a natural key.
+        * @param key Receives the key.
+        */
+        static void encode(std::string_view, const uint16_t, const bool, std::string&);
+        /**
+        * @brief Sorts items on as many threads as are worth it, then merges the sorted chunks.
+        */
+        template <typename Less>
+        static void parallelSort(std::vector<Item>&, const Less&);
+
+    public:
+        /**
+        * @brief Sorts the entries of an index.
+        *
+        * @param index Index.
+        * @param rootStrings Root directories, by root id.
+        * @param source Source times and sizes are read from.
+        * @param key Key to sort by.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void build(const PathIndex&, const std::vector<std::string>&, const DirectorySource&, const Key);
+        /**
+        * @brief Empties the order.
+        */
+        void clear();
+
+        // @return Amount of sorted entries
+        size_t size() const { return positions.size(); }
+        // @return true if there are no sorted entries
+        bool empty() const { return positions.empty(); }
+        // @return Position of the `i`th entry in order
+        size_t operator[](const size_t i) const { return positions[i]; }
+};
+
+#endif
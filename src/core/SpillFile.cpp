@@ -0,0 +1,171 @@
+// SpillFile.cpp : descriptions for the on-disk storage of spilled index entries
+
+#include "SpillFile.h"
+
+#include <algorithm>   // upper_bound, min_element
+#include <cstring>     // memcpy
+#include <random>      // random_device
+#include <stdexcept>   // runtime_error
+
+SpillFile::SpillFile() {
+	fileSize = 0;
+	entryCount = 0;
+	pathBytes = 0;
+	pageFirstEntry = 0;
+	useCounter = 0;
+}
+
+SpillFile::~SpillFile() {
+	stream.close();
+
+	// Only left behind where open files cannot be removed.
+	if (!filePath.empty()) {
+		std::error_code ignored;
+		std::filesystem::remove(filePath, ignored);
+	}
+}
+
+void SpillFile::open(const std::filesystem::path& directory) {
+	std::random_device random;
+	char name[48];
+	snprintf(name, sizeof(name), "rfopener-%08x%08x.spill", (unsigned int)random(), (unsigned int)random());
+	filePath = directory / name;
+
+	stream.open(filePath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		throw std::runtime_error("Could not create spill file \"" + filePath.generic_u8string() + "\"");
+	}
+
+	// Removes the name right away where possible, so that nothing is left behind after a crash.
+	std::error_code error;
+	if (std::filesystem::remove(filePath, error)) {
+		filePath.clear();
+	}
+}
+
+void SpillFile::beginChunk() {
+	chunkStarts.push_back(entryCount);
+}
+
+void SpillFile::write(const uint16_t rootId, std::string_view path) {
+	if (path.size() > UINT32_MAX) {
+		throw std::runtime_error("Path is too long to be spilled");
+	}
+	const uint32_t length = (uint32_t)path.size();
+
+	// Entries never straddle pages.
+	if (
+		!pageBuffer.empty() &&
+		(pageBuffer.size() + RECORD_HEADER_BYTES + length > PAGE_BYTES)
+	) {
+		flushPage();
+	}
+	if (pageBuffer.empty()) {
+		pageFirstEntry = entryCount;
+	}
+
+	char header[RECORD_HEADER_BYTES];
+	memcpy(header, &rootId, sizeof(rootId));
+	memcpy(header + sizeof(rootId), &length, sizeof(length));
+	pageBuffer.append(header, RECORD_HEADER_BYTES);
+	pageBuffer.append(path.data(), path.size());
+
+	++entryCount;
+	pathBytes += length;
+}
+
+void SpillFile::endChunk() {
+	flushPage();
+
+	// Every chunk may be read concurrently with the rest while merging them.
+	cache.reserve(PAGE_CACHE_SIZE + chunkStarts.size());
+}
+
+std::string_view SpillFile::lookup(const uint64_t entry, uint16_t& rootId) const {
+	// Finds the page holding the entry.
+	const std::vector<Page>::const_iterator it = std::upper_bound(
+		pages.begin(),
+		pages.end(),
+		entry,
+		[](const uint64_t value, const Page& page) { return value < page.firstEntry; }
+	);
+	const size_t page = (size_t)(it - pages.begin()) - 1;
+	CachedPage& cached = loadPage(page);
+
+	// Walks the page from the cursor, or from its start if the entry is behind the cursor.
+	const uint64_t target = entry - pages[page].firstEntry;
+	if (cached.cursorEntry > target) {
+		cached.cursorEntry = 0;
+		cached.cursorByte = 0;
+	}
+	uint32_t length;
+	while (cached.cursorEntry < target) {
+		memcpy(&length, cached.bytes.data() + cached.cursorByte + sizeof(uint16_t), sizeof(length));
+		cached.cursorByte += RECORD_HEADER_BYTES + length;
+		++cached.cursorEntry;
+	}
+
+	const char* record = cached.bytes.data() + cached.cursorByte;
+	memcpy(&rootId, record, sizeof(rootId));
+	memcpy(&length, record + sizeof(rootId), sizeof(length));
+	return std::string_view(record + RECORD_HEADER_BYTES, length);
+}
+
+void SpillFile::flushPage() {
+	if (pageBuffer.empty()) {
+		return;
+	}
+
+	stream.clear();
+	stream.seekp((std::streamoff)fileSize);
+	stream.write(pageBuffer.data(), (std::streamsize)pageBuffer.size());
+	if (!stream) {
+		throw std::runtime_error("Could not write spill file (is the disk full?)");
+	}
+
+	Page page;
+	page.offset = fileSize;
+	page.firstEntry = pageFirstEntry;
+	page.bytes = (uint32_t)pageBuffer.size();
+	pages.push_back(page);
+
+	fileSize += pageBuffer.size();
+	pageBuffer.clear();
+}
+
+SpillFile::CachedPage& SpillFile::loadPage(const size_t page) const {
+	++useCounter;
+	for (CachedPage& cached : cache) {
+		if (cached.page == page) {
+			cached.lastUse = useCounter;
+			return cached;
+		}
+	}
+
+	// Takes a free slot, or evicts the least recently used page.
+	CachedPage* slot;
+	if (cache.size() < PAGE_CACHE_SIZE + chunkStarts.size()) {
+		cache.emplace_back();
+		slot = &cache.back();
+	} else {
+		slot = &*std::min_element(cache.begin(), cache.end(), [](const CachedPage& a, const CachedPage& b) {
+			return a.lastUse < b.lastUse;
+		});
+	}
+
+	std::fstream& file = const_cast<std::fstream&>(stream);
+	slot->page = SIZE_MAX;
+	slot->bytes.resize(pages[page].bytes);
+	file.clear();
+	file.seekg((std::streamoff)pages[page].offset);
+	file.read(&slot->bytes[0], (std::streamsize)pages[page].bytes);
+	if (!file) {
+		throw std::runtime_error("Could not read spill file");
+	}
+
+	slot->page = page;
+	slot->lastUse = useCounter;
+	slot->cursorEntry = 0;
+	slot->cursorByte = 0;
+	return *slot;
+}
@@ -0,0 +1,127 @@
+// SpillFile.h : declarations for the on-disk storage of spilled index entries
+
+#pragma once
+
+#ifndef SPILLFILE_H_
+#define SPILLFILE_H_
+
+#include <cstdint>     // fixed width integers
+#include <fstream>     // file streams
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+/**
+* Temporary file holding index entries that did not fit in the memory budget.
+*
+* Entries are written in sorted chunks, packed into pages that never split an entry. Only a
+* small directory of pages stays in memory; entries are read back through a small cache of
+* pages, each remembering where its last lookup ended so that sequential access is cheap.
+*
+* Errors throw `std::runtime_error`. Lookups are not thread-safe, and a returned view is only
+* valid until the following lookup.
+*/
+class SpillFile {
+
+    private:
+        // Location of a page in the file.
+        struct Page {
+            uint64_t offset;
+            uint64_t firstEntry;
+            uint32_t bytes;
+        };
+
+        // A page read back into memory.
+        struct CachedPage {
+            size_t page = SIZE_MAX;
+            std::string bytes;
+            uint64_t lastUse = 0;
+            uint64_t cursorEntry = 0; // Entry (relative to the page) the cursor points at.
+            size_t cursorByte = 0;    // Offset of that entry in the page.
+        };
+
+        std::filesystem::path filePath;
+        std::fstream stream;
+        uint64_t fileSize;
+
+        // Directory.
+        std::vector<Page> pages;
+        std::vector<uint64_t> chunkStarts;
+        uint64_t entryCount;
+        uint64_t pathBytes;
+
+        // Page being written.
+        std::string pageBuffer;
+        uint64_t pageFirstEntry;
+
+        // Cache.
+        mutable std::vector<CachedPage> cache;
+        mutable uint64_t useCounter;
+
+        /**
+        * @brief Writes the page being built at the end of the file.
+        */
+        void flushPage();
+        /**
+        * @brief Finds a page in the cache, reading it (and evicting the least recently used one) if missing.
+        *
+        * @param page Page number.
+        */
+        CachedPage& loadPage(const size_t) const;
+
+    public:
+        static const size_t PAGE_BYTES = 64 * 1024;    // Pages grow past this only to fit a single long entry
+        static const size_t PAGE_CACHE_SIZE = 16;      // Minimum amount of cached pages
+        static const size_t RECORD_HEADER_BYTES = 6;   // Root id (2 bytes) and path length (4 bytes)
+
+        // == Constructor ==
+        SpillFile();
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+        ~SpillFile();
+
+        /**
+        * @brief Creates the temporary file.
+        *
+        * @param directory Directory where the file is created.
+        */
+        void open(const std::filesystem::path&);
+        /**
+        * @brief Starts a chunk. Entries of a chunk are expected to be written sorted.
+        */
+        void beginChunk();
+        /**
+        * @brief Appends an entry to the current chunk.
+        *
+        * @param rootId Root id of the entry.
+        * @param path Relative path of the entry.
+        */
+        void write(const uint16_t, std::string_view);
+        /**
+        * @brief Completes the current chunk, flushing its last page.
+        */
+        void endChunk();
+        /**
+        * @brief Reads an entry back.
+        *
+        * @param entry Number of the entry, in writing order.
+        * @param rootId Receives the root id of the entry.
+        * @return Relative path of the entry, valid until the following lookup.
+        */
+        std::string_view lookup(const uint64_t, uint16_t&) const;
+
+        // @return Amount of entries written
+        uint64_t size() const { return entryCount; }
+        // @return Amount of path bytes written
+        uint64_t getPathBytes() const { return pathBytes; }
+        // @return Amount of chunks
+        size_t getChunkCount() const { return chunkStarts.size(); }
+        // @return First entry of a chunk
+        uint64_t chunkBegin(const size_t chunk) const { return chunkStarts[chunk]; }
+        // @return Entry past the end of a chunk
+        uint64_t chunkEnd(const size_t chunk) const { return (chunk + 1 < chunkStarts.size()) ? chunkStarts[chunk + 1] : entryCount; }
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Stats.h : counters and timers reported by scans and picks
+
+#pragma once
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <algorithm>   // max
+#include <cstdint>     // fixed width integers
+
+/**
+* Counters and timers of a scan. Every worker fills its own, and they are added up afterwards.
+* Only directory (and archive) listings are timed, so the overhead stays at two clock reads per directory.
+* Telling the type of files, and finding copies, are timed as a whole.
+*/
+struct ScanStats {
+    uint64_t listedDirectories = 0; // Directories listed.
+    uint64_t seenEntries = 0;       // Entries returned by the listings.
+    uint64_t statCalls = 0;         // Status calls made beyond the listings themselves (e.g. to follow links).
+    uint64_t listNanoseconds = 0;   // Time spent listing directories, added up across workers.
+    uint64_t wallNanoseconds = 0;   // Duration of the whole scan.
+    uint64_t skippedDirectories = 0; // Directories abandoned because they were not listed before the deadline.
+    uint64_t lateDirectories = 0;   // Abandoned directories whose listing completed before the scan did.
+    uint64_t throttleNanoseconds = 0; // Time spent paused by rate limits and back-off, added up across workers.
+    uint64_t expandedArchives = 0;  // Archives whose entries were indexed instead of them.
+    uint64_t archiveEntries = 0;    // Files found inside archives.
+    uint64_t archiveNanoseconds = 0; // Time spent reading the listings of archives, added up across workers.
+    uint64_t sniffedFiles = 0;      // Files whose first bytes were read to tell their type.
+    uint64_t cachedTypes = 0;       // Files whose type was found in the type cache instead.
+    uint64_t sniffNanoseconds = 0;  // Time spent telling the type of files.
+    uint64_t sampledFiles = 0;      // Files whose first and last bytes were hashed to find copies.
+    uint64_t hashedFiles = 0;       // Files hashed whole to find copies.
+    uint64_t hashedBytes = 0;       // Bytes read to sample and hash files.
+    uint64_t cachedHashes = 0;      // Files whose sample or hash was found in the hash cache instead.
+    uint64_t duplicateFiles = 0;    // Files found to be copies of another one.
+    uint64_t hashNanoseconds = 0;   // Time spent finding copies.
+
+    // Entries rejected, by reason.
+    uint64_t shardRejects = 0;      // Top-level entries of other shards.
+    uint64_t depthRejects = 0;      // Directories past the maximum depth.
+    uint64_t blacklistRejects = 0;  // Blacklisted directories.
+    uint64_t extensionRejects = 0;  // Files without a whitelisted extension.
+    uint64_t otherRejects = 0;      // Entries that are neither files nor directories (e.g. links to directories).
+    uint64_t deviceRejects = 0;     // Directories on other devices than their root's.
+    uint64_t filesystemRejects = 0; // Directories on filesystems of skipped types.
+    uint64_t loopRejects = 0;       // Directories reached before (e.g. through a bind mount).
+    uint64_t rootRejects = 0;       // Listed paths outside every root directory, or with `.` or `..` in them.
+
+    // Index storage.
+    uint64_t pathBytes = 0;         // Bytes of stored paths.
+    uint64_t peakIndexBytes = 0;    // Peak memory taken by the index (or indexes, while scanning concurrently).
+
+    // Heap allocations, only counted in builds with RFOPENER_ALLOC_ACCOUNTING.
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+
+    /**
+    * @brief Adds the stats of a concurrent worker.
+    *
+    * @param other Stats to add.
+    */
+    void add(const ScanStats& other) {
+        listedDirectories += other.listedDirectories;
+        seenEntries += other.seenEntries;
+        statCalls += other.statCalls;
+        listNanoseconds += other.listNanoseconds;
+        wallNanoseconds = (std::max)(wallNanoseconds, other.wallNanoseconds);
+        skippedDirectories += other.skippedDirectories;
+        lateDirectories += other.lateDirectories;
+        throttleNanoseconds += other.throttleNanoseconds;
+        expandedArchives += other.expandedArchives;
+        archiveEntries += other.archiveEntries;
+        archiveNanoseconds += other.archiveNanoseconds;
+        sniffedFiles += other.sniffedFiles;
+        cachedTypes += other.cachedTypes;
+        sniffNanoseconds += other.sniffNanoseconds;
+        sampledFiles += other.sampledFiles;
+        hashedFiles += other.hashedFiles;
+        hashedBytes += other.hashedBytes;
+        cachedHashes += other.cachedHashes;
+        duplicateFiles += other.duplicateFiles;
+        hashNanoseconds += other.hashNanoseconds;
+        shardRejects += other.shardRejects;
+        depthRejects += other.depthRejects;
+        blacklistRejects += other.blacklistRejects;
+        extensionRejects += other.extensionRejects;
+        otherRejects += other.otherRejects;
+        deviceRejects += other.deviceRejects;
+        filesystemRejects += other.filesystemRejects;
+        loopRejects += other.loopRejects;
+        rootRejects += other.rootRejects;
+        pathBytes += other.pathBytes;
+        peakIndexBytes += other.peakIndexBytes;
+        allocations += other.allocations;
+        allocatedBytes += other.allocatedBytes;
+    }
+};
+
+/**
+* Counters and timers of the picks made during a session.
+*/
+struct PickStats {
+    uint64_t randomPicks = 0;
+    uint64_t sequentialPicks = 0;
+    uint64_t launches = 0;          // Files handed to the shell.
+    uint64_t launchFailures = 0;    // Files the shell could not open.
+    uint64_t buildNanoseconds = 0;  // Time spent building absolute paths.
+    uint64_t launchNanoseconds = 0; // Time spent in the shell.
+
+    // Heap allocations made while executing files, only counted in builds with RFOPENER_ALLOC_ACCOUNTING.
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+#endif
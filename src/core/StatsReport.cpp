@@ -0,0 +1,194 @@
+// StatsReport.cpp : descriptions for the JSON and Prometheus renderings of scan and pick stats
+
+#include "StatsReport.h"
+#include "Json.h"
+#include "Allocations.h"
+
+#include <cstdio>      // snprintf
+
+/**
+* @return Nanoseconds as seconds.
+*/
+static std::string seconds(const uint64_t nanoseconds) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.6f", nanoseconds / 1e9);
+	return text;
+}
+
+/**
+* @return Amount per second, or 0 if no time passed.
+*/
+static std::string rate(const uint64_t amount, const uint64_t nanoseconds) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.1f", (nanoseconds > 0) ? amount / (nanoseconds / 1e9) : 0.0);
+	return text;
+}
+
+/**
+* @return Amount per item, or 0 if there are no items.
+*/
+static std::string ratio(const uint64_t amount, const uint64_t items) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.2f", (items > 0) ? (double)amount / items : 0.0);
+	return text;
+}
+
+std::string StatsReport::toJson(const ScanResult* scan, const PickStats* picks, const std::vector<std::string>& roots) {
+	std::string json = "{";
+	if (scan != nullptr) {
+		const ScanStats& stats = scan->stats;
+		json += "\n  \"scan\": {";
+		json += "\n    \"ok\": " + std::string(scan->ok ? "true" : "false") + ",";
+		json += "\n    \"cancelled\": " + std::string(scan->isCancelled ? "true" : "false") + ",";
+		json += "\n    \"sharedAttached\": " + std::string(scan->isSharedAttached ? "true" : "false") + ",";
+		json += "\n    \"wallSeconds\": " + seconds(stats.wallNanoseconds) + ",";
+		json += "\n    \"listSeconds\": " + seconds(stats.listNanoseconds) + ",";
+		json += "\n    \"throttleSeconds\": " + seconds(stats.throttleNanoseconds) + ",";
+		json += "\n    \"archiveSeconds\": " + seconds(stats.archiveNanoseconds) + ",";
+		json += "\n    \"sniffSeconds\": " + seconds(stats.sniffNanoseconds) + ",";
+		json += "\n    \"hashSeconds\": " + seconds(stats.hashNanoseconds) + ",";
+		json += "\n    \"files\": " + std::to_string(scan->fileCount) + ",";
+		json += "\n    \"directories\": " + std::to_string(scan->directoryCount) + ",";
+		json += "\n    \"listedDirectories\": " + std::to_string(stats.listedDirectories) + ",";
+		json += "\n    \"entries\": " + std::to_string(stats.seenEntries) + ",";
+		json += "\n    \"directoriesPerSecond\": " + rate(stats.listedDirectories, stats.wallNanoseconds) + ",";
+		json += "\n    \"entriesPerSecond\": " + rate(stats.seenEntries, stats.wallNanoseconds) + ",";
+		json += "\n    \"statCalls\": " + std::to_string(stats.statCalls) + ",";
+		json += "\n    \"skippedDirectories\": " + std::to_string(stats.skippedDirectories) + ",";
+		json += "\n    \"lateDirectories\": " + std::to_string(stats.lateDirectories) + ",";
+		json += "\n    \"expandedArchives\": " + std::to_string(stats.expandedArchives) + ",";
+		json += "\n    \"archiveEntries\": " + std::to_string(stats.archiveEntries) + ",";
+		json += "\n    \"sniffedFiles\": " + std::to_string(stats.sniffedFiles) + ",";
+		json += "\n    \"cachedTypes\": " + std::to_string(stats.cachedTypes) + ",";
+		json += "\n    \"sampledFiles\": " + std::to_string(stats.sampledFiles) + ",";
+		json += "\n    \"hashedFiles\": " + std::to_string(stats.hashedFiles) + ",";
+		json += "\n    \"hashedBytes\": " + std::to_string(stats.hashedBytes) + ",";
+		json += "\n    \"cachedHashes\": " + std::to_string(stats.cachedHashes) + ",";
+		json += "\n    \"duplicateFiles\": " + std::to_string(stats.duplicateFiles) + ",";
+		json += "\n    \"rejected\": {";
+		json += "\n      \"shard\": " + std::to_string(stats.shardRejects) + ",";
+		json += "\n      \"depth\": " + std::to_string(stats.depthRejects) + ",";
+		json += "\n      \"blacklist\": " + std::to_string(stats.blacklistRejects) + ",";
+		json += "\n      \"extension\": " + std::to_string(stats.extensionRejects) + ",";
+		json += "\n      \"other\": " + std::to_string(stats.otherRejects) + ",";
+		json += "\n      \"device\": " + std::to_string(stats.deviceRejects) + ",";
+		json += "\n      \"filesystem\": " + std::to_string(stats.filesystemRejects) + ",";
+		json += "\n      \"loop\": " + std::to_string(stats.loopRejects) + ",";
+		json += "\n      \"root\": " + std::to_string(stats.rootRejects);
+		json += "\n    },";
+		json += "\n    \"pathBytes\": " + std::to_string(stats.pathBytes) + ",";
+		json += "\n    \"peakIndexBytes\": " + std::to_string(stats.peakIndexBytes) + ",";
+		json += "\n    \"spilledEntries\": " + std::to_string(scan->spilledCount) + ",";
+		if (Allocations::isEnabled()) {
+			json += "\n    \"allocations\": {";
+			json += "\n      \"count\": " + std::to_string(stats.allocations) + ",";
+			json += "\n      \"bytes\": " + std::to_string(stats.allocatedBytes) + ",";
+			json += "\n      \"perFile\": " + ratio(stats.allocations, scan->fileCount) + ",";
+			json += "\n      \"bytesPerFile\": " + ratio(stats.allocatedBytes, scan->fileCount);
+			json += "\n    },";
+		}
+		json += "\n    \"roots\": [";
+		for (size_t rootId = 0; rootId < scan->rootCounts.size() && rootId < roots.size(); ++rootId) {
+			json += std::string((rootId > 0) ? "," : "") + "\n      { \"path\": \"" + Json::escape(roots[rootId]) + "\""
+				+ ", \"files\": " + std::to_string(scan->rootCounts[rootId].fileCount)
+				+ ", \"directories\": " + std::to_string(scan->rootCounts[rootId].directoryCount) + " }";
+		}
+		json += "\n    ]";
+		json += "\n  }";
+	}
+	if (picks != nullptr) {
+		json += std::string((scan != nullptr) ? "," : "") + "\n  \"picks\": {";
+		json += "\n    \"random\": " + std::to_string(picks->randomPicks) + ",";
+		json += "\n    \"sequential\": " + std::to_string(picks->sequentialPicks) + ",";
+		json += "\n    \"launches\": " + std::to_string(picks->launches) + ",";
+		json += "\n    \"launchFailures\": " + std::to_string(picks->launchFailures) + ",";
+		json += "\n    \"buildSeconds\": " + seconds(picks->buildNanoseconds) + ",";
+		json += "\n    \"launchSeconds\": " + seconds(picks->launchNanoseconds);
+		if (Allocations::isEnabled()) {
+			json += ",\n    \"allocations\": {";
+			json += "\n      \"count\": " + std::to_string(picks->allocations) + ",";
+			json += "\n      \"bytes\": " + std::to_string(picks->allocatedBytes) + ",";
+			json += "\n      \"perLaunch\": " + ratio(picks->allocations, picks->launches);
+			json += "\n    }";
+		}
+		json += "\n  }";
+	}
+	json += "\n}\n";
+	return json;
+}
+
+/**
+* @brief Appends a metric, with its help and type lines the first time.
+*/
+static void addMetric(std::string& text, const char* name, const char* type, const char* help, const std::string& labels, const std::string& value) {
+	const std::string header = std::string("# HELP ") + name + " ";
+	if (text.find(header) == std::string::npos) {
+		text += header + help + "\n# TYPE " + name + " " + type + "\n";
+	}
+	text += name + (labels.empty() ? "" : "{" + labels + "}") + " " + value + "\n";
+}
+
+std::string StatsReport::toPrometheus(const ScanResult* scan, const PickStats* picks, const std::vector<std::string>& roots) {
+	std::string text;
+	if (scan != nullptr) {
+		const ScanStats& stats = scan->stats;
+		addMetric(text, "rfopener_scan_ok", "gauge", "Whether the last scan completed without errors.", "", scan->ok ? "1" : "0");
+		addMetric(text, "rfopener_scan_seconds", "gauge", "Duration of the last scan.", "", seconds(stats.wallNanoseconds));
+		addMetric(text, "rfopener_scan_list_seconds", "gauge", "Time spent listing directories, added up across workers.", "", seconds(stats.listNanoseconds));
+		addMetric(text, "rfopener_scan_throttle_seconds", "gauge", "Time spent paused by rate limits and back-off, added up across workers.", "", seconds(stats.throttleNanoseconds));
+		addMetric(text, "rfopener_scan_archive_seconds", "gauge", "Time spent reading the listings of archives, added up across workers.", "", seconds(stats.archiveNanoseconds));
+		addMetric(text, "rfopener_scan_sniff_seconds", "gauge", "Time spent telling the type of files.", "", seconds(stats.sniffNanoseconds));
+		addMetric(text, "rfopener_scan_hash_seconds", "gauge", "Time spent finding copies of files.", "", seconds(stats.hashNanoseconds));
+		addMetric(text, "rfopener_scan_listed_directories", "gauge", "Directories listed.", "", std::to_string(stats.listedDirectories));
+		addMetric(text, "rfopener_scan_entries", "gauge", "Entries returned by directory listings.", "", std::to_string(stats.seenEntries));
+		addMetric(text, "rfopener_scan_stat_calls", "gauge", "Status calls made beyond directory listings.", "", std::to_string(stats.statCalls));
+		addMetric(text, "rfopener_scan_skipped_directories", "gauge", "Directories abandoned because they were not listed before the deadline.", "", std::to_string(stats.skippedDirectories));
+		addMetric(text, "rfopener_scan_late_directories", "gauge", "Abandoned directories listed after all before the scan completed.", "", std::to_string(stats.lateDirectories));
+		addMetric(text, "rfopener_scan_expanded_archives", "gauge", "Archives whose entries were indexed instead of them.", "", std::to_string(stats.expandedArchives));
+		addMetric(text, "rfopener_scan_archive_entries", "gauge", "Files found inside archives.", "", std::to_string(stats.archiveEntries));
+		addMetric(text, "rfopener_scan_sniffed_files", "gauge", "Files whose first bytes were read to tell their type.", "", std::to_string(stats.sniffedFiles));
+		addMetric(text, "rfopener_scan_cached_types", "gauge", "Files whose type was found in the type cache.", "", std::to_string(stats.cachedTypes));
+		addMetric(text, "rfopener_scan_sampled_files", "gauge", "Files whose first and last bytes were hashed to find copies.", "", std::to_string(stats.sampledFiles));
+		addMetric(text, "rfopener_scan_hashed_files", "gauge", "Files hashed whole to find copies.", "", std::to_string(stats.hashedFiles));
+		addMetric(text, "rfopener_scan_hashed_bytes", "gauge", "Bytes read to sample and hash files.", "", std::to_string(stats.hashedBytes));
+		addMetric(text, "rfopener_scan_cached_hashes", "gauge", "Files whose sample or hash was found in the hash cache.", "", std::to_string(stats.cachedHashes));
+		addMetric(text, "rfopener_scan_duplicate_files", "gauge", "Files found to be copies of another one.", "", std::to_string(stats.duplicateFiles));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "Entries left out of the index, by reason.", "reason=\"shard\"", std::to_string(stats.shardRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"depth\"", std::to_string(stats.depthRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"blacklist\"", std::to_string(stats.blacklistRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"extension\"", std::to_string(stats.extensionRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"other\"", std::to_string(stats.otherRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"device\"", std::to_string(stats.deviceRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"filesystem\"", std::to_string(stats.filesystemRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"loop\"", std::to_string(stats.loopRejects));
+		addMetric(text, "rfopener_scan_rejected_entries", "gauge", "", "reason=\"root\"", std::to_string(stats.rootRejects));
+		addMetric(text, "rfopener_index_path_bytes", "gauge", "Bytes of stored paths.", "", std::to_string(stats.pathBytes));
+		addMetric(text, "rfopener_index_peak_bytes", "gauge", "Peak memory taken by the index while scanning.", "", std::to_string(stats.peakIndexBytes));
+		addMetric(text, "rfopener_index_spilled_entries", "gauge", "Entries spilled to disk because of the memory budget.", "", std::to_string(scan->spilledCount));
+		if (Allocations::isEnabled()) {
+			addMetric(text, "rfopener_scan_allocations", "gauge", "Heap allocations made by the last scan.", "", std::to_string(stats.allocations));
+			addMetric(text, "rfopener_scan_allocated_bytes", "gauge", "Bytes requested by the heap allocations of the last scan.", "", std::to_string(stats.allocatedBytes));
+		}
+		for (size_t rootId = 0; rootId < scan->rootCounts.size() && rootId < roots.size(); ++rootId) {
+			const std::string labels = "root=\"" + Json::escape(roots[rootId]) + "\"";
+			addMetric(text, "rfopener_root_files", "gauge", "Files indexed per root directory.", labels, std::to_string(scan->rootCounts[rootId].fileCount));
+		}
+		for (size_t rootId = 0; rootId < scan->rootCounts.size() && rootId < roots.size(); ++rootId) {
+			const std::string labels = "root=\"" + Json::escape(roots[rootId]) + "\"";
+			addMetric(text, "rfopener_root_directories", "gauge", "Directories scanned per root directory.", labels, std::to_string(scan->rootCounts[rootId].directoryCount));
+		}
+	}
+	if (picks != nullptr) {
+		addMetric(text, "rfopener_picks_total", "counter", "Picks made, by kind.", "kind=\"random\"", std::to_string(picks->randomPicks));
+		addMetric(text, "rfopener_picks_total", "counter", "", "kind=\"sequential\"", std::to_string(picks->sequentialPicks));
+		addMetric(text, "rfopener_launches_total", "counter", "Files handed to the shell.", "", std::to_string(picks->launches));
+		addMetric(text, "rfopener_launch_failures_total", "counter", "Files the shell could not open.", "", std::to_string(picks->launchFailures));
+		addMetric(text, "rfopener_path_build_seconds_total", "counter", "Time spent building absolute paths.", "", seconds(picks->buildNanoseconds));
+		addMetric(text, "rfopener_launch_seconds_total", "counter", "Time spent in the shell.", "", seconds(picks->launchNanoseconds));
+		if (Allocations::isEnabled()) {
+			addMetric(text, "rfopener_launch_allocations_total", "counter", "Heap allocations made while executing files.", "", std::to_string(picks->allocations));
+			addMetric(text, "rfopener_launch_allocated_bytes_total", "counter", "Bytes requested by the heap allocations made while executing files.", "", std::to_string(picks->allocatedBytes));
+		}
+	}
+	return text;
+}
@@ -0,0 +1,39 @@
+// StatsReport.h : declarations for the JSON and Prometheus renderings of scan and pick stats
+
+#pragma once
+
+#ifndef STATSREPORT_H_
+#define STATSREPORT_H_
+
+#include <string>      // strings
+#include <vector>      // dynamic containers
+
+#include "Scanner.h"
+#include "Stats.h"
+
+/**
+* Renders stats as text. Either part may be missing (`nullptr`), e.g. when an index was loaded
+* instead of scanned, or before any pick was made.
+*/
+class StatsReport {
+
+    public:
+        /**
+        * @brief Renders the stats as a JSON object.
+        *
+        * @param scan Outcome of the scan, or `nullptr`.
+        * @param picks Pick stats, or `nullptr`.
+        * @param roots Root directories, by root id.
+        */
+        static std::string toJson(const ScanResult*, const PickStats*, const std::vector<std::string>&);
+        /**
+        * @brief Renders the stats in the Prometheus text exposition format, e.g. for the node exporter's textfile collector.
+        *
+        * @param scan Outcome of the scan, or `nullptr`.
+        * @param picks Pick stats, or `nullptr`.
+        * @param roots Root directories, by root id.
+        */
+        static std::string toPrometheus(const ScanResult*, const PickStats*, const std::vector<std::string>&);
+};
+
+#endif
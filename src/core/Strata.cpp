@@ -0,0 +1,177 @@
+// Strata.cpp : descriptions for the strata used to sample files per directory
+
+#include "Strata.h"
+#include "Permutation.h"
+
+#include <algorithm>     // sort, upper_bound
+#include <cmath>         // sqrt
+#include <numeric>       // iota
+#include <string>        // strings
+#include <unordered_map> // stratum ids
+
+std::string_view Strata::keyOf(std::string_view path) const {
+	const size_t lastSeparator = path.rfind('/');
+	const std::string_view directory = (lastSeparator == std::string_view::npos) ? std::string_view() : path.substr(0, lastSeparator);
+	if (options.grouping == StratifyOptions::directory) {
+		return directory;
+	}
+
+	// Cuts the directory after the given amount of levels, if it is deeper.
+	size_t end = 0;
+	for (int level = 0; level < options.levels; ++level) {
+		const size_t separator = directory.find('/', end);
+		if (separator == std::string_view::npos) {
+			return directory;
+		}
+		end = separator + 1;
+	}
+	return directory.substr(0, (end == 0) ? 0 : end - 1);
+}
+
+void Strata::build(const PathIndex& index, const Bitmap* positions, const StratifyOptions& stratifyOptions) {
+	clear();
+	options = stratifyOptions;
+
+	// Numbers strata by first appearance, and records the runs of consecutive entries of the same stratum.
+	// Keys start with the root id, so that equal relative directories under different roots are apart.
+	std::unordered_map<std::string, uint32_t> strataIds;
+	std::vector<uint64_t> counts;
+	std::vector<uint32_t> runStrata;
+	std::vector<uint64_t> runStarts;
+	std::string key;
+	std::string previousKey;
+	uint64_t rank = 0;
+	const auto visit = [&](const uint32_t position) {
+		// The root is looked up first, as the view into a spilled entry only lasts until the following lookup.
+		const uint16_t rootId = index.root(position);
+		key.assign(1, (char)(rootId >> 8)).append(1, (char)(rootId & 0xFF)).append(keyOf(index[position]));
+		if (runStrata.empty() || key != previousKey) {
+			const std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> inserted = strataIds.emplace(key, (uint32_t)counts.size());
+			if (inserted.second) {
+				counts.push_back(0);
+			}
+			runStrata.push_back(inserted.first->second);
+			runStarts.push_back(rank);
+			previousKey.swap(key);
+		}
+		++counts[runStrata.back()];
+		++rank;
+	};
+	if (positions != nullptr) {
+		positions->forEach(visit);
+	} else {
+		for (size_t position = 0; position < index.size(); ++position) {
+			visit((uint32_t)position);
+		}
+	}
+	runStarts.push_back(rank);
+
+	offsets.resize(counts.size() + 1);
+	offsets[0] = 0;
+	for (size_t stratum = 0; stratum < counts.size(); ++stratum) {
+		offsets[stratum + 1] = offsets[stratum] + counts[stratum];
+	}
+
+	// Strata split into several runs (e.g. by the sorted chunks of a spilled index) need their ranks grouped.
+	if (runStrata.size() != counts.size()) {
+		ranks.resize((size_t)rank);
+		std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+		for (size_t run = 0; run < runStrata.size(); ++run) {
+			uint64_t& slot = next[runStrata[run]];
+			for (uint64_t runRank = runStarts[run]; runRank < runStarts[run + 1]; ++runRank) {
+				ranks[(size_t)slot++] = (uint32_t)runRank;
+			}
+		}
+	}
+
+	if (options.weighting == StratifyOptions::squareRoot) {
+		buildAliasTable();
+	}
+	buildRounds();
+}
+
+void Strata::buildAliasTable() {
+	// Vose's alias method: every slot keeps its own stratum with some probability, and an alias otherwise.
+	const size_t count = size();
+	std::vector<double> scaled(count);
+	double total = 0;
+	for (size_t stratum = 0; stratum < count; ++stratum) {
+		scaled[stratum] = std::sqrt((double)sizeOf(stratum));
+		total += scaled[stratum];
+	}
+	std::vector<uint32_t> small;
+	std::vector<uint32_t> large;
+	for (size_t stratum = 0; stratum < count; ++stratum) {
+		scaled[stratum] *= (double)count / total;
+		(scaled[stratum] < 1.0 ? small : large).push_back((uint32_t)stratum);
+	}
+	aliasProbabilities.assign(count, 1.0);
+	aliases.resize(count);
+	std::iota(aliases.begin(), aliases.end(), 0);
+	while (!small.empty() && !large.empty()) {
+		const uint32_t less = small.back();
+		small.pop_back();
+		const uint32_t more = large.back();
+		large.pop_back();
+		aliasProbabilities[less] = scaled[less];
+		aliases[less] = more;
+		scaled[more] += scaled[less] - 1.0;
+		(scaled[more] < 1.0 ? small : large).push_back(more);
+	}
+}
+
+void Strata::buildRounds() {
+	largestFirst.resize(size());
+	std::iota(largestFirst.begin(), largestFirst.end(), 0);
+	std::stable_sort(largestFirst.begin(), largestFirst.end(), [this](const uint32_t a, const uint32_t b) { return sizeOf(a) > sizeOf(b); });
+
+	// A new run starts whenever the smallest stratum still visited runs out of entries.
+	uint64_t round = 0;
+	uint64_t place = 0;
+	for (size_t visited = largestFirst.size(); visited > 0; ) {
+		const uint64_t lastRound = sizeOf(largestFirst[visited - 1]);
+		if (lastRound > round) {
+			roundRuns.push_back(RoundRun{ round, place, (uint32_t)visited });
+			place += (lastRound - round) * visited;
+			round = lastRound;
+		}
+		--visited;
+	}
+}
+
+void Strata::clear() {
+	offsets.clear();
+	ranks.clear();
+	aliasProbabilities.clear();
+	aliases.clear();
+	largestFirst.clear();
+	roundRuns.clear();
+}
+
+size_t Strata::pick(std::default_random_engine& randomEngine) const {
+	size_t stratum = std::uniform_int_distribution<size_t>(0, size() - 1)(randomEngine);
+	if (
+		!aliasProbabilities.empty() &&
+		std::uniform_real_distribution<double>(0.0, 1.0)(randomEngine) >= aliasProbabilities[stratum]
+	) {
+		stratum = aliases[stratum];
+	}
+	return rankAt(stratum, std::uniform_int_distribution<uint64_t>(0, sizeOf(stratum) - 1)(randomEngine));
+}
+
+size_t Strata::playlistRank(const uint64_t place, const uint64_t seed) const {
+	const std::vector<RoundRun>::const_iterator run = std::upper_bound(
+		roundRuns.begin(), roundRuns.end(), place,
+		[](const uint64_t value, const RoundRun& roundRun) { return value < roundRun.firstPlace; }
+	) - 1;
+	const uint64_t round = run->firstRound + (place - run->firstPlace) / run->strataCount;
+	const uint64_t slot = (place - run->firstPlace) % run->strataCount;
+
+	// Every round visits its strata in its own order, and every stratum yields its entries in its own order.
+	Permutation order;
+	order.reset(run->strataCount, seed ^ (round * 0x9e3779b97f4a7c15ULL));
+	const uint32_t stratum = largestFirst[order(slot)];
+	Permutation entries;
+	entries.reset(sizeOf(stratum), ~seed ^ (stratum * 0xd1b54a32d192ed03ULL));
+	return rankAt(stratum, entries(round));
+}
@@ -0,0 +1,125 @@
+// Strata.h : declarations for the strata used to sample files per directory
+
+#pragma once
+
+#ifndef STRATA_H_
+#define STRATA_H_
+
+#include <cstddef>     // size_t
+#include <cstdint>     // fixed width integers
+#include <random>      // default_random_engine
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "PathIndex.h"
+
+/**
+* How picks are spread over directories rather than over files.
+*/
+struct StratifyOptions {
+    enum Grouping {
+        none,      // Files are picked uniformly.
+        directory, // Files are grouped by the directory that holds them.
+        depth      // Files are grouped by their directory down to `levels` levels below the root.
+    };
+    enum Weighting {
+        uniform,   // Every group is picked as often.
+        squareRoot // Groups are picked in proportion to the square root of their amount of files.
+    };
+
+    Grouping grouping = none;
+    int levels = 0; // Levels kept by the `depth` grouping. 0 groups files by root.
+    Weighting weighting = uniform;
+};
+
+/**
+* Groups (strata) of the entries of an index, stored in CSR form: the entries of stratum `s` are the
+* ranks `[offsets[s], offsets[s + 1])`, either directly or through a rank array when the entries of a
+* stratum are not contiguous. A random pick chooses a stratum, uniformly or through an alias table,
+* and then an entry within it, in constant time.
+*
+* Ranks count the entries that strata were built from, which are either every entry or the positions
+* of a bitmap.
+*/
+class Strata {
+
+    private:
+        StratifyOptions options;
+
+        // CSR ranges. Ranks are empty when every stratum is contiguous, as scans list the files of a directory together.
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> ranks;
+
+        // Alias table, for weighted picks.
+        std::vector<double> aliasProbabilities;
+        std::vector<uint32_t> aliases;
+
+        // Playlist: strata from largest to smallest, and the runs of rounds that visit as many strata.
+        // Round `r` takes an entry of every stratum with more than `r` entries, which is a prefix of the order,
+        // so runs are as many as the distinct sizes of the strata rather than as rounds.
+        struct RoundRun {
+            uint64_t firstRound;
+            uint64_t firstPlace; // Place within the playlist where the run starts.
+            uint32_t strataCount;
+        };
+        std::vector<uint32_t> largestFirst;
+        std::vector<RoundRun> roundRuns;
+
+        /**
+        * @return Part of a relative path that identifies its stratum.
+        */
+        std::string_view keyOf(std::string_view) const;
+        /**
+        * @brief Builds the alias table from the sizes of the strata.
+        */
+        void buildAliasTable();
+        /**
+        * @brief Builds the round robin playlist from the sizes of the strata.
+        */
+        void buildRounds();
+
+    public:
+        /**
+        * @brief Groups entries into strata.
+        *
+        * @param index Index.
+        * @param positions Positions to group, or `nullptr` to group every entry.
+        * @param stratifyOptions Grouping and weighting.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void build(const PathIndex&, const Bitmap*, const StratifyOptions&);
+        /**
+        * @brief Empties the strata.
+        */
+        void clear();
+        /**
+        * @brief Picks a random entry, choosing its stratum first.
+        *
+        * @param randomEngine Random engine.
+        * @return Rank of the entry.
+        */
+        size_t pick(std::default_random_engine&) const;
+        /**
+        * @brief Finds an entry of a playlist that goes round robin over the strata: every round visits the
+        * strata that still have entries, in a random order, and takes an entry from each one.
+        *
+        * @param place Place within the playlist.
+        * @param seed Seed the playlist is derived from.
+        * @return Rank of the entry.
+        */
+        size_t playlistRank(const uint64_t, const uint64_t) const;
+
+        // @return Amount of strata
+        size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+        // @return true if there are no strata
+        bool empty() const { return size() == 0; }
+        // @return Amount of entries in a stratum
+        uint64_t sizeOf(const size_t stratum) const { return offsets[stratum + 1] - offsets[stratum]; }
+        // @return Rank of the `i`th entry of a stratum
+        size_t rankAt(const size_t stratum, const uint64_t i) const {
+            return ranks.empty() ? (size_t)(offsets[stratum] + i) : (size_t)ranks[(size_t)(offsets[stratum] + i)];
+        }
+};
+
+#endif
@@ -0,0 +1,105 @@
+// TempFiles.cpp : descriptions for the private temporary files of a user
+
+#include "TempFiles.h"
+
+#include <atomic>      // unique counter
+
+#ifdef _WIN32
+#include <process.h>   // _getpid
+#include <windows.h>   // CreateFileW
+#else
+#include <cerrno>      // errno
+#include <fcntl.h>     // open
+#include <sys/stat.h>  // mkdir, lstat
+#include <unistd.h>    // geteuid, getpid, close
+#endif
+
+std::filesystem::path TempFiles::temporaryFor(const std::filesystem::path& path) {
+	static std::atomic<unsigned> counter(0);
+#ifdef _WIN32
+	const unsigned long processId = (unsigned long)_getpid();
+#else
+	const unsigned long processId = (unsigned long)getpid();
+#endif
+	// Not named after the file itself, whose name may already be as long as the file system allows.
+	return path.parent_path() / (".rfopener-" + std::to_string(processId) + "-" + std::to_string(counter.fetch_add(1)) + ".tmp");
+}
+
+
+
+#ifdef _WIN32
+
+bool TempFiles::directory(std::filesystem::path& directory, std::string& error) {
+	std::error_code errorCode;
+	directory = std::filesystem::temp_directory_path(errorCode);
+	if (!errorCode) {
+		directory /= "rfopener";
+		std::filesystem::create_directory(directory, errorCode);
+	}
+	if (errorCode) {
+		error = "Could not create the temporary directory \"" + directory.u8string() + "\"";
+		return false;
+	}
+	return true;
+}
+
+bool TempFiles::create(const std::filesystem::path& path) {
+	const HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	CloseHandle(file);
+	return true;
+}
+
+bool TempFiles::isPrivate(const std::filesystem::path& path) {
+	std::error_code errorCode;
+	return std::filesystem::is_regular_file(std::filesystem::symlink_status(path, errorCode));
+}
+
+#else
+
+bool TempFiles::directory(std::filesystem::path& directory, std::string& error) {
+	std::error_code errorCode;
+	directory = std::filesystem::temp_directory_path(errorCode);
+	if (errorCode) {
+		error = "There is no temporary directory";
+		return false;
+	}
+	directory /= "rfopener-" + std::to_string((unsigned long)geteuid());
+
+	// An existing directory is only used if it is the user's own and nobody else may write into it.
+	struct stat status;
+	if (
+		(mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) ||
+		(lstat(directory.c_str(), &status) != 0)
+	) {
+		error = "Could not create the temporary directory \"" + directory.u8string() + "\"";
+		return false;
+	}
+	if (!S_ISDIR(status.st_mode) || status.st_uid != geteuid() || (status.st_mode & 077) != 0) {
+		error = "Temporary directory \"" + directory.u8string() + "\" is not private to the user";
+		return false;
+	}
+	return true;
+}
+
+bool TempFiles::create(const std::filesystem::path& path) {
+	const int descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	if (descriptor < 0) {
+		return false;
+	}
+	close(descriptor);
+	return true;
+}
+
+bool TempFiles::isPrivate(const std::filesystem::path& path) {
+	struct stat status;
+	return
+		(lstat(path.c_str(), &status) == 0) &&
+		S_ISREG(status.st_mode) &&
+		(status.st_uid == geteuid()) &&
+		((status.st_mode & 077) == 0);
+}
+
+#endif
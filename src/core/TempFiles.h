@@ -0,0 +1,51 @@
+// TempFiles.h : declarations for the private temporary files of a user
+
+#pragma once
+
+#ifndef TEMPFILES_H_
+#define TEMPFILES_H_
+
+#include <string>      // strings
+
+#include <filesystem>  // file navigation. C++17 ONLY.
+
+/**
+* Finds and creates the files kept between runs (checkpoints, caches and extracted archive entries), so that
+* no other local user can read them, plant them or replace them.
+*
+* They live in a directory of their own inside the temporary directory. Elsewhere than on Windows, it is named
+* after the user id, created 0700 and refused if anyone else owns it or may write into it, and files inside it
+* are created 0600. On Windows, the temporary directory already belongs to the user.
+*/
+class TempFiles {
+
+    public:
+        /**
+        * @brief Finds the private directory of the user, creating it if needed.
+        *
+        * @param directory Receives the path of the directory.
+        * @param error Receives the description of the error, if any.
+        * @return If the directory could not be created, or is not private, returns `false`.
+        */
+        static bool directory(std::filesystem::path&, std::string&);
+        /**
+        * @brief Creates an empty file that only the user may read and write.
+        *
+        * @param path Path of the file.
+        * @return If the file already exists, or could not be created, returns `false`.
+        */
+        static bool create(const std::filesystem::path&);
+        /**
+        * @param path Path of a file.
+        * @return Whether the file is a regular file owned by the user, which no other user may read or write.
+        */
+        static bool isPrivate(const std::filesystem::path&);
+        /**
+        * @param path Path of a file about to be replaced.
+        * @return Path, unique to this call, of a temporary file in the same directory, to be written and then renamed
+        * over it.
+        */
+        static std::filesystem::path temporaryFor(const std::filesystem::path&);
+};
+
+#endif
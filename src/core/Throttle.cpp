@@ -0,0 +1,88 @@
+// Throttle.cpp : descriptions for throttling scans in favour of other I/O
+
+#include "Throttle.h"
+
+#include <algorithm>   // min, max
+
+#ifdef _WIN32
+#include <windows.h>   // SetThreadPriority
+#elif defined(__linux__)
+#include <sys/syscall.h> // SYS_ioprio_set, SYS_ioprio_get
+#include <unistd.h>      // syscall
+
+static const int IOPRIO_WHO_PROCESS = 1; // With an id of 0, the calling thread.
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+#endif
+
+IdleIoScope::IdleIoScope(const bool isEnabled) {
+	isLowered = false;
+	previousPriority = 0;
+	if (!isEnabled) {
+		return;
+	}
+#ifdef _WIN32
+	isLowered = (SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != 0);
+#elif defined(__linux__)
+	previousPriority = (int)syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+	isLowered = (previousPriority >= 0) &&
+		(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == 0);
+#endif
+}
+
+IdleIoScope::~IdleIoScope() {
+	if (!isLowered) {
+		return;
+	}
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#elif defined(__linux__)
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, previousPriority);
+#endif
+}
+
+TokenBucket::TokenBucket() {
+	rate = 0;
+	tokens = 0;
+	lastRefill = std::chrono::steady_clock::now();
+}
+
+void TokenBucket::setRate(const double perSecond) {
+	const std::lock_guard<std::mutex> lock(mutex);
+	rate = (std::max)(perSecond, 0.0);
+	tokens = rate;
+	lastRefill = std::chrono::steady_clock::now();
+}
+
+std::chrono::nanoseconds TokenBucket::take(const double amount) {
+	if (rate <= 0) {
+		return std::chrono::nanoseconds(0);
+	}
+
+	// Refills up to a second of tokens, and then takes them, going into debt if needed.
+	const std::lock_guard<std::mutex> lock(mutex);
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	tokens = (std::min)(rate, tokens + std::chrono::duration<double>(now - lastRefill).count() * rate);
+	lastRefill = now;
+	tokens -= amount;
+	if (tokens >= 0) {
+		return std::chrono::nanoseconds(0);
+	}
+	return std::chrono::nanoseconds((int64_t)(-tokens / rate * 1e9));
+}
+
+LatencyBackoff::LatencyBackoff(const std::chrono::nanoseconds threshold) : threshold(threshold) {
+	factor = 0;
+}
+
+std::chrono::nanoseconds LatencyBackoff::update(const std::chrono::nanoseconds listTime) {
+	if (threshold.count() <= 0) {
+		return std::chrono::nanoseconds(0);
+	}
+	if (listTime > threshold) {
+		factor = (std::min)((std::max)(factor * 2, 1.0), MAX_FACTOR);
+	} else {
+		factor = (factor > 1) ? factor / 2 : 0;
+	}
+	return std::chrono::nanoseconds((int64_t)((double)listTime.count() * factor));
+}
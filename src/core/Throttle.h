@@ -0,0 +1,105 @@
+// Throttle.h : declarations for throttling scans in favour of other I/O
+
+#pragma once
+
+#ifndef THROTTLE_H_
+#define THROTTLE_H_
+
+#include <chrono>      // steady clock, durations
+#include <cstdint>     // fixed width integers
+#include <mutex>       // mutex
+
+/**
+* Lowers the I/O priority of the calling thread to idle for as long as it lives, so that its reads
+* only use the disk when nothing else does: with `THREAD_MODE_BACKGROUND_BEGIN` on Windows, and with
+* `ioprio_set` on Linux. Elsewhere, it does nothing.
+*/
+class IdleIoScope {
+
+    private:
+        bool isLowered;
+        int previousPriority; // Priority to restore, on Linux.
+
+    public:
+        // == Constructor ==
+        /**
+        * @param isEnabled Whether to lower the priority at all.
+        */
+        explicit IdleIoScope(const bool);
+        ~IdleIoScope();
+
+        IdleIoScope(const IdleIoScope&) = delete;
+        IdleIoScope& operator=(const IdleIoScope&) = delete;
+
+        // @return true if the priority was lowered
+        bool getIsLowered() const { return isLowered; }
+};
+
+/**
+* Token bucket that caps a rate (e.g. of listed directories), shared by the threads of a scan.
+*
+* Taking more tokens than there are leaves the bucket in debt, and whoever takes them is told to wait
+* until the debt is paid, so that a single large take (e.g. the entries of a huge directory) is allowed
+* but paid for. The bucket holds up to a second of tokens, so short bursts are not delayed.
+*/
+class TokenBucket {
+
+    private:
+        std::mutex mutex;
+        double rate;   // Tokens per second, or 0 for no limit.
+        double tokens; // Tokens available, negative while in debt.
+        std::chrono::steady_clock::time_point lastRefill;
+
+    public:
+        // == Constructor ==
+        TokenBucket();
+
+        /**
+        * @brief Sets the rate, and fills the bucket.
+        *
+        * @param perSecond Tokens per second, or 0 for no limit.
+        */
+        void setRate(const double);
+        /**
+        * @brief Takes tokens.
+        *
+        * @param amount Amount of tokens.
+        * @return Time the caller must wait before going on.
+        */
+        std::chrono::nanoseconds take(const double);
+
+        // @return true if the rate is limited
+        bool isLimited() const { return rate > 0; }
+};
+
+/**
+* Pauses a scan while listing directories takes longer than a threshold, which is the sign of a disk busy
+* serving others. The pause after every slow listing is the listing time times a factor, which doubles
+* while listings stay slow and halves once they are fast again (up to `MAX_FACTOR`), so the scan takes a
+* shrinking share of the disk until it recovers.
+*/
+class LatencyBackoff {
+
+    private:
+        std::chrono::nanoseconds threshold; // 0 for no back-off.
+        double factor;
+
+    public:
+        static constexpr double MAX_FACTOR = 16; // Highest pause, relative to the listing time
+
+        // == Constructor ==
+        /**
+        * @param threshold Listing time past which the scan backs off, or 0 to never back off.
+        */
+        explicit LatencyBackoff(const std::chrono::nanoseconds);
+
+        /**
+        * @brief Updates the factor with the time a listing took.
+        *
+        * @param listTime Time the listing took.
+        * @return Time the caller must pause before the next listing.
+        */
+        std::chrono::nanoseconds update(const std::chrono::nanoseconds);
+};
+
+#endif
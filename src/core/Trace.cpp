@@ -0,0 +1,152 @@
+// Trace.cpp : descriptions for the opt-in timeline of scans and picks
+
+#include "Trace.h"
+#include "Json.h"
+
+#include <cstdio>      // snprintf
+#include <cstring>     // memcpy
+#include <fstream>     // trace file
+#include <mutex>       // ring registry
+
+struct Trace::Event {
+    const char* name;
+    const char* category;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    char detail[DETAIL_LENGTH]; // Null-terminated.
+};
+
+struct Trace::Ring {
+    std::unique_ptr<Event[]> events;
+    size_t capacity = 0;
+    std::atomic<uint64_t> written{0}; // Spans ever recorded. Only the owning thread writes it.
+    uint32_t threadId = 0;
+    const char* threadName = nullptr;
+};
+
+std::atomic<bool> Trace::enabled{false};
+
+// Guards the rings and the settings below.
+static std::mutex registryMutex;
+static size_t ringCapacity = Trace::DEFAULT_CAPACITY;
+static std::chrono::steady_clock::time_point epoch;
+
+void Trace::enable(const size_t capacity) {
+	{
+		const std::lock_guard<std::mutex> lock(registryMutex);
+		ringCapacity = (capacity > 0) ? capacity : DEFAULT_CAPACITY;
+		epoch = std::chrono::steady_clock::now();
+	}
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+std::vector<std::unique_ptr<Trace::Ring>>& Trace::getRings() {
+	static std::vector<std::unique_ptr<Ring>> rings;
+	return rings;
+}
+
+Trace::Ring& Trace::localRing() {
+	thread_local Ring* ring = nullptr;
+	if (ring == nullptr) {
+		std::unique_ptr<Ring> created = std::make_unique<Ring>();
+		const std::lock_guard<std::mutex> lock(registryMutex);
+		created->capacity = ringCapacity;
+		created->events = std::make_unique<Event[]>(ringCapacity);
+		created->threadId = (uint32_t)getRings().size() + 1;
+		ring = created.get();
+		getRings().push_back(std::move(created));
+	}
+	return *ring;
+}
+
+void Trace::record(const char* name, const char* category, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point end, std::string_view detail) {
+	if (!isEnabled()) {
+		return;
+	}
+	Ring& ring = localRing();
+	const uint64_t position = ring.written.load(std::memory_order_relaxed);
+	Event& event = ring.events[(size_t)(position % ring.capacity)];
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.end = end;
+
+	// Keeps the end of long details (e.g. the deepest directories of a path), without splitting a UTF8 character.
+	if (detail.size() >= DETAIL_LENGTH) {
+		detail.remove_prefix(detail.size() - (DETAIL_LENGTH - 1));
+		while (!detail.empty() && ((unsigned char)detail.front() & 0xC0) == 0x80) {
+			detail.remove_prefix(1);
+		}
+	}
+	memcpy(event.detail, detail.data(), detail.size());
+	event.detail[detail.size()] = '\0';
+
+	ring.written.store(position + 1, std::memory_order_release);
+}
+
+void Trace::nameThread(const char* name) {
+	if (isEnabled()) {
+		localRing().threadName = name;
+	}
+}
+
+std::string Trace::toJson() {
+	const std::lock_guard<std::mutex> lock(registryMutex);
+
+	// Timestamps are in microseconds since tracing was enabled.
+	const auto microseconds = [](const std::chrono::steady_clock::duration duration) {
+		char text[32];
+		snprintf(text, sizeof(text), "%.3f", std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 1e3);
+		return std::string(text);
+	};
+
+	std::string json = "{\"traceEvents\":[\n";
+	json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"rfopener\"}}";
+	uint64_t droppedCount = 0;
+	for (const std::unique_ptr<Ring>& ring : getRings()) {
+		const std::string threadId = std::to_string(ring->threadId);
+		json += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + threadId + ",\"args\":{\"name\":\"";
+		if (ring->threadName != nullptr) {
+			Json::appendEscaped(json, ring->threadName);
+		} else {
+			json += "thread " + threadId;
+		}
+		json += "\"}}";
+
+		const uint64_t written = ring->written.load(std::memory_order_acquire);
+		const uint64_t first = (written > ring->capacity) ? written - ring->capacity : 0;
+		droppedCount += first;
+		for (uint64_t position = first; position < written; ++position) {
+			const Event& event = ring->events[(size_t)(position % ring->capacity)];
+			json += ",\n{\"name\":\"";
+			Json::appendEscaped(json, event.name);
+			json += "\",\"cat\":\"";
+			Json::appendEscaped(json, event.category);
+			json += "\",\"ph\":\"X\",\"ts\":" + microseconds(event.start - epoch)
+				+ ",\"dur\":" + microseconds(event.end - event.start)
+				+ ",\"pid\":1,\"tid\":" + threadId;
+			if (event.detail[0] != '\0') {
+				json += ",\"args\":{\"detail\":\"";
+				Json::appendEscaped(json, event.detail);
+				json += "\"}";
+			}
+			json += "}";
+		}
+	}
+	json += "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":" + std::to_string(droppedCount) + "}}\n";
+	return json;
+}
+
+bool Trace::write(const std::string& path, std::string& error) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		error = "Could not open " + path + " for writing";
+		return false;
+	}
+	file << toJson();
+	if (!file) {
+		error = "Could not write " + path;
+		return false;
+	}
+	return true;
+}
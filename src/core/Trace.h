@@ -0,0 +1,117 @@
+// Trace.h : declarations for the opt-in timeline of scans and picks
+
+#pragma once
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>      // enabled flag, ring positions
+#include <chrono>      // steady_clock
+#include <cstdint>     // fixed width integers
+#include <memory>      // smart pointers
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+/**
+* Records spans (e.g. directory reads, filter batches, launches) into a ring buffer per thread,
+* and writes them as Chrome trace JSON, which opens in Perfetto or chrome://tracing.
+*
+* Recording takes no locks: every thread writes into its own ring, and only registering a ring
+* (once per thread) takes a mutex. When a ring is full, the oldest spans are overwritten. While
+* disabled, which is the default, a span costs a single relaxed load.
+*/
+class Trace {
+
+    public:
+        static const size_t DEFAULT_CAPACITY = 1 << 16; // Spans kept per thread.
+        static const size_t DETAIL_LENGTH = 64;         // Bytes kept of the detail of a span, including the terminator.
+
+        /**
+        * Times the scope it lives in, if tracing is enabled.
+        */
+        class Span {
+
+            private:
+                const char* name;
+                const char* category;
+                std::string_view detail;
+                bool isActive;
+                std::chrono::steady_clock::time_point start;
+
+            public:
+                /**
+                * @param name Name of the span. Must outlive the trace (e.g. a literal).
+                * @param category Category of the span. Must outlive the trace (e.g. a literal).
+                * @param detail Detail shown with the span (e.g. a path). Must outlive the span.
+                */
+                Span(const char* spanName, const char* spanCategory, std::string_view spanDetail = std::string_view())
+                    : name(spanName), category(spanCategory), detail(spanDetail), isActive(Trace::isEnabled()) {
+                    if (isActive) {
+                        start = std::chrono::steady_clock::now();
+                    }
+                }
+                ~Span() {
+                    if (isActive) {
+                        Trace::record(name, category, start, std::chrono::steady_clock::now(), detail);
+                    }
+                }
+                Span(const Span&) = delete;
+                Span& operator=(const Span&) = delete;
+        };
+
+        /**
+        * @brief Starts recording. Spans ended before this are not recorded.
+        *
+        * @param capacity Spans kept per thread.
+        */
+        static void enable(const size_t = DEFAULT_CAPACITY);
+        // @return Whether spans are being recorded.
+        static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+        /**
+        * @brief Records a span on the calling thread. Does nothing while disabled.
+        *
+        * @param name Name of the span. Must outlive the trace (e.g. a literal).
+        * @param category Category of the span. Must outlive the trace (e.g. a literal).
+        * @param start When the span started.
+        * @param end When the span ended.
+        * @param detail Detail shown with the span (e.g. a path). Only its last bytes are kept if it is too long.
+        */
+        static void record(const char*, const char*, const std::chrono::steady_clock::time_point, const std::chrono::steady_clock::time_point, std::string_view = std::string_view());
+        /**
+        * @brief Names the calling thread in the timeline. Does nothing while disabled.
+        *
+        * @param name Name of the thread. Must outlive the trace (e.g. a literal).
+        */
+        static void nameThread(const char*);
+        /**
+        * @brief Writes the recorded spans as Chrome trace JSON. Threads should not be recording meanwhile.
+        *
+        * @param path Path to the trace file.
+        * @param error Receives the description of the error, if any.
+        * @return If the file could not be written, returns `false`.
+        */
+        static bool write(const std::string&, std::string&);
+        /**
+        * @brief Renders the recorded spans as Chrome trace JSON. Threads should not be recording meanwhile.
+        */
+        static std::string toJson();
+
+    private:
+        struct Event;
+        struct Ring;
+
+        static std::atomic<bool> enabled;
+
+        /**
+        * @return Rings of every thread that recorded a span, kept until exit so that they outlive their threads.
+        */
+        static std::vector<std::unique_ptr<Ring>>& getRings();
+
+        /**
+        * @return Ring of the calling thread, registered on first use.
+        */
+        static Ring& localRing();
+};
+
+#endif
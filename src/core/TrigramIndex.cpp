@@ -0,0 +1,163 @@
+// TrigramIndex.cpp : descriptions for the trigram index that narrows substring searches
+
+#include "TrigramIndex.h"
+
+#include <algorithm>   // sort, unique
+
+uint32_t TrigramIndex::trigramAt(const char* text) {
+	return ((uint32_t)(unsigned char)text[0] << 16) | ((uint32_t)(unsigned char)text[1] << 8) | (uint32_t)(unsigned char)text[2];
+}
+
+void TrigramIndex::toLower(std::string_view text, std::string& lowered) {
+	lowered.assign(text.data(), text.size());
+	for (char& c : lowered) {
+		if (c >= 'A' && c <= 'Z') {
+			c = (char)(c - 'A' + 'a');
+		}
+	}
+}
+
+uint32_t TrigramIndex::idOf(const uint32_t trigram) const {
+	const size_t page = trigram >> 8;
+	if (page >= idPages.size() || !idPages[page]) {
+		return NO_ID;
+	}
+	return idPages[page][trigram & 0xFF];
+}
+
+uint32_t TrigramIndex::addTrigram(const uint32_t trigram) {
+	std::unique_ptr<uint32_t[]>& page = idPages[trigram >> 8];
+	if (!page) {
+		page = std::make_unique<uint32_t[]>(PAGE_SIZE);
+		std::fill(page.get(), page.get() + PAGE_SIZE, NO_ID);
+	}
+	uint32_t& id = page[trigram & 0xFF];
+	if (id == NO_ID) {
+		id = (uint32_t)postings.size();
+		postings.emplace_back();
+	}
+	return id;
+}
+
+void TrigramIndex::addBatch(std::vector<uint64_t>& batch, std::vector<uint64_t>& sorted) {
+	// Counting sort by id, which keeps the positions of every id in increasing order.
+	std::vector<size_t> starts(postings.size() + 1, 0);
+	for (const uint64_t pair : batch) {
+		++starts[(size_t)(pair >> 32) + 1];
+	}
+	for (size_t i = 1; i < starts.size(); ++i) {
+		starts[i] += starts[i - 1];
+	}
+	sorted.resize(batch.size());
+	for (const uint64_t pair : batch) {
+		sorted[starts[(size_t)(pair >> 32)]++] = pair;
+	}
+	for (const uint64_t pair : sorted) {
+		postings[(size_t)(pair >> 32)].add((uint32_t)pair);
+	}
+	batch.clear();
+}
+
+void TrigramIndex::build(const PathIndex& index) {
+	clear();
+	idPages.resize((size_t)1 << 16);
+
+	// The last position added to each posting list, plus one, so that trigrams repeated within a path are added once.
+	std::vector<uint32_t> lastPositions;
+	std::vector<uint64_t> batch;
+	std::vector<uint64_t> sorted;
+	batch.reserve(BATCH_SIZE);
+	std::string lowered;
+	for (size_t position = 0; position < index.size(); ++position) {
+		toLower(index[position], lowered);
+		for (size_t i = 0; i + TRIGRAM_LENGTH <= lowered.size(); ++i) {
+			const uint32_t id = addTrigram(trigramAt(lowered.data() + i));
+			if (id == lastPositions.size()) {
+				lastPositions.push_back(0);
+			}
+			if (lastPositions[id] != position + 1) {
+				lastPositions[id] = (uint32_t)(position + 1);
+				batch.push_back(((uint64_t)id << 32) | position);
+			}
+		}
+		if (batch.size() + lowered.size() > BATCH_SIZE) {
+			addBatch(batch, sorted);
+		}
+	}
+	addBatch(batch, sorted);
+	for (Bitmap& posting : postings) {
+		posting.finish();
+	}
+}
+
+void TrigramIndex::clear() {
+	idPages.clear();
+	postings.clear();
+}
+
+void TrigramIndex::match(std::string_view query, const PathIndex& index, Bitmap& result) const {
+	std::string needle;
+	toLower(query, needle);
+	result.clear();
+
+	// Intersects the posting lists of the trigrams of the query, smallest first. Queries shorter than a
+	// trigram cannot be narrowed, so every path is a candidate.
+	Bitmap candidates;
+	bool isNarrowed = false;
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i + TRIGRAM_LENGTH <= needle.size(); ++i) {
+		const uint32_t id = idOf(trigramAt(needle.data() + i));
+		if (id == NO_ID) {
+			result.finish();
+			return;
+		}
+		ids.push_back(id);
+	}
+	if (!ids.empty()) {
+		std::sort(ids.begin(), ids.end(), [this](const uint32_t a, const uint32_t b) {
+			return (postings[a].size() != postings[b].size()) ? (postings[a].size() < postings[b].size()) : (a < b);
+		});
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		candidates = postings[ids[0]];
+		Bitmap intersection;
+		for (size_t i = 1; i < ids.size() && !candidates.empty(); ++i) {
+			Bitmap::intersect(candidates, postings[ids[i]], intersection);
+			std::swap(candidates, intersection);
+		}
+		isNarrowed = true;
+
+		// A query that is a single trigram needs no verification.
+		if (needle.size() == TRIGRAM_LENGTH) {
+			result = std::move(candidates);
+			return;
+		}
+	}
+
+	// Verifies the candidates, as a path may contain every trigram of the query but not the query itself.
+	std::string lowered;
+	const auto verify = [&](const uint32_t position) {
+		toLower(index[position], lowered);
+		if (lowered.find(needle) != std::string::npos) {
+			result.add(position);
+		}
+	};
+	if (isNarrowed) {
+		candidates.forEach(verify);
+	} else {
+		for (size_t position = 0; position < index.size(); ++position) {
+			verify((uint32_t)position);
+		}
+	}
+	result.finish();
+}
+
+uint64_t TrigramIndex::memoryBytes() const {
+	uint64_t bytes = idPages.capacity() * sizeof(std::unique_ptr<uint32_t[]>) + postings.capacity() * sizeof(Bitmap);
+	for (const std::unique_ptr<uint32_t[]>& page : idPages) {
+		if (page) bytes += PAGE_SIZE * sizeof(uint32_t);
+	}
+	for (const Bitmap& posting : postings) {
+		bytes += posting.memoryBytes();
+	}
+	return bytes;
+}
@@ -0,0 +1,91 @@
+// TrigramIndex.h : declarations for the trigram index that narrows substring searches
+
+#pragma once
+
+#ifndef TRIGRAMINDEX_H_
+#define TRIGRAMINDEX_H_
+
+#include <cstdint>     // fixed width integers
+#include <memory>      // unique_ptr
+#include <string>      // strings
+#include <string_view> // non-owning string views
+#include <vector>      // dynamic containers
+
+#include "Bitmap.h"
+#include "PathIndex.h"
+
+/**
+* Posting lists of the positions of an index whose path contains each trigram (3 consecutive
+* bytes, ignoring ASCII case), so that a substring search only verifies the paths that contain
+* every trigram of the query instead of every path.
+*/
+class TrigramIndex {
+
+    private:
+        static const size_t TRIGRAM_LENGTH = 3;
+        static const uint32_t NO_ID = UINT32_MAX;
+        static const size_t PAGE_SIZE = 256;          // Ids of the trigrams sharing their first two bytes.
+        static const size_t BATCH_SIZE = 1 << 20;     // Pairs of trigram ids and positions added to the posting lists at once.
+
+        // Ids of the trigrams, by their first two bytes and then by the third one. Pages are only allocated
+        // for the pairs of bytes that appear, which keeps lookups free of hashing.
+        std::vector<std::unique_ptr<uint32_t[]>> idPages;
+        std::vector<Bitmap> postings;
+
+        /**
+        * @return Trigram starting at the given byte, packed into an integer.
+        */
+        static uint32_t trigramAt(const char*);
+        /**
+        * @return Id of a trigram, or `NO_ID` if it is not indexed.
+        */
+        uint32_t idOf(const uint32_t) const;
+        /**
+        * @return Id of a trigram, assigning a new one if it is not indexed.
+        */
+        uint32_t addTrigram(const uint32_t);
+        /**
+        * @brief Adds a batch of pairs of trigram ids and positions to the posting lists, grouped by id so that
+        * every posting list is touched once per batch.
+        *
+        * @param batch Pairs, with the id in the high 32 bits. Emptied afterwards.
+        * @param sorted Buffer for the grouped pairs.
+        */
+        void addBatch(std::vector<uint64_t>&, std::vector<uint64_t>&);
+
+    public:
+        /**
+        * @brief Builds the posting lists of every entry of an index.
+        *
+        * @param index Index.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void build(const PathIndex&);
+        /**
+        * @brief Empties the posting lists.
+        */
+        void clear();
+        /**
+        * @brief Finds the positions of the entries whose path contains a text, ignoring ASCII case.
+        *
+        * @param query Text. If empty, every entry matches.
+        * @param index Index the posting lists were built from, to verify the candidates.
+        * @param result Receives the positions.
+        * @throws std::runtime_error If a spilled entry could not be read.
+        */
+        void match(std::string_view, const PathIndex&, Bitmap&) const;
+        /**
+        * @brief Lowers the ASCII letters of a text, reusing the memory of the output.
+        *
+        * @param text Text.
+        * @param lowered Receives the lowered text.
+        */
+        static void toLower(std::string_view, std::string&);
+
+        // @return Amount of distinct trigrams
+        size_t size() const { return postings.size(); }
+        // @return Memory taken by the posting lists, in bytes
+        uint64_t memoryBytes() const;
+};
+
+#endif
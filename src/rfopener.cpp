@@ -26,21 +26,69 @@ static const char* VERSION = "2.1.0";
 const enum Actions{
     xDefault,
     xPlaylist,
-    xHelp
+    xHelp,
+    xWriteIndex,
+    xMerge,
+    xDiff,
+    xPurge
 };
 
 FileManager* buildFileManager(
-    std::string& directoryPathString,
-	std::vector<std::string>& forbiddenDirectories,
-    std::vector<std::string>& allowedExtensions,
-    int depth,
-    bool checkCaps
+    std::vector<std::string>& directoryPathStrings,
+    ScanOptions& scanOptions,
+    std::string& indexInputPath,
+    std::string& listPath,
+    bool isStatsEnabled,
+    std::string& prometheusPath,
+    std::vector<std::string>& toggleFilterNames,
+    std::vector<PickFilter>& toggleFilters,
+    bool isMatchEnabled,
+    std::string& matchQuery,
+    StratifyOptions& stratifyOptions,
+    std::string& historyPath,
+    std::string& snapshotPath,
+    bool isNewOnly,
+    std::vector<ContentType::Kind>& contentTypes,
+    bool isDeduplicated,
+    bool isOrdered,
+    SortedOrder::Key orderKey
 ) {
-    // Instantiates a file manager in the current directory or, if provided, a different one.
-    FileManager* fileManager = new FileManager(directoryPathString);
+    // Instantiates a file manager in the current directory or, if provided, different ones.
+    FileManager* fileManager = new FileManager(directoryPathStrings);
+    if (isStatsEnabled) {
+        fileManager->enableStats(prometheusPath);
+    }
+    for (size_t i = 0; i < toggleFilters.size(); ++i) {
+        fileManager->addToggleFilter(toggleFilterNames[i], toggleFilters[i]);
+    }
+    if (isMatchEnabled) {
+        fileManager->enableMatch(matchQuery);
+    }
+    if (stratifyOptions.grouping != StratifyOptions::none) {
+        fileManager->stratify(stratifyOptions);
+    }
+    if (!historyPath.empty()) {
+        fileManager->enableFairRotation(historyPath);
+    }
+    if (!snapshotPath.empty()) {
+        fileManager->enableSnapshot(snapshotPath, isNewOnly);
+    }
+    if (!contentTypes.empty()) {
+        fileManager->restrictToTypes(contentTypes);
+    }
+    if (isDeduplicated) {
+        fileManager->collapseDuplicates();
+    }
+    if (isOrdered) {
+        fileManager->setOrder(orderKey);
+    }
 
-    // Read the file paths recursively into memory.
-    fileManager->readPaths(forbiddenDirectories, allowedExtensions, depth, checkCaps);
+    // Read the file paths recursively (or from a list) into memory, or load them from an index file.
+    if (indexInputPath.empty()) {
+        fileManager->readPaths(scanOptions, listPath);
+    } else {
+        fileManager->loadIndex(indexInputPath, scanOptions.memoryBudget);
+    }
 
     return fileManager;
 }
@@ -51,12 +99,24 @@ FileManager* buildFileManager(
  * @param fileManager File manager instance.
 */
 void randomLoop(FileManager* fileManager) {
-    std::cout << "Press Enter to open files, or Esc to exit\n\n";
+    std::cout << "Press Enter to open files, or Esc to exit\n";
+    if (fileManager->hasToggleFilters()) {
+        std::cout << "Press a number to toggle a filter, or 0 to clear them\n";
+    }
+    if (fileManager->hasMatch()) {
+        std::cout << "Press / to search\n";
+    }
+    std::cout << "\n";
     int c;
     do {
         c = _getch();
+        const Trace::Span span("key", "input");
         if (Keys::isConfirmKey(c)) {
             fileManager->executeRandomFile();
+        } else if (Keys::digitOf(c) >= 0) {
+            fileManager->toggleFilter(Keys::digitOf(c));
+        } else if (Keys::isSearchKey(c)) {
+            fileManager->promptMatch();
         }
     } while (!Keys::isExitKey(c));
 }
@@ -67,15 +127,32 @@ void randomLoop(FileManager* fileManager) {
  * @param fileManager File manager instance.
 */
 void sequentialLoop(FileManager* fileManager) {
-    std::cout << "\nPress the left and right arrow keys to navigate the playlist, or Esc to exit\n" << std::endl;
+    std::cout << "\nPress the left and right arrow keys to navigate the playlist, or Esc to exit\n";
+    if (fileManager->hasToggleFilters()) {
+        std::cout << "Press a number to toggle a filter and reshuffle, or 0 to clear them\n";
+    }
+    if (fileManager->hasMatch()) {
+        std::cout << "Press / to search and reshuffle\n";
+    }
+    std::cout << std::endl;
     int c;
     do {
         c = _getch();
+        const int digit = Keys::digitOf(c);
+        const bool isSearch = Keys::isSearchKey(c);
         c = Keys::refreshArrow(c);
+        const Trace::Span span("key", "input");
         if (Keys::isForwardKey(c)) {
             fileManager->executeSequentialFile();
         } else if (Keys::isBackKey(c)) {
             fileManager->executeSequentialFile(true);
+        } else if (
+            (digit >= 0 && fileManager->toggleFilter(digit)) ||
+            (isSearch && fileManager->promptMatch())
+        ) {
+            // Starts a new playlist over the matching files.
+            fileManager->shuffle();
+            fileManager->executeFirstFile();
         }
     } while (!Keys::isExitKey(c));
 }
@@ -117,7 +194,7 @@ void showUsage(const char* programName){
      
      << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::root] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::root] << termcolor::reset
      << termcolor::bright_cyan << " directory" << termcolor::reset
-         << "\tRelative or absolute path to the root directory. Defaults to the current working directory.\n"
+         << "\tRelative or absolute path to the root directory. Defaults to the current working directory. Repeat to scan several roots at once.\n"
 
      << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::playlist] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::playlist] << termcolor::reset
          << "\t\tEnable playlist mode, where files will be shuffled and accessible sequentially.\n"
@@ -133,21 +210,150 @@ void showUsage(const char* programName){
              << termcolor::bright_cyan << "extension2" << termcolor::reset << Args::DELIMITER << "..." << Args::DELIMITER
              << termcolor::bright_cyan << "extensionN" << termcolor::reset
          << "\tEnables file extension whitelisting. Only files that exactly match any of the specified extensions will be taken into account.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::archives] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::archives] << termcolor::reset
+         << "\tIndex the files inside .zip and .tar archives (as archive.zip!/inner/path) instead of the archives. Picked files are extracted into the temporary directory.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::contentType] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::contentType] << termcolor::reset
+     << termcolor::bright_cyan << " video" << termcolor::reset << "|" << termcolor::bright_cyan << "image" << termcolor::reset << "|"
+             << termcolor::bright_cyan << "audio" << termcolor::reset << Args::DELIMITER << "..."
+         << "\tOnly pick files of the given types, told from their first bytes rather than their extension."
+         << " Types are cached in the temporary directory, so each file is read once until it changes.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::dedupe] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::dedupe] << termcolor::reset
+     << termcolor::bright_cyan << " content" << termcolor::reset
+         << "\tOnly pick one of the files with the same contents. Only files of the same size are read, and their hashes are cached in the temporary directory.\n"
      
      << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::depth] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::depth] << termcolor::reset
      << termcolor::bright_cyan << " levels" << termcolor::reset
          << "\tMaximum (inclusive) levels of depth the recursive iterator is allowed to reach (min. "
-         << termcolor::bright_cyan << FileManager::MIN_DEPTH     << termcolor::reset << ", max. "
-         << termcolor::bright_cyan << FileManager::MAX_DEPTH     << termcolor::reset << ", default. "
-         << termcolor::bright_cyan << FileManager::DEPTH_DEFAULT << termcolor::reset
+         << termcolor::bright_cyan << Scanner::MIN_DEPTH     << termcolor::reset << ", max. "
+         << termcolor::bright_cyan << Scanner::MAX_DEPTH     << termcolor::reset << ", default. "
+         << termcolor::bright_cyan << Scanner::DEPTH_DEFAULT << termcolor::reset
          << "). 0 equals to the working directory.\n"
      
      << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::nocap] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::nocap] << termcolor::reset
-         << "\t\tDisable soft caps for storage of relative paths in memory (max. "
-         << termcolor::bright_cyan << FileManager::MAX_PATHS << termcolor::reset
-         << " paths) and depth levels (max. "
-         << termcolor::bright_cyan << FileManager::MAX_DEPTH << termcolor::reset
-         << " levels). Caps are enabled by default.\n\n";
+         << "\t\tDisable the soft cap for depth levels (max. "
+         << termcolor::bright_cyan << Scanner::MAX_DEPTH << termcolor::reset
+         << " levels). The cap is enabled by default.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::memBudget] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::memBudget] << termcolor::reset
+     << termcolor::bright_cyan << " size" << termcolor::reset
+         << "\tMemory the paths may take (e.g. 512K, 64M, 2G; default. 256M, 0 for no limit). Paths past it are spilled to a temporary file.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::toggle] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::toggle] << termcolor::reset
+     << termcolor::bright_cyan << " extension1" << termcolor::reset << Args::DELIMITER << "..." << Args::DELIMITER
+             << "@" << termcolor::bright_cyan << "directory1" << termcolor::reset << Args::DELIMITER << "..."
+         << "\tAdd a filter toggled with a number key while picking, without rescanning. It matches files with any of the extensions"
+         << " within any of the top-level directories (marked with @). Repeat for up to "
+         << termcolor::bright_cyan << FileManager::MAX_TOGGLE_FILTERS << termcolor::reset << " filters; active filters narrow each other down.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::match] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::match] << termcolor::reset
+     << termcolor::bright_cyan << " text" << termcolor::reset
+         << "\tOnly pick files whose relative path contains the text, ignoring case, through a trigram index built after the scan."
+         << " Press / while picking to search another text. An empty text only enables the search.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::stratify] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::stratify] << termcolor::reset
+     << termcolor::bright_cyan << " dir" << termcolor::reset << "|" << termcolor::bright_cyan << "depth:N" << termcolor::reset << "[" << termcolor::bright_cyan << ":sqrt" << termcolor::reset << "]"
+         << "\tPick a directory first and then a file within it, so that large directories do not drown out small ones."
+         << " Directories are grouped down to N levels with depth:N, and weighted by the square root of their files with :sqrt."
+         << " Playlists go round robin over directories.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::fair] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::fair] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tPick at random among the files opened the fewest times, so that every file is opened once before any is opened twice."
+         << " Opens are recorded into the history file, which is created if needed and kept across runs. Cannot be combined with "
+         << Args::FLAGS_SHORTENED[Args::stratify] << ".\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::newOnly] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::newOnly] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tOnly pick files added or changed since the previous run, as recorded in the snapshot file, which is created if needed"
+         << " and replaced after every scan.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::diff] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::diff] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tList the files added and changed since the previous run, and count the removed ones, instead of picking."
+         << " The snapshot file is replaced as with " << Args::FLAGS_SHORTENED[Args::newOnly] << ".\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::order] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::order] << termcolor::reset
+     << termcolor::bright_cyan << " natural" << termcolor::reset << "|" << termcolor::bright_cyan << "mtime" << termcolor::reset << "|"
+             << termcolor::bright_cyan << "size" << termcolor::reset << "|" << termcolor::bright_cyan << "path" << termcolor::reset
+         << "\tGo through the playlist in order instead of shuffled: by name with numbers compared as such (\"ep2\" before \"ep10\"),"
+         << " by last write time, by size or by path bytes. Implies " << Args::FLAGS_SHORTENED[Args::playlist] << ".\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::stats] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::stats] << termcolor::reset
+         << "\t\tReport scan and pick stats (rates, status calls, rejects by reason, index memory) as JSON instead of the bare file counts.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::prometheus] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::prometheus] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tAlso write the stats into a Prometheus text file, rewritten after the scan and on exit. Implies "
+         << Args::FLAGS_SHORTENED[Args::stats] << ".\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::trace] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::trace] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tRecord a timeline of directory reads, filtering, shuffling, key presses and launches, written on exit as Chrome trace JSON (opens in Perfetto).\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::shared] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::shared] << termcolor::reset
+         << "\t\tShare the index through shared memory. Attaches to an index published by another process for the same root and options, or scans and publishes one.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::sharedPurge] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::sharedPurge] << termcolor::reset
+         << "\tRemove every shared index of the user, whatever its root and options, and exit. Processes using them are not disturbed.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::shard] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::shard] << termcolor::reset
+     << termcolor::bright_cyan << " i/N" << termcolor::reset
+         << "\tOnly scan shard i (from 1 to N) of the top-level entries of each root, chosen by a stable hash of their names.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::resumeScan] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::resumeScan] << termcolor::reset
+         << "\tResume an interrupted scan from its last checkpoint. Roots with many files are checkpointed every few seconds.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::listTimeout] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::listTimeout] << termcolor::reset
+     << termcolor::bright_cyan << " ms[:retry]" << termcolor::reset
+         << "\tSkip directories that take longer than ms milliseconds to be listed (e.g. on a hung network mount) and report them."
+         << " With :retry, skipped directories are still taken if they are listed before the rest of the scan completes.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::ioClass] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::ioClass] << termcolor::reset
+     << termcolor::bright_cyan << " idle|normal" << termcolor::reset
+         << "\tList directories at idle I/O priority, so that the scan only reads when nothing else does.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::rateLimit] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::rateLimit] << termcolor::reset
+     << termcolor::bright_cyan << " dirs[:entries]" << termcolor::reset
+         << "\tList at most dirs directories and entries entries per second, across roots (0 for no limit).\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::backoff] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::backoff] << termcolor::reset
+     << termcolor::bright_cyan << " ms" << termcolor::reset
+         << "\tPause the scan while listing a directory takes longer than ms milliseconds, for longer the longer it lasts.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::oneFileSystem] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::oneFileSystem] << termcolor::reset
+         << "\tStay on the device of each root, skipping the filesystems mounted below it.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::skipFstype] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::skipFstype] << termcolor::reset
+     << termcolor::bright_cyan << " type1" << termcolor::reset << Args::DELIMITER
+             << termcolor::bright_cyan << "type2" << termcolor::reset << Args::DELIMITER << "..." << Args::DELIMITER
+             << termcolor::bright_cyan << "typeN" << termcolor::reset
+         << "\tSkip filesystems of the given types mounted below the roots (e.g. nfs" << Args::DELIMITER << "fuse.*). A trailing * matches any subtype.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::splitDevices] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::splitDevices] << termcolor::reset
+         << "\tScan the filesystems mounted below the roots with a worker of their own per device, as roots on different devices are.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::output] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::output] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tWrite the index (or the merged index files) into an index file and exit.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::index] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::index] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset
+         << "\tLoad the index from an index file instead of scanning.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::fromList] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::fromList] << termcolor::reset
+     << termcolor::bright_cyan << " file" << termcolor::reset << "|" << termcolor::bright_cyan << "-" << termcolor::reset
+         << "\tRead the paths from a list (one per line, or separated by NUL characters) instead of scanning, or from the standard input with -."
+         << " Paths below the root directories that pass the filters are taken as listed.\n"
+
+     << termcolor::bright_yellow << Args::FLAGS_SHORTENED[Args::merge] << termcolor::reset << ", " << termcolor::bright_yellow << Args::FLAGS_WHOLE[Args::merge] << termcolor::reset
+     << termcolor::bright_cyan << " file1" << termcolor::reset << Args::DELIMITER
+             << termcolor::bright_cyan << "file2" << termcolor::reset << Args::DELIMITER << "..." << Args::DELIMITER
+             << termcolor::bright_cyan << "fileN" << termcolor::reset
+         << "\tMerge index files (e.g. shards) into the file given with "
+         << Args::FLAGS_SHORTENED[Args::output] << " and exit.\n\n";
 }
 
 /**
@@ -162,11 +368,29 @@ int main(int argc, char** argv) {
 
     // Declares and initializes variables.
     FileManager* fileManager;                      // File manager.
-    std::string directoryPathString;               // Path to the root directory as a string.
-    std::vector<std::string> forbiddenDirectories; // Directory whitelist.
-    std::vector<std::string> allowedExtensions;    // Extension whitelist.
-    int depth = FileManager::DEPTH_DEFAULT;        // Maximum depth to iterate to.
-    bool areCapsEnabled = true;                    // Whethter soft caps are enabled.
+    std::vector<std::string> directoryPathStrings; // Paths to the root directories as strings.
+    ScanOptions scanOptions;                       // Directory blacklist, extension whitelist, depth, cap, memory budget, sharing and shard.
+    std::string indexInputPath;                    // Index file to load instead of scanning.
+    std::string listPath;                          // List of paths to read instead of scanning.
+    std::string indexOutputPath;                   // Index file to write instead of picking.
+    std::vector<std::string> indexMergePaths;      // Index files to merge.
+    bool isStatsEnabled = false;                   // Whether to report stats.
+    std::string prometheusPath;                    // Prometheus text file to write the stats into.
+    std::string tracePath;                         // Trace file to write the timeline into.
+    std::vector<std::string> toggleFilterNames;    // Filters toggled while picking, as written.
+    std::vector<PickFilter> toggleFilters;         // Filters toggled while picking.
+    bool isMatchEnabled = false;                   // Whether to index trigrams for searches.
+    std::string matchQuery;                        // Text paths must contain to be picked.
+    StratifyOptions stratifyOptions;               // How picks are spread over directories.
+    std::string historyPath;                       // History file random picks rotate fairly through.
+    std::string snapshotPath;                      // Snapshot file of the previous run.
+    bool isNewOnly = false;                        // Whether to pick only files that are new since the previous run.
+    bool isDiffReported = false;                   // Whether to list the differences with the previous run.
+    bool isSharedPurged = false;                   // Whether to remove the shared indexes.
+    std::vector<ContentType::Kind> contentTypes;   // Types of the files to pick, if restricted.
+    bool isDeduplicated = false;                   // Whether to pick only one of the files with the same contents.
+    bool isOrdered = false;                        // Whether playlists are sorted rather than shuffled.
+    SortedOrder::Key orderKey = SortedOrder::natural; // Key playlists are sorted by.
     
     int action = xDefault; // Action to perform.
 
@@ -191,7 +415,7 @@ int main(int argc, char** argv) {
                     } else if (!std::filesystem::exists(argv[i])) {
                         throw std::invalid_argument("The provided path for the root directory is not valid.");
                     }
-                    directoryPathString = argv[i];
+                    directoryPathStrings.push_back(argv[i]);
                 } catch(const std::exception& ex) {
                     std::cerr << termcolor::bright_red << "ERROR resolving path for the root directory:\n" << ex.what() << termcolor::reset << std::endl;
                     exit(EXIT_FAILURE);
@@ -210,7 +434,7 @@ int main(int argc, char** argv) {
                     std::stringstream stringstream {argv[i]};
 
                     while (std::getline(stringstream, temp, Args::DELIMITER)) {
-                        forbiddenDirectories.push_back(temp);
+                        scanOptions.excludedDirectories.push_back(temp);
                     }
                 } catch (const std::exception& ex) {
                     std::cerr << termcolor::bright_red << "ERROR blacklisting directories:\n" << ex.what() << termcolor::reset << std::endl;
@@ -230,7 +454,7 @@ int main(int argc, char** argv) {
                     std::stringstream stringstream {argv[i]};
 
                     while (std::getline(stringstream, temp, Args::DELIMITER)) {
-                        allowedExtensions.push_back(temp);
+                        scanOptions.extensions.push_back(temp);
                     }
                 } catch (const std::exception& ex) {
                     std::cerr << termcolor::bright_red << "ERROR whitelisting extensions:\n" << ex.what() << termcolor::reset << std::endl;
@@ -243,40 +467,489 @@ int main(int argc, char** argv) {
                     if (++i >= argc) {
                         throw std::invalid_argument("Alternative recursive depth was enabled, but no value was provided");
                     }
-                    depth = std::stoi(argv[i]);
+                    scanOptions.depth = std::stoi(argv[i]);
                 } catch (const std::exception& ex) {
                     std::cerr << termcolor::bright_red << "ERROR while establishing maximum depth:\n" << ex.what() << termcolor::reset << std::endl;
                     exit(EXIT_FAILURE);
                 }
             } break;
-            // Disable soft caps.
+            // Disable the soft cap for depth.
             case Args::nocap: {
-                areCapsEnabled = false;
+                scanOptions.checkCaps = false;
+            } break;
+            // Share the index between processes.
+            case Args::shared: {
+                scanOptions.share = true;
+            } break;
+            // Remove the shared indexes.
+            case Args::sharedPurge: {
+                isSharedPurged = true;
+            } break;
+            // Resume an interrupted scan from its checkpoints.
+            case Args::resumeScan: {
+                scanOptions.resume = true;
+            } break;
+            // Skip directories that are not listed in time.
+            case Args::listTimeout: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("A list timeout was enabled, but no time was provided");
+                    }
+
+                    // Parses "ms", optionally followed by ":retry".
+                    arg = argv[i];
+                    const size_t separator = arg.find(':');
+                    const int timeout = std::stoi(arg.substr(0, separator));
+                    if (timeout <= 0) {
+                        throw std::invalid_argument("The timeout must be at least 1 ms");
+                    }
+                    if (separator != std::string::npos) {
+                        if (arg.substr(separator + 1) != "retry") {
+                            throw std::invalid_argument("The only option is retry");
+                        }
+                        scanOptions.retrySkipped = true;
+                    }
+                    scanOptions.listTimeout = (uint32_t)timeout;
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the list timeout:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Scan at the given I/O priority.
+            case Args::ioClass: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the I/O class:\nAn I/O class was enabled, but no class was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                arg = argv[i];
+                if (arg == "idle") {
+                    scanOptions.idleIo = true;
+                } else if (arg == "normal") {
+                    scanOptions.idleIo = false;
+                } else {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the I/O class:\nClasses are idle and normal" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Cap the directories and entries listed per second.
+            case Args::rateLimit: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("A rate limit was enabled, but no rate was provided");
+                    }
+
+                    // Parses "directories", optionally followed by ":entries". Either may be 0 for no limit.
+                    arg = argv[i];
+                    const size_t separator = arg.find(':');
+                    const double directoryRate = std::stod(arg.substr(0, separator));
+                    const double entryRate = (separator == std::string::npos) ? 0 : std::stod(arg.substr(separator + 1));
+                    if (directoryRate < 0 || entryRate < 0) {
+                        throw std::invalid_argument("Rates may not be negative");
+                    }
+                    scanOptions.directoryRate = directoryRate;
+                    scanOptions.entryRate = entryRate;
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the rate limit:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Back off while listings are slow.
+            case Args::backoff: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("Back-off was enabled, but no threshold was provided");
+                    }
+                    const int threshold = std::stoi(argv[i]);
+                    if (threshold <= 0) {
+                        throw std::invalid_argument("The threshold must be at least 1 ms");
+                    }
+                    scanOptions.backoffThreshold = (uint32_t)threshold;
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the back-off:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Stay on the device of each root.
+            case Args::oneFileSystem: {
+                scanOptions.oneFileSystem = true;
+            } break;
+            // Skip filesystems of the given types.
+            case Args::skipFstype: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while skipping filesystem types:\nSkipping filesystem types was enabled, but no types were provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                // Split string into individual types.
+                std::string temp;
+                std::stringstream stringstream {argv[i]};
+
+                while (std::getline(stringstream, temp, Args::DELIMITER)) {
+                    if (!temp.empty()) {
+                        scanOptions.skippedFilesystemTypes.push_back(temp);
+                    }
+                }
+            } break;
+            // Scan the mounts below the roots apart, by device.
+            case Args::splitDevices: {
+                scanOptions.splitDevices = true;
+            } break;
+            // Index the files inside archives.
+            case Args::archives: {
+                scanOptions.archives = true;
+            } break;
+            // Pick only files of the given types.
+            case Args::contentType: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while restricting file types:\nTypes were enabled, but none were provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                // Split string into individual types.
+                std::string temp;
+                std::stringstream stringstream {argv[i]};
+
+                while (std::getline(stringstream, temp, Args::DELIMITER)) {
+                    ContentType::Kind kind;
+                    if (!ContentType::parse(temp, kind)) {
+                        std::cerr << termcolor::bright_red << "ERROR while restricting file types:\nTypes are video, image and audio" << termcolor::reset << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                    contentTypes.push_back(kind);
+                }
+            } break;
+            // Pick only one of the files with the same contents.
+            case Args::dedupe: {
+                if (++i >= argc || std::string(argv[i]) != "content") {
+                    std::cerr << termcolor::bright_red << "ERROR while finding duplicates:\nThe only mode is content" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                isDeduplicated = true;
+            } break;
+            // Scan a single shard of the tree.
+            case Args::shard: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("Sharding was enabled, but no shard was provided");
+                    }
+
+                    // Parses "i/N", where shards are numbered from 1 to N.
+                    const std::string shard = argv[i];
+                    const size_t separator = shard.find('/');
+                    if (separator == std::string::npos) {
+                        throw std::invalid_argument("Shards must be provided as i/N");
+                    }
+                    const int shardNumber = std::stoi(shard.substr(0, separator));
+                    const int shardCount = std::stoi(shard.substr(separator + 1));
+                    if (shardCount < 1 || shardNumber < 1 || shardNumber > shardCount) {
+                        throw std::invalid_argument("Shards are numbered from 1 to N");
+                    }
+                    scanOptions.shardIndex = (uint32_t)(shardNumber - 1);
+                    scanOptions.shardCount = (uint32_t)shardCount;
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the shard:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Set the memory budget of the index.
+            case Args::memBudget: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("A memory budget was enabled, but no size was provided");
+                    }
+
+                    // Parses a byte amount with an optional K, M or G suffix.
+                    const std::string size = argv[i];
+                    size_t suffix = 0;
+                    uint64_t budget = std::stoull(size, &suffix);
+                    if (suffix + 1 == size.size()) {
+                        switch (size[suffix]) {
+                            case 'k': case 'K': budget <<= 10; break;
+                            case 'm': case 'M': budget <<= 20; break;
+                            case 'g': case 'G': budget <<= 30; break;
+                            default: throw std::invalid_argument("Memory budget suffixes are K, M and G");
+                        }
+                    } else if (suffix != size.size()) {
+                        throw std::invalid_argument("Memory budget suffixes are K, M and G");
+                    }
+                    scanOptions.memoryBudget = budget;
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the memory budget:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Report stats.
+            case Args::stats: {
+                isStatsEnabled = true;
+            } break;
+            // Write the stats into a Prometheus text file.
+            case Args::prometheus: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR writing Prometheus file:\nA Prometheus file was enabled, but no path was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                isStatsEnabled = true;
+                prometheusPath = argv[i];
+            } break;
+            // Record a timeline.
+            case Args::trace: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR writing trace file:\nTracing was enabled, but no path was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                tracePath = argv[i];
+                Trace::enable();
+                Trace::nameThread("main");
+            } break;
+            // Add a filter toggled while picking.
+            case Args::toggle: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("A toggle filter was enabled, but no extensions or directories were provided");
+                    } else if (toggleFilters.size() >= FileManager::MAX_TOGGLE_FILTERS) {
+                        throw std::invalid_argument("No more than " + std::to_string(FileManager::MAX_TOGGLE_FILTERS) + " toggle filters can be provided");
+                    }
+
+                    // Split string into extensions and top-level directories, which start with @.
+                    PickFilter filter;
+                    std::string temp;
+                    std::stringstream stringstream {argv[i]};
+
+                    while (std::getline(stringstream, temp, Args::DELIMITER)) {
+                        if (!temp.empty() && temp[0] == '@') {
+                            filter.directories.push_back(temp.substr(1));
+                        } else {
+                            filter.extensions.push_back(temp);
+                        }
+                    }
+                    toggleFilterNames.push_back(argv[i]);
+                    toggleFilters.push_back(filter);
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR adding toggle filter:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Only pick paths that contain a text.
+            case Args::match: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR matching paths:\nMatching was enabled, but no text was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                isMatchEnabled = true;
+                matchQuery = argv[i];
+            } break;
+            // Spread picks over directories.
+            case Args::stratify: {
+                try{
+                    if (++i >= argc) {
+                        throw std::invalid_argument("Stratified picks were enabled, but no grouping was provided");
+                    }
+
+                    // Parses "dir" or "depth:N", optionally followed by ":sqrt".
+                    std::vector<std::string> parts;
+                    std::string temp;
+                    std::stringstream stringstream {argv[i]};
+                    while (std::getline(stringstream, temp, ':')) {
+                        parts.push_back(temp);
+                    }
+                    size_t next = 1;
+                    if (!parts.empty() && parts[0] == "dir") {
+                        stratifyOptions.grouping = StratifyOptions::directory;
+                    } else if (!parts.empty() && parts[0] == "depth" && parts.size() > 1) {
+                        stratifyOptions.grouping = StratifyOptions::depth;
+                        stratifyOptions.levels = std::stoi(parts[1]);
+                        if (stratifyOptions.levels < 0) {
+                            throw std::invalid_argument("Depths start at 0");
+                        }
+                        next = 2;
+                    } else {
+                        throw std::invalid_argument("Groupings are dir and depth:N");
+                    }
+                    if (next < parts.size()) {
+                        if (parts[next] != "sqrt" || next + 1 < parts.size()) {
+                            throw std::invalid_argument("The only weighting is sqrt");
+                        }
+                        stratifyOptions.weighting = StratifyOptions::squareRoot;
+                    }
+                } catch (const std::exception& ex) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing stratified picks:\n" << ex.what() << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            // Rotate random picks fairly through the open history.
+            case Args::fair: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing fair rotation:\nFair rotation was enabled, but no history file was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                historyPath = argv[i];
+            } break;
+            // Compare with the previous run, and pick new files or list the differences.
+            case Args::newOnly:
+            case Args::diff: {
+                const bool isDiff = (Args::checkFlag(argv[i]) == Args::diff);
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while comparing with the previous run:\nNo snapshot file was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                if (!snapshotPath.empty() && snapshotPath != argv[i]) {
+                    std::cerr << termcolor::bright_red << "ERROR while comparing with the previous run:\nOnly one snapshot file can be used" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                snapshotPath = argv[i];
+                if (isDiff) {
+                    isDiffReported = true;
+                } else {
+                    isNewOnly = true;
+                }
+            } break;
+            // Sort playlists instead of shuffling them.
+            case Args::order: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the playlist order:\nAn order was enabled, but no key was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                arg = argv[i];
+                if (arg == "natural") {
+                    orderKey = SortedOrder::natural;
+                } else if (arg == "mtime") {
+                    orderKey = SortedOrder::writeTime;
+                } else if (arg == "size") {
+                    orderKey = SortedOrder::fileSize;
+                } else if (arg == "path") {
+                    orderKey = SortedOrder::path;
+                } else {
+                    std::cerr << termcolor::bright_red << "ERROR while establishing the playlist order:\nKeys are natural, mtime, size and path" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                isOrdered = true;
+            } break;
+            // Write the index into a file.
+            case Args::output: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR writing index file:\nAn output was enabled, but no path was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                indexOutputPath = argv[i];
+            } break;
+            // Load the index from a file.
+            case Args::index: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR loading index file:\nAn index file was enabled, but no path was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                indexInputPath = argv[i];
+            } break;
+            // Read the paths from a list.
+            case Args::fromList: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR reading path list:\nA path list was enabled, but no path was provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                listPath = argv[i];
+            } break;
+            // Merge index files.
+            case Args::merge: {
+                if (++i >= argc) {
+                    std::cerr << termcolor::bright_red << "ERROR merging index files:\nMerging was enabled, but no index files were provided" << termcolor::reset << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                // Split string into individual index files.
+                std::string temp;
+                std::stringstream stringstream {argv[i]};
+
+                while (std::getline(stringstream, temp, Args::DELIMITER)) {
+                    indexMergePaths.push_back(temp);
+                }
             } break;
 
             default: break;
          }
     }
 
+    // Fair rotation already decides which files random picks come from.
+    if (!historyPath.empty() && stratifyOptions.grouping != StratifyOptions::none) {
+        std::cerr << termcolor::bright_red << "ERROR while establishing fair rotation:\nFair rotation cannot be combined with "
+            << Args::FLAGS_SHORTENED[Args::stratify] << " or " << Args::FLAGS_WHOLE[Args::stratify] << termcolor::reset << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Index files already hold the paths.
+    if (!indexInputPath.empty() && !listPath.empty()) {
+        std::cerr << termcolor::bright_red << "ERROR reading path list:\nA path list cannot be combined with "
+            << Args::FLAGS_SHORTENED[Args::index] << " or " << Args::FLAGS_WHOLE[Args::index] << termcolor::reset << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Ordered playlists are only used in playlist mode.
+    if (isOrdered && action == xDefault) {
+        action = xPlaylist;
+    }
+
+    // Purging shared indexes, writing and merging index files, and listing differences, replace picking.
+    if (action != xHelp) {
+        if (isSharedPurged) {
+            action = xPurge;
+        } else if (!indexMergePaths.empty()) {
+            action = xMerge;
+        } else if (!indexOutputPath.empty()) {
+            action = xWriteIndex;
+        } else if (isDiffReported) {
+            action = xDiff;
+        }
+    }
+
     // === Execute the selected action ===
     switch (action) {
         // Regular actions
         case xDefault:
         case xPlaylist:
+        case xWriteIndex:
+        case xDiff:
             fileManager = buildFileManager(
-                directoryPathString,
-                forbiddenDirectories,
-                allowedExtensions,
-                depth,
-                areCapsEnabled
+                directoryPathStrings,
+                scanOptions,
+                indexInputPath,
+                listPath,
+                isStatsEnabled,
+                prometheusPath,
+                toggleFilterNames,
+                toggleFilters,
+                isMatchEnabled,
+                matchQuery,
+                stratifyOptions,
+                historyPath,
+                snapshotPath,
+                isNewOnly,
+                contentTypes,
+                isDeduplicated,
+                isOrdered,
+                orderKey
             );
             switch (action) {
-                case xDefault:  defaultAction(fileManager);  break;
-                case xPlaylist: playlistAction(fileManager); break;
+                case xDefault:    defaultAction(fileManager);               break;
+                case xPlaylist:   playlistAction(fileManager);              break;
+                case xWriteIndex: fileManager->writeIndex(indexOutputPath); break;
+                case xDiff:       fileManager->reportDiff();                break;
                 default: break;
             }
+            fileManager->reportStats();
             delete fileManager;
         break;
+        // Merge index files
+        case xMerge:
+            if (indexOutputPath.empty()) {
+                std::cerr << termcolor::bright_red << "ERROR merging index files:\nNo output was provided with "
+                    << Args::FLAGS_SHORTENED[Args::output] << " or " << Args::FLAGS_WHOLE[Args::output] << termcolor::reset << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            FileManager::mergeIndexes(indexMergePaths, indexOutputPath);
+        break;
+        // Remove shared indexes
+        case xPurge:
+            FileManager::purgeSharedIndexes();
+        break;
         // Show help
         case xHelp:
             showUsage(executableName);
@@ -285,5 +958,15 @@ int main(int argc, char** argv) {
         default: break;
     }
 
+    // Writes the timeline, if recorded.
+    if (!tracePath.empty()) {
+        std::string error;
+        if (!Trace::write(tracePath, error)) {
+            std::cerr << termcolor::bright_red << "ERROR writing trace file:\n" << error << termcolor::reset << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::cout << "Trace written to " << termcolor::bright_cyan << tracePath << termcolor::reset << "\n";
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
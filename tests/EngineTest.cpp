@@ -0,0 +1,392 @@
+/**
+ * EngineTest.cpp : checks the engine of the core library end to end over in-memory trees
+ *
+ * Covers the merge of the roots and of index files, spilled indexes, archives and checkpoints. Runs on Linux
+ * (or any POSIX system). See the Testing section of the README to build and run it.
+ */
+
+#include <algorithm>     // is_sorted
+#include <cstdio>        // printf
+#include <fstream>       // file streams
+#include <memory>        // shared_ptr
+#include <set>           // ordered sets
+#include <sstream>       // stringstream
+#include <string>        // strings
+#include <utility>       // pair
+#include <vector>        // dynamic containers
+
+#include <filesystem>    // file navigation. C++17 ONLY.
+
+#include <unistd.h>      // getpid
+
+#include "core/Archive.h"
+#include "core/Engine.h"
+#include "core/Hash.h"
+#include "core/IndexFile.h"
+#include "core/MemorySource.h"
+#include "core/ScanCheckpoint.h"
+
+typedef std::set<std::pair<uint16_t, std::string>> EntrySet;
+
+static int failureCount = 0;
+
+/**
+* @brief Reports a failed check, if it failed.
+*
+* @param isPassed Whether the check passed.
+* @param description Description of the check.
+*/
+static void check(const bool isPassed, const std::string& description) {
+	if (!isPassed) {
+		printf("FAILED: %s\n", description.c_str());
+		++failureCount;
+	}
+}
+
+/**
+* @return Root id and path of every entry of an index.
+*/
+static EntrySet collect(const PathIndex& index) {
+	EntrySet entries;
+	for (size_t i = 0; i < index.size(); ++i) {
+		entries.emplace(index.root(i), std::string(index[i]));
+	}
+	return entries;
+}
+
+/**
+* @brief Points an engine to an in-memory tree and configures it.
+*
+* @return If the roots or the options were refused, returns `false`.
+*/
+static bool prepare(Engine& engine, const std::shared_ptr<MemorySource>& source, const std::vector<std::string>& roots, const ScanOptions& options) {
+	std::string error;
+	engine.setSource(source);
+	if (!engine.setRoots(roots, error) || !engine.configure(options, error)) {
+		printf("FAILED: %s\n", error.c_str());
+		++failureCount;
+		return false;
+	}
+	return true;
+}
+
+// == Tests ==
+
+/**
+* @brief Scans several roots, and checks that their entries are merged in root order, that index files are
+* written sorted and without repeats, and that merging the shards of a tree gives the tree.
+*/
+static void testMerge(const std::filesystem::path& directory) {
+	std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+	EntrySet expected;
+	for (int top = 0; top < 12; ++top) {
+		for (int file = 0; file < 50; ++file) {
+			const std::string path = "top" + std::to_string(top) + "/sub/file" + std::to_string(file) + ".mp4";
+			source->addFile("/second/" + path);
+			source->addFile("/first/" + path);
+			expected.emplace(0, path);
+			expected.emplace(1, path);
+		}
+	}
+	ScanOptions options;
+	Engine engine;
+	if (!prepare(engine, source, { "/second/", "/first/" }, options)) return;
+	const ScanResult result = engine.scan();
+	const PathIndex& index = engine.getIndex();
+	check(result.ok && result.fileCount == expected.size(), "multi-root scan finds every file");
+	check(collect(index) == expected, "multi-root scan finds the expected paths");
+	bool isInRootOrder = true;
+	for (size_t i = 1; i < index.size(); ++i) {
+		isInRootOrder = isInRootOrder && (index.root(i - 1) <= index.root(i));
+	}
+	check(isInRootOrder, "multi-root scan merges roots in the order they were given");
+	std::string path;
+	engine.buildAbsolutePath(0, path);
+	check(path.compare(0, 8, "/second/") == 0, "first entry belongs to the first root");
+
+	// Repeated entries are written once, sorted by root and then by path bytes.
+	std::string error;
+	PathIndex repeated;
+	repeated.add("b/file.mp4", 1);
+	repeated.add("a/file.mp4", 1);
+	repeated.add("b/file.mp4", 1);
+	repeated.add("z/file.mp4", 0);
+	IndexFileHeader header;
+	header.roots = { "/second/", "/first/" };
+	const std::string repeatedPath = (directory / "repeated.rfi").u8string();
+	PathIndex written;
+	IndexFileHeader writtenHeader;
+	check(
+		IndexFile::write(repeatedPath, repeated, header, error) && IndexFile::read(repeatedPath, written, writtenHeader, error),
+		"index file round-trips: " + error
+	);
+	std::vector<std::pair<uint16_t, std::string>> entries;
+	for (size_t i = 0; i < written.size(); ++i) {
+		entries.emplace_back(written.root(i), std::string(written[i]));
+	}
+	const std::vector<std::pair<uint16_t, std::string>> expectedEntries = { { 0, "z/file.mp4" }, { 1, "a/file.mp4" }, { 1, "b/file.mp4" } };
+	check(entries == expectedEntries && writtenHeader.entryCount == 3, "index file is sorted and holds repeated entries once");
+
+	// Shards merge back into the whole tree, sorted.
+	const uint32_t shardCount = 3;
+	std::vector<std::string> shardPaths;
+	uint64_t shardFileCount = 0;
+	for (uint32_t shard = 0; shard < shardCount; ++shard) {
+		options.shardIndex = shard;
+		options.shardCount = shardCount;
+		Engine shardEngine;
+		if (!prepare(shardEngine, source, { "/second/", "/first/" }, options)) return;
+		shardFileCount += shardEngine.scan().fileCount;
+		shardPaths.push_back((directory / ("shard" + std::to_string(shard) + ".rfi")).u8string());
+		check(shardEngine.writeIndex(shardPaths.back(), error), "shard is written: " + error);
+	}
+	check(shardFileCount == expected.size(), "shards split the tree without overlap");
+	uint64_t mergedCount = 0;
+	check(IndexFile::merge(shardPaths, shardPaths[0], mergedCount, error), "shards merge: " + error);
+	check(mergedCount == expected.size(), "merged file holds every entry once");
+	PathIndex merged;
+	IndexFileHeader mergedHeader;
+	check(IndexFile::read(shardPaths[0], merged, mergedHeader, error), "merged file is read: " + error);
+	std::vector<std::pair<uint16_t, std::string>> mergedEntries;
+	for (size_t i = 0; i < merged.size(); ++i) {
+		mergedEntries.emplace_back(merged.root(i), std::string(merged[i]));
+	}
+	check(std::is_sorted(mergedEntries.begin(), mergedEntries.end()), "merged file is sorted");
+	check(collect(merged) == expected && mergedHeader.shardCount == 1, "merged file is the whole tree");
+
+	// A missing shard is refused.
+	check(!IndexFile::merge({ shardPaths[1], shardPaths[2] }, (directory / "partial.rfi").u8string(), mergedCount, error), "merge refuses a missing shard");
+}
+
+/**
+* @brief Scans a tree into an index that spills most of its entries, and checks that every entry is kept, that
+* picks and paths agree, and that it round-trips through an index file.
+*/
+static void testSpill(const std::filesystem::path& directory) {
+	std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+	EntrySet expected;
+	for (int top = 0; top < 50; ++top) {
+		for (int file = 0; file < 1000; ++file) {
+			const std::string path = "directory" + std::to_string(top) + "/a rather long clip name " + std::to_string(file) + ".webm";
+			source->addFile("/media/" + path);
+			expected.emplace(0, path);
+		}
+	}
+	ScanOptions options;
+	options.memoryBudget = 1 << 20; // The smallest budget allowed
+	Engine engine;
+	if (!prepare(engine, source, { "/media/" }, options)) return;
+	const ScanResult result = engine.scan();
+	check(result.ok && engine.getIndex().spilledSize() > 0, "small memory budget spills the index");
+	check(collect(engine.getIndex()) == expected, "spilled index keeps every entry");
+
+	// A shuffled playlist visits every entry once, and paths of picks match their entries.
+	engine.seed(7);
+	engine.shuffle();
+	std::vector<bool> isVisited(engine.size(), false);
+	bool isConsistent = true;
+	size_t position = 0;
+	std::string path;
+	for (size_t i = 0; i < engine.size(); ++i) {
+		if (!(i == 0 ? engine.pickCurrent(position) : engine.pickSequential(false, position)) || isVisited[position]) {
+			isConsistent = false;
+			break;
+		}
+		isVisited[position] = true;
+		engine.buildAbsolutePath(position, path);
+		isConsistent = isConsistent && (path == "/media/" + std::string(engine.path(position)));
+	}
+	check(isConsistent, "playlist over a spilled index visits every entry once, with matching paths");
+	for (int i = 0; i < 1000 && isConsistent; ++i) {
+		isConsistent = engine.pickRandom(position) && position < engine.size();
+		engine.buildAbsolutePath(position, path);
+		isConsistent = isConsistent && (path == "/media/" + std::string(engine.path(position)));
+	}
+	check(isConsistent, "random picks over a spilled index match their paths");
+
+	// Round-trips through an index file.
+	std::string error;
+	const std::string indexPath = (directory / "spilled.rfi").u8string();
+	Engine loaded;
+	loaded.setMemoryBudget(1 << 20);
+	check(engine.writeIndex(indexPath, error) && loaded.loadIndex(indexPath, error), "spilled index round-trips: " + error);
+	check(collect(loaded.getIndex()) == expected && loaded.getRootStrings() == engine.getRootStrings(), "loaded index matches the scan");
+}
+
+/**
+* @brief Appends a little-endian integer.
+*/
+static void appendLittle(std::string& bytes, const uint64_t value, const size_t width) {
+	for (size_t i = 0; i < width; ++i) {
+		bytes.push_back((char)((value >> (8 * i)) & 0xFF));
+	}
+}
+
+/**
+* @return Bytes of a zip archive that stores its files uncompressed.
+*/
+static std::string buildZip(const std::vector<std::pair<std::string, std::string>>& files) {
+	std::string archive;
+	std::string directory;
+	for (const std::pair<std::string, std::string>& file : files) {
+		const uint32_t crc = Hash::crc32(file.second.data(), file.second.size());
+		const uint64_t offset = archive.size();
+		appendLittle(archive, 0x04034b50, 4); // local header
+		appendLittle(archive, 20, 2);         // version needed
+		appendLittle(archive, 0, 2);          // flags
+		appendLittle(archive, 0, 2);          // stored
+		appendLittle(archive, 0, 4);          // time and date
+		appendLittle(archive, crc, 4);
+		appendLittle(archive, file.second.size(), 4);
+		appendLittle(archive, file.second.size(), 4);
+		appendLittle(archive, file.first.size(), 2);
+		appendLittle(archive, 0, 2);          // extra length
+		archive += file.first;
+		archive += file.second;
+
+		appendLittle(directory, 0x02014b50, 4); // central header
+		appendLittle(directory, 20, 2);         // version made by
+		appendLittle(directory, 20, 2);         // version needed
+		appendLittle(directory, 0, 2);          // flags
+		appendLittle(directory, 0, 2);          // stored
+		appendLittle(directory, 0, 4);          // time and date
+		appendLittle(directory, crc, 4);
+		appendLittle(directory, file.second.size(), 4);
+		appendLittle(directory, file.second.size(), 4);
+		appendLittle(directory, file.first.size(), 2);
+		appendLittle(directory, 0, 2);          // extra length
+		appendLittle(directory, 0, 2);          // comment length
+		appendLittle(directory, 0, 2);          // disk
+		appendLittle(directory, 0, 2);          // internal attributes
+		appendLittle(directory, 0, 4);          // external attributes
+		appendLittle(directory, offset, 4);
+		directory += file.first;
+	}
+	const uint64_t directoryOffset = archive.size();
+	archive += directory;
+	appendLittle(archive, 0x06054b50, 4); // end record
+	appendLittle(archive, 0, 2);          // disk
+	appendLittle(archive, 0, 2);          // disk of the central directory
+	appendLittle(archive, files.size(), 2);
+	appendLittle(archive, files.size(), 2);
+	appendLittle(archive, directory.size(), 4);
+	appendLittle(archive, directoryOffset, 4);
+	appendLittle(archive, 0, 2);          // comment length
+	return archive;
+}
+
+/**
+* @brief Scans a tree holding a zip archive with archives expanded, and checks that its files are listed in
+* place of the archive and extract to their contents.
+*/
+static void testArchives() {
+	const std::vector<std::pair<std::string, std::string>> files = {
+		{ "album/one.mp3", "first song" },
+		{ "album/two.mp3", std::string(70000, 'x') + "second song" },
+		{ "cover.jpg", "" },
+		{ "album/", "" }, // Directories are not listed.
+	};
+	std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+	source->addFile("/music/loose.mp3", "loose song");
+	source->addFile("/music/albums/set.zip", buildZip(files));
+	ScanOptions options;
+	options.archives = true;
+	Engine engine;
+	if (!prepare(engine, source, { "/music/" }, options)) return;
+	const ScanResult result = engine.scan();
+	const EntrySet expected = {
+		{ 0, "loose.mp3" },
+		{ 0, std::string("albums/set.zip") + Archive::SEPARATOR + "album/one.mp3" },
+		{ 0, std::string("albums/set.zip") + Archive::SEPARATOR + "album/two.mp3" },
+		{ 0, std::string("albums/set.zip") + Archive::SEPARATOR + "cover.jpg" },
+	};
+	check(result.ok && result.stats.expandedArchives == 1 && result.stats.archiveEntries == 3, "archive is expanded into its files");
+	check(collect(engine.getIndex()) == expected, "archive files are listed in place of the archive");
+
+	// Picked files extract to their contents, and others launch from their own path.
+	std::string error;
+	for (size_t position = 0; position < engine.size(); ++position) {
+		const std::string path(engine.path(position));
+		std::string launchPath;
+		if (!engine.buildLaunchPath(position, launchPath, error)) {
+			check(false, "\"" + path + "\" extracts: " + error);
+			continue;
+		}
+		if (path == "loose.mp3") {
+			check(launchPath == "/music/loose.mp3", "loose file launches from its own path");
+			continue;
+		}
+		const std::string innerPath = path.substr(path.find(Archive::SEPARATOR) + std::char_traits<char>::length(Archive::SEPARATOR));
+		std::ifstream extracted(launchPath, std::ios::binary);
+		std::stringstream bytes;
+		bytes << extracted.rdbuf();
+		bool isMatched = false;
+		for (const std::pair<std::string, std::string>& file : files) {
+			isMatched = isMatched || (file.first == innerPath && file.second == bytes.str());
+		}
+		check(isMatched, "\"" + path + "\" extracts to its contents");
+	}
+}
+
+/**
+* @brief Cancels a scan of a root large enough to be checkpointed once it was, and checks that resuming it
+* restores the committed files and finds the same files as a full scan.
+*/
+static void testCheckpoints() {
+	std::shared_ptr<MemorySource> source = std::make_shared<MemorySource>();
+	for (int top = 0; top < 30; ++top) {
+		for (int sub = 0; sub < 50; ++sub) {
+			for (int file = 0; file < 100; ++file) {
+				source->addFile("/checkpointed/top" + std::to_string(top) + "/sub" + std::to_string(sub) + "/file" + std::to_string(file) + ".mkv");
+			}
+		}
+	}
+	ScanOptions options;
+	Engine full;
+	if (!prepare(full, source, { "/checkpointed/" }, options)) return;
+	const ScanResult fullResult = full.scan();
+	check(fullResult.ok && fullResult.fileCount == 150000, "checkpointed root is scanned whole");
+
+	// The first commit happens once the root holds enough files, which the cancelled scan goes past.
+	Engine cancelled;
+	if (!prepare(cancelled, source, { "/checkpointed/" }, options)) return;
+	const ScanResult cancelledResult = cancelled.scan([](const ScanProgress& progress) {
+		return progress.fileCount < ScanCheckpoint::FILE_THRESHOLD + 20000;
+	});
+	check(cancelledResult.isCancelled && cancelledResult.checkpointError.empty(), "scan is cancelled after its first commit: " + cancelledResult.checkpointError);
+
+	options.resume = true;
+	Engine resumed;
+	if (!prepare(resumed, source, { "/checkpointed/" }, options)) return;
+	const ScanResult resumedResult = resumed.scan();
+	check(resumedResult.ok && resumedResult.resumedFileCount >= ScanCheckpoint::FILE_THRESHOLD, "resumed scan restores the committed files");
+	check(resumedResult.fileCount == fullResult.fileCount && collect(resumed.getIndex()) == collect(full.getIndex()), "resumed scan finds the same files as a full scan");
+
+	// A completed scan leaves nothing to resume.
+	Engine again;
+	if (!prepare(again, source, { "/checkpointed/" }, options)) return;
+	check(again.scan().resumedFileCount == 0, "completed scan leaves nothing to resume");
+}
+
+int main() {
+	std::error_code errorCode;
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("rfopener-test-" + std::to_string((long)getpid()));
+	std::filesystem::create_directories(directory, errorCode);
+	if (errorCode) {
+		printf("FAILED: could not create \"%s\"\n", directory.u8string().c_str());
+		return 1;
+	}
+
+	testMerge(directory);
+	testSpill(directory);
+	testArchives();
+	testCheckpoints();
+
+	std::filesystem::remove_all(directory, errorCode);
+	if (failureCount > 0) {
+		printf("%d checks failed\n", failureCount);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}